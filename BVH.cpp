@@ -0,0 +1,264 @@
+#include "BVH.h"
+#include <algorithm>
+
+const int BVH::NONE;
+
+// fat boxes grow by a fixed amount plus a quarter of the object's size, so spinning or slowly
+// moving objects are not reinserted every frame
+static AABB Fatten(const AABB& box)
+{
+	glm::vec3 extent = box.Extent();
+	return box.Expanded(0.1f + 0.25f * std::max(extent.x, std::max(extent.y, extent.z)));
+}
+
+int BVH::AllocateNode()
+{
+	int node;
+	if (freeList != NONE) {
+		node = freeList;
+		freeList = nodes[node].parent;
+	}
+	else {
+		node = (int)nodes.size();
+		nodes.push_back(Node());
+	}
+	nodes[node].parent = NONE;
+	nodes[node].left = nodes[node].right = NONE;
+	nodes[node].height = 0;
+	nodes[node].userData = 0;
+	return node;
+}
+
+void BVH::FreeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+void BVH::Clear()
+{
+	nodes.clear();
+	root = freeList = NONE;
+	leafCount = 0;
+}
+
+int BVH::Insert(const AABB& box, unsigned int userData)
+{
+	int leaf = AllocateNode();
+	nodes[leaf].box = Fatten(box);
+	nodes[leaf].userData = userData;
+	InsertLeaf(leaf);
+	leafCount++;
+	return leaf;
+}
+
+void BVH::Remove(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	leafCount--;
+}
+
+bool BVH::Move(int proxy, const AABB& box)
+{
+	if (nodes[proxy].box.Contains(box)) {
+		return false;
+	}
+	RemoveLeaf(proxy);
+	nodes[proxy].box = Fatten(box);
+	InsertLeaf(proxy);
+	return true;
+}
+
+// walks down to the sibling that grows the total surface area the least, as in Box2D
+void BVH::InsertLeaf(int leaf)
+{
+	if (root == NONE) {
+		root = leaf;
+		nodes[leaf].parent = NONE;
+		return;
+	}
+
+	AABB leafBox = nodes[leaf].box;
+	int index = root;
+	while (nodes[index].left != NONE) {
+		int left = nodes[index].left, right = nodes[index].right;
+		float area = nodes[index].box.SurfaceArea();
+		float combinedArea = nodes[index].box.Union(leafBox).SurfaceArea();
+		// cost of a new parent for this node and the leaf, and the minimum cost of pushing it further down
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - area);
+
+		float costLeft = leafBox.Union(nodes[left].box).SurfaceArea() + inheritance;
+		if (nodes[left].left != NONE) {
+			costLeft -= nodes[left].box.SurfaceArea();
+		}
+		float costRight = leafBox.Union(nodes[right].box).SurfaceArea() + inheritance;
+		if (nodes[right].left != NONE) {
+			costRight -= nodes[right].box.SurfaceArea();
+		}
+
+		if (cost < costLeft && cost < costRight) {
+			break;
+		}
+		index = costLeft < costRight ? left : right;
+	}
+
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = leafBox.Union(nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent != NONE) {
+		if (nodes[oldParent].left == sibling) {
+			nodes[oldParent].left = newParent;
+		}
+		else {
+			nodes[oldParent].right = newParent;
+		}
+	}
+	else {
+		root = newParent;
+	}
+
+	Refit(newParent);
+}
+
+void BVH::RemoveLeaf(int leaf)
+{
+	if (leaf == root) {
+		root = NONE;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+	FreeNode(parent);
+	if (grandParent != NONE) {
+		if (nodes[grandParent].left == parent) {
+			nodes[grandParent].left = sibling;
+		}
+		else {
+			nodes[grandParent].right = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		Refit(grandParent);
+	}
+	else {
+		root = sibling;
+		nodes[sibling].parent = NONE;
+	}
+}
+
+void BVH::Refit(int node)
+{
+	while (node != NONE) {
+		node = Balance(node);
+		int left = nodes[node].left, right = nodes[node].right;
+		nodes[node].height = 1 + std::max(nodes[left].height, nodes[right].height);
+		nodes[node].box = nodes[left].box.Union(nodes[right].box);
+		node = nodes[node].parent;
+	}
+}
+
+// If one child of a is two levels taller than the other, its taller grandchild takes a's
+// place below the child and the child moves up. Returns the node now at a's position.
+int BVH::Balance(int a)
+{
+	if (nodes[a].left == NONE || nodes[a].height < 2) {
+		return a;
+	}
+	int b = nodes[a].left, c = nodes[a].right;
+	int balance = nodes[c].height - nodes[b].height;
+	if (balance >= -1 && balance <= 1) {
+		return a;
+	}
+
+	// up is the taller child, keep stays below a
+	int up = balance > 1 ? c : b;
+	int keep = balance > 1 ? b : c;
+	int f = nodes[up].left, g = nodes[up].right;
+
+	nodes[up].left = a;
+	nodes[up].parent = nodes[a].parent;
+	nodes[a].parent = up;
+	if (nodes[up].parent != NONE) {
+		if (nodes[nodes[up].parent].left == a) {
+			nodes[nodes[up].parent].left = up;
+		}
+		else {
+			nodes[nodes[up].parent].right = up;
+		}
+	}
+	else {
+		root = up;
+	}
+
+	// the taller grandchild stays with up, the shorter one replaces up below a
+	int taller = nodes[f].height > nodes[g].height ? f : g;
+	int shorter = taller == f ? g : f;
+	nodes[up].right = taller;
+	if (balance > 1) {
+		nodes[a].right = shorter;
+	}
+	else {
+		nodes[a].left = shorter;
+	}
+	nodes[shorter].parent = a;
+
+	nodes[a].box = nodes[keep].box.Union(nodes[shorter].box);
+	nodes[a].height = 1 + std::max(nodes[keep].height, nodes[shorter].height);
+	nodes[up].box = nodes[a].box.Union(nodes[taller].box);
+	nodes[up].height = 1 + std::max(nodes[a].height, nodes[taller].height);
+	return up;
+}
+
+size_t BVH::Query(const Frustum& frustum, std::vector<unsigned int>& visible) const
+{
+	if (root == NONE) {
+		return 0;
+	}
+	size_t tested = 0;
+	struct Entry { int node; unsigned int planeMask; };
+	Entry stack[64];
+	int top = 0;
+	stack[top++] = { root, Frustum::ALL_PLANES };
+	while (top > 0) {
+		Entry entry = stack[--top];
+		const Node& node = nodes[entry.node];
+		tested++;
+		Frustum::Result result = frustum.Test(node.box, entry.planeMask);
+		if (result == Frustum::OUTSIDE) {
+			continue;
+		}
+		if (result == Frustum::INSIDE) {
+			CollectLeaves(entry.node, visible);
+		}
+		else if (node.left == NONE) {
+			visible.push_back(node.userData);
+		}
+		else {
+			// an AVL balanced tree of 2^32 leaves is less than 64 levels deep
+			stack[top++] = { node.left, entry.planeMask };
+			stack[top++] = { node.right, entry.planeMask };
+		}
+	}
+	return tested;
+}
+
+void BVH::CollectLeaves(int node, std::vector<unsigned int>& visible) const
+{
+	if (nodes[node].left == NONE) {
+		visible.push_back(nodes[node].userData);
+		return;
+	}
+	CollectLeaves(nodes[node].left, visible);
+	CollectLeaves(nodes[node].right, visible);
+}
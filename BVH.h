@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Frustum.h"
+
+// Dynamic bounding volume hierarchy over object AABBs, a binary tree kept balanced with AVL
+// rotations. Leaves store a fattened box, so an object that moves a little stays inside it
+// and Move does nothing; only objects that leave their fat box are taken out and reinserted.
+class BVH
+{
+public:
+	static const int NONE = -1;
+
+	// returns the proxy id of the new leaf, userData comes back from Query
+	int Insert(const AABB& box, unsigned int userData);
+	void Remove(int proxy);
+	// returns true if the proxy had to be reinserted
+	bool Move(int proxy, const AABB& box);
+	void SetUserData(int proxy, unsigned int userData) { nodes[proxy].userData = userData; }
+	void Clear();
+
+	// appends the userData of every leaf that is not outside the frustum; subtrees fully
+	// inside are collected without testing their boxes; returns the number of boxes tested
+	size_t Query(const Frustum& frustum, std::vector<unsigned int>& visible) const;
+
+	int Height() const { return root == NONE ? 0 : nodes[root].height; }
+	size_t LeafCount() const { return leafCount; }
+
+private:
+	struct Node
+	{
+		AABB box;
+		int parent;
+		// left is NONE for leaves; free nodes chain through parent
+		int left, right;
+		int height;
+		unsigned int userData;
+	};
+
+	std::vector<Node> nodes;
+	int root = NONE;
+	int freeList = NONE;
+	size_t leafCount = 0;
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	// refits the boxes and heights from node up to the root, rebalancing on the way
+	void Refit(int node);
+	int Balance(int node);
+	void CollectLeaves(int node, std::vector<unsigned int>& visible) const;
+};
@@ -0,0 +1,275 @@
+#include "BakedTexture.h"
+#include <SOIL/SOIL.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+bool BakedTexture::Open(const std::string& path)
+{
+	Close();
+	if (!file.Open(path)) {
+		return false;
+	}
+	size_t size = file.Size();
+	if (size < sizeof(BakedHeader)) {
+		Close();
+		return false;
+	}
+	header = (const BakedHeader*)file.Data();
+	if (header->magic != BAKED_TEXTURE_MAGIC || header->version != BAKED_TEXTURE_VERSION
+		|| header->format > BAKED_BC1 || header->levels == 0 || header->levels > BAKED_TEXTURE_MAX_LEVELS
+		|| size < sizeof(BakedHeader) + header->levels * sizeof(BakedLevel)) {
+		std::cout << "WARNING::BAKED_TEXTURE::INVALID_HEADER " << path << std::endl;
+		Close();
+		return false;
+	}
+	levels = (const BakedLevel*)(file.Data() + sizeof(BakedHeader));
+	// levels have to be in upload order and exactly as large as their format says
+	size_t end = sizeof(BakedHeader) + header->levels * sizeof(BakedLevel);
+	for (unsigned int level = 0; level < header->levels; level++) {
+		const BakedLevel& data = levels[level];
+		if (data.offset < end || data.offset > size || data.size > size - data.offset
+			|| data.size != LevelSize(Format(), data.width, data.height)) {
+			std::cout << "WARNING::BAKED_TEXTURE::INVALID_LEVEL " << path << std::endl;
+			Close();
+			return false;
+		}
+		end = data.offset + data.size;
+	}
+	return true;
+}
+
+void BakedTexture::Close()
+{
+	file.Close();
+	header = NULL;
+	levels = NULL;
+}
+
+void BakedTexture::Prefault() const
+{
+	volatile unsigned char sink = 0;
+	for (size_t offset = 0; offset < file.Size(); offset += 4096) {
+		sink ^= file.Data()[offset];
+	}
+	(void)sink;
+}
+
+GLenum BakedTexture::InternalFormat(BakedFormat format)
+{
+	return format == BAKED_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8;
+}
+
+bool BakedTexture::CompressionSupported()
+{
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != NULL && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t BakedTexture::LevelSize(BakedFormat format, unsigned int width, unsigned int height)
+{
+	if (format == BAKED_BC1) {
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+	}
+	return (size_t)width * height * 4;
+}
+
+std::string BakedTexture::BakedPath(const std::string& imagePath)
+{
+	size_t dot = imagePath.find_last_of('.');
+	size_t slash = imagePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return imagePath + ".btex";
+	}
+	return imagePath.substr(0, dot) + ".btex";
+}
+
+// baking
+// ------
+
+// next mip level, each texel the average of the (up to) 2x2 texels it covers, like glGenerateMipmap
+static std::vector<unsigned char> Downsample(const std::vector<unsigned char>& pixels, unsigned int width, unsigned int height)
+{
+	unsigned int halfWidth = std::max(1u, width / 2), halfHeight = std::max(1u, height / 2);
+	std::vector<unsigned char> half(halfWidth * halfHeight * 4);
+	for (unsigned int y = 0; y < halfHeight; y++) {
+		unsigned int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+		for (unsigned int x = 0; x < halfWidth; x++) {
+			unsigned int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			for (unsigned int c = 0; c < 4; c++) {
+				unsigned int sum = pixels[(y0 * width + x0) * 4 + c] + pixels[(y0 * width + x1) * 4 + c]
+					+ pixels[(y1 * width + x0) * 4 + c] + pixels[(y1 * width + x1) * 4 + c];
+				half[(y * halfWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return half;
+}
+
+static unsigned short To565(const int* rgb)
+{
+	return (unsigned short)(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+}
+
+static void From565(unsigned short color, int* rgb)
+{
+	int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 block from 16 RGBA texels. The endpoints are the corners of the colour bounding box,
+// on the diagonal that follows the correlation of the channels, then every texel takes the
+// nearest of the four palette colours.
+static void CompressBlock(const unsigned char texels[16][4], unsigned char* block)
+{
+	int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			low[c] = std::min(low[c], (int)texels[i][c]);
+			high[c] = std::max(high[c], (int)texels[i][c]);
+			mean[c] += texels[i][c];
+		}
+	}
+	int covarianceG = 0, covarianceB = 0;
+	for (int i = 0; i < 16; i++) {
+		int r = texels[i][0] * 16 - mean[0];
+		covarianceG += r * (texels[i][1] * 16 - mean[1]);
+		covarianceB += r * (texels[i][2] * 16 - mean[2]);
+	}
+	if (covarianceG < 0) {
+		std::swap(low[1], high[1]);
+	}
+	if (covarianceB < 0) {
+		std::swap(low[2], high[2]);
+	}
+
+	unsigned short color0 = To565(high), color1 = To565(low);
+	// color0 > color1 selects the four colour mode, equal endpoints only need index 0
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+	int palette[4][3];
+	From565(color0, palette[0]);
+	From565(color1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	unsigned int indices = 0;
+	if (color0 != color1) {
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestDistance = 1 << 30;
+			for (int p = 0; p < 4; p++) {
+				int distance = 0;
+				for (int c = 0; c < 3; c++) {
+					int d = texels[i][c] - palette[p][c];
+					distance += d * d;
+				}
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= (unsigned int)best << (i * 2);
+		}
+	}
+	block[0] = (unsigned char)(color0 & 0xFF);
+	block[1] = (unsigned char)(color0 >> 8);
+	block[2] = (unsigned char)(color1 & 0xFF);
+	block[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++) {
+		block[4 + i] = (unsigned char)(indices >> (i * 8));
+	}
+}
+
+static std::vector<unsigned char> CompressBC1(const std::vector<unsigned char>& pixels, unsigned int width, unsigned int height)
+{
+	unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	std::vector<unsigned char> blocks(blocksX * blocksY * 8);
+	unsigned char texels[16][4];
+	for (unsigned int by = 0; by < blocksY; by++) {
+		for (unsigned int bx = 0; bx < blocksX; bx++) {
+			// blocks hanging over the edge repeat the last row and column
+			for (unsigned int i = 0; i < 16; i++) {
+				unsigned int x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+				std::copy(&pixels[(y * width + x) * 4], &pixels[(y * width + x) * 4] + 4, texels[i]);
+			}
+			CompressBlock(texels, &blocks[(by * blocksX + bx) * 8]);
+		}
+	}
+	return blocks;
+}
+
+bool BakedTexture::Bake(const std::string& imagePath, const std::string& outPath, bool compress)
+{
+	int width, height;
+	unsigned char* image = SOIL_load_image(imagePath.c_str(), &width, &height, 0, SOIL_LOAD_RGBA);
+	if (image == NULL) {
+		std::cout << "ERROR::BAKED_TEXTURE::LOAD_FAILED " << imagePath << std::endl;
+		return false;
+	}
+	std::vector<unsigned char> pixels(image, image + width * height * 4);
+	SOIL_free_image_data(image);
+
+	// the full chain down to 1x1
+	std::vector<std::vector<unsigned char>> data;
+	std::vector<BakedLevel> levels;
+	unsigned int levelWidth = width, levelHeight = height;
+	for (;;) {
+		BakedLevel level;
+		level.width = levelWidth;
+		level.height = levelHeight;
+		data.push_back(compress ? CompressBC1(pixels, levelWidth, levelHeight) : pixels);
+		level.size = (unsigned int)data.back().size();
+		levels.push_back(level);
+		if ((levelWidth == 1 && levelHeight == 1) || levels.size() == BAKED_TEXTURE_MAX_LEVELS) {
+			break;
+		}
+		pixels = Downsample(pixels, levelWidth, levelHeight);
+		levelWidth = std::max(1u, levelWidth / 2);
+		levelHeight = std::max(1u, levelHeight / 2);
+	}
+
+	size_t offset = sizeof(BakedHeader) + levels.size() * sizeof(BakedLevel);
+	for (BakedLevel& level : levels) {
+		offset = (offset + BAKED_TEXTURE_ALIGNMENT - 1) / BAKED_TEXTURE_ALIGNMENT * BAKED_TEXTURE_ALIGNMENT;
+		level.offset = (unsigned int)offset;
+		offset += level.size;
+	}
+
+	BakedHeader header;
+	header.magic = BAKED_TEXTURE_MAGIC;
+	header.version = BAKED_TEXTURE_VERSION;
+	header.format = compress ? BAKED_BC1 : BAKED_RGBA8;
+	header.width = width;
+	header.height = height;
+	header.levels = (unsigned int)levels.size();
+
+	std::ofstream file(outPath.c_str(), std::ios::binary);
+	if (!file) {
+		std::cout << "ERROR::BAKED_TEXTURE::WRITE_FAILED " << outPath << std::endl;
+		return false;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)levels.data(), levels.size() * sizeof(BakedLevel));
+	const char padding[BAKED_TEXTURE_ALIGNMENT] = {};
+	size_t written = sizeof(BakedHeader) + levels.size() * sizeof(BakedLevel);
+	for (size_t i = 0; i < levels.size(); i++) {
+		file.write(padding, levels[i].offset - written);
+		file.write((const char*)data[i].data(), data[i].size());
+		written = levels[i].offset + levels[i].size;
+	}
+	return (bool)file;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <string>
+#include "MappedFile.h"
+
+// from EXT_texture_compression_s3tc, which every desktop driver exposes but is not core
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#define BAKED_TEXTURE_MAGIC 0x58455442u // "BTEX"
+#define BAKED_TEXTURE_VERSION 1
+#define BAKED_TEXTURE_MAX_LEVELS 16
+// level data starts on this boundary inside the file, and so inside the upload buffer
+#define BAKED_TEXTURE_ALIGNMENT 16
+
+enum BakedFormat
+{
+	BAKED_RGBA8 = 0,
+	// 4x4 blocks of 8 bytes, opaque RGB, an eighth of the size of RGBA8
+	BAKED_BC1 = 1
+};
+
+// On disk layout: header, one BakedLevel per mip level, then the level data in upload order.
+// All fields are little endian 32 bit values.
+struct BakedHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int format;
+	unsigned int width, height;
+	unsigned int levels;
+};
+
+struct BakedLevel
+{
+	unsigned int width, height;
+	// from the start of the file
+	unsigned int offset;
+	unsigned int size;
+};
+
+// Texture whose whole mip chain was decoded, filtered and optionally compressed offline by Bake,
+// so loading it is a memory map and a copy into GL with nothing left to decode or generate.
+class BakedTexture
+{
+public:
+	// maps the file and validates every level against its size, returns false if it is not usable
+	bool Open(const std::string& path);
+	void Close();
+
+	BakedFormat Format() const { return (BakedFormat)header->format; }
+	unsigned int Width() const { return header->width; }
+	unsigned int Height() const { return header->height; }
+	unsigned int Levels() const { return header->levels; }
+	const BakedLevel& Level(unsigned int level) const { return levels[level]; }
+	const unsigned char* LevelData(unsigned int level) const { return file.Data() + levels[level].offset; }
+	// reads every page of the mapping, so later copies out of it do not fault
+	void Prefault() const;
+
+	// internal format for glTexImage2D or glCompressedTexImage2D
+	static GLenum InternalFormat(BakedFormat format);
+	// whether the current context can sample BAKED_BC1 textures
+	static bool CompressionSupported();
+	// bytes of one level: 4 per texel, or 8 per started 4x4 block
+	static size_t LevelSize(BakedFormat format, unsigned int width, unsigned int height);
+	// the baked file that replaces an image, "lantai.png" becomes "lantai.btex"
+	static std::string BakedPath(const std::string& imagePath);
+	// decodes the image, box filters the full mip chain and writes it to outPath
+	static bool Bake(const std::string& imagePath, const std::string& outPath, bool compress);
+
+private:
+	MappedFile file;
+	const BakedHeader* header = NULL;
+	const BakedLevel* levels = NULL;
+};
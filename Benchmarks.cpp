@@ -0,0 +1,2058 @@
+#include "Benchmarks.h"
+#include "ClusteredLights.h"
+#include "BakedTexture.h"
+#include "DeferredRenderer.h"
+#include "GLState.h"
+#include "GeometryArena.h"
+#include "HeadlessContext.h"
+#include "InstancedMesh.h"
+#include "MeshOptimizer.h"
+#include "ObjImporter.h"
+#include "OcclusionCuller.h"
+#include "LightSet.h"
+#include "LightmapBaker.h"
+#include "Scene.h"
+#include "ScenePackage.h"
+#include "ShadowMaps.h"
+#include "SoftwareRenderer.h"
+#include "TransformSystem.h"
+#include "ThreadPool.h"
+#include <SOIL/SOIL.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double MillisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// What the GL benchmarks share: a headless context with GL loaded, then on request an offscreen
+// colour target bound with its viewport, with a depth (or depth stencil) buffer when depthFormat
+// is not 0, and a 1x1 white texture for plain materials next to a light set holding dirLight.
+// Destroy deletes whatever was created, then the context.
+struct BenchContext
+{
+	HeadlessContext context;
+	GLuint framebuffer = 0, color = 0, depth = 0;
+	GLuint white = 0;
+	LightSet lights;
+
+	bool Create()
+	{
+		if (!context.Create() || !gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress)) {
+			std::cout << "Failed to create an OpenGL context" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void CreateTarget(unsigned int width, unsigned int height, GLenum depthFormat)
+	{
+		glGenRenderbuffers(1, &color);
+		glBindRenderbuffer(GL_RENDERBUFFER, color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+		if (depthFormat != 0) {
+			glGenRenderbuffers(1, &depth);
+			glBindRenderbuffer(GL_RENDERBUFFER, depth);
+			glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, width, height);
+			GLenum attachment = depthFormat == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, depth);
+		}
+		glViewport(0, 0, width, height);
+	}
+
+	void CreateMaterials(const DirLight& dirLight)
+	{
+		const unsigned char texel[] = { 255, 255, 255, 255 };
+		glGenTextures(1, &white);
+		glBindTexture(GL_TEXTURE_2D, white);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		lights.Create();
+		lights.SetDirLight(dirLight);
+		lights.Upload();
+	}
+
+	void Destroy()
+	{
+		// deleting the name 0 is ignored, so the parts that were not asked for need no check
+		lights.Delete();
+		glDeleteTextures(1, &white);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &color);
+		glDeleteRenderbuffers(1, &depth);
+		context.Destroy();
+	}
+};
+
+// Light assignment cost of the clustered forward path for 4 to 4096 point lights, seen from
+// the Demo start camera. "lights/cluster" is the average loop length of the fragment shader in
+// occupied clusters, against "lights" for the classic loop over every light.
+static int BenchmarkClusters()
+{
+	const int iterations = 200;
+	// same projection and start camera as Demo::Render
+	glm::mat4 projection = glm::perspective(45.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 8.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	ThreadPool pool;
+	ThreadPool single(1);
+
+	std::cout << "clustered light assignment, " << CLUSTER_X << "x" << CLUSTER_Y << "x" << CLUSTER_Z << " clusters, "
+		<< pool.Size() << " threads" << std::endl;
+	std::cout << std::setw(8) << "lights" << std::setw(14) << "assign ms" << std::setw(14) << "2 threads ms"
+		<< std::setw(10) << "indices" << std::setw(16) << "lights/cluster" << std::setw(8) << "max" << std::endl;
+
+	for (int count = 4; count <= 4096; count *= 2) {
+		ClusteredLights clusters;
+		clusters.SetLights(ClusteredLights::ScatterLights(count, 45.0f));
+		clusters.SetProjection(projection);
+		clusters.Assign(view, pool);
+
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < iterations; i++) {
+			clusters.Assign(view, pool);
+		}
+		double pooled = MillisecondsSince(start) / iterations;
+
+		start = Clock::now();
+		for (int i = 0; i < iterations; i++) {
+			clusters.Assign(view, single);
+		}
+		double paired = MillisecondsSince(start) / iterations;
+
+		const std::vector<unsigned int>& grid = clusters.Grid();
+		size_t occupied = 0, longest = 0;
+		for (size_t c = 0; c < CLUSTER_COUNT; c++) {
+			occupied += grid[c * 2 + 1] > 0;
+			longest = std::max<size_t>(longest, grid[c * 2 + 1]);
+		}
+		double average = occupied ? (double)clusters.IndexCount() / occupied : 0.0;
+
+		std::cout << std::setw(8) << count << std::setw(14) << std::fixed << std::setprecision(4) << pooled
+			<< std::setw(14) << paired << std::setw(10) << clusters.IndexCount()
+			<< std::setw(16) << std::setprecision(2) << average << std::setw(8) << longest << std::endl;
+	}
+	return 0;
+}
+
+// Startup cost of the demo textures, loaded one after another on one thread with their full mip
+// chains: PNG decode plus glGenerateMipmap against a mapped baked file, raw and BC1 compressed.
+// The baked files are written next to the images for the run and removed afterwards.
+static int BenchmarkTextures()
+{
+	const char* images[] = { "lantai.png", "pintuP.png", "Spintu.png", "spekular_lantai.png" };
+	const int imageCount = 4, runs = 20;
+
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+
+	bool bakedOk = true;
+	for (int i = 0; i < imageCount; i++) {
+		bakedOk = bakedOk && BakedTexture::Bake(images[i], std::string(images[i]) + ".rgba8.btex", false)
+			&& BakedTexture::Bake(images[i], std::string(images[i]) + ".bc1.btex", true);
+	}
+
+	GLuint textures[imageCount];
+	glGenTextures(imageCount, textures);
+	// each path is timed until the textures are resident, the fastest of the runs is reported
+	auto measure = [&](const char* suffix) {
+		double best = 1e30;
+		size_t bytes = 0;
+		for (int run = 0; run <= runs; run++) {
+			bytes = 0;
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < imageCount; i++) {
+				glBindTexture(GL_TEXTURE_2D, textures[i]);
+				if (suffix == NULL) {
+					int width, height;
+					unsigned char* image = SOIL_load_image(images[i], &width, &height, 0, SOIL_LOAD_RGBA);
+					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+					glGenerateMipmap(GL_TEXTURE_2D);
+					SOIL_free_image_data(image);
+					std::ifstream file(images[i], std::ios::binary | std::ios::ate);
+					bytes += (size_t)file.tellg();
+					continue;
+				}
+				BakedTexture baked;
+				if (!baked.Open(std::string(images[i]) + suffix)) {
+					return -1.0;
+				}
+				GLenum internalFormat = BakedTexture::InternalFormat(baked.Format());
+				for (unsigned int level = 0; level < baked.Levels(); level++) {
+					const BakedLevel& data = baked.Level(level);
+					if (baked.Format() == BAKED_BC1) {
+						glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, data.width, data.height, 0, data.size, baked.LevelData(level));
+					}
+					else {
+						glTexImage2D(GL_TEXTURE_2D, level, internalFormat, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, baked.LevelData(level));
+					}
+					bytes += data.size;
+				}
+			}
+			glFinish();
+			// run 0 only warms the file cache and the driver
+			if (run > 0) {
+				best = std::min(best, MillisecondsSince(start));
+			}
+		}
+		std::cout << std::setw(12) << (suffix == NULL ? "png" : suffix[1] == 'r' ? "baked rgba8" : "baked bc1")
+			<< std::setw(12) << std::fixed << std::setprecision(3) << best << std::setw(12) << bytes / 1024 << std::endl;
+		return best;
+	};
+
+	std::cout << "texture startup, " << imageCount << " images with mip chains, best of " << runs << " runs" << std::endl;
+	std::cout << std::setw(12) << "path" << std::setw(12) << "ms" << std::setw(12) << "KiB read" << std::endl;
+	int result = 0;
+	if (!bakedOk || measure(NULL) < 0 || measure(".rgba8.btex") < 0) {
+		result = 1;
+	}
+	else if (BakedTexture::CompressionSupported()) {
+		measure(".bc1.btex");
+	}
+	else {
+		std::cout << std::setw(12) << "baked bc1" << "  skipped, no GL_EXT_texture_compression_s3tc" << std::endl;
+	}
+
+	glDeleteTextures(imageCount, textures);
+	for (int i = 0; i < imageCount; i++) {
+		std::remove((std::string(images[i]) + ".rgba8.btex").c_str());
+		std::remove((std::string(images[i]) + ".bc1.btex").c_str());
+	}
+	bench.Destroy();
+	return result;
+}
+
+// minimal program for the GL benchmarks, they measure submission and not shading
+static GLuint BuildBenchmarkProgram(const char* vertexSource, const char* fragmentSource)
+{
+	GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex, 1, &vertexSource, NULL);
+	glCompileShader(vertex);
+	GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment, 1, &fragmentSource, NULL);
+	glCompileShader(fragment);
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+// the demo's own shader files, with defines inserted after the #version line like RenderEngine does
+static GLuint BuildBenchmarkProgramFromFiles(const char* vertexPath, const char* fragmentPath, const std::string& defines)
+{
+	std::string sources[2];
+	const char* paths[2] = { vertexPath, fragmentPath };
+	for (int i = 0; i < 2; i++) {
+		std::ifstream file(paths[i]);
+		std::string line;
+		while (std::getline(file, line)) {
+			sources[i] += line + "\n";
+			if (line.compare(0, 8, "#version") == 0) {
+				sources[i] += defines;
+			}
+		}
+	}
+	return BuildBenchmarkProgram(sources[0].c_str(), sources[1].c_str());
+}
+
+// box of the given half size in the GeometryArena vertex layout, normals and tex coords zeroed
+static void BuildBenchmarkBox(const glm::vec3& half, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+	vertices.assign(8 * GEOMETRY_VERTEX_FLOATS, 0.0f);
+	for (int corner = 0; corner < 8; corner++) {
+		vertices[corner * GEOMETRY_VERTEX_FLOATS + 0] = corner & 1 ? half.x : -half.x;
+		vertices[corner * GEOMETRY_VERTEX_FLOATS + 1] = corner & 2 ? half.y : -half.y;
+		vertices[corner * GEOMETRY_VERTEX_FLOATS + 2] = corner & 4 ? half.z : -half.z;
+	}
+	const GLuint box[] = { 0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+	indices.assign(box, box + 36);
+}
+
+// box of the given half size with its own 4 vertices and normal per face, like the demo's crate
+static void BuildBenchmarkFacetedBox(const glm::vec3& half, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+	vertices.clear();
+	indices.clear();
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = -1; side <= 1; side += 2) {
+			int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			GLuint first = (GLuint)(vertices.size() / GEOMETRY_VERTEX_FLOATS);
+			for (int corner = 0; corner < 4; corner++) {
+				glm::vec3 position(0.0f), normal(0.0f);
+				position[axis] = side * half[axis];
+				position[u] = (corner == 1 || corner == 2 ? 1.0f : -1.0f) * half[u];
+				position[v] = (corner >= 2 ? 1.0f : -1.0f) * half[v];
+				normal[axis] = (float)side;
+				const GLfloat vertex[] = { position.x, position.y, position.z, 0, 0, normal.x, normal.y, normal.z };
+				vertices.insert(vertices.end(), vertex, vertex + GEOMETRY_VERTEX_FLOATS);
+			}
+			const GLuint quad[] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Cubes drawn with one glDrawElementsInstanced against one glUniformMatrix4fv plus glDrawElements
+// each, for 1 to 100k cubes. "submit" is the CPU time to issue the frame, "total" includes glFinish.
+// The cubes are tiny and the target is 256x256, so the numbers are dominated by per draw overhead.
+static int BenchmarkInstancing()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+
+	const char* instancedVertex =
+		"#version 330 core\n"
+		"layout (location = 0) in vec3 aPos;\n"
+		"layout (location = 3) in mat4 instanceModel;\n"
+		"uniform mat4 viewProjection;\n"
+		"void main() { gl_Position = viewProjection * instanceModel * vec4(aPos, 1.0); }\n";
+	const char* uniformVertex =
+		"#version 330 core\n"
+		"layout (location = 0) in vec3 aPos;\n"
+		"uniform mat4 model;\n"
+		"uniform mat4 viewProjection;\n"
+		"void main() { gl_Position = viewProjection * model * vec4(aPos, 1.0); }\n";
+	const char* fragmentSource =
+		"#version 330 core\n"
+		"out vec4 FragColor;\n"
+		"void main() { FragColor = vec4(1.0); }\n";
+	GLuint instancedProgram = BuildBenchmarkProgram(instancedVertex, fragmentSource);
+	GLuint uniformProgram = BuildBenchmarkProgram(uniformVertex, fragmentSource);
+	if (instancedProgram == 0 || uniformProgram == 0) {
+		std::cout << "Failed to build the benchmark shaders" << std::endl;
+		return 1;
+	}
+
+	bench.CreateTarget(256, 256, 0);
+
+	const GLfloat vertices[] = { -1, -1, -1, 1, -1, -1, 1, 1, -1, -1, 1, -1, -1, -1, 1, 1, -1, 1, 1, 1, 1, -1, 1, 1 };
+	const GLuint indices[] = { 0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4, 3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5 };
+	GLuint vao, vbo, ebo;
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ebo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+	InstancedMesh mesh;
+	mesh.Create(vao, 36);
+
+	glm::mat4 viewProjection = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -10.0f, 10.0f);
+	glUseProgram(instancedProgram);
+	glUniformMatrix4fv(glGetUniformLocation(instancedProgram, "viewProjection"), 1, GL_FALSE, &viewProjection[0][0]);
+	glUseProgram(uniformProgram);
+	glUniformMatrix4fv(glGetUniformLocation(uniformProgram, "viewProjection"), 1, GL_FALSE, &viewProjection[0][0]);
+	GLint modelLocation = glGetUniformLocation(uniformProgram, "model");
+
+	std::cout << "instanced cubes against one draw per cube, 256x256 target" << std::endl;
+	std::cout << std::setw(10) << "instances" << std::setw(18) << "instanced submit" << std::setw(16) << "instanced total"
+		<< std::setw(14) << "draws submit" << std::setw(14) << "draws total" << std::setw(10) << "speedup" << std::endl;
+
+	for (int count = 1; count <= 100000; count *= 10) {
+		// cubes of a hundredth of the target spread over a grid
+		std::vector<InstanceTransform> transforms(count);
+		int side = (int)std::ceil(std::sqrt((double)count));
+		for (int i = 0; i < count; i++) {
+			glm::vec3 position(((i % side) + 0.5f) / side * 2.0f - 1.0f, ((i / side) + 0.5f) / side * 2.0f - 1.0f, 0.0f);
+			transforms[i].model = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.01f));
+			for (int c = 0; c < 3; c++) {
+				transforms[i].normal[c] = glm::vec4(0.0f);
+				transforms[i].normal[c][c] = 100.0f;
+			}
+		}
+		// enough frames for about the same amount of work at every size
+		int frames = std::max(3, 100000 / count);
+
+		double instancedSubmit = 0, instancedTotal = 0;
+		glUseProgram(instancedProgram);
+		for (int frame = 0; frame <= frames; frame++) {
+			glClear(GL_COLOR_BUFFER_BIT);
+			Clock::time_point start = Clock::now();
+			mesh.SetInstances(transforms.data(), transforms.size());
+			mesh.Draw();
+			double submit = MillisecondsSince(start);
+			glFinish();
+			// frame 0 warms up the driver
+			if (frame > 0) {
+				instancedSubmit += submit;
+				instancedTotal += MillisecondsSince(start);
+			}
+		}
+
+		double drawsSubmit = 0, drawsTotal = 0;
+		glUseProgram(uniformProgram);
+		glBindVertexArray(vao);
+		for (int frame = 0; frame <= frames; frame++) {
+			glClear(GL_COLOR_BUFFER_BIT);
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < count; i++) {
+				glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &transforms[i].model[0][0]);
+				glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+			}
+			double submit = MillisecondsSince(start);
+			glFinish();
+			if (frame > 0) {
+				drawsSubmit += submit;
+				drawsTotal += MillisecondsSince(start);
+			}
+		}
+		glBindVertexArray(0);
+
+		std::cout << std::setw(10) << count << std::fixed << std::setprecision(3)
+			<< std::setw(18) << instancedSubmit / frames << std::setw(16) << instancedTotal / frames
+			<< std::setw(14) << drawsSubmit / frames << std::setw(14) << drawsTotal / frames
+			<< std::setw(9) << std::setprecision(1) << drawsTotal / instancedTotal << "x" << std::endl;
+	}
+
+	mesh.Delete();
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+	glDeleteProgram(instancedProgram);
+	glDeleteProgram(uniformProgram);
+	bench.Destroy();
+	return 0;
+}
+
+// Model and normal matrices for 1k to 1M objects: the glm path with a full inverse per object
+// (what the vertex shader used to do per vertex), the SSE kernel on one thread and on the pool,
+// and the kernel when only every tenth object moved. "max error" is the largest difference of
+// any matrix element between the kernel and the glm path.
+static int BenchmarkTransforms()
+{
+	ThreadPool pool;
+	std::cout << "transform update, milliseconds per frame, " << pool.Size() << " threads" << std::endl;
+	std::cout << std::setw(10) << "objects" << std::setw(12) << "glm" << std::setw(12) << "kernel" << std::setw(12) << "pool"
+		<< std::setw(14) << "10% dirty" << std::setw(14) << "max error" << std::endl;
+
+	for (size_t count = 1000; count <= 1000000; count *= 10) {
+		TransformSystem transforms;
+		std::vector<glm::vec4> rotations(count);
+		unsigned int seed = 12345;
+		auto random = [&seed]() {
+			seed = seed * 1664525u + 1013904223u;
+			return (seed >> 8) / 16777216.0f;
+		};
+		for (size_t i = 0; i < count; i++) {
+			glm::vec3 axis(random() - 0.5f, random() - 0.5f, random() - 0.5f);
+			rotations[i] = TransformSystem::AxisAngle(axis + glm::vec3(0.0f, 0.01f, 0.0f), random() * 6.28f);
+			// non uniform scale, so the normal matrix is not just the rotation
+			glm::vec3 scale(0.5f + random(), 0.5f + random(), 0.5f + random());
+			transforms.Add(glm::vec3(random() * 100.0f, random() * 10.0f, random() * 100.0f), rotations[i], scale);
+		}
+		int frames = (int)std::max((size_t)3, 2000000 / count);
+		auto touch = [&](size_t step) {
+			for (size_t i = 0; i < count; i += step) {
+				transforms.SetRotation(i, rotations[i]);
+			}
+		};
+
+		double reference = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			Clock::time_point start = Clock::now();
+			transforms.UpdateReference();
+			reference += MillisecondsSince(start);
+		}
+		std::vector<InstanceTransform> expected(transforms.Instances(), transforms.Instances() + count);
+
+		double kernel = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			touch(1);
+			Clock::time_point start = Clock::now();
+			transforms.Update();
+			kernel += MillisecondsSince(start);
+		}
+		double pooled = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			touch(1);
+			Clock::time_point start = Clock::now();
+			transforms.Update(&pool);
+			pooled += MillisecondsSince(start);
+		}
+		double partial = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			touch(10);
+			Clock::time_point start = Clock::now();
+			transforms.Update(&pool);
+			partial += MillisecondsSince(start);
+		}
+
+		float maxError = 0;
+		const InstanceTransform* actual = transforms.Instances();
+		for (size_t i = 0; i < count; i++) {
+			for (int c = 0; c < 4; c++) {
+				for (int r = 0; r < 4; r++) {
+					maxError = std::max(maxError, std::abs(actual[i].model[c][r] - expected[i].model[c][r]));
+				}
+			}
+			for (int c = 0; c < 3; c++) {
+				for (int r = 0; r < 3; r++) {
+					maxError = std::max(maxError, std::abs(actual[i].normal[c][r] - expected[i].normal[c][r]));
+				}
+			}
+		}
+
+		std::cout << std::setw(10) << count << std::fixed << std::setprecision(3)
+			<< std::setw(12) << reference / frames << std::setw(12) << kernel / frames << std::setw(12) << pooled / frames
+			<< std::setw(14) << partial / frames << std::setw(14) << std::scientific << std::setprecision(1) << maxError
+			<< std::defaultfloat << std::endl;
+	}
+	return 0;
+}
+
+// what Demo used to do: one heap object per mesh, each with its own matrix built through glm
+struct LegacyObject
+{
+	glm::vec3 position;
+	float angle;
+	GLuint vao, diffuse, specular;
+	glm::mat4 model;
+};
+
+// The scene store at 100k renderables spread over 4 materials: creating them, the per frame
+// update with everything or a tenth of it moving (transforms, BVH refit and regrouping into batches),
+// the instance upload, and destroying and recreating a tenth of the entities. The baseline
+// walks one heap allocated object per entity and rebuilds its matrix with glm.
+static int BenchmarkScene()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+	const size_t count = 100000;
+	const int frames = 20;
+	const glm::vec3 up(0, 1, 0);
+	ThreadPool pool;
+
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	BuildBenchmarkBox(glm::vec3(0.5f), vertices, indices);
+	Scene scene;
+	unsigned int mesh = scene.AddMesh(vertices.data(), vertices.size() / GEOMETRY_VERTEX_FLOATS, indices.data(), (GLsizei)indices.size());
+	for (int i = 0; i < 4; i++) {
+		scene.AddMaterial(SceneMaterial());
+	}
+
+	std::vector<Entity> entities(count);
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < count; i++) {
+		entities[i] = scene.Create();
+		glm::vec3 position((float)(i % 316), 0.0f, (float)(i / 316));
+		scene.AddRenderable(entities[i], mesh, (unsigned int)(i % 4), position, TransformSystem::AxisAngle(up, i * 0.37f), glm::vec3(1, 1, 1));
+	}
+	// the first update builds the BVH
+	scene.Update(&pool);
+	double create = MillisecondsSince(start);
+
+	// every entity, then every tenth entity moves
+	double all = 0, tenth = 0, upload = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		for (size_t i = 0; i < count; i++) {
+			scene.SetRotation(entities[i], TransformSystem::AxisAngle(up, frame + i * 0.37f));
+		}
+		start = Clock::now();
+		scene.Update(&pool);
+		scene.Cull(Frustum());
+		all += MillisecondsSince(start);
+		start = Clock::now();
+		scene.Upload();
+		glFinish();
+		upload += MillisecondsSince(start);
+	}
+	for (int frame = 0; frame < frames; frame++) {
+		for (size_t i = 0; i < count; i += 10) {
+			scene.SetRotation(entities[i], TransformSystem::AxisAngle(up, frame + i * 0.37f));
+		}
+		start = Clock::now();
+		scene.Update(&pool);
+		scene.Cull(Frustum());
+		tenth += MillisecondsSince(start);
+	}
+
+	// removal swaps the last slot in, so churn costs the same wherever the entity sits
+	start = Clock::now();
+	for (size_t i = 0; i < count; i += 10) {
+		scene.Destroy(entities[i]);
+		entities[i] = scene.Create();
+		scene.AddRenderable(entities[i], mesh, (unsigned int)(i % 4), glm::vec3(0, 0, 0), glm::vec4(0, 0, 0, 1), glm::vec3(1, 1, 1));
+	}
+	double churn = MillisecondsSince(start);
+	bool consistent = scene.RenderableCount() == count && scene.EntityCount() == count;
+
+	std::vector<std::unique_ptr<LegacyObject>> objects;
+	for (size_t i = 0; i < count; i++) {
+		objects.push_back(std::unique_ptr<LegacyObject>(new LegacyObject()));
+		objects.back()->position = glm::vec3((float)(i % 316), 0.0f, (float)(i / 316));
+	}
+	// scatter the pointers the way a long running scene ends up
+	unsigned int seed = 12345;
+	for (size_t i = count - 1; i > 0; i--) {
+		seed = seed * 1664525u + 1013904223u;
+		std::swap(objects[i], objects[(seed >> 8) % (i + 1)]);
+	}
+	double legacy = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		start = Clock::now();
+		for (size_t i = 0; i < count; i++) {
+			LegacyObject& object = *objects[i];
+			object.angle = frame + i * 0.37f;
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), object.position);
+			object.model = glm::rotate(model, object.angle, up);
+		}
+		legacy += MillisecondsSince(start);
+	}
+
+	std::cout << "scene store, " << count << " renderables, 4 materials, " << pool.Size() << " threads" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::setw(28) << "create" << std::setw(10) << create << " ms" << std::setw(10) << count / create / 1000.0 << " M/s" << std::endl;
+	std::cout << std::setw(28) << "update, all moved" << std::setw(10) << all / frames << " ms" << std::setw(10) << count / (all / frames) / 1000.0 << " M/s" << std::endl;
+	std::cout << std::setw(28) << "update, 10% moved" << std::setw(10) << tenth / frames << " ms" << std::endl;
+	std::cout << std::setw(28) << "upload" << std::setw(10) << upload / frames << " ms" << std::endl;
+	std::cout << std::setw(28) << "destroy + create 10%" << std::setw(10) << churn << " ms" << std::endl;
+	std::cout << std::setw(28) << "object list, all moved" << std::setw(10) << legacy / frames << " ms" << std::setw(10) << count / (legacy / frames) / 1000.0 << " M/s" << std::endl;
+	std::cout << "batches " << scene.Batches().size() << ", handles " << (consistent ? "consistent" : "INCONSISTENT") << std::endl;
+
+	scene.Delete();
+	bench.Destroy();
+	return consistent ? 0 : 1;
+}
+
+// Frustum culling of 100k unit boxes on a 316x316 grid, seen from above one edge looking across
+// the field: every box tested against the frustum against a query of the BVH, and the cost of
+// refitting the BVH when a tenth of the boxes move a little or jump to a random place.
+static int BenchmarkCulling()
+{
+	const size_t count = 100000;
+	const int side = 316, frames = 20;
+	std::vector<AABB> boxes(count);
+	BVH bvh;
+	std::vector<int> proxies(count);
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 center((float)(i % side) * 2.0f - side, 0.0f, (float)(i / side) * 2.0f - side);
+		boxes[i] = AABB(center - glm::vec3(0.5f), center + glm::vec3(0.5f));
+		proxies[i] = bvh.Insert(boxes[i], (unsigned int)i);
+	}
+	double build = MillisecondsSince(start);
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 3.0f, (float)side), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0, 1, 0));
+	Frustum frustum(projection * view);
+
+	std::vector<unsigned int> visible;
+	double bruteForce = 0;
+	size_t bruteVisible = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		visible.clear();
+		start = Clock::now();
+		for (size_t i = 0; i < count; i++) {
+			unsigned int planeMask = Frustum::ALL_PLANES;
+			if (frustum.Test(boxes[i], planeMask) != Frustum::OUTSIDE) {
+				visible.push_back((unsigned int)i);
+			}
+		}
+		bruteForce += MillisecondsSince(start);
+		bruteVisible = visible.size();
+	}
+	double query = 0;
+	size_t tested = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		visible.clear();
+		start = Clock::now();
+		tested = bvh.Query(frustum, visible);
+		query += MillisecondsSince(start);
+	}
+
+	// small moves stay inside the fat leaves, teleports are reinserted
+	double nudge = 0, teleport = 0;
+	size_t reinserted = 0;
+	unsigned int seed = 12345;
+	for (int frame = 0; frame < frames; frame++) {
+		start = Clock::now();
+		for (size_t i = frame % 10; i < count; i += 10) {
+			glm::vec3 offset(0.02f * ((frame & 1) ? 1.0f : -1.0f), 0.0f, 0.0f);
+			boxes[i] = AABB(boxes[i].min + offset, boxes[i].max + offset);
+			reinserted += bvh.Move(proxies[i], boxes[i]) ? 1 : 0;
+		}
+		nudge += MillisecondsSince(start);
+	}
+	for (int frame = 0; frame < frames; frame++) {
+		start = Clock::now();
+		for (size_t i = frame % 10; i < count; i += 10) {
+			seed = seed * 1664525u + 1013904223u;
+			glm::vec3 center((float)(seed % (2 * side)) - side, 0.0f, (float)((seed >> 12) % (2 * side)) - side);
+			boxes[i] = AABB(center - glm::vec3(0.5f), center + glm::vec3(0.5f));
+			bvh.Move(proxies[i], boxes[i]);
+		}
+		teleport += MillisecondsSince(start);
+	}
+
+	std::cout << "frustum culling, " << count << " boxes, BVH height " << bvh.Height() << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::setw(24) << "build" << std::setw(10) << build << " ms" << std::endl;
+	std::cout << std::setw(24) << "test every box" << std::setw(10) << bruteForce / frames << " ms" << std::setw(10) << bruteVisible << " visible" << std::setw(10) << count << " tested" << std::endl;
+	std::cout << std::setw(24) << "BVH query" << std::setw(10) << query / frames << " ms" << std::setw(10) << visible.size() << " visible" << std::setw(10) << tested << " tested" << std::endl;
+	std::cout << std::setw(24) << "refit 10%, nudged" << std::setw(10) << nudge / frames << " ms" << std::setw(10) << reinserted << " reinserted" << std::endl;
+	std::cout << std::setw(24) << "refit 10%, teleported" << std::setw(10) << teleport / frames << " ms" << std::endl;
+	// leaves are tested with their fat boxes, so the BVH may keep a few more than the exact test
+	return visible.size() >= bruteVisible ? 0 : 1;
+}
+
+// 64 to 4096 distinct small meshes, each drawn once per frame: one VAO, vertex and index buffer
+// per mesh against one GeometryArena drawn with glDrawElementsBaseVertex from a single VAO.
+// "submit" is the CPU time to issue the frame, "total" includes glFinish. Afterwards every other
+// mesh is removed and added again, which has to fit in the freed ranges without growing the arena.
+static int BenchmarkGeometry()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+
+	const char* vertexSource =
+		"#version 330 core\n"
+		"layout (location = 0) in vec3 aPos;\n"
+		"void main() { gl_Position = vec4(aPos, 1.0); }\n";
+	const char* fragmentSource =
+		"#version 330 core\n"
+		"out vec4 FragColor;\n"
+		"void main() { FragColor = vec4(1.0); }\n";
+	GLuint program = BuildBenchmarkProgram(vertexSource, fragmentSource);
+	if (program == 0) {
+		std::cout << "Failed to build the benchmark shaders" << std::endl;
+		return 1;
+	}
+	glUseProgram(program);
+
+	bench.CreateTarget(256, 256, 0);
+
+	std::cout << "distinct meshes, one VAO each against one geometry arena, 256x256 target" << std::endl;
+	std::cout << std::setw(8) << "meshes" << std::setw(12) << "GL objects" << std::setw(16) << "separate submit" << std::setw(15) << "separate total"
+		<< std::setw(14) << "arena submit" << std::setw(13) << "arena total" << std::setw(10) << "speedup" << std::endl;
+
+	bool reused = true;
+	for (int count = 64; count <= 4096; count *= 4) {
+		// boxes of slightly different sizes, so every mesh really is its own geometry
+		std::vector<std::vector<GLfloat>> vertices(count);
+		std::vector<GLuint> indices;
+		for (int i = 0; i < count; i++) {
+			BuildBenchmarkBox(glm::vec3(0.002f + 0.00001f * i), vertices[i], indices);
+		}
+
+		std::vector<GLuint> vaos(count), buffers(2 * count);
+		glGenVertexArrays(count, vaos.data());
+		glGenBuffers(2 * count, buffers.data());
+		for (int i = 0; i < count; i++) {
+			glBindVertexArray(vaos[i]);
+			glBindBuffer(GL_ARRAY_BUFFER, buffers[2 * i]);
+			glBufferData(GL_ARRAY_BUFFER, vertices[i].size() * sizeof(GLfloat), vertices[i].data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2 * i + 1]);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, GEOMETRY_VERTEX_FLOATS * sizeof(GLfloat), 0);
+			glEnableVertexAttribArray(0);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		GeometryArena arena;
+		arena.Create(VERTEX_FLOAT, 1024, 4096);
+		std::vector<MeshRange> ranges(count);
+		for (int i = 0; i < count; i++) {
+			ranges[i] = arena.Add(vertices[i].data(), 8, indices.data(), (GLsizei)indices.size());
+		}
+
+		int frames = std::max(10, 40000 / count);
+		double separateSubmit = 0, separateTotal = 0;
+		for (int frame = 0; frame <= frames; frame++) {
+			glClear(GL_COLOR_BUFFER_BIT);
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < count; i++) {
+				glBindVertexArray(vaos[i]);
+				glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+			}
+			double submit = MillisecondsSince(start);
+			glFinish();
+			// frame 0 warms up the driver
+			if (frame > 0) {
+				separateSubmit += submit;
+				separateTotal += MillisecondsSince(start);
+			}
+		}
+
+		double arenaSubmit = 0, arenaTotal = 0;
+		for (int frame = 0; frame <= frames; frame++) {
+			glClear(GL_COLOR_BUFFER_BIT);
+			Clock::time_point start = Clock::now();
+			glBindVertexArray(arena.Vao());
+			for (int i = 0; i < count; i++) {
+				glDrawElementsBaseVertex(GL_TRIANGLES, ranges[i].indexCount, GL_UNSIGNED_INT, (GLvoid*)(ranges[i].firstIndex * sizeof(GLuint)), (GLint)ranges[i].firstVertex);
+			}
+			double submit = MillisecondsSince(start);
+			glFinish();
+			if (frame > 0) {
+				arenaSubmit += submit;
+				arenaTotal += MillisecondsSince(start);
+			}
+		}
+		glBindVertexArray(0);
+
+		std::cout << std::setw(8) << count << std::setw(6) << 3 * count << " / 3" << std::fixed << std::setprecision(3)
+			<< std::setw(16) << separateSubmit / frames << std::setw(15) << separateTotal / frames
+			<< std::setw(14) << arenaSubmit / frames << std::setw(13) << arenaTotal / frames
+			<< std::setw(9) << std::setprecision(1) << separateTotal / arenaTotal << "x" << std::endl;
+
+		size_t vertexCapacity = arena.VertexCapacity(), indexCapacity = arena.IndexCapacity();
+		for (int i = 0; i < count; i += 2) {
+			arena.Remove(ranges[i]);
+		}
+		for (int i = 0; i < count; i += 2) {
+			ranges[i] = arena.Add(vertices[i].data(), 8, indices.data(), (GLsizei)indices.size());
+		}
+		reused = reused && arena.VertexCapacity() == vertexCapacity && arena.IndexCapacity() == indexCapacity;
+
+		arena.Delete();
+		glDeleteVertexArrays(count, vaos.data());
+		glDeleteBuffers(2 * count, buffers.data());
+	}
+	std::cout << "removed ranges " << (reused ? "reused" : "NOT REUSED, the arena grew") << std::endl;
+
+	glDeleteProgram(program);
+	bench.Destroy();
+	return reused ? 0 : 1;
+}
+
+// side x side vertex grid over [-1, 1]^2 facing +z, with its triangles and vertices shuffled the
+// way an exporter that does not care about order leaves them
+static void BuildShuffledGrid(int side, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+	vertices.resize((size_t)side * side * GEOMETRY_VERTEX_FLOATS);
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			GLfloat* vertex = &vertices[((size_t)y * side + x) * GEOMETRY_VERTEX_FLOATS];
+			float u = (float)x / (side - 1), v = (float)y / (side - 1);
+			const GLfloat values[GEOMETRY_VERTEX_FLOATS] = { u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.0f, u * 4.0f, v * 4.0f, 0.0f, 0.0f, 1.0f };
+			std::copy(values, values + GEOMETRY_VERTEX_FLOATS, vertex);
+		}
+	}
+	indices.clear();
+	for (int y = 0; y + 1 < side; y++) {
+		for (int x = 0; x + 1 < side; x++) {
+			GLuint corner = (GLuint)(y * side + x);
+			const GLuint quad[6] = { corner, corner + 1, corner + side + 1, corner, corner + side + 1, corner + side };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	unsigned int seed = 12345;
+	size_t triangles = indices.size() / 3;
+	for (size_t i = triangles - 1; i > 0; i--) {
+		seed = seed * 1664525u + 1013904223u;
+		size_t j = (seed >> 8) % (i + 1);
+		for (int corner = 0; corner < 3; corner++) {
+			std::swap(indices[i * 3 + corner], indices[j * 3 + corner]);
+		}
+	}
+	size_t count = (size_t)side * side;
+	std::vector<GLuint> order(count);
+	for (size_t i = 0; i < count; i++) {
+		order[i] = (GLuint)i;
+	}
+	for (size_t i = count - 1; i > 0; i--) {
+		seed = seed * 1664525u + 1013904223u;
+		std::swap(order[i], order[(seed >> 8) % (i + 1)]);
+	}
+	std::vector<GLfloat> shuffled(vertices.size());
+	std::vector<GLuint> moved(count);
+	for (size_t i = 0; i < count; i++) {
+		std::copy(&vertices[order[i] * GEOMETRY_VERTEX_FLOATS], &vertices[order[i] * GEOMETRY_VERTEX_FLOATS] + GEOMETRY_VERTEX_FLOATS, &shuffled[i * GEOMETRY_VERTEX_FLOATS]);
+		moved[order[i]] = (GLuint)i;
+	}
+	vertices.swap(shuffled);
+	for (GLuint& index : indices) {
+		index = moved[index];
+	}
+}
+
+// Large grids as an unordered exporter leaves them against the same grids after the vertex cache
+// and vertex fetch optimization, drawn in every vertex format. "ACMR" is the average cache miss
+// ratio with a 16 entry FIFO, "MB" the vertex data one draw reads. The target is 64x64, so the
+// times are dominated by vertex work rather than shading.
+static int BenchmarkVertices()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+
+	// every attribute feeds the output so none of the fetches can be skipped
+	const char* vertexSource =
+		"#version 330 core\n"
+		"layout (location = 0) in vec3 aPos;\n"
+		"layout (location = 1) in vec2 aTexCoords;\n"
+		"layout (location = 2) in vec3 aNormal;\n"
+		"out vec4 color;\n"
+		"void main() { color = vec4(aNormal * 0.5 + 0.5, fract(aTexCoords.x + aTexCoords.y)); gl_Position = vec4(aPos, 1.0); }\n";
+	const char* fragmentSource =
+		"#version 330 core\n"
+		"in vec4 color;\n"
+		"out vec4 FragColor;\n"
+		"void main() { FragColor = color; }\n";
+	GLuint program = BuildBenchmarkProgram(vertexSource, fragmentSource);
+	if (program == 0) {
+		std::cout << "Failed to build the benchmark shaders" << std::endl;
+		return 1;
+	}
+	glUseProgram(program);
+
+	bench.CreateTarget(64, 64, 0);
+
+	std::cout << "vertex formats and vertex cache order, 64x64 target" << std::endl;
+	std::cout << std::setw(10) << "vertices" << std::setw(11) << "order" << std::setw(8) << "ACMR" << std::setw(11) << "format"
+		<< std::setw(8) << "bytes" << std::setw(9) << "MB" << std::setw(11) << "ms/draw" << std::setw(12) << "Mverts/s" << std::endl;
+
+	const VertexFormat formats[] = { VERTEX_FLOAT, VERTEX_PACKED, VERTEX_QUANTIZED };
+	bool improved = true;
+	for (int side = 256; side <= 1024; side *= 4) {
+		std::vector<GLfloat> vertices;
+		std::vector<GLuint> indices;
+		BuildShuffledGrid(side, vertices, indices);
+		size_t vertexCount = (size_t)side * side;
+		float shuffledRatio = MeshOptimizer::AverageCacheMissRatio(indices.data(), indices.size(), vertexCount);
+
+		std::vector<GLfloat> optimizedVertices(vertices);
+		std::vector<GLuint> optimizedIndices(indices);
+		Clock::time_point start = Clock::now();
+		MeshOptimizer::OptimizeVertexCache(optimizedIndices.data(), optimizedIndices.size(), vertexCount);
+		MeshOptimizer::OptimizeVertexFetch(optimizedVertices.data(), vertexCount, optimizedIndices.data(), optimizedIndices.size());
+		double optimize = MillisecondsSince(start);
+		float optimizedRatio = MeshOptimizer::AverageCacheMissRatio(optimizedIndices.data(), optimizedIndices.size(), vertexCount);
+		improved = improved && optimizedRatio < shuffledRatio;
+
+		for (int optimized = 0; optimized < 2; optimized++) {
+			for (VertexFormat format : formats) {
+				GeometryArena arena;
+				arena.Create(format, vertexCount, indices.size());
+				MeshRange range = optimized ? arena.Add(optimizedVertices.data(), vertexCount, optimizedIndices.data(), (GLsizei)optimizedIndices.size())
+					: arena.Add(vertices.data(), vertexCount, indices.data(), (GLsizei)indices.size());
+				glBindVertexArray(arena.Vao());
+
+				const int frames = 10;
+				double total = 0;
+				for (int frame = 0; frame <= frames; frame++) {
+					glClear(GL_COLOR_BUFFER_BIT);
+					start = Clock::now();
+					glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (GLvoid*)(range.firstIndex * sizeof(GLuint)), (GLint)range.firstVertex);
+					glFinish();
+					// frame 0 warms up the driver
+					if (frame > 0) {
+						total += MillisecondsSince(start);
+					}
+				}
+				glBindVertexArray(0);
+				arena.Delete();
+
+				size_t stride = VertexLayout::Stride(format);
+				std::cout << std::setw(10) << vertexCount << std::setw(11) << (optimized ? "optimized" : "shuffled")
+					<< std::fixed << std::setprecision(3) << std::setw(8) << (optimized ? optimizedRatio : shuffledRatio)
+					<< std::setw(11) << VertexLayout::Name(format) << std::setw(8) << stride
+					<< std::setprecision(2) << std::setw(9) << vertexCount * stride / (1024.0 * 1024.0)
+					<< std::setprecision(3) << std::setw(11) << total / frames
+					<< std::setprecision(1) << std::setw(12) << vertexCount / (total / frames) / 1000.0 << std::endl;
+			}
+		}
+		std::cout << std::setw(10) << vertexCount << " optimized in " << std::fixed << std::setprecision(1) << optimize << " ms" << std::endl;
+	}
+
+	// worst position error of half floats over the demo's floor, the largest coordinates in it
+	float worst = 0.0f;
+	for (float x = -50.0f; x <= 50.0f; x += 0.37f) {
+		unsigned short half = VertexLayout::ToHalf(x);
+		// back to float: the sign, exponent and mantissa fields line up after rebiasing
+		unsigned int bits = ((half & 0x8000u) << 16) | ((((half >> 10) & 0x1Fu) + 112) << 23) | ((half & 0x3FFu) << 13);
+		float back;
+		memcpy(&back, &bits, sizeof(back));
+		if ((half & 0x7FFFu) != 0) {
+			worst = std::max(worst, std::fabs(back - x));
+		}
+	}
+	std::cout << "quantized position error over [-50, 50]: " << std::setprecision(4) << worst << std::endl;
+
+	glDeleteProgram(program);
+	bench.Destroy();
+	return improved ? 0 : 1;
+}
+
+// Forward against deferred shading of the same scene: 1 to 16 stacked floor layers seen from
+// above, drawn back to front so every layer is shaded in forward mode, under 16 to 1024 of the
+// demo's scattered point lights and a directional light. Forward is the demo's clustered path,
+// deferred the G-buffer plus one light volume per point light. 640x480, milliseconds per frame
+// including glFinish, averaged over a few frames after a warm up frame.
+static int BenchmarkDeferred()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+	const unsigned int width = 640, height = 480;
+	const int frames = 3;
+	const int depths[] = { 1, 4, 16 };
+	const int lightCounts[] = { 16, 128, 1024 };
+
+	// only the directional light and the point lights, in both paths
+	const std::string rig = "#define DIR_LIGHT 1\n#define POINT_LIGHT_COUNT 0\n#define SPOT_LIGHT 0\n";
+	Shader forward, gbuffer, passes[DEFERRED_PASS_COUNT];
+	forward.program = BuildBenchmarkProgramFromFiles("multipleLight.vert", "multipleLight.frag", "#define INSTANCED\n" + rig + ClusteredLights::Defines());
+	gbuffer.program = BuildBenchmarkProgramFromFiles("multipleLight.vert", "gbuffer.frag", "#define INSTANCED\n");
+	for (int pass = 0; pass < DEFERRED_PASS_COUNT; pass++) {
+		passes[pass].program = BuildBenchmarkProgramFromFiles("deferredLight.vert", "deferredLight.frag", DeferredRenderer::Defines((DeferredPass)pass) + rig);
+	}
+	if (forward.program == 0 || gbuffer.program == 0 || passes[DEFERRED_FULLSCREEN].program == 0 || passes[DEFERRED_POINT].program == 0 || passes[DEFERRED_SPOT].program == 0) {
+		std::cout << "Failed to build the shaders, run from the directory with the .vert and .frag files" << std::endl;
+		return 1;
+	}
+	forward.Reflect();
+	gbuffer.Reflect();
+	for (Shader& pass : passes) {
+		pass.Reflect();
+	}
+	forward.BindUniformBlock("Lights", LightSet::BINDING);
+
+	// plain white materials under a dim directional light
+	DirLight dirLight = {};
+	dirLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	dirLight.diffuse = glm::vec3(0.1f, 0.1f, 0.1f);
+	dirLight.specular = glm::vec3(0.1f, 0.1f, 0.1f);
+	bench.CreateTarget(width, height, GL_DEPTH24_STENCIL8);
+	bench.CreateMaterials(dirLight);
+	LightFeatures features;
+	features.pointLights = 0;
+	features.spotLight = false;
+
+	DeferredRenderer deferred;
+	deferred.Create(width, height);
+	deferred.SetShaders(passes[DEFERRED_FULLSCREEN], passes[DEFERRED_POINT], passes[DEFERRED_SPOT]);
+	ClusteredLights clusters;
+	clusters.Create();
+	ThreadPool pool;
+	GLState state;
+
+	const glm::vec3 eye(0.0f, 12.0f, 0.0f);
+	glm::mat4 projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	glm::mat4 viewProjection = projection * view;
+	clusters.SetProjection(projection);
+
+	const GLfloat plane[] = {
+		-1, 0, -1, 0, 0, 0, 1, 0,
+		1, 0, -1, 1, 0, 0, 1, 0,
+		1, 0, 1, 1, 1, 0, 1, 0,
+		-1, 0, 1, 0, 1, 0, 1, 0,
+	};
+	const GLuint planeIndices[] = { 0, 2, 1, 0, 3, 2 };
+
+	std::cout << "forward (clustered) against deferred shading, " << width << "x" << height << ", ms per frame" << std::endl;
+	std::cout << std::setw(8) << "layers" << std::setw(8) << "lights" << std::setw(12) << "forward" << std::setw(12) << "deferred" << std::setw(10) << "speedup" << std::endl;
+	for (int depth : depths) {
+		// a layer per material so each is its own batch, drawn farthest first
+		Scene scene;
+		unsigned int mesh = scene.AddMesh(plane, 4, planeIndices, 6);
+		for (int layer = 0; layer < depth; layer++) {
+			SceneMaterial material;
+			material.diffuse = material.specular = bench.white;
+			material.shininess = 32.0f;
+			scene.AddRenderable(scene.Create(), mesh, scene.AddMaterial(material), glm::vec3(0.0f, -0.05f * layer, 0.0f), glm::vec4(0, 0, 0, 1), glm::vec3(20, 1, 20));
+		}
+		scene.Update(&pool);
+		scene.Cull(Frustum(viewProjection), eye);
+		scene.Upload();
+		std::vector<SceneBatch> batches = scene.Batches();
+		std::sort(batches.begin(), batches.end(), [](const SceneBatch& a, const SceneBatch& b) { return a.distance > b.distance; });
+
+		auto drawScene = [&](const Shader& shader) {
+			state.UseProgram(shader.program);
+			shader.Set(shader.Get<glm::mat4>("viewProjection"), viewProjection);
+			shader.Set(shader.Get<int>("material.diffuse"), 0);
+			shader.Set(shader.Get<int>("material.specular"), 1);
+			shader.Set(shader.Get<float>("material.shininess"), 32.0f);
+			state.BindTexture(0, GL_TEXTURE_2D, bench.white);
+			state.BindTexture(1, GL_TEXTURE_2D, bench.white);
+			state.Enable(GL_DEPTH_TEST);
+			state.BindVertexArray(scene.Instances().Vao());
+			for (const SceneBatch& batch : batches) {
+				scene.Instances().DrawBound(scene.Mesh(batch.mesh).range, batch.first, batch.count);
+			}
+		};
+
+		for (int lightCount : lightCounts) {
+			std::vector<PointLight> pointLights = ClusteredLights::ScatterLights(lightCount, 20.0f);
+			clusters.SetLights(pointLights);
+			deferred.SetPointLights(pointLights);
+
+			double times[2] = { 0, 0 };
+			for (int frame = 0; frame <= frames; frame++) {
+				Clock::time_point start = Clock::now();
+				glBindFramebuffer(GL_FRAMEBUFFER, bench.framebuffer);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				clusters.Assign(view, pool);
+				clusters.Upload();
+				state.UseProgram(forward.program);
+				forward.Set(forward.Get<glm::vec3>("viewPos"), eye);
+				clusters.Bind(forward, state, width, height);
+				drawScene(forward);
+				glFinish();
+				if (frame > 0) {
+					times[0] += MillisecondsSince(start);
+				}
+
+				start = Clock::now();
+				glBindFramebuffer(GL_FRAMEBUFFER, bench.framebuffer);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				deferred.BeginGeometry();
+				drawScene(gbuffer);
+				deferred.Light(state, bench.framebuffer, viewProjection, eye, bench.lights.Block(), features);
+				glFinish();
+				if (frame > 0) {
+					times[1] += MillisecondsSince(start);
+				}
+			}
+			std::cout << std::fixed << std::setprecision(2) << std::setw(8) << depth << std::setw(8) << lightCount
+				<< std::setw(12) << times[0] / frames << std::setw(12) << times[1] / frames << std::setw(9) << times[0] / times[1] << "x" << std::endl;
+		}
+		scene.Delete();
+	}
+
+	clusters.Delete();
+	deferred.Delete();
+	for (Shader& pass : passes) {
+		pass.Delete();
+	}
+	forward.Delete();
+	gbuffer.Delete();
+	bench.Destroy();
+	return 0;
+}
+
+// The shadow pass of a warehouse of 32x32 crates under the demo's directional light and a
+// spotlight, every eighth crate spinning, for 30 frames of the Demo start camera. "redraw"
+// draws every map from all its casters every frame, the cached modes keep the static casters'
+// depth and redraw a layer only when its view or its casters changed. "passes" and "casters"
+// are layer draws and instances drawn per frame; ms per frame include glFinish.
+static int BenchmarkShadows()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+	Shader depth;
+	depth.program = BuildBenchmarkProgramFromFiles("multipleLight.vert", "shadowDepth.frag", "#define INSTANCED\n");
+	if (depth.program == 0) {
+		std::cout << "Failed to build the shaders, run from the directory with the .vert and .frag files" << std::endl;
+		return 1;
+	}
+	depth.Reflect();
+
+	const int side = 32, frames = 30;
+	const float aspect = 800.0f / 600.0f;
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	BuildBenchmarkBox(glm::vec3(0.5f, 1.25f, 0.05f), vertices, indices);
+	const GLfloat plane[] = {
+		-50, 0, -50, 0, 0, 0, 1, 0,
+		50, 0, -50, 1, 0, 0, 1, 0,
+		50, 0, 50, 1, 1, 0, 1, 0,
+		-50, 0, 50, 0, 1, 0, 1, 0,
+	};
+	const GLuint planeIndices[] = { 0, 2, 1, 0, 3, 2 };
+
+	LightBlock block = {};
+	block.dirLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	block.spotLight.position = glm::vec3(0, 3, 3);
+	block.spotLight.direction = glm::vec3(0, -1, -1);
+	block.spotLight.diffuse = glm::vec3(1.0f);
+	block.spotLight.constant = 1.0f;
+	block.spotLight.linear = 0.09f;
+	block.spotLight.quadratic = 0.032f;
+	block.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+	block.spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+	LightFeatures features;
+	GLState state;
+	const glm::vec3 up(0, 1, 0);
+
+	struct Mode
+	{
+		const char* name;
+		bool caching, spinning, moving;
+	};
+	const Mode modes[] = {
+		{ "redraw, spinning", false, true, false },
+		{ "cached, spinning", true, true, false },
+		{ "cached, still", true, false, false },
+		{ "cached, spinning, walking", true, true, true },
+	};
+
+	std::cout << "shadow pass, " << side * side << " crates, " << SHADOW_CASCADES << " cascades and a spotlight at " << SHADOW_MAP_SIZE << "x" << SHADOW_MAP_SIZE << std::endl;
+	std::cout << std::setw(28) << "mode" << std::setw(10) << "passes" << std::setw(10) << "casters" << std::setw(10) << "ms" << std::endl;
+	double redraw = 0;
+	for (const Mode& mode : modes) {
+		Scene scene;
+		unsigned int crate = scene.AddMesh(vertices.data(), 8, indices.data(), 36);
+		unsigned int floor = scene.AddMesh(plane, 4, planeIndices, 6);
+		scene.AddRenderable(scene.Create(), floor, scene.AddMaterial(SceneMaterial()), glm::vec3(0, -0.5f, 0), glm::vec4(0, 0, 0, 1), glm::vec3(1, 1, 1));
+		std::vector<Entity> spinners;
+		for (int i = 0; i < side * side; i++) {
+			Entity entity = scene.Create();
+			glm::vec3 position((i % side - side * 0.5f) * 2.0f, 0.75f, (i / side - side * 0.5f) * 2.0f);
+			scene.AddRenderable(entity, crate, 0, position, TransformSystem::AxisAngle(up, i * 0.37f), glm::vec3(1, 1, 1));
+			if (i % 8 == 0) {
+				scene.SetDynamic(entity, true);
+				spinners.push_back(entity);
+			}
+		}
+
+		ShadowMaps shadows;
+		shadows.Create();
+		shadows.SetShader(depth);
+		shadows.SetCaching(mode.caching);
+
+		double passes = 0, casters = 0, ms = 0;
+		for (int frame = 0; frame <= frames; frame++) {
+			if (mode.spinning) {
+				for (size_t i = 0; i < spinners.size(); i++) {
+					scene.SetRotation(spinners[i], TransformSystem::AxisAngle(up, frame * 0.05f + i * 0.37f));
+				}
+			}
+			// a slow walk forward, as the demo's camera at its default speed
+			glm::vec3 eye(0.0f, 1.0f, 8.0f - (mode.moving ? frame * 0.1f : 0.0f));
+			glm::mat4 projection = glm::perspective(45.0f, aspect, 0.1f, 100.0f);
+			glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0, 0, -8), up);
+
+			Clock::time_point start = Clock::now();
+			scene.Update();
+			scene.Cull(Frustum(projection * view), eye);
+			shadows.Prepare(scene, view, projection, block, features);
+			scene.Upload();
+			shadows.Render(state, scene);
+			glFinish();
+			// the first frame fills every cache in every mode
+			if (frame > 0) {
+				ms += MillisecondsSince(start);
+				passes += shadows.Passes();
+				casters += (double)shadows.Casters();
+			}
+		}
+		if (!mode.caching) {
+			redraw = ms;
+		}
+		std::cout << std::fixed << std::setprecision(2) << std::setw(28) << mode.name << std::setw(10) << passes / frames << std::setw(10) << casters / frames
+			<< std::setw(10) << ms / frames;
+		// a still scene costs next to nothing, a ratio against that says nothing
+		if (mode.caching && ms / frames >= 0.01) {
+			std::cout << std::setw(9) << redraw / ms << "x";
+		}
+		std::cout << std::endl;
+		shadows.Delete();
+		scene.Delete();
+		// the next scene's VAO may get the deleted one's name
+		state.Invalidate();
+	}
+
+	depth.Delete();
+	bench.Destroy();
+	return 0;
+}
+
+// The static rig baked into lightmaps against lighting it per fragment. First the bake of a
+// 16x16 warehouse of crates on a floor under the directional light and 4 to 64 of the demo's
+// scattered point lights, on one thread and on the pool. Then the floor alone filling a 640x480
+// target from above under the same rigs: the clustered forward variant loops over the lights
+// of every fragment, the lightmapped one makes the same two lookups for any number of lights.
+// Milliseconds per frame including glFinish, averaged over a few frames after a warm up frame.
+static int BenchmarkLightmap()
+{
+	const int lightCounts[] = { 4, 16, 64 };
+	DirLight dirLight = {};
+	dirLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	dirLight.diffuse = glm::vec3(0.1f, 0.1f, 0.1f);
+	dirLight.specular = glm::vec3(0.1f, 0.1f, 0.1f);
+	const GLfloat plane[] = {
+		-1, 0, -1, 0, 0, 0, 1, 0,
+		1, 0, -1, 1, 0, 0, 1, 0,
+		1, 0, 1, 1, 1, 0, 1, 0,
+		-1, 0, 1, 0, 1, 0, 1, 0,
+	};
+	const GLuint planeIndices[] = { 0, 2, 1, 0, 3, 2 };
+	const glm::mat4 floorModel = glm::scale(glm::mat4(1.0f), glm::vec3(20.0f, 1.0f, 20.0f));
+	ThreadPool pool;
+
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	BuildBenchmarkFacetedBox(glm::vec3(0.5f, 1.25f, 0.05f), vertices, indices);
+	const int side = 16;
+	std::cout << "lightmap bake, " << side * side << " crates on a floor, ms" << std::endl;
+	std::cout << std::setw(8) << "lights" << std::setw(10) << "texels" << std::setw(12) << "1 thread" << std::setw(12) << "pool" << std::setw(10) << "speedup" << std::endl;
+	for (int lightCount : lightCounts) {
+		double times[2] = { 0, 0 };
+		size_t texels = 0;
+		for (int run = 0; run < 2; run++) {
+			LightmapBaker baker;
+			baker.SetLights(dirLight, ClusteredLights::ScatterLights(lightCount, 16.0f));
+			unsigned int crate = baker.AddMesh(vertices.data(), vertices.size() / GEOMETRY_VERTEX_FLOATS, indices.data(), indices.size());
+			unsigned int floor = baker.AddMesh(plane, 4, planeIndices, 6);
+			baker.AddInstance(floor, floorModel);
+			for (int i = 0; i < side * side; i++) {
+				glm::vec3 position((i % side - side * 0.5f) * 2.0f, 1.25f, (i / side - side * 0.5f) * 2.0f);
+				baker.AddInstance(crate, glm::rotate(glm::translate(glm::mat4(1.0f), position), i * 0.37f, glm::vec3(0, 1, 0)));
+			}
+			Clock::time_point start = Clock::now();
+			baker.Bake(run == 0 ? NULL : &pool);
+			times[run] = MillisecondsSince(start);
+			texels = baker.LitTexels();
+		}
+		std::cout << std::fixed << std::setprecision(2) << std::setw(8) << lightCount + 1 << std::setw(10) << texels
+			<< std::setw(12) << times[0] << std::setw(12) << times[1] << std::setw(9) << times[0] / times[1] << "x" << std::endl;
+	}
+
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+	const unsigned int width = 640, height = 480;
+	const int frames = 10;
+	Shader forward, lightmapped;
+	forward.program = BuildBenchmarkProgramFromFiles("multipleLight.vert", "multipleLight.frag", "#define INSTANCED\n#define DIR_LIGHT 1\n#define POINT_LIGHT_COUNT 0\n#define SPOT_LIGHT 0\n" + ClusteredLights::Defines());
+	lightmapped.program = BuildBenchmarkProgramFromFiles("multipleLight.vert", "multipleLight.frag", "#define INSTANCED\n#define LIGHTMAP\n#define DIR_LIGHT 0\n#define POINT_LIGHT_COUNT 0\n#define SPOT_LIGHT 0\n");
+	if (forward.program == 0 || lightmapped.program == 0) {
+		std::cout << "Failed to build the shaders, run from the directory with the .vert and .frag files" << std::endl;
+		return 1;
+	}
+	forward.Reflect();
+	lightmapped.Reflect();
+	forward.BindUniformBlock("Lights", LightSet::BINDING);
+	lightmapped.BindUniformBlock("Lights", LightSet::BINDING);
+
+	bench.CreateTarget(width, height, GL_DEPTH_COMPONENT24);
+	bench.CreateMaterials(dirLight);
+	ClusteredLights clusters;
+	clusters.Create();
+	GLState state;
+
+	const glm::vec3 eye(0.0f, 12.0f, 0.0f);
+	glm::mat4 projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	glm::mat4 viewProjection = projection * view;
+	clusters.SetProjection(projection);
+
+	std::cout << "floor at " << width << "x" << height << ", ms per frame" << std::endl;
+	std::cout << std::setw(8) << "lights" << std::setw(14) << "per fragment" << std::setw(14) << "lightmapped" << std::setw(10) << "speedup" << std::endl;
+	for (int lightCount : lightCounts) {
+		std::vector<PointLight> pointLights = ClusteredLights::ScatterLights(lightCount, 20.0f);
+		clusters.SetLights(pointLights);
+
+		Scene scene;
+		scene.SetKeepMeshData(true);
+		unsigned int mesh = scene.AddMesh(plane, 4, planeIndices, 6);
+		SceneMaterial material;
+		material.diffuse = material.specular = bench.white;
+		material.shininess = 32.0f;
+		Entity floor = scene.Create();
+		scene.AddRenderable(floor, mesh, scene.AddMaterial(material), glm::vec3(0.0f), glm::vec4(0, 0, 0, 1), glm::vec3(20, 1, 20));
+		scene.Update(&pool);
+
+		LightmapBaker baker;
+		baker.SetLights(dirLight, pointLights);
+		const SceneMesh& source = scene.Mesh(mesh);
+		baker.AddInstance(baker.AddMesh(source.vertices.data(), 4, source.indices.data(), source.indices.size()), floorModel);
+		baker.Bake(&pool);
+		GLuint lightmap = baker.CreateTexture();
+		scene.SetLightmapCoords(mesh, baker.MeshCoords(0).data());
+		scene.SetLightmapTile(floor, baker.InstanceTile(0));
+		scene.Cull(Frustum(viewProjection), eye);
+		scene.Upload();
+		state.UseProgram(lightmapped.program);
+		lightmapped.Set(lightmapped.Get<int>("lightmap"), 2);
+		state.BindTexture(2, GL_TEXTURE_2D_ARRAY, lightmap);
+
+		auto drawScene = [&](const Shader& shader) {
+			state.UseProgram(shader.program);
+			shader.Set(shader.Get<glm::mat4>("viewProjection"), viewProjection);
+			shader.Set(shader.Get<glm::vec3>("viewPos"), eye);
+			shader.Set(shader.Get<int>("material.diffuse"), 0);
+			shader.Set(shader.Get<int>("material.specular"), 1);
+			shader.Set(shader.Get<float>("material.shininess"), 32.0f);
+			state.BindTexture(0, GL_TEXTURE_2D, bench.white);
+			state.BindTexture(1, GL_TEXTURE_2D, bench.white);
+			state.Enable(GL_DEPTH_TEST);
+			state.BindVertexArray(scene.Instances().Vao());
+			for (const SceneBatch& batch : scene.Batches()) {
+				scene.Instances().DrawBound(scene.Mesh(batch.mesh).range, batch.first, batch.count);
+			}
+		};
+
+		double times[2] = { 0, 0 };
+		for (int frame = 0; frame <= frames; frame++) {
+			Clock::time_point start = Clock::now();
+			glBindFramebuffer(GL_FRAMEBUFFER, bench.framebuffer);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			clusters.Assign(view, pool);
+			clusters.Upload();
+			state.UseProgram(forward.program);
+			clusters.Bind(forward, state, width, height);
+			drawScene(forward);
+			glFinish();
+			if (frame > 0) {
+				times[0] += MillisecondsSince(start);
+			}
+
+			start = Clock::now();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			drawScene(lightmapped);
+			glFinish();
+			if (frame > 0) {
+				times[1] += MillisecondsSince(start);
+			}
+		}
+		std::cout << std::fixed << std::setprecision(2) << std::setw(8) << lightCount + 1 << std::setw(14) << times[0] / frames
+			<< std::setw(14) << times[1] / frames << std::setw(9) << times[0] / times[1] << "x" << std::endl;
+		glDeleteTextures(1, &lightmap);
+		scene.Delete();
+		// the next scene's VAO may get the deleted one's name
+		state.Invalidate();
+	}
+
+	clusters.Delete();
+	forward.Delete();
+	lightmapped.Delete();
+	bench.Destroy();
+	return 0;
+}
+
+// The software renderer on a warehouse of 16x16 crates on a floor at 800x600, seen at an angle
+// from above, under the demo's block rig (directional light, 4 point lights and the flashlight)
+// and under 64 and 256 scattered point lights culled per tile. Milliseconds per frame of the
+// scalar shading on one thread, the SIMD shading on one thread and on the pool, averaged over a
+// few frames after a warm up frame. "max diff" is the largest channel difference between the
+// SIMD and the scalar image, "threads" whether the pool's image is the serial one bit for bit.
+static int BenchmarkSoftware()
+{
+	const unsigned int width = 800, height = 600;
+	const int frames = 5;
+	const int lightCounts[] = { 0, 64, 256 };
+	ThreadPool pool;
+
+	std::vector<GLfloat> crate;
+	std::vector<GLuint> crateIndices;
+	BuildBenchmarkFacetedBox(glm::vec3(0.5f, 1.25f, 0.5f), crate, crateIndices);
+	const GLfloat plane[] = {
+		-1, 0, -1, 0, 0, 0, 1, 0,
+		1, 0, -1, 20, 0, 0, 1, 0,
+		1, 0, 1, 20, 20, 0, 1, 0,
+		-1, 0, 1, 0, 20, 0, 1, 0,
+	};
+	const GLuint planeIndices[] = { 0, 2, 1, 0, 3, 2 };
+	const int side = 16;
+	TransformSystem transforms;
+	for (int i = 0; i < side * side; i++) {
+		glm::vec3 position((i % side - side * 0.5f) * 2.0f, 0.75f, (i / side - side * 0.5f) * 2.0f);
+		transforms.Add(position, TransformSystem::AxisAngle(glm::vec3(0, 1, 0), i * 0.37f), glm::vec3(1.0f));
+	}
+	transforms.Add(glm::vec3(0.0f, -0.5f, 0.0f), glm::vec4(0, 0, 0, 1), glm::vec3(20.0f, 1.0f, 20.0f));
+	transforms.Update(&pool);
+
+	// a checker board for every map, the floor's mipmapped
+	std::vector<unsigned char> checker(256 * 256 * 4);
+	for (int y = 0; y < 256; y++) {
+		for (int x = 0; x < 256; x++) {
+			unsigned char value = ((x / 32 + y / 32) % 2) ? 230 : 60;
+			unsigned char* texel = &checker[(y * 256 + x) * 4];
+			texel[0] = value;
+			texel[1] = (unsigned char)(value * 3 / 4);
+			texel[2] = (unsigned char)(value / 2);
+			texel[3] = 255;
+		}
+	}
+	SoftwareRenderer renderer;
+	renderer.Create(width, height);
+	renderer.SetTexture(1, 256, 256, checker.data(), false);
+	renderer.SetTexture(2, 256, 256, checker.data(), true);
+
+	std::vector<SoftwareDraw> draws(2);
+	draws[0].vertices = crate.data();
+	draws[0].vertexCount = crate.size() / GEOMETRY_VERTEX_FLOATS;
+	draws[0].indices = crateIndices.data();
+	draws[0].indexCount = crateIndices.size();
+	draws[0].instances = transforms.Instances();
+	draws[0].instanceCount = side * side;
+	draws[0].material.diffuse = draws[0].material.specular = 1;
+	draws[0].material.shininess = 32.0f;
+	draws[1].vertices = plane;
+	draws[1].vertexCount = 4;
+	draws[1].indices = planeIndices;
+	draws[1].indexCount = 6;
+	draws[1].instances = transforms.Instances() + side * side;
+	draws[1].instanceCount = 1;
+	draws[1].material.diffuse = draws[1].material.specular = 2;
+	draws[1].material.shininess = 32.0f;
+
+	const glm::vec3 eye(0.0f, 10.0f, 24.0f);
+	glm::mat4 projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// the demo's rig, its point lights spread over the warehouse
+	LightBlock block = {};
+	block.dirLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	block.dirLight.diffuse = glm::vec3(0.1f, 0.1f, 0.1f);
+	block.dirLight.specular = glm::vec3(0.1f, 0.1f, 0.1f);
+	std::vector<PointLight> scattered = ClusteredLights::ScatterLights(NR_POINT_LIGHTS, 16.0f);
+	for (int i = 0; i < NR_POINT_LIGHTS; i++) {
+		block.pointLights[i] = scattered[i];
+	}
+	block.spotLight.position = glm::vec3(0.0f, 3.0f, 3.0f);
+	block.spotLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	block.spotLight.ambient = block.spotLight.diffuse = block.spotLight.specular = glm::vec3(1.0f);
+	block.spotLight.constant = 1.0f;
+	block.spotLight.linear = 0.09f;
+	block.spotLight.quadratic = 0.032f;
+	block.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+	block.spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+
+	std::cout << "software renderer, " << side * side << " crates on a floor at " << width << "x" << height << ", "
+		<< (SoftwareRenderer::SimdSupported() ? "SIMD" : "no SIMD") << ", " << pool.Size() << " threads, ms per frame" << std::endl;
+	std::cout << std::setw(8) << "lights" << std::setw(12) << "fragments" << std::setw(10) << "scalar" << std::setw(10) << "SIMD"
+		<< std::setw(10) << "pool" << std::setw(10) << "speedup" << std::setw(10) << "max diff" << std::setw(9) << "threads" << std::endl;
+	for (int lightCount : lightCounts) {
+		LightFeatures features;
+		if (lightCount > 0) {
+			features.pointLights = 0;
+			renderer.SetPointLights(ClusteredLights::ScatterLights(lightCount, 16.0f));
+		}
+		else {
+			renderer.SetPointLights(std::vector<PointLight>());
+		}
+		renderer.SetLights(block, features);
+
+		// scalar and SIMD on one thread, then SIMD on the pool
+		double times[3] = { 0, 0, 0 };
+		std::vector<unsigned char> images[3];
+		for (int mode = 0; mode < 3; mode++) {
+			renderer.SetSimd(mode > 0);
+			for (int frame = 0; frame <= frames; frame++) {
+				Clock::time_point start = Clock::now();
+				renderer.Render(draws, view, projection, eye, mode == 2 ? &pool : NULL);
+				if (frame > 0) {
+					times[mode] += MillisecondsSince(start);
+				}
+			}
+			images[mode] = renderer.Pixels();
+		}
+		int maxDiff = 0;
+		for (size_t i = 0; i < images[0].size(); i++) {
+			maxDiff = std::max(maxDiff, std::abs((int)images[0][i] - (int)images[1][i]));
+		}
+		std::cout << std::fixed << std::setprecision(2) << std::setw(8) << (lightCount > 0 ? lightCount : NR_POINT_LIGHTS) + 2
+			<< std::setw(12) << renderer.Fragments() << std::setw(10) << times[0] / frames << std::setw(10) << times[1] / frames
+			<< std::setw(10) << times[2] / frames << std::setw(9) << times[0] / times[2] << "x" << std::setw(10) << maxDiff
+			<< std::setw(9) << (images[1] == images[2] ? "same" : "DIFFER") << std::endl;
+	}
+	renderer.Delete();
+	return 0;
+}
+
+// Occlusion culling of 24x24 panels of 1k triangles each standing behind a wall, seen from a
+// camera strafing along the wall so panels keep coming out from behind it and going back, 640x480
+// with the forward variant under the demo's directional light. "drawn" is triangles drawn per
+// frame, "occluded" renderables hidden per frame; ms per frame include the box queries and
+// glFinish, over 60 frames after a warm up frame.
+static int BenchmarkOcclusion()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+	Shader forward, box;
+	forward.program = BuildBenchmarkProgramFromFiles("multipleLight.vert", "multipleLight.frag", "#define INSTANCED\n#define DIR_LIGHT 1\n#define POINT_LIGHT_COUNT 0\n#define SPOT_LIGHT 0\n");
+	box.program = BuildBenchmarkProgramFromFiles("occlusionBox.vert", "shadowDepth.frag", "");
+	if (forward.program == 0 || box.program == 0) {
+		std::cout << "Failed to build the shaders, run from the directory with the .vert and .frag files" << std::endl;
+		return 1;
+	}
+	forward.Reflect();
+	box.Reflect();
+	forward.BindUniformBlock("Lights", LightSet::BINDING);
+
+	const unsigned int width = 640, height = 480;
+	const int side = 24, frames = 60;
+	DirLight dirLight = {};
+	dirLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	dirLight.ambient = glm::vec3(0.2f);
+	dirLight.diffuse = glm::vec3(0.8f);
+	bench.CreateTarget(width, height, GL_DEPTH_COMPONENT24);
+	bench.CreateMaterials(dirLight);
+	GLState state;
+
+	std::vector<GLfloat> panel, wall;
+	std::vector<GLuint> panelIndices, wallIndices;
+	BuildShuffledGrid(24, panel, panelIndices);
+	BuildBenchmarkFacetedBox(glm::vec3(6.0f, 4.0f, 0.25f), wall, wallIndices);
+	const glm::vec3 up(0, 1, 0);
+	glm::mat4 projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+
+	std::cout << "occlusion culling, " << side * side << " panels of " << panelIndices.size() / 3 << " triangles behind a wall, "
+		<< width << "x" << height << std::endl;
+	std::cout << std::setw(12) << "occlusion" << std::setw(12) << "drawn" << std::setw(10) << "occluded" << std::setw(10) << "queries" << std::setw(10) << "ms" << std::endl;
+	double off = 0;
+	for (int mode = 0; mode < 2; mode++) {
+		bool culling = mode == 1;
+		Scene scene;
+		unsigned int panelMesh = scene.AddMesh(panel.data(), panel.size() / GEOMETRY_VERTEX_FLOATS, panelIndices.data(), (GLsizei)panelIndices.size());
+		unsigned int wallMesh = scene.AddMesh(wall.data(), wall.size() / GEOMETRY_VERTEX_FLOATS, wallIndices.data(), (GLsizei)wallIndices.size());
+		SceneMaterial material;
+		material.diffuse = material.specular = bench.white;
+		material.shininess = 32.0f;
+		unsigned int materialId = scene.AddMaterial(material);
+		scene.AddRenderable(scene.Create(), wallMesh, materialId, glm::vec3(0.0f, 4.0f, 0.0f), glm::vec4(0, 0, 0, 1), glm::vec3(1.0f));
+		for (int i = 0; i < side * side; i++) {
+			glm::vec3 position((i % side - side * 0.5f) * 2.5f, 1.0f, -2.0f - (i / side) * 2.5f);
+			scene.AddRenderable(scene.Create(), panelMesh, materialId, position, glm::vec4(0, 0, 0, 1), glm::vec3(1.0f));
+		}
+
+		OcclusionCuller occlusion;
+		if (culling) {
+			occlusion.Create();
+			occlusion.SetShader(box);
+		}
+
+		double ms = 0, drawn = 0, occluded = 0, queries = 0;
+		for (int frame = 0; frame <= frames; frame++) {
+			// strafing from one end of the wall to the other, 10 units in front of it
+			glm::vec3 eye(-8.0f + frame * 16.0f / frames, 3.0f, 10.0f);
+			glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0, -0.1f, -1), up);
+			glm::mat4 viewProjection = projection * view;
+
+			Clock::time_point start = Clock::now();
+			if (culling) {
+				occlusion.Resolve(scene);
+			}
+			scene.Update();
+			scene.Cull(Frustum(viewProjection), eye);
+			scene.Upload();
+			glBindFramebuffer(GL_FRAMEBUFFER, bench.framebuffer);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			state.UseProgram(forward.program);
+			forward.Set(forward.Get<glm::mat4>("viewProjection"), viewProjection);
+			forward.Set(forward.Get<glm::vec3>("viewPos"), eye);
+			forward.Set(forward.Get<int>("material.diffuse"), 0);
+			forward.Set(forward.Get<int>("material.specular"), 1);
+			forward.Set(forward.Get<float>("material.shininess"), 32.0f);
+			state.BindTexture(0, GL_TEXTURE_2D, bench.white);
+			state.BindTexture(1, GL_TEXTURE_2D, bench.white);
+			state.Enable(GL_DEPTH_TEST);
+			state.BindVertexArray(scene.Instances().Vao());
+			size_t triangles = 0;
+			// the wall first, like the demo's front to back order would
+			std::vector<SceneBatch> batches = scene.Batches();
+			std::sort(batches.begin(), batches.end(), [](const SceneBatch& a, const SceneBatch& b) { return a.distance < b.distance; });
+			for (const SceneBatch& batch : batches) {
+				scene.Instances().DrawBound(scene.Mesh(batch.mesh).range, batch.first, batch.count);
+				triangles += batch.count * scene.Mesh(batch.mesh).range.indexCount / 3;
+			}
+			if (culling) {
+				occlusion.Issue(state, scene, viewProjection, eye);
+			}
+			glFinish();
+			if (frame > 0) {
+				ms += MillisecondsSince(start);
+				drawn += (double)triangles;
+				occluded += (double)occlusion.Hidden();
+				queries += (double)occlusion.Queries();
+			}
+		}
+		if (!culling) {
+			off = ms;
+		}
+		std::cout << std::fixed << std::setprecision(2) << std::setw(12) << (culling ? "on" : "off") << std::setw(12) << std::setprecision(0) << drawn / frames
+			<< std::setw(10) << std::setprecision(1) << occluded / frames << std::setw(10) << queries / frames << std::setw(10) << std::setprecision(2) << ms / frames;
+		if (culling) {
+			std::cout << std::setw(9) << off / ms << "x";
+		}
+		std::cout << std::endl;
+		if (culling) {
+			occlusion.Delete();
+		}
+		scene.Delete();
+		// the next scene's VAO may get the deleted one's name
+		state.Invalidate();
+	}
+
+	forward.Delete();
+	box.Delete();
+	bench.Destroy();
+	return 0;
+}
+
+// rings x segments vertex sphere of radius about 1 with a few bumps on it, so no two of its
+// triangles lie in one plane; the seam meridian and the poles repeat their positions
+static void BuildBenchmarkRock(int rings, int segments, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+	vertices.clear();
+	indices.clear();
+	const float pi = 3.14159265f;
+	for (int ring = 0; ring <= rings; ring++) {
+		for (int segment = 0; segment <= segments; segment++) {
+			float u = (float)segment / segments, v = (float)ring / rings;
+			float theta = v * pi, phi = u * 2.0f * pi;
+			glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			float radius = 1.0f + 0.08f * std::sin(5.0f * theta) * std::sin(4.0f * phi) + 0.04f * std::sin(11.0f * theta + 3.0f * phi);
+			glm::vec3 position = normal * radius;
+			const GLfloat values[GEOMETRY_VERTEX_FLOATS] = { position.x, position.y, position.z, u, v, normal.x, normal.y, normal.z };
+			vertices.insert(vertices.end(), values, values + GEOMETRY_VERTEX_FLOATS);
+		}
+	}
+	for (int ring = 0; ring < rings; ring++) {
+		for (int segment = 0; segment < segments; segment++) {
+			GLuint corner = (GLuint)(ring * (segments + 1) + segment);
+			GLuint below = corner + segments + 1;
+			const GLuint quad[6] = { corner, corner + 1, below + 1, corner, below + 1, below };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Levels of detail on a field of 24x24 rocks of 18k triangles each, 640x480 with the forward
+// variant, seen from a camera walking into the field. First the chain MeshOptimizer::BuildLods
+// makes of the rock, then triangles drawn and milliseconds per frame, including glFinish, with
+// full meshes and with the levels picked for 1 and 4 pixels of error, over 20 frames after a
+// warm up frame.
+static int BenchmarkLod()
+{
+	std::vector<GLfloat> rock;
+	std::vector<GLuint> rockIndices;
+	BuildBenchmarkRock(96, 96, rock, rockIndices);
+	std::vector<MeshLodLevel> levels;
+	Clock::time_point built = Clock::now();
+	MeshOptimizer::BuildLods(rock.data(), rock.size() / GEOMETRY_VERTEX_FLOATS, rockIndices.data(), rockIndices.size(), levels);
+	double buildMs = MillisecondsSince(built);
+	std::cout << "level of detail chain of a rock, built in " << std::fixed << std::setprecision(2) << buildMs << " ms" << std::endl;
+	std::cout << std::setw(8) << "level" << std::setw(12) << "triangles" << std::setw(12) << "error" << std::endl;
+	std::cout << std::setw(8) << 0 << std::setw(12) << rockIndices.size() / 3 << std::setw(12) << std::setprecision(5) << 0.0f << std::endl;
+	for (size_t i = 0; i < levels.size(); i++) {
+		std::cout << std::setw(8) << i + 1 << std::setw(12) << levels[i].indices.size() / 3 << std::setw(12) << levels[i].error << std::endl;
+	}
+
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+	Shader forward;
+	forward.program = BuildBenchmarkProgramFromFiles("multipleLight.vert", "multipleLight.frag", "#define INSTANCED\n#define DIR_LIGHT 1\n#define POINT_LIGHT_COUNT 0\n#define SPOT_LIGHT 0\n");
+	if (forward.program == 0) {
+		std::cout << "Failed to build the shaders, run from the directory with the .vert and .frag files" << std::endl;
+		return 1;
+	}
+	forward.Reflect();
+	forward.BindUniformBlock("Lights", LightSet::BINDING);
+
+	const unsigned int width = 640, height = 480;
+	const int side = 24, frames = 20;
+	DirLight dirLight = {};
+	dirLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	dirLight.ambient = glm::vec3(0.2f);
+	dirLight.diffuse = glm::vec3(0.8f);
+	bench.CreateTarget(width, height, GL_DEPTH_COMPONENT24);
+	bench.CreateMaterials(dirLight);
+	GLState state;
+
+	const glm::vec3 up(0, 1, 0);
+	glm::mat4 projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+	const float pixelSettings[] = { 0.0f, 1.0f, 4.0f };
+
+	std::cout << side * side << " rocks at " << width << "x" << height << std::endl;
+	std::cout << std::setw(10) << "pixels" << std::setw(12) << "triangles" << std::setw(10) << "ms" << std::endl;
+	double full = 0;
+	for (float pixels : pixelSettings) {
+		Scene scene;
+		unsigned int mesh = scene.AddMesh(rock.data(), rock.size() / GEOMETRY_VERTEX_FLOATS, rockIndices.data(), (GLsizei)rockIndices.size());
+		SceneMaterial material;
+		material.diffuse = material.specular = bench.white;
+		material.shininess = 32.0f;
+		unsigned int materialId = scene.AddMaterial(material);
+		for (int i = 0; i < side * side; i++) {
+			glm::vec3 position((i % side - side * 0.5f) * 3.0f, 1.0f, -(i / side) * 3.0f);
+			scene.AddRenderable(scene.Create(), mesh, materialId, position, TransformSystem::AxisAngle(up, i * 0.37f), glm::vec3(1.0f));
+		}
+		scene.SetLodProjection(projection, (float)height, pixels);
+
+		double ms = 0, triangles = 0;
+		for (int frame = 0; frame <= frames; frame++) {
+			// walking into the field from its front edge, looking slightly down
+			glm::vec3 eye(0.0f, 3.0f, 8.0f - frame * 0.5f);
+			glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0, -0.2f, -1), up);
+			glm::mat4 viewProjection = projection * view;
+
+			Clock::time_point start = Clock::now();
+			scene.Update();
+			scene.Cull(Frustum(viewProjection), eye);
+			scene.Upload();
+			glBindFramebuffer(GL_FRAMEBUFFER, bench.framebuffer);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			state.UseProgram(forward.program);
+			forward.Set(forward.Get<glm::mat4>("viewProjection"), viewProjection);
+			forward.Set(forward.Get<glm::vec3>("viewPos"), eye);
+			forward.Set(forward.Get<int>("material.diffuse"), 0);
+			forward.Set(forward.Get<int>("material.specular"), 1);
+			forward.Set(forward.Get<float>("material.shininess"), 32.0f);
+			state.BindTexture(0, GL_TEXTURE_2D, bench.white);
+			state.BindTexture(1, GL_TEXTURE_2D, bench.white);
+			state.Enable(GL_DEPTH_TEST);
+			state.BindVertexArray(scene.Instances().Vao());
+			for (const SceneBatch& batch : scene.Batches()) {
+				scene.Instances().DrawBound(scene.LodRange(batch.mesh, batch.lod), batch.first, batch.count);
+			}
+			glFinish();
+			if (frame > 0) {
+				ms += MillisecondsSince(start);
+				triangles += (double)scene.BatchTriangles();
+			}
+		}
+		if (pixels == 0.0f) {
+			full = ms;
+		}
+		std::cout << std::fixed << std::setprecision(0) << std::setw(10) << (pixels == 0.0f ? "full" : std::to_string((int)pixels)) << std::setw(12) << triangles / frames
+			<< std::setw(10) << std::setprecision(2) << ms / frames;
+		if (pixels > 0.0f) {
+			std::cout << std::setw(9) << full / ms << "x";
+		}
+		std::cout << std::endl;
+		scene.Delete();
+		// the next scene's VAO may get the deleted one's name
+		state.Invalidate();
+	}
+
+	forward.Delete();
+	bench.Destroy();
+	return 0;
+}
+
+// resident set size of the process, the current one or the peak since start or the last reset
+static size_t ResidentBytes(bool peak)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return peak ? counters.PeakWorkingSetSize : counters.WorkingSetSize;
+#else
+	std::ifstream status("/proc/self/status");
+	std::string line, key = peak ? "VmHWM:" : "VmRSS:";
+	while (std::getline(status, line)) {
+		if (line.compare(0, key.size(), key) == 0) {
+			return (size_t)atol(line.c_str() + key.size()) * 1024;
+		}
+	}
+	return 0;
+#endif
+}
+
+// restarts the peak from the current size; only Linux can, elsewhere the peak keeps counting
+static bool ResetPeakResident()
+{
+#ifdef _WIN32
+	return false;
+#else
+	std::ofstream clear("/proc/self/clear_refs");
+	clear << "5";
+	clear.close();
+	return (bool)clear;
+#endif
+}
+
+// Loading a 512x512 vertex grid with tex coords and normals: the OBJ text parsed, optimized,
+// simplified into its levels of detail, packed and uploaded, against the package the same
+// import baked, mapped and uploaded straight from the mapping. "resident" is the growth of the
+// resident set with the loaded data still held, "peak" the growth of the peak during the load.
+// The files live next to the binary for the run and are removed afterwards.
+static int BenchmarkPackage()
+{
+	BenchContext bench;
+	if (!bench.Create()) {
+		return 1;
+	}
+	const char* objPath = "package_benchmark.obj";
+	std::string packagePath = ScenePackage::PackagePath(objPath);
+	const int side = 512;
+	{
+		std::ofstream obj(objPath);
+		obj << std::fixed << std::setprecision(6);
+		for (int y = 0; y < side; y++) {
+			for (int x = 0; x < side; x++) {
+				obj << "v " << x * 0.1f << " 0 " << y * 0.1f << "\n";
+			}
+		}
+		for (int y = 0; y < side; y++) {
+			for (int x = 0; x < side; x++) {
+				obj << "vt " << (float)x / (side - 1) << " " << (float)y / (side - 1) << "\n";
+			}
+		}
+		obj << "vn 0 1 0\n";
+		for (int y = 0; y + 1 < side; y++) {
+			for (int x = 0; x + 1 < side; x++) {
+				int corner = y * side + x + 1;
+				obj << "f " << corner << "/" << corner << "/1 " << corner + side << "/" << corner + side << "/1 " << corner + 1 << "/" << corner + 1 << "/1\n";
+				obj << "f " << corner + 1 << "/" << corner + 1 << "/1 " << corner + side << "/" << corner + side << "/1 " << corner + side + 1 << "/" << corner + side + 1 << "/1\n";
+			}
+		}
+	}
+
+	bool peaks = ResetPeakResident();
+	size_t resident = ResidentBytes(false), peak = ResidentBytes(true);
+	Clock::time_point start = Clock::now();
+	PackageContent content;
+	bool imported = ObjImporter::Import(objPath, content);
+	double parse = MillisecondsSince(start);
+	GeometryArena textArena;
+	textArena.Create(VERTEX_PACKED, content.vertices.size() / GEOMETRY_VERTEX_FLOATS, content.indices.size());
+	textArena.Add(content.vertices.data(), content.vertices.size() / GEOMETRY_VERTEX_FLOATS, content.indices.data(), (GLsizei)content.indices.size());
+	glFinish();
+	double textLoad = MillisecondsSince(start);
+	double textResident = ((double)ResidentBytes(false) - resident) / (1024 * 1024);
+	double textPeak = ((double)ResidentBytes(true) - peak) / (1024 * 1024);
+	textArena.Delete();
+
+	bool written = imported && ScenePackage::Write(packagePath, content, VERTEX_PACKED);
+	size_t vertexCount = content.vertices.size() / GEOMETRY_VERTEX_FLOATS;
+	content = PackageContent();
+
+	peaks = ResetPeakResident() && peaks;
+	resident = ResidentBytes(false);
+	peak = ResidentBytes(true);
+	start = Clock::now();
+	ScenePackage package;
+	bool opened = written && package.Open(packagePath);
+	GeometryArena packageArena;
+	if (opened) {
+		packageArena.Create(package.Format(), package.VertexCount(), package.IndexCount());
+		packageArena.AddPacked(package.VertexData(), package.VertexCount(), package.IndexData(), (GLsizei)package.IndexCount());
+		glFinish();
+	}
+	double packageLoad = MillisecondsSince(start);
+	double packageResident = ((double)ResidentBytes(false) - resident) / (1024 * 1024);
+	double packagePeak = ((double)ResidentBytes(true) - peak) / (1024 * 1024);
+	packageArena.Delete();
+	package.Close();
+
+	std::ifstream objFile(objPath, std::ios::binary | std::ios::ate), packageFile(packagePath.c_str(), std::ios::binary | std::ios::ate);
+	double objBytes = (double)objFile.tellg() / (1024 * 1024), packageBytes = (double)packageFile.tellg() / (1024 * 1024);
+	objFile.close();
+	packageFile.close();
+	std::remove(objPath);
+	std::remove(packagePath.c_str());
+	if (!opened) {
+		std::cout << "Failed to import or bake the benchmark mesh" << std::endl;
+		return 1;
+	}
+
+	std::cout << "loading " << vertexCount << " vertices, " << (side - 1) * (side - 1) * 2 << " triangles" << std::endl;
+	std::cout << std::setw(18) << "" << std::setw(10) << "file MB" << std::setw(10) << "load ms" << std::setw(13) << "resident MB" << std::setw(10) << "peak MB" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << std::setw(18) << "OBJ text import" << std::setw(10) << objBytes << std::setw(10) << textLoad << std::setw(13) << textResident << std::setw(10) << textPeak << std::endl;
+	std::cout << std::setw(18) << "mapped package" << std::setw(10) << packageBytes << std::setw(10) << packageLoad << std::setw(13) << packageResident << std::setw(10) << packagePeak << std::endl;
+	std::cout << "parsing, optimizing and building the levels took " << parse << " of the import's " << textLoad << " ms" << std::endl;
+	if (!peaks) {
+		std::cout << "the peak cannot be reset on this platform, the package's peak only shows growth past the import's" << std::endl;
+	}
+	bench.Destroy();
+	return 0;
+}
+
+int RunBenchmark(const std::string& name)
+{
+	if (name == "clusters") {
+		return BenchmarkClusters();
+	}
+	if (name == "textures") {
+		return BenchmarkTextures();
+	}
+	if (name == "instancing") {
+		return BenchmarkInstancing();
+	}
+	if (name == "transforms") {
+		return BenchmarkTransforms();
+	}
+	if (name == "scene") {
+		return BenchmarkScene();
+	}
+	if (name == "culling") {
+		return BenchmarkCulling();
+	}
+	if (name == "geometry") {
+		return BenchmarkGeometry();
+	}
+	if (name == "vertices") {
+		return BenchmarkVertices();
+	}
+	if (name == "package") {
+		return BenchmarkPackage();
+	}
+	if (name == "deferred") {
+		return BenchmarkDeferred();
+	}
+	if (name == "shadows") {
+		return BenchmarkShadows();
+	}
+	if (name == "lightmap") {
+		return BenchmarkLightmap();
+	}
+	if (name == "software") {
+		return BenchmarkSoftware();
+	}
+	if (name == "occlusion") {
+		return BenchmarkOcclusion();
+	}
+	if (name == "lod") {
+		return BenchmarkLod();
+	}
+	std::cout << "Unknown benchmark: " << name << std::endl;
+	std::cout << "Available: clusters, textures, instancing, transforms, scene, culling, geometry, vertices, package, deferred, shadows, lightmap, software, occlusion, lod" << std::endl;
+	return 1;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <string>
+
+// Runs one of the named benchmarks and prints its results, returns the process exit code.
+// Started with "--bench <name>" from the command line, no window is opened; the ones that
+// need OpenGL create a headless context.
+int RunBenchmark(const std::string& name);
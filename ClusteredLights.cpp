@@ -0,0 +1,304 @@
+#include "ClusteredLights.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static void CreateTextureBuffer(GLuint& buffer, GLuint& texture, GLenum format)
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::Create()
+{
+	CreateTextureBuffer(gridBuffer, gridTexture, GL_RG32UI);
+	CreateTextureBuffer(indexBuffer, indexTexture, GL_R32UI);
+	CreateTextureBuffer(lightBuffer, lightTexture, GL_RGBA32F);
+}
+
+void ClusteredLights::Delete()
+{
+	GLuint textures[] = { gridTexture, indexTexture, lightTexture };
+	GLuint buffers[] = { gridBuffer, indexBuffer, lightBuffer };
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+}
+
+std::string ClusteredLights::Defines()
+{
+	return "#define CLUSTERED_LIGHTING\n"
+		"#define CLUSTER_X " + std::to_string(CLUSTER_X) + "\n"
+		"#define CLUSTER_Y " + std::to_string(CLUSTER_Y) + "\n"
+		"#define CLUSTER_Z " + std::to_string(CLUSTER_Z) + "\n";
+}
+
+float ClusteredLights::LightRadius(const PointLight& light)
+{
+	glm::vec3 brightest = glm::max(light.ambient, glm::max(light.diffuse, light.specular));
+	float maxComponent = std::max(brightest.x, std::max(brightest.y, brightest.z));
+	if (maxComponent <= 0.0f) {
+		return 0.0f;
+	}
+	// solve constant + linear * d + quadratic * d^2 = 256 * maxComponent
+	float target = 256.0f * maxComponent - light.constant;
+	if (target <= 0.0f) {
+		return 0.0f;
+	}
+	if (light.quadratic > 0.0f) {
+		return (-light.linear + std::sqrt(light.linear * light.linear + 4.0f * light.quadratic * target)) / (2.0f * light.quadratic);
+	}
+	if (light.linear > 0.0f) {
+		return target / light.linear;
+	}
+	return FLT_MAX;
+}
+
+std::vector<PointLight> ClusteredLights::ScatterLights(int count, float extent)
+{
+	std::vector<PointLight> result(count);
+	int side = (int)std::ceil(std::sqrt((float)count));
+	for (int i = 0; i < count; i++) {
+		float u = (i % side + 0.5f) / side, v = (i / side + 0.5f) / side;
+		// cycle through a few saturated colours
+		glm::vec3 colour(0.5f * (i % 3 == 0), 0.5f * (i % 3 == 1), 0.5f * ((i / 3) % 2 == 0));
+		PointLight& light = result[i];
+		light = PointLight();
+		light.position = glm::vec3((u * 2.0f - 1.0f) * extent, 0.5f + (i % 4) * 0.5f, (v * 2.0f - 1.0f) * extent);
+		light.ambient = colour * 0.05f;
+		light.diffuse = colour;
+		light.specular = colour;
+		light.constant = 1.0f;
+		light.linear = 0.7f;
+		light.quadratic = 1.8f;
+	}
+	return result;
+}
+
+void ClusteredLights::SetLights(const std::vector<PointLight>& pointLights)
+{
+	lights = pointLights;
+	radius.resize(lights.size());
+	for (size_t i = 0; i < lights.size(); i++) {
+		radius[i] = LightRadius(lights[i]);
+	}
+	viewX.resize(lights.size());
+	viewY.resize(lights.size());
+	viewZ.resize(lights.size());
+	viewRadius.resize(lights.size());
+	lightsDirty = true;
+}
+
+void ClusteredLights::SetProjection(const glm::mat4& newProjection)
+{
+	bool same = true;
+	for (int c = 0; c < 4 && same; c++) {
+		for (int r = 0; r < 4 && same; r++) {
+			same = projection[c][r] == newProjection[c][r];
+		}
+	}
+	if (same) {
+		return;
+	}
+	projection = newProjection;
+
+	// recover the frustum from the matrix itself so it works whatever unit fovy was given in
+	float tanHalfY = 1.0f / projection[1][1];
+	float tanHalfX = 1.0f / projection[0][0];
+	nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+	farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+
+	clusterMin.resize(CLUSTER_COUNT);
+	clusterMax.resize(CLUSTER_COUNT);
+	grid.assign(CLUSTER_COUNT * 2, 0);
+	sliceIndices.resize(CLUSTER_Z);
+	for (int z = 0; z < CLUSTER_Z; z++) {
+		float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)z / CLUSTER_Z);
+		float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / CLUSTER_Z);
+		for (int y = 0; y < CLUSTER_Y; y++) {
+			float y0 = -1.0f + 2.0f * y / CLUSTER_Y, y1 = -1.0f + 2.0f * (y + 1) / CLUSTER_Y;
+			for (int x = 0; x < CLUSTER_X; x++) {
+				float x0 = -1.0f + 2.0f * x / CLUSTER_X, x1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+				// the tile widens with depth, so the far slice plane bounds x and y on the outer edges
+				glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+				float depths[2] = { sliceNear, sliceFar };
+				for (float d : depths) {
+					float xs[2] = { x0 * d * tanHalfX, x1 * d * tanHalfX };
+					float ys[2] = { y0 * d * tanHalfY, y1 * d * tanHalfY };
+					for (float vx : xs) {
+						for (float vy : ys) {
+							lo = glm::min(lo, glm::vec3(vx, vy, -d));
+							hi = glm::max(hi, glm::vec3(vx, vy, -d));
+						}
+					}
+				}
+				int index = x + CLUSTER_X * (y + CLUSTER_Y * z);
+				clusterMin[index] = lo;
+				clusterMax[index] = hi;
+			}
+		}
+	}
+}
+
+void ClusteredLights::Assign(const glm::mat4& view, ThreadPool& pool)
+{
+	size_t count = lights.size();
+
+	// transform the light centres into view space once
+	pool.ParallelFor(count, 1024, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3& p = lights[i].position;
+			viewX[i] = view[0][0] * p.x + view[1][0] * p.y + view[2][0] * p.z + view[3][0];
+			viewY[i] = view[0][1] * p.x + view[1][1] * p.y + view[2][1] * p.z + view[3][1];
+			viewZ[i] = view[0][2] * p.x + view[1][2] * p.y + view[2][2] * p.z + view[3][2];
+			viewRadius[i] = radius[i];
+		}
+	});
+
+	// slices are independent, each one fills its own part of the grid and its own index list
+	pool.ParallelFor(CLUSTER_Z, 1, [&](size_t begin, size_t end) {
+		SliceScratch scratch;
+		for (size_t slice = begin; slice < end; slice++) {
+			AssignSlice((unsigned int)slice, scratch);
+		}
+	});
+
+	// concatenate the slice lists and turn the slice relative offsets into global ones
+	indices.clear();
+	for (unsigned int z = 0; z < CLUSTER_Z; z++) {
+		unsigned int base = (unsigned int)indices.size();
+		for (unsigned int c = z * CLUSTER_X * CLUSTER_Y; c < (z + 1) * CLUSTER_X * CLUSTER_Y; c++) {
+			grid[c * 2] += base;
+		}
+		indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+	}
+}
+
+void ClusteredLights::AssignSlice(unsigned int slice, SliceScratch& scratch)
+{
+	const int tiles = CLUSTER_X * CLUSTER_Y;
+	size_t count = lights.size();
+	int first = slice * tiles;
+	float sliceMinZ = clusterMin[first].z, sliceMaxZ = clusterMax[first].z;
+
+	// branch free depth test over all lights, then compact the survivors
+	scratch.mask.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		scratch.mask[i] = (viewZ[i] - viewRadius[i] <= sliceMaxZ) & (viewZ[i] + viewRadius[i] >= sliceMinZ);
+	}
+	scratch.candidates.clear();
+	for (size_t i = 0; i < count; i++) {
+		if (scratch.mask[i]) {
+			scratch.candidates.push_back((unsigned int)i);
+		}
+	}
+
+	// x extent of every tile column and y extent of every tile row within this slice
+	float columnMin[CLUSTER_X], columnMax[CLUSTER_X], rowMin[CLUSTER_Y], rowMax[CLUSTER_Y];
+	for (int x = 0; x < CLUSTER_X; x++) {
+		columnMin[x] = std::min(clusterMin[first + x].x, clusterMin[first + (CLUSTER_Y - 1) * CLUSTER_X + x].x);
+		columnMax[x] = std::max(clusterMax[first + x].x, clusterMax[first + (CLUSTER_Y - 1) * CLUSTER_X + x].x);
+	}
+	for (int y = 0; y < CLUSTER_Y; y++) {
+		rowMin[y] = std::min(clusterMin[first + y * CLUSTER_X].y, clusterMin[first + y * CLUSTER_X + CLUSTER_X - 1].y);
+		rowMax[y] = std::max(clusterMax[first + y * CLUSTER_X].y, clusterMax[first + y * CLUSTER_X + CLUSTER_X - 1].y);
+	}
+
+	// narrow every light to the tile rectangle its bounds overlap, then do the exact sphere/box test
+	scratch.hits.clear();
+	unsigned int tileCounts[tiles] = {};
+	for (unsigned int i : scratch.candidates) {
+		float x = viewX[i], y = viewY[i], z = viewZ[i], r = viewRadius[i];
+		int x0 = 0, x1 = CLUSTER_X - 1, y0 = 0, y1 = CLUSTER_Y - 1;
+		while (x0 <= x1 && columnMax[x0] < x - r) x0++;
+		while (x1 >= x0 && columnMin[x1] > x + r) x1--;
+		while (y0 <= y1 && rowMax[y0] < y - r) y0++;
+		while (y1 >= y0 && rowMin[y1] > y + r) y1--;
+		for (int ty = y0; ty <= y1; ty++) {
+			for (int tx = x0; tx <= x1; tx++) {
+				int tile = ty * CLUSTER_X + tx;
+				const glm::vec3& lo = clusterMin[first + tile];
+				const glm::vec3& hi = clusterMax[first + tile];
+				// squared distance from the sphere centre to the cluster box
+				float dx = std::max(0.0f, std::max(lo.x - x, x - hi.x));
+				float dy = std::max(0.0f, std::max(lo.y - y, y - hi.y));
+				float dz = std::max(0.0f, std::max(lo.z - z, z - hi.z));
+				if (dx * dx + dy * dy + dz * dz <= r * r) {
+					scratch.hits.push_back(((unsigned long long)tile << 32) | i);
+					tileCounts[tile]++;
+				}
+			}
+		}
+	}
+
+	// counting sort of the hits by tile gives contiguous per cluster lists
+	std::vector<unsigned int>& out = sliceIndices[slice];
+	out.resize(scratch.hits.size());
+	unsigned int offset = 0;
+	for (int tile = 0; tile < tiles; tile++) {
+		grid[(first + tile) * 2] = offset;
+		grid[(first + tile) * 2 + 1] = tileCounts[tile];
+		offset += tileCounts[tile];
+	}
+	for (unsigned long long hit : scratch.hits) {
+		int tile = (int)(hit >> 32);
+		unsigned int& cursor = grid[(first + tile) * 2];
+		out[cursor++] = (unsigned int)hit;
+	}
+	for (int tile = 0; tile < tiles; tile++) {
+		grid[(first + tile) * 2] -= tileCounts[tile];
+	}
+}
+
+void ClusteredLights::Upload()
+{
+	// glBufferData with fresh contents orphans last frame's storage instead of waiting on it
+	glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(unsigned int), grid.data(), GL_STREAM_DRAW);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+	if (indices.empty()) {
+		unsigned int zero = 0;
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(unsigned int), &zero, GL_STREAM_DRAW);
+	}
+	else {
+		glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STREAM_DRAW);
+	}
+
+	// PointLight is four vec4s, so it maps onto four RGBA32F texels
+	if (lightsDirty && !lights.empty()) {
+		glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, lights.size() * sizeof(PointLight), lights.data(), GL_STATIC_DRAW);
+		lightsDirty = false;
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::Bind(const Shader& shader, GLState& state, unsigned int screenWidth, unsigned int screenHeight)
+{
+	if (boundProgram != shader.program) {
+		gridUniform = shader.Get<int>("clusterGrid");
+		indexUniform = shader.Get<int>("clusterLightIndices");
+		lightUniform = shader.Get<int>("clusterLights");
+		tileSizeUniform = shader.Get<glm::vec2>("clusterTileSize");
+		depthUniform = shader.Get<glm::vec4>("clusterDepth");
+		boundProgram = shader.program;
+	}
+
+	state.BindTexture(GRID_UNIT, GL_TEXTURE_BUFFER, gridTexture);
+	state.BindTexture(INDEX_UNIT, GL_TEXTURE_BUFFER, indexTexture);
+	state.BindTexture(LIGHT_UNIT, GL_TEXTURE_BUFFER, lightTexture);
+
+	shader.Set(gridUniform, (int)GRID_UNIT);
+	shader.Set(indexUniform, (int)INDEX_UNIT);
+	shader.Set(lightUniform, (int)LIGHT_UNIT);
+	shader.Set(tileSizeUniform, glm::vec2((float)screenWidth / CLUSTER_X, (float)screenHeight / CLUSTER_Y));
+	// slice = log(depth) * scale - bias, the inverse of the exponential split in SetProjection
+	float logRatio = std::log(farPlane / nearPlane);
+	shader.Set(depthUniform, glm::vec4(nearPlane, farPlane, CLUSTER_Z / logRatio, CLUSTER_Z * std::log(nearPlane) / logRatio));
+}
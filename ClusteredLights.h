@@ -0,0 +1,85 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "LightSet.h"
+#include "GLState.h"
+#include "Shader.h"
+#include "ThreadPool.h"
+
+// cluster grid resolution: screen tiles in x and y, exponential depth slices in z
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// Clustered forward shading for large numbers of point lights. The view frustum is split into a
+// CLUSTER_X * CLUSTER_Y * CLUSTER_Z grid, every light is bounded by the distance at which its
+// attenuation makes it invisible, and the lights touching each cluster are listed in texture
+// buffers so the fragment shader only loops over its own cluster.
+class ClusteredLights
+{
+public:
+	// texture units used by Bind, chosen above the material units used by Demo
+	static const GLuint GRID_UNIT = 4;
+	static const GLuint INDEX_UNIT = 5;
+	static const GLuint LIGHT_UNIT = 6;
+
+	void Create();
+	void Delete();
+
+	// "#define"s to compile multipleLight.frag with, see RenderEngine::BuildShader
+	static std::string Defines();
+	// distance at which the light drops below 1/256 of its brightest colour
+	static float LightRadius(const PointLight& light);
+	// deterministic field of coloured lights over a square of the given half extent, for demos and benchmarks
+	static std::vector<PointLight> ScatterLights(int count, float extent);
+
+	void SetLights(const std::vector<PointLight>& pointLights);
+	// rebuilds the view space cluster bounds, cheap to call every frame when nothing changed
+	void SetProjection(const glm::mat4& projection);
+	// CPU light assignment, no GL calls so it can be benchmarked on its own
+	void Assign(const glm::mat4& view, ThreadPool& pool);
+	void Upload();
+	void Bind(const Shader& shader, GLState& state, unsigned int screenWidth, unsigned int screenHeight);
+
+	size_t LightCount() const { return lights.size(); }
+	size_t IndexCount() const { return indices.size(); }
+	const std::vector<unsigned int>& Grid() const { return grid; }
+
+private:
+	std::vector<PointLight> lights;
+	std::vector<float> radius;
+	bool lightsDirty = false;
+
+	glm::mat4 projection = glm::mat4(0.0f);
+	float nearPlane = 0.1f, farPlane = 100.0f;
+	std::vector<glm::vec3> clusterMin, clusterMax;
+
+	// view space light bounds in structure of arrays form so the culling loops vectorize
+	std::vector<float> viewX, viewY, viewZ, viewRadius;
+
+	// per cluster (offset, count) pairs into the index list
+	std::vector<unsigned int> grid;
+	std::vector<unsigned int> indices;
+	std::vector<std::vector<unsigned int>> sliceIndices;
+
+	GLuint gridBuffer = 0, gridTexture = 0;
+	GLuint indexBuffer = 0, indexTexture = 0;
+	GLuint lightBuffer = 0, lightTexture = 0;
+
+	Uniform<int> gridUniform, indexUniform, lightUniform;
+	Uniform<glm::vec2> tileSizeUniform;
+	Uniform<glm::vec4> depthUniform;
+	GLuint boundProgram = 0;
+
+	struct SliceScratch
+	{
+		std::vector<unsigned char> mask;
+		std::vector<unsigned int> candidates;
+		// (tile << 32 | light) pairs before they are sorted into per cluster lists
+		std::vector<unsigned long long> hits;
+	};
+	void AssignSlice(unsigned int slice, SliceScratch& scratch);
+};
@@ -0,0 +1,297 @@
+#include "DeferredRenderer.h"
+#include "ClusteredLights.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static GLuint CreateTargetTexture(GLenum internalFormat, GLenum format, GLenum type, unsigned int width, unsigned int height)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+	// read with texelFetch, one texel per pixel
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
+void DeferredRenderer::Create(unsigned int width, unsigned int height)
+{
+	this->width = width;
+	this->height = height;
+	CreateTarget();
+	CreateVolumes();
+}
+
+void DeferredRenderer::CreateTarget()
+{
+	albedo = CreateTargetTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+	specular = CreateTargetTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+	// normal in xyz, shininess in w, which is not limited to [0, 1]
+	normal = CreateTargetTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+	depth = CreateTargetTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, specular, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, normal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "ERROR::DEFERRED::GBUFFER_INCOMPLETE" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::CreateVolumes()
+{
+	// the faces of a tessellated sphere or cone cut inside the smooth one, pushing the vertices
+	// out by 1/cos of half a segment's angle keeps every face outside it
+	const float pi = 3.14159265f;
+	const float inflate = 1.0f / (std::cos(pi / DEFERRED_VOLUME_SEGMENTS) * std::cos(pi / (2 * DEFERRED_SPHERE_RINGS)));
+
+	// unit sphere, rings from pole to pole, counter clockwise from outside
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	for (int ring = 0; ring <= DEFERRED_SPHERE_RINGS; ring++) {
+		float theta = pi * ring / DEFERRED_SPHERE_RINGS;
+		for (int segment = 0; segment <= DEFERRED_VOLUME_SEGMENTS; segment++) {
+			float phi = 2.0f * pi * segment / DEFERRED_VOLUME_SEGMENTS;
+			vertices.push_back(std::sin(theta) * std::cos(phi) * inflate);
+			vertices.push_back(std::cos(theta) * inflate);
+			vertices.push_back(-std::sin(theta) * std::sin(phi) * inflate);
+		}
+	}
+	for (int ring = 0; ring < DEFERRED_SPHERE_RINGS; ring++) {
+		for (int segment = 0; segment < DEFERRED_VOLUME_SEGMENTS; segment++) {
+			GLuint top = ring * (DEFERRED_VOLUME_SEGMENTS + 1) + segment, bottom = top + DEFERRED_VOLUME_SEGMENTS + 1;
+			GLuint quad[] = { top, bottom, bottom + 1, top, bottom + 1, top + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	sphereIndexCount = (GLsizei)indices.size();
+
+	glGenVertexArrays(1, &sphereVao);
+	glGenBuffers(1, &sphereBuffer);
+	glGenBuffers(1, &sphereIndices);
+	glGenBuffers(1, &lightBuffer);
+	glBindVertexArray(sphereVao);
+	glBindBuffer(GL_ARRAY_BUFFER, sphereBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+	glEnableVertexAttribArray(0);
+	// a PointLight per instance, its four vec4s at locations 1 to 4, the radius in the last w
+	glBindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+	for (GLuint column = 0; column < 4; column++) {
+		glVertexAttribPointer(1 + column, 4, GL_FLOAT, GL_FALSE, sizeof(PointLight), (void*)(column * 4 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(1 + column);
+		glVertexAttribDivisor(1 + column, 1);
+	}
+
+	// unit cone along -z, apex at the origin and a closed base at z = -1
+	vertices.assign(3, 0.0f);
+	indices.clear();
+	for (int segment = 0; segment < DEFERRED_VOLUME_SEGMENTS; segment++) {
+		float phi = 2.0f * pi * segment / DEFERRED_VOLUME_SEGMENTS;
+		vertices.push_back(std::cos(phi) * inflate);
+		vertices.push_back(std::sin(phi) * inflate);
+		vertices.push_back(-1.0f);
+	}
+	vertices.push_back(0.0f);
+	vertices.push_back(0.0f);
+	vertices.push_back(-1.0f);
+	GLuint center = DEFERRED_VOLUME_SEGMENTS + 1;
+	for (GLuint segment = 0; segment < DEFERRED_VOLUME_SEGMENTS; segment++) {
+		GLuint current = 1 + segment, next = 1 + (segment + 1) % DEFERRED_VOLUME_SEGMENTS;
+		GLuint faces[] = { 0, current, next, center, next, current };
+		indices.insert(indices.end(), faces, faces + 6);
+	}
+	coneIndexCount = (GLsizei)indices.size();
+
+	glGenVertexArrays(1, &coneVao);
+	glGenBuffers(1, &coneBuffer);
+	glGenBuffers(1, &coneIndices);
+	glBindVertexArray(coneVao);
+	glBindBuffer(GL_ARRAY_BUFFER, coneBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, coneIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glGenVertexArrays(1, &emptyVao);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeferredRenderer::Delete()
+{
+	GLuint textures[] = { albedo, specular, normal, depth };
+	glDeleteTextures(4, textures);
+	glDeleteFramebuffers(1, &framebuffer);
+	GLuint buffers[] = { sphereBuffer, sphereIndices, coneBuffer, coneIndices, lightBuffer };
+	glDeleteBuffers(5, buffers);
+	GLuint vaos[] = { sphereVao, coneVao, emptyVao };
+	glDeleteVertexArrays(3, vaos);
+	framebuffer = 0;
+}
+
+std::string DeferredRenderer::Defines(DeferredPass pass)
+{
+	switch (pass) {
+	case DEFERRED_FULLSCREEN:
+		return "#define FULLSCREEN_PASS\n";
+	case DEFERRED_POINT:
+		return "#define POINT_VOLUME\n";
+	default:
+		return "#define SPOT_VOLUME\n";
+	}
+}
+
+// the passes use different subsets of the uniforms and the linker drops the rest, so missing
+// ones are looked up quietly instead of through Shader::Get
+template <typename T>
+static Uniform<T> PassUniform(const Shader& shader, const char* name)
+{
+	Uniform<T> handle;
+	handle.location = shader.Location(name);
+	return handle;
+}
+
+void DeferredRenderer::SetShaders(const Shader& fullscreen, const Shader& point, const Shader& spot)
+{
+	const Shader* shaders[DEFERRED_PASS_COUNT] = { &fullscreen, &point, &spot };
+	for (int i = 0; i < DEFERRED_PASS_COUNT; i++) {
+		PassUniforms& pass = passes[i];
+		pass.shader = *shaders[i];
+		pass.albedo = PassUniform<int>(pass.shader, "gAlbedo");
+		pass.specular = PassUniform<int>(pass.shader, "gSpecular");
+		pass.normal = PassUniform<int>(pass.shader, "gNormal");
+		pass.depth = PassUniform<int>(pass.shader, "gDepth");
+		pass.viewProjection = PassUniform<glm::mat4>(pass.shader, "viewProjection");
+		pass.inverseViewProjection = PassUniform<glm::mat4>(pass.shader, "inverseViewProjection");
+		pass.spotModel = PassUniform<glm::mat4>(pass.shader, "spotModel");
+		pass.viewPos = PassUniform<glm::vec3>(pass.shader, "viewPos");
+		pass.screenSize = PassUniform<glm::vec2>(pass.shader, "screenSize");
+		// the point pass has its lights per instance
+		if (i != DEFERRED_POINT) {
+			pass.shader.BindUniformBlock("Lights", LightSet::BINDING);
+		}
+	}
+}
+
+void DeferredRenderer::SetPointLights(const std::vector<PointLight>& pointLights)
+{
+	std::vector<PointLight> instances = pointLights;
+	for (PointLight& light : instances) {
+		light.pad0 = std::min(ClusteredLights::LightRadius(light), DEFERRED_MAX_LIGHT_RADIUS);
+	}
+	lightCount = instances.size();
+	glBindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(PointLight), instances.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeferredRenderer::BeginGeometry()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::BindPass(GLState& state, PassUniforms& pass, const glm::mat4& viewProjection, const glm::vec3& viewPos)
+{
+	state.UseProgram(pass.shader.program);
+	pass.shader.Set(pass.albedo, (int)ALBEDO_UNIT);
+	pass.shader.Set(pass.specular, (int)SPECULAR_UNIT);
+	pass.shader.Set(pass.normal, (int)NORMAL_UNIT);
+	pass.shader.Set(pass.depth, (int)DEPTH_UNIT);
+	pass.shader.Set(pass.viewProjection, viewProjection);
+	pass.shader.Set(pass.inverseViewProjection, glm::inverse(viewProjection));
+	pass.shader.Set(pass.viewPos, viewPos);
+	pass.shader.Set(pass.screenSize, glm::vec2((float)width, (float)height));
+}
+
+void DeferredRenderer::Light(GLState& state, GLuint target, const glm::mat4& viewProjection, const glm::vec3& viewPos, const LightBlock& block, const LightFeatures& features)
+{
+	// the volumes are depth tested against the scene, so its depth goes to the target first
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+	state.BindTexture(ALBEDO_UNIT, GL_TEXTURE_2D, albedo);
+	state.BindTexture(SPECULAR_UNIT, GL_TEXTURE_2D, specular);
+	state.BindTexture(NORMAL_UNIT, GL_TEXTURE_2D, normal);
+	state.BindTexture(DEPTH_UNIT, GL_TEXTURE_2D, depth);
+
+	// every pass adds its light on top of the cleared target
+	state.Enable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glDepthMask(GL_FALSE);
+
+	// directional light, and the spotlight's ambient outside its cone, for every covered pixel
+	if (features.dirLight || features.spotLight) {
+		state.Disable(GL_DEPTH_TEST);
+		BindPass(state, passes[DEFERRED_FULLSCREEN], viewProjection, viewPos);
+		state.BindVertexArray(emptyVao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	// back faces behind the scene's surface; depth clamp keeps the ones past the far plane
+	state.Enable(GL_DEPTH_TEST);
+	glDepthFunc(GL_GEQUAL);
+	state.Enable(GL_CULL_FACE);
+	glCullFace(GL_FRONT);
+	state.Enable(GL_DEPTH_CLAMP);
+
+	if (lightCount > 0) {
+		BindPass(state, passes[DEFERRED_POINT], viewProjection, viewPos);
+		state.BindVertexArray(sphereVao);
+		glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)lightCount);
+	}
+	if (features.spotLight) {
+		PassUniforms& pass = passes[DEFERRED_SPOT];
+		BindPass(state, pass, viewProjection, viewPos);
+		pass.shader.Set(pass.spotModel, SpotModel(block.spotLight));
+		state.BindVertexArray(coneVao);
+		glDrawElements(GL_TRIANGLES, coneIndexCount, GL_UNSIGNED_INT, 0);
+	}
+
+	state.Disable(GL_DEPTH_CLAMP);
+	glCullFace(GL_BACK);
+	state.Disable(GL_CULL_FACE);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	state.Disable(GL_BLEND);
+}
+
+glm::mat4 DeferredRenderer::SpotModel(const SpotLight& light)
+{
+	PointLight reach = {};
+	reach.ambient = light.ambient;
+	reach.diffuse = light.diffuse;
+	reach.specular = light.specular;
+	reach.constant = light.constant;
+	reach.linear = light.linear;
+	reach.quadratic = light.quadratic;
+	float range = std::min(ClusteredLights::LightRadius(reach), DEFERRED_MAX_LIGHT_RADIUS);
+	float outer = std::acos(glm::clamp(std::min(light.cutOff, light.outerCutOff), -1.0f, 1.0f));
+	// kept short of a right angle, where the base would go to infinity; the demo's is 15 degrees
+	float spread = range * std::tan(std::min(outer, 1.5f));
+
+	glm::vec3 direction = glm::normalize(light.direction);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+	// lookAt maps the light's frame onto -z, its inverse places the cone there
+	glm::mat4 frame = glm::inverse(glm::lookAt(light.position, light.position + direction, up));
+	return glm::scale(frame, glm::vec3(spread, spread, range));
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "LightSet.h"
+#include "GLState.h"
+#include "Shader.h"
+
+// segments of the light volume meshes around their axis, and rings of the sphere
+#define DEFERRED_VOLUME_SEGMENTS 16
+#define DEFERRED_SPHERE_RINGS 12
+// bound for lights whose attenuation never fades them out
+#define DEFERRED_MAX_LIGHT_RADIUS 1000.0f
+
+// the three lighting passes of deferredLight.frag
+enum DeferredPass
+{
+	DEFERRED_FULLSCREEN,
+	DEFERRED_POINT,
+	DEFERRED_SPOT,
+	DEFERRED_PASS_COUNT
+};
+
+// Deferred shading, the alternative to lighting every fragment in multipleLight.frag. The scene
+// is drawn once into a G-buffer (gbuffer.frag: albedo, specular colour, normal and shininess,
+// depth), then each light shades only the pixels it reaches: the directional light in a
+// fullscreen pass, every point light as one instance of a sphere sized by its attenuation and
+// the spotlight as a cone, all added up. Lighting cost follows the lit pixels instead of the
+// overdraw times the light count.
+//
+// The volumes are drawn back faces only with depth test GL_GEQUAL against the scene's depth, so
+// pixels behind a volume are never shaded and a camera inside one still sees its light.
+// Lighting beyond ClusteredLights::LightRadius is dropped, like in clustered forward mode.
+class DeferredRenderer
+{
+public:
+	// texture units the lighting passes read the G-buffer from
+	static const GLuint ALBEDO_UNIT = 0;
+	static const GLuint SPECULAR_UNIT = 1;
+	static const GLuint NORMAL_UNIT = 2;
+	static const GLuint DEPTH_UNIT = 3;
+
+	void Create(unsigned int width, unsigned int height);
+	void Delete();
+
+	// "#define"s to compile deferredLight.vert and .frag with for a pass, see RenderEngine::BuildShader
+	static std::string Defines(DeferredPass pass);
+	// the three lighting programs, built from Defines; they read the "Lights" block at LightSet::BINDING
+	void SetShaders(const Shader& fullscreen, const Shader& point, const Shader& spot);
+	const Shader& PassShader(DeferredPass pass) const { return passes[pass].shader; }
+	void SetPointLights(const std::vector<PointLight>& pointLights);
+
+	// binds and clears the G-buffer, the scene is then drawn with a gbuffer.frag program
+	void BeginGeometry();
+	// lights the G-buffer into target, whose depth buffer must be DEPTH24_STENCIL8 like the
+	// G-buffer's; the scene's depth ends up in target too. Dir and spot light come from block.
+	void Light(GLState& state, GLuint target, const glm::mat4& viewProjection, const glm::vec3& viewPos, const LightBlock& block, const LightFeatures& features);
+
+	size_t PointLightCount() const { return lightCount; }
+
+private:
+	unsigned int width = 0, height = 0;
+	GLuint framebuffer = 0;
+	GLuint albedo = 0, specular = 0, normal = 0, depth = 0;
+
+	// unit sphere and cone, the sphere's VAO also carries the per light instance attributes
+	GLuint sphereVao = 0, sphereBuffer = 0, sphereIndices = 0;
+	GLuint coneVao = 0, coneBuffer = 0, coneIndices = 0;
+	GLsizei sphereIndexCount = 0, coneIndexCount = 0;
+	GLuint lightBuffer = 0;
+	size_t lightCount = 0;
+	// the fullscreen triangle is generated from gl_VertexID, core profiles still need a VAO bound
+	GLuint emptyVao = 0;
+
+	struct PassUniforms
+	{
+		Shader shader;
+		Uniform<int> albedo, specular, normal, depth;
+		Uniform<glm::mat4> viewProjection, inverseViewProjection, spotModel;
+		Uniform<glm::vec3> viewPos;
+		Uniform<glm::vec2> screenSize;
+	};
+	PassUniforms passes[DEFERRED_PASS_COUNT];
+
+	void CreateTarget();
+	void CreateVolumes();
+	void BindPass(GLState& state, PassUniforms& pass, const glm::mat4& viewProjection, const glm::vec3& viewPos);
+	// cone volume of the spotlight, wide enough for its outer cut off
+	static glm::mat4 SpotModel(const SpotLight& light);
+};
@@ -1,6 +1,19 @@
 #include "Demo.h"
-
-
+#include "Benchmarks.h"
+#include "BakedTexture.h"
+#include "LightmapBaker.h"
+#include "ObjImporter.h"
+#include "RegressionHarness.h"
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+
+// the last bake, reused while the static renderables and lights stay the same
+#define LIGHTMAP_FILE "demo.blmp"
+
+const GLuint Demo::LIGHTMAP_UNIT;
 
 Demo::Demo() {
 
@@ -13,86 +26,178 @@ Demo::~Demo() {
 
 
 void Demo::Init() {
-	// build and compile our shader program
-	// ------------------------------------
-	shadowmapShader = BuildShader("multipleLight.vert", "multipleLight.frag", nullptr);
+	if (backend == BACKEND_SOFTWARE) {
+		// the CPU rasterizer has neither
+		shadowsEnabled = false;
+		lightmapsEnabled = false;
+		deferredShading = false;
+	}
+	if (deferredShading || backend == BACKEND_SOFTWARE) {
+		occlusionCulling = false;
+	}
+	if (occlusionCulling) {
+		occlusion.Create();
+		occlusion.SetShader(BuildShaderVariant("occlusionBox.vert", "shadowDepth.frag", ""));
+	}
+	if (deferredShading) {
+		deferred.Create(this->screenWidth, this->screenHeight);
+	}
+	if (shadowsEnabled) {
+		shadows.Create();
+		shadows.SetShader(BuildShaderVariant("multipleLight.vert", "shadowDepth.frag", "#define INSTANCED\n"));
+	}
 
-	BuildTexturedCube();
+	if (backend == BACKEND_SOFTWARE) {
+		software.Create(this->screenWidth, this->screenHeight);
+	}
 
-	BuildTexturedPlane();
+	InitScene();
 
 	InitCamera();
+	if (!cameraPath.empty()) {
+		FollowCameraPath();
+	}
+
+	InitLights();
+
+	if (lightmapsEnabled && !deferredShading) {
+		InitLightmaps();
+	}
+
+	// the renderer starts from the initial state until the first tick arrives
+	TakeSnapshot(current);
+	previous = current;
+	shown = current;
+
+	// build and compile our shader program, the variant that fits the light rig
+	// -------------------------------------------------------------------------
+	if (backend == BACKEND_OPENGL) {
+		SelectShader(lights.Features());
+	}
+}
+
+void Demo::SelectShader(const LightFeatures& features)
+{
+	shaderFeatures = features;
+	std::string shadowDefines = shadowsEnabled ? ShadowMaps::Defines() : std::string();
+	if (deferredShading) {
+		// the scene only fills the G-buffer, the rig is applied by the lighting passes
+		shadowmapShader = BuildShaderVariant("multipleLight.vert", "gbuffer.frag", "#define INSTANCED\n");
+		deferred.SetShaders(BuildShaderVariant("deferredLight.vert", "deferredLight.frag", DeferredRenderer::Defines(DEFERRED_FULLSCREEN) + features.Defines() + shadowDefines),
+			BuildShaderVariant("deferredLight.vert", "deferredLight.frag", DeferredRenderer::Defines(DEFERRED_POINT)),
+			BuildShaderVariant("deferredLight.vert", "deferredLight.frag", DeferredRenderer::Defines(DEFERRED_SPOT) + shadowDefines));
+	}
+	else {
+		// every mesh is drawn instanced, the plane as a single instance
+		std::string defines = "#define INSTANCED\n" + features.Defines() + shadowDefines;
+		if (clusteredLightCount > 0) {
+			defines += ClusteredLights::Defines();
+		}
+		shadowmapShader = BuildShaderVariant("multipleLight.vert", "multipleLight.frag", defines);
+		viewPosUniform = shadowmapShader.Get<glm::vec3>("viewPos");
+		shadowmapShader.BindUniformBlock("Lights", LightSet::BINDING);
+	}
+	viewProjectionUniform = shadowmapShader.Get<glm::mat4>("viewProjection");
+	materialDiffuseUniform = shadowmapShader.Get<int>("material.diffuse");
+	materialSpecularUniform = shadowmapShader.Get<int>("material.specular");
+	materialShininessUniform = shadowmapShader.Get<float>("material.shininess");
+
+	// every material binds its maps to the same two units, so the samplers are set once
+	UseShader(shadowmapShader);
+	shadowmapShader.Set(materialDiffuseUniform, 0);
+	shadowmapShader.Set(materialSpecularUniform, 1);
+
+	if (lightmap != 0) {
+		// the spotlight stays dynamic, the rest of the rig is in the lightmap
+		LightFeatures baked = features;
+		baked.dirLight = false;
+		baked.pointLights = 0;
+		lightmapShader = BuildShaderVariant("multipleLight.vert", "multipleLight.frag", "#define INSTANCED\n#define LIGHTMAP\n" + baked.Defines() + shadowDefines);
+		lightmapShader.BindUniformBlock("Lights", LightSet::BINDING);
+		lightmapViewProjectionUniform = lightmapShader.Get<glm::mat4>("viewProjection");
+		lightmapViewPosUniform = lightmapShader.Get<glm::vec3>("viewPos");
+		lightmapShininessUniform = lightmapShader.Get<float>("material.shininess");
+		UseShader(lightmapShader);
+		lightmapShader.Set(lightmapShader.Get<int>("material.diffuse"), 0);
+		lightmapShader.Set(lightmapShader.Get<int>("material.specular"), 1);
+		lightmapShader.Set(lightmapShader.Get<int>("lightmap"), (int)LIGHTMAP_UNIT);
+	}
 }
 
 void Demo::DeInit() {
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
-	glDeleteVertexArrays(1, &cubeVAO);
-	glDeleteBuffers(1, &cubeVBO);
-	glDeleteBuffers(1, &cubeEBO);
-	glDeleteVertexArrays(1, &planeVAO);
-	glDeleteBuffers(1, &planeVBO);
-	glDeleteBuffers(1, &planeEBO);
+	scene.Delete();
+	if (backend == BACKEND_SOFTWARE) {
+		// the only GL objects are Present's, if it ran
+		software.Delete();
+		return;
+	}
+	lights.Delete();
+	glDeleteTextures(1, &lightmap);
+	lightmap = 0;
+	if (shadowsEnabled) {
+		shadows.Delete();
+	}
+	if (occlusionCulling) {
+		occlusion.Delete();
+	}
+	if (deferredShading) {
+		deferred.Delete();
+	}
+	else if (clusteredLightCount > 0) {
+		clusteredLights.Delete();
+	}
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void Demo::ProcessInput(GLFWwindow *window) {
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-		glfwSetWindowShouldClose(window, true);
+// react to the input of a tick, on the simulation thread; speeds are per ms of the tick
+// -------------------------------------------------------------------------------------
+void Demo::ProcessInput(const InputState& input) {
+	float tick = (float)simulationTick;
+	if (input.keys[GLFW_KEY_ESCAPE]) {
+		RequestExit();
 	}
 
 	// zoom camera
 	// -----------
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) {
+	if (input.buttons[GLFW_MOUSE_BUTTON_RIGHT]) {
 		if (fovy < 90) {
-			fovy += 0.0001f;
+			fovy += 0.00005f * tick;
 		}
 	}
 
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+	if (input.buttons[GLFW_MOUSE_BUTTON_LEFT]) {
 		if (fovy > 0) {
-			fovy -= 0.0001f;
+			fovy -= 0.00005f * tick;
 		}
 	}
 
 	// update camera movement 
 	// -------------
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-		MoveCamera(CAMERA_SPEED);
+	if (input.keys[GLFW_KEY_W]) {
+		MoveCamera(CAMERA_SPEED * tick);
 	}
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-		MoveCamera(-CAMERA_SPEED);
+	if (input.keys[GLFW_KEY_S]) {
+		MoveCamera(-CAMERA_SPEED * tick);
 	}
 
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-		StrafeCamera(-CAMERA_SPEED);
+	if (input.keys[GLFW_KEY_A]) {
+		StrafeCamera(-CAMERA_SPEED * tick);
 	}
 
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-		StrafeCamera(CAMERA_SPEED);
+	if (input.keys[GLFW_KEY_D]) {
+		StrafeCamera(CAMERA_SPEED * tick);
 	}
 
 	// update camera rotation
 	// ----------------------
-	double mouseX, mouseY;
-	double midX = screenWidth / 2;
-	double midY = screenHeight / 2;
-	float angleY = 0.0f;
-	float angleZ = 0.0f;
-
-	// Get mouse position
-	glfwGetCursorPos(window, &mouseX, &mouseY);
-	if ((mouseX == midX) && (mouseY == midY)) {
+	if (input.cursorX == 0 && input.cursorY == 0) {
 		return;
 	}
 
-	// Set mouse position
-	glfwSetCursorPos(window, midX, midY);
-
-	// Get the direction from the mouse cursor, set a resonable maneuvering speed
-	angleY = (float)((midX - mouseX)) / 1000;
-	angleZ = (float)((midY - mouseY)) / 1000;
+	// Get the direction from the mouse movement, set a resonable maneuvering speed
+	float angleY = (float)(-input.cursorX) / 1000;
+	float angleZ = (float)(-input.cursorY) / 1000;
 
 	// The higher the value is the faster the camera looks around.
 	viewCamY += angleZ * 2;
@@ -111,112 +216,163 @@ void Demo::ProcessInput(GLFWwindow *window) {
 
 void Demo::Update(double deltaTime) {
 	angle += (float)((deltaTime * 1.5f) / 1000);
+	if (!cameraPath.empty()) {
+		FollowCameraPath();
+	}
+
+	TakeSnapshot(snapshots.Back());
+	snapshots.Publish();
+}
+
+void Demo::TakeSnapshot(Snapshot& snapshot) const
+{
+	snapshot.time = simulationTime;
+	snapshot.cameraPos = glm::vec3(posCamX, posCamY, posCamZ);
+	snapshot.cameraTarget = glm::vec3(viewCamX, viewCamY, viewCamZ);
+	snapshot.cameraUp = glm::vec3(upCamX, upCamY, upCamZ);
+	snapshot.fovy = fovy;
+	snapshot.angle = angle;
+	snapshot.flashlightPos = flashlightPos;
+	snapshot.flashlightDir = flashlightDir;
+}
+
+// blends the two newest ticks at renderTime, so motion stays smooth at any frame rate
+void Demo::Interpolate(double renderTime)
+{
+	if (snapshots.Acquire()) {
+		previous = current;
+		current = snapshots.Front();
+	}
+	float t = 1.0f;
+	if (current.time > previous.time) {
+		t = (float)glm::clamp((renderTime - previous.time) / (current.time - previous.time), 0.0, 1.0);
+	}
+	shown.time = renderTime;
+	shown.cameraPos = glm::mix(previous.cameraPos, current.cameraPos, t);
+	shown.cameraTarget = glm::mix(previous.cameraTarget, current.cameraTarget, t);
+	shown.cameraUp = glm::mix(previous.cameraUp, current.cameraUp, t);
+	shown.fovy = glm::mix(previous.fovy, current.fovy, t);
+	shown.angle = glm::mix(previous.angle, current.angle, t);
+	shown.flashlightPos = glm::mix(previous.flashlightPos, current.flashlightPos, t);
+	shown.flashlightDir = glm::mix(previous.flashlightDir, current.flashlightDir, t);
 }
 
 void Demo::Render() {
-	glViewport(0, 0, this->screenWidth, this->screenHeight);
+	// both stay set from frame to frame, the state tracker drops the repeats
+	glState.PolygonMode(GL_FILL);
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glState.Enable(GL_DEPTH_TEST);
 
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	// only the flashlight is set per frame, the light set skips the upload when nothing changed
+	SyncLights();
+	AimFlashlight();
+	profiler.SetCounter("light_upload_bytes", (double)lights.Upload());
 
-	glEnable(GL_DEPTH_TEST);
+	// switch to another variant only when a phase was switched on or off
+	if (lights.Features() != shaderFeatures) {
+		SelectShader(lights.Features());
+	}
+
+	// uniforms below go to the bound program, so bind it before setting them
+	UseShader(this->shadowmapShader);
 
 	// Pass perspective projection matrix
-	glm::mat4 projection = glm::perspective(fovy, (GLfloat)this->screenWidth / (GLfloat)this->screenHeight, 0.1f, 100.0f);
-	GLint projLoc = glGetUniformLocation(this->shadowmapShader, "projection");
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	glm::mat4 projection = glm::perspective(shown.fovy, (GLfloat)this->screenWidth / (GLfloat)this->screenHeight, 0.1f, 100.0f);
 
 	// LookAt camera (position, target/direction, up)
-	glm::vec3 cameraPos = glm::vec3(0, 3, 3);
-	glm::vec3 cameraFront = glm::vec3(0, -1, -1);
-	glm::mat4 view = glm::lookAt(glm::vec3(posCamX, posCamY, posCamZ), glm::vec3(viewCamX, viewCamY, viewCamZ), glm::vec3(upCamX, upCamY, upCamZ));
-	GLint viewLoc = glGetUniformLocation(this->shadowmapShader, "view");
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	glm::mat4 view = glm::lookAt(shown.cameraPos, shown.cameraTarget, shown.cameraUp);
+	// combined once here instead of once per vertex
+	glm::mat4 viewProjection = projection * view;
+	shadowmapShader.Set(viewProjectionUniform, viewProjection);
 
 	// set lighting attributes
-	GLint viewPosLoc = glGetUniformLocation(this->shadowmapShader, "viewPos");
-	glUniform3f(viewPosLoc, cameraPos.x, cameraPos.y, cameraPos.z);
-
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "dirLight.direction"), 0.0f, -1.0f, -1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "dirLight.ambient"), 0.0f, 0.0f, 0.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "dirLight.diffuse"), 0.1f, 0.1f, 0.1f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "dirLight.specular"), 0.1f, 0.1f, 0.1f);
-	// point light 1
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[0].position"), 0.0f, 3.0f, 0.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[0].ambient"), 1.0f, 0.0f, 1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[0].diffuse"), 1.0f, 0.0f, 0.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[0].specular"), 1.0f, 0.0f, 0.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[0].constant"), 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[0].linear"), 0.09f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[0].quadratic"), 0.032f);
-	// point light 2
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[1].position"), -2.0f, 3.0f, 0.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[1].ambient"), 0.0f, 1.0f, 0.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[1].diffuse"), 0.0f, 1.0f, 0.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[1].specular"), 0.0f, 1.0f, 0.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[1].constant"), 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[1].linear"), 0.09f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[1].quadratic"), 0.032f);
-	// point light 3
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[2].position"), 2.0f, 3.0f, 0.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[2].ambient"), 0.0f, 0.0f, 1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[2].diffuse"), 0.0f, 0.0f, 1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[2].specular"), 0.0f, 0.0f, 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[2].constant"), 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[2].linear"), 0.09f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[2].quadratic"), 0.032f);
-	// point light 4
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[3].position"), 0.0f, 3.0f, 2.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[3].ambient"), 0.0f, 1.0f, 1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[3].diffuse"), 0.0f, 1.0f, 1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "pointLights[3].specular"), 0.0f, 1.0f, 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[3].constant"), 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[3].linear"), 0.09f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "pointLights[3].quadratic"), 0.032f);
-	// spotLight
-	glUniform3fv(glGetUniformLocation(this->shadowmapShader, "spotLight.position"), 1, &cameraPos[0]);
-	glUniform3fv(glGetUniformLocation(this->shadowmapShader, "spotLight.direction"), 1, &cameraFront[0]);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "spotLight.ambient"), 1.0f, 1.0f, 1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "spotLight.diffuse"), 1.0f, 1.0f, 1.0f);
-	glUniform3f(glGetUniformLocation(this->shadowmapShader, "spotLight.specular"), 1.0f, 1.0f, 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "spotLight.constant"), 1.0f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "spotLight.linear"), 0.09f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "spotLight.quadratic"), 0.032f);
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "spotLight.cutOff"), glm::cos(glm::radians(12.5f)));
-	glUniform1f(glGetUniformLocation(this->shadowmapShader, "spotLight.outerCutOff"), glm::cos(glm::radians(15.0f)));
-	
-	DrawTexturedCube();
-	DrawTexturedPlane();
-
-	glDisable(GL_DEPTH_TEST);
+	shadowmapShader.Set(viewPosUniform, shown.flashlightPos);
+	if (lightmap != 0) {
+		UseShader(lightmapShader);
+		lightmapShader.Set(lightmapViewProjectionUniform, viewProjection);
+		lightmapShader.Set(lightmapViewPosUniform, shown.flashlightPos);
+		UseShader(shadowmapShader);
+	}
+
+	if (clusteredLightCount > 0 && !deferredShading) {
+		clusteredLights.SetProjection(projection);
+		clusteredLights.Assign(view, jobs);
+		clusteredLights.Upload();
+		clusteredLights.Bind(shadowmapShader, glState, this->screenWidth, this->screenHeight);
+		profiler.SetCounter("cluster_light_indices", (double)clusteredLights.IndexCount());
+	}
+
+	AnimateCrates();
+
+	// what the queries of earlier frames found hidden is left out of the batches
+	if (occlusionCulling) {
+		occlusion.Resolve(scene);
+	}
+	CullScene(projection, viewProjection);
+	// the shadow casters go into the instance buffer behind the visible renderables
+	if (shadowsEnabled) {
+		shadows.Prepare(scene, view, projection, lights.Block(), shaderFeatures);
+	}
+	scene.Upload();
+
+	if (shadowsEnabled) {
+		{
+			GpuScope scope(profiler, "shadows");
+			shadows.Render(glState, scene);
+		}
+		profiler.SetCounter("shadow_passes", (double)shadows.Passes());
+		profiler.SetCounter("shadow_casters", (double)shadows.Casters());
+		BindMainFramebuffer();
+	}
+
+	glViewport(0, 0, this->screenWidth, this->screenHeight);
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+	if (deferredShading) {
+		{
+			GpuScope scope(profiler, "gbuffer");
+			deferred.BeginGeometry();
+			DrawScene();
+		}
+		GpuScope scope(profiler, "lighting");
+		if (shadowsEnabled) {
+			shadows.Bind(glState, deferred.PassShader(DEFERRED_FULLSCREEN));
+			shadows.Bind(glState, deferred.PassShader(DEFERRED_SPOT));
+		}
+		deferred.Light(glState, mainFramebuffer, viewProjection, shown.flashlightPos, lights.Block(), shaderFeatures);
+		profiler.SetCounter("light_volumes", (double)deferred.PointLightCount());
+		return;
+	}
+
+	if (shadowsEnabled) {
+		shadows.Bind(glState, shadowmapShader);
+		if (lightmap != 0) {
+			shadows.Bind(glState, lightmapShader);
+		}
+	}
+	if (lightmap != 0) {
+		glState.BindTexture(LIGHTMAP_UNIT, GL_TEXTURE_2D_ARRAY, lightmap);
+	}
+	{
+		GpuScope scope(profiler, "scene");
+		DrawScene();
+	}
+	if (occlusionCulling) {
+		// tested against this frame's depth, read from the next frame on
+		{
+			GpuScope scope(profiler, "occlusion");
+			occlusion.Issue(glState, scene, viewProjection, shown.cameraPos);
+		}
+		profiler.SetCounter("occlusion_queries", (double)occlusion.Queries());
+		profiler.SetCounter("occluded", (double)occlusion.Hidden());
+		profiler.SetCounter("occluded_triangles", (double)occlusion.HiddenTriangles());
+	}
 }
 
-void Demo::BuildTexturedCube()
+unsigned int Demo::BuildCubeMesh()
 {
-	// load image into texture memory
-	// ------------------------------
-	// Load and create a texture 
-	glGenTextures(1, &cube_texture);
-	glBindTexture(GL_TEXTURE_2D, cube_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	int width, height;
-	unsigned char* image = SOIL_load_image("pintuP.png", &width, &height, 0, SOIL_LOAD_RGBA);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	SOIL_free_image_data(image);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	glGenTextures(1, &stexture);
-	glBindTexture(GL_TEXTURE_2D, stexture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	image = SOIL_load_image("Spintu.png", &width, &height, 0, SOIL_LOAD_RGBA);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	SOIL_free_image_data(image);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
 	// set up vertex data (and buffer(s)) and configure vertex attributes
 	// ------------------------------------------------------------------
 	float vertices[] = {
@@ -267,101 +423,12 @@ void Demo::BuildTexturedCube()
 		20, 22, 21, 20, 23, 22   // bottom
 	};
 
-	glGenVertexArrays(1, &cubeVAO);
-	glGenBuffers(1, &cubeVBO);
-	glGenBuffers(1, &cubeEBO);
-	// bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-	glBindVertexArray(cubeVAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	// define position pointer layout 0
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(0 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(0);
-
-	// define texcoord pointer layout 1
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
-
-	// define normal pointer layout 2
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(5 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
-
-	// note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// You can unbind the VAO afterwards so other VAO calls won't accidentally modify this VAO, but this rarely happens. Modifying other
-	// VAOs requires a call to glBindVertexArray anyways so we generally don't unbind VAOs (nor VBOs) when it's not directly necessary.
-	glBindVertexArray(0);
-
-	// remember: do NOT unbind the EBO while a VAO is active as the bound element buffer object IS stored in the VAO; keep the EBO bound.
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// the scene copies it into its geometry arena
+	return scene.AddMesh(vertices, 24, indices, 36);
 }
 
-void Demo::DrawTexturedCube()
+unsigned int Demo::BuildPlaneMesh()
 {
-	UseShader(this->shadowmapShader);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, cube_texture);
-	glUniform1i(glGetUniformLocation(this->shadowmapShader, "material.diffuse"), 0);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, stexture);
-	glUniform1i(glGetUniformLocation(this->shadowmapShader, "material.specular"), 1);
-
-	GLint shininessMatLoc = glGetUniformLocation(this->shadowmapShader, "material.shininess");
-	glUniform1f(shininessMatLoc, 0.4f);
-
-	glBindVertexArray(cubeVAO); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
-
-	glm::mat4 model;
-
-	model = glm::translate(model, glm::vec3(0, 3, 0));
-
-	model = glm::rotate(model, angle, glm::vec3(0, 1, 0));
-
-	model = glm::scale(model, glm::vec3(3, 3, 3));
-
-	GLint modelLoc = glGetUniformLocation(this->shadowmapShader, "model");
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindVertexArray(0);
-}
-
-void Demo::BuildTexturedPlane()
-{
-	// Load and create a texture 
-	glGenTextures(1, &plane_texture);
-	glBindTexture(GL_TEXTURE_2D, plane_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	int width, height;
-	unsigned char* image = SOIL_load_image("lantai.png", &width, &height, 0, SOIL_LOAD_RGBA);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	SOIL_free_image_data(image);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	glGenTextures(1, &stexture2);
-	glBindTexture(GL_TEXTURE_2D, stexture2);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	image = SOIL_load_image("spekular_lantai.png", &width, &height, 0, SOIL_LOAD_RGBA);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	SOIL_free_image_data(image);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
 	// Build geometry
 	GLfloat vertices[] = {
 		// format position, tex coords
@@ -376,56 +443,185 @@ void Demo::BuildTexturedPlane()
 
 	GLuint indices[] = { 0,  2,  1,  0,  3,  2 };
 
-	glGenVertexArrays(1, &planeVAO);
-	glGenBuffers(1, &planeVBO);
-	glGenBuffers(1, &planeEBO);
-
-	glBindVertexArray(planeVAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	return scene.AddMesh(vertices, 4, indices, 6);
+}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, planeEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+void Demo::InitScene()
+{
+	// the software backend draws the meshes from their CPU copies, without an arena
+	scene.SetCpuOnly(backend == BACKEND_SOFTWARE);
+	if (!packagePath.empty() && LoadPackage(packagePath)) {
+		return;
+	}
 
-	// Position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), 0);
-	glEnableVertexAttribArray(0);
-	// TexCoord attribute
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
-	// Normal attribute
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(5 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
+	// load image into texture memory
+	// ------------------------------
+	// decoded in the background, a placeholder is bound until then
+	TextureOptions options;
+	SceneMaterial door;
+	door.diffuse = LoadTexture("pintuP.png", options);
+	options.placeholder[0] = options.placeholder[1] = options.placeholder[2] = 0;
+	door.specular = LoadTexture("Spintu.png", options);
+
+	options = TextureOptions();
+	options.mipmaps = true;
+	SceneMaterial floor;
+	floor.diffuse = LoadTexture("lantai.png", options);
+	options = TextureOptions();
+	options.placeholder[0] = options.placeholder[1] = options.placeholder[2] = 0;
+	floor.specular = LoadTexture("spekular_lantai.png", options);
+
+	scene.SetVertexFormat(vertexFormat);
+	// the baker unwraps and lights the meshes from their CPU copies
+	scene.SetKeepMeshData(lightmapsEnabled);
+	unsigned int cubeMesh = BuildCubeMesh();
+	unsigned int planeMesh = BuildPlaneMesh();
+	unsigned int doorMaterial = scene.AddMaterial(door);
+	unsigned int floorMaterial = scene.AddMaterial(floor);
+
+	const glm::vec3 up(0, 1, 0);
+	if (cubeInstanceCount == 1) {
+		Spinner spinner;
+		spinner.entity = scene.Create();
+		spinner.phase = 0.0f;
+		scene.AddRenderable(spinner.entity, cubeMesh, doorMaterial, glm::vec3(0, 3, 0), TransformSystem::AxisAngle(up, angle), glm::vec3(3, 3, 3));
+		scene.SetDynamic(spinner.entity, true);
+		spinners.push_back(spinner);
+	}
+	else {
+		// a square warehouse floor of crates, two units apart, each turned by its own phase;
+		// most stay put, every eighth one spins
+		int side = (int)std::ceil(std::sqrt((double)cubeInstanceCount));
+		float half = (side - 1) * 0.5f;
+		for (int i = 0; i < cubeInstanceCount; i++) {
+			Entity crate = scene.Create();
+			glm::vec3 position((i % side - half) * 2.0f, 0.0f, (i / side - half) * 2.0f);
+			scene.AddRenderable(crate, cubeMesh, doorMaterial, position, TransformSystem::AxisAngle(up, i * 0.37f), glm::vec3(1, 1, 1));
+			if (i % 8 == 0) {
+				Spinner spinner;
+				spinner.entity = crate;
+				spinner.phase = i * 0.37f;
+				scene.SetDynamic(crate, true);
+				spinners.push_back(spinner);
+			}
+		}
+	}
 
-	glBindVertexArray(0); // Unbind VAO
+	// the floor never moves, its instance is uploaded once
+	Entity floorEntity = scene.Create();
+	scene.AddRenderable(floorEntity, planeMesh, floorMaterial, glm::vec3(0, 0, 0), glm::vec4(0, 0, 0, 1), glm::vec3(1, 1, 1));
 }
 
-void Demo::DrawTexturedPlane()
+bool Demo::LoadPackage(const std::string& path)
 {
-	UseShader(this->shadowmapShader);
+	ScenePackage package;
+	unsigned int firstMesh;
+	if (!package.Open(path) || !scene.AddPackageMeshes(package, firstMesh)) {
+		std::cout << "ERROR::DEMO::PACKAGE_NOT_LOADED " << path << ", showing the built-in scene" << std::endl;
+		return false;
+	}
+	// texture paths are relative to the package
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+	std::vector<unsigned int> materials;
+	for (unsigned int i = 0; i < package.MaterialCount(); i++) {
+		const PackageMaterial& source = package.Material(i);
+		SceneMaterial material;
+		TextureOptions options;
+		options.mipmaps = (source.flags & SCENE_PACKAGE_MIPMAPS) != 0;
+		// without a map texture 0 stays bound, which samples as black: no specular highlight
+		if (source.diffuse != SCENE_PACKAGE_NO_STRING) {
+			material.diffuse = LoadTexture(directory + package.String(source.diffuse), options);
+		}
+		options.placeholder[0] = options.placeholder[1] = options.placeholder[2] = 0;
+		if (source.specular != SCENE_PACKAGE_NO_STRING) {
+			material.specular = LoadTexture(directory + package.String(source.specular), options);
+		}
+		material.shininess = source.shininess;
+		materials.push_back(scene.AddMaterial(material));
+	}
 
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, plane_texture);
-	glUniform1i(glGetUniformLocation(this->shadowmapShader, "material.diffuse"), 2);
+	for (unsigned int i = 0; i < package.RenderableCount(); i++) {
+		const PackageRenderable& source = package.Renderable(i);
+		scene.AddRenderable(scene.Create(), firstMesh + source.mesh, materials[source.material],
+			glm::make_vec3(source.position), glm::make_vec4(source.rotation), glm::make_vec3(source.scale));
+	}
 
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, stexture2);
-	glUniform1i(glGetUniformLocation(this->shadowmapShader, "material.specular"), 3);
+	// the package's rig replaces the four fixed point lights, see InitLights
+	for (unsigned int i = 0; i < package.LightCount(); i++) {
+		const PackageLight& source = package.Light(i);
+		PointLight light = {};
+		light.position = glm::make_vec3(source.position);
+		light.ambient = glm::make_vec3(source.ambient);
+		light.diffuse = glm::make_vec3(source.diffuse);
+		light.specular = glm::make_vec3(source.specular);
+		light.constant = source.constant;
+		light.linear = source.linear;
+		light.quadratic = source.quadratic;
+		scene.AddLight(scene.Create(), light);
+	}
+	return true;
+}
 
-	GLint shininessMatLoc = glGetUniformLocation(this->shadowmapShader, "material.shininess");
-	glUniform1f(shininessMatLoc, 0.4f);
+// the spotlight follows the flashlight of the shown snapshot
+void Demo::AimFlashlight()
+{
+	SpotLight spotLight = lights.Block().spotLight;
+	spotLight.position = shown.flashlightPos;
+	spotLight.direction = shown.flashlightDir;
+	lights.SetSpotLight(spotLight);
+}
 
-	glBindVertexArray(planeVAO); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
+void Demo::AnimateCrates()
+{
+	const glm::vec3 up(0, 1, 0);
+	for (const Spinner& spinner : spinners) {
+		scene.SetRotation(spinner.entity, TransformSystem::AxisAngle(up, shown.angle + spinner.phase));
+	}
+	profiler.SetCounter("transforms_updated", (double)scene.Update(&jobs));
+}
 
-	glm::mat4 model;
-	GLint modelLoc = glGetUniformLocation(this->shadowmapShader, "model");
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+// only what the BVH finds inside the view frustum is batched and drawn, each at the coarsest
+// level of detail that still looks the same from where it is seen
+void Demo::CullScene(const glm::mat4& projection, const glm::mat4& viewProjection)
+{
+	scene.SetLodProjection(projection, (float)this->screenHeight, lodPixels);
+	size_t visible = scene.Cull(Frustum(viewProjection), shown.cameraPos);
+	profiler.SetCounter("visible", (double)visible);
+	profiler.SetCounter("culled", (double)(scene.RenderableCount() - visible));
+	profiler.SetCounter("triangles", (double)scene.BatchTriangles());
+}
 
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+void Demo::DrawScene()
+{
+	// one instanced draw per batch from the shared VAO, ordered by program and material, then front to back
+	drawQueue.Clear();
+	for (const SceneBatch& batch : scene.Batches()) {
+		DrawCommand command;
+		command.program = scene.Material(batch.material).lightmapped ? lightmapShader.program : shadowmapShader.program;
+		command.material = batch.material;
+		command.mesh = &scene.Instances();
+		command.range = scene.LodRange(batch.mesh, batch.lod);
+		command.first = batch.first;
+		command.count = batch.count;
+		command.key = DrawQueue::Key(command.program, command.material, command.mesh->Vao(), batch.distance);
+		drawQueue.Submit(command);
+	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindVertexArray(0);
+	drawQueue.Execute(glState, [this](GLuint program, unsigned int materialId) {
+		const SceneMaterial& material = scene.Material(materialId);
+		glState.BindTexture(0, GL_TEXTURE_2D, material.diffuse);
+		glState.BindTexture(1, GL_TEXTURE_2D, material.specular);
+		// the shininess goes to the program the queue just bound for the material
+		if (program == lightmapShader.program) {
+			lightmapShader.Set(lightmapShininessUniform, material.shininess);
+		}
+		else {
+			shadowmapShader.Set(materialShininessUniform, material.shininess);
+		}
+	});
+	profiler.SetCounter("draw_calls", (double)drawQueue.Size());
 }
 
 void Demo::InitCamera()
@@ -439,11 +635,259 @@ void Demo::InitCamera()
 	upCamX = 0.0f;
 	upCamY = 1.0f;
 	upCamZ = 0.0f;
-	CAMERA_SPEED = 0.001f;
+	CAMERA_SPEED = 0.0004f;
 	fovy = 45.0f;
-	glfwSetInputMode(this->window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	// the flashlight hangs fixed above the door
+	flashlightPos = glm::vec3(0, 3, 3);
+	flashlightDir = glm::vec3(0, -1, -1);
+	// headless runs have no window to grab the cursor of
+	if (this->window != NULL) {
+		glfwSetInputMode(this->window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
+}
+
+// places the camera where the path is at the current simulated time
+void Demo::FollowCameraPath()
+{
+	size_t next = 0;
+	while (next < cameraPath.size() && cameraPath[next].time <= simulationTime) {
+		next++;
+	}
+	const CameraKey& from = cameraPath[next > 0 ? next - 1 : 0];
+	const CameraKey& to = cameraPath[next < cameraPath.size() ? next : cameraPath.size() - 1];
+	float t = to.time > from.time ? (float)((simulationTime - from.time) / (to.time - from.time)) : 0.0f;
+	glm::vec3 position = glm::mix(from.position, to.position, t);
+	glm::vec3 target = glm::mix(from.target, to.target, t);
+	posCamX = position.x;
+	posCamY = position.y;
+	posCamZ = position.z;
+	viewCamX = target.x;
+	viewCamY = target.y;
+	viewCamZ = target.z;
 }
 
+void Demo::InitLights()
+{
+	// the software backend only reads the block, it has no buffer to upload it to
+	if (backend == BACKEND_OPENGL) {
+		lights.Create();
+	}
+
+	DirLight dirLight = {};
+	dirLight.direction = glm::vec3(0.0f, -1.0f, -1.0f);
+	dirLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+	dirLight.diffuse = glm::vec3(0.1f, 0.1f, 0.1f);
+	dirLight.specular = glm::vec3(0.1f, 0.1f, 0.1f);
+	lights.SetDirLight(dirLight);
+
+	// position, ambient and diffuse/specular colour of the four point lights
+	const glm::vec3 pointLightData[NR_POINT_LIGHTS][3] = {
+		{ glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(1.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f) },
+		{ glm::vec3(-2.0f, 3.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+		{ glm::vec3(2.0f, 3.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+		{ glm::vec3(0.0f, 3.0f, 2.0f), glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(0.0f, 1.0f, 1.0f) },
+	};
+	// every point light is a light entity of the scene; clustered mode replaces the four fixed
+	// ones with a large field spread over the floor, a package with a rig of its own keeps it.
+	// Deferred shading takes the same field as light volumes instead of clusters.
+	if (clusteredLightCount > 0) {
+		if (!deferredShading && backend == BACKEND_OPENGL) {
+			clusteredLights.Create();
+		}
+		for (const PointLight& pointLight : ClusteredLights::ScatterLights(clusteredLightCount, 45.0f)) {
+			scene.AddLight(scene.Create(), pointLight);
+		}
+	}
+	else if (scene.Lights().empty()) {
+		for (int i = 0; i < NR_POINT_LIGHTS; i++) {
+			PointLight pointLight = {};
+			pointLight.position = pointLightData[i][0];
+			pointLight.ambient = pointLightData[i][1];
+			pointLight.diffuse = pointLightData[i][2];
+			pointLight.specular = pointLightData[i][2];
+			pointLight.constant = 1.0f;
+			pointLight.linear = 0.09f;
+			pointLight.quadratic = 0.032f;
+			scene.AddLight(scene.Create(), pointLight);
+		}
+	}
+	SyncLights();
+
+	SpotLight spotLight = {};
+	spotLight.ambient = glm::vec3(1.0f, 1.0f, 1.0f);
+	spotLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+	spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	spotLight.constant = 1.0f;
+	spotLight.linear = 0.09f;
+	spotLight.quadratic = 0.032f;
+	spotLight.cutOff = glm::cos(glm::radians(12.5f));
+	spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+	lights.SetSpotLight(spotLight);
+
+	if (backend == BACKEND_OPENGL) {
+		lights.Upload();
+	}
+}
+
+// Bakes what the directional and the point lights cast on the static renderables, or loads the
+// bake of an earlier run with the same scene, and switches those renderables to lightmapped
+// twins of their materials. Package meshes keep no CPU copy and stay lit per fragment.
+void Demo::InitLightmaps()
+{
+	// world matrices are only computed by an update
+	scene.Update(&jobs);
+	std::vector<Entity> statics, baked;
+	scene.Renderables(CASTERS_STATIC, statics);
+
+	LightmapBaker baker;
+	baker.SetLights(lights.Block().dirLight, scene.Lights());
+	const unsigned int none = 0xFFFFFFFFu;
+	std::vector<unsigned int> bakerMesh;
+	for (Entity entity : statics) {
+		unsigned int mesh, material;
+		glm::mat4 model;
+		if (!scene.Renderable(entity, mesh, material, model) || scene.Mesh(mesh).vertices.empty()) {
+			continue;
+		}
+		if (mesh >= bakerMesh.size()) {
+			bakerMesh.resize(mesh + 1, none);
+		}
+		if (bakerMesh[mesh] == none) {
+			const SceneMesh& source = scene.Mesh(mesh);
+			bakerMesh[mesh] = baker.AddMesh(source.vertices.data(), source.vertices.size() / GEOMETRY_VERTEX_FLOATS, source.indices.data(), source.range.indexCount);
+		}
+		baker.AddInstance(bakerMesh[mesh], model);
+		baked.push_back(entity);
+	}
+	if (baked.empty()) {
+		return;
+	}
+
+	if (!baker.Load(LIGHTMAP_FILE)) {
+		// the texture decodes queued by InitScene share the pool, the bake's jobs would only
+		// start once they are through, so they are waited for before the bake is timed
+		textures.Finish();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!baker.Bake(&jobs)) {
+			return;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Lightmap: baked " << baker.LitTexels() << " texels of " << baked.size() << " renderables into "
+			<< baker.Size() << "x" << baker.Size() << " in " << std::fixed << std::setprecision(1) << ms << " ms" << std::defaultfloat << std::endl;
+		baker.Save(LIGHTMAP_FILE);
+	}
+	lightmap = baker.CreateTexture();
+
+	for (unsigned int mesh = 0; mesh < bakerMesh.size(); mesh++) {
+		if (bakerMesh[mesh] != none) {
+			scene.SetLightmapCoords(mesh, baker.MeshCoords(bakerMesh[mesh]).data());
+		}
+	}
+	std::vector<unsigned int> twinOf;
+	for (unsigned int i = 0; i < baked.size(); i++) {
+		unsigned int mesh, material;
+		glm::mat4 model;
+		scene.Renderable(baked[i], mesh, material, model);
+		if (material >= twinOf.size()) {
+			twinOf.resize(material + 1, none);
+		}
+		if (twinOf[material] == none) {
+			SceneMaterial twin = scene.Material(material);
+			twin.lightmapped = true;
+			twinOf[material] = scene.AddMaterial(twin);
+		}
+		scene.SetMaterial(baked[i], twinOf[material]);
+		scene.SetLightmapTile(baked[i], baker.InstanceTile(i));
+	}
+}
+
+// a material texture: from the TextureLoader, or for the software backend decoded right away
+// into the rasterizer's own copy
+GLuint Demo::LoadTexture(const std::string& path, const TextureOptions& options)
+{
+	if (backend == BACKEND_SOFTWARE) {
+		return software.LoadTexture(path, options.mipmaps);
+	}
+	return textures.Load(path, options);
+}
+
+// the frame of BACKEND_SOFTWARE: culls like Render, draws the batches on the job threads without
+// any GL call and shows them in the window, if there is one
+void Demo::RenderSoftware()
+{
+	SyncLights();
+	AimFlashlight();
+	glm::mat4 projection = glm::perspective(shown.fovy, (GLfloat)this->screenWidth / (GLfloat)this->screenHeight, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(shown.cameraPos, shown.cameraTarget, shown.cameraUp);
+	AnimateCrates();
+	CullScene(projection, projection * view);
+
+	softwareDraws.clear();
+	const std::vector<InstanceTransform>& instances = scene.StagedInstances();
+	for (const SceneBatch& batch : scene.Batches()) {
+		const SceneMesh& mesh = scene.Mesh(batch.mesh);
+		// the scene is CPU only, its ranges index the mesh's copy
+		MeshRange range = scene.LodRange(batch.mesh, batch.lod);
+		SoftwareDraw draw;
+		draw.vertices = mesh.vertices.data();
+		draw.vertexCount = mesh.vertices.size() / GEOMETRY_VERTEX_FLOATS;
+		draw.indices = mesh.indices.data() + (range.firstIndex - mesh.range.firstIndex);
+		draw.indexCount = range.indexCount;
+		draw.instances = &instances[batch.first];
+		draw.instanceCount = batch.count;
+		draw.material = scene.Material(batch.material);
+		softwareDraws.push_back(draw);
+	}
+
+	software.SetLights(lights.Block(), lights.Features());
+	software.Render(softwareDraws, view, projection, shown.flashlightPos, &jobs);
+	profiler.SetCounter("raster_triangles", (double)software.Triangles());
+	profiler.SetCounter("raster_fragments", (double)software.Fragments());
+	if (glContext) {
+		software.Present(glState, mainFramebuffer);
+	}
+}
+
+// headless runs take the software backend's frame straight from the rasterizer
+void Demo::ReadFrame(std::vector<unsigned char>& pixels)
+{
+	if (backend == BACKEND_SOFTWARE) {
+		pixels = software.Pixels();
+		return;
+	}
+	RenderEngine::ReadFrame(pixels);
+}
+
+// copies the scene's light components to where the shader reads them, when they changed
+void Demo::SyncLights()
+{
+	if (scene.LightRevision() == sceneLightRevision) {
+		return;
+	}
+	sceneLightRevision = scene.LightRevision();
+	const std::vector<PointLight>& pointLights = scene.Lights();
+	if (deferredShading) {
+		deferred.SetPointLights(pointLights);
+		return;
+	}
+	if (clusteredLightCount > 0) {
+		if (backend == BACKEND_SOFTWARE) {
+			software.SetPointLights(pointLights);
+		}
+		else {
+			clusteredLights.SetLights(pointLights);
+		}
+		return;
+	}
+	// slots without a light stay dark, so the variant leaves them out
+	for (int i = 0; i < NR_POINT_LIGHTS; i++) {
+		PointLight pointLight = {};
+		if (i < (int)pointLights.size()) {
+			pointLight = pointLights[i];
+		}
+		lights.SetPointLight(i, pointLight);
+	}
+}
 
 void Demo::MoveCamera(float speed)
 {
@@ -478,7 +922,211 @@ void Demo::RotateCamera(float speed)
 	viewCamX = (float)(posCamX + glm::cos(speed) * x - glm::sin(speed) * z);
 }
 
+// the whole of text as a finite number, false for anything else
+static bool ParseNumber(const std::string& text, double& value)
+{
+	char* end = NULL;
+	value = strtod(text.c_str(), &end);
+	return !text.empty() && *end == '\0' && std::isfinite(value);
+}
+
+// the whole of text as a whole number that fits an int, false for anything else
+static bool ParseCount(const std::string& text, int& value)
+{
+	char* end = NULL;
+	long parsed = strtol(text.c_str(), &end, 10);
+	value = (int)parsed;
+	return !text.empty() && *end == '\0' && parsed >= INT_MIN && parsed <= INT_MAX;
+}
+
 int main(int argc, char** argv) {
-	RenderEngine &app = Demo();
-	app.Start("Multiple Lighting Demo", 800, 600, false, false);
+	int clusteredLightCount = 0, headlessFrames = 0, cubeInstanceCount = 1;
+	VertexFormat vertexFormat = VERTEX_PACKED;
+	std::string packagePath;
+	bool deferredShading = false, softwareRendering = false, shadows = true, lightmaps = false, occlusion = true;
+	float lodPixels = 1.0f;
+	double timestep = 1000.0 / 60.0, tick = SIMULATION_TICK_MS;
+	std::string reportPath, profilePath;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--bench" && i + 1 < argc) {
+			return RunBenchmark(argv[++i]);
+		}
+		else if (arg == "--bake") {
+			// offline step: "--bake [--bc1] lantai.png ..." writes lantai.btex, which the texture loader then prefers
+			bool compress = false, ok = true;
+			for (i++; i < argc; i++) {
+				std::string image = argv[i];
+				if (image == "--bc1") {
+					compress = true;
+				}
+				else {
+					ok = BakedTexture::Bake(image, BakedTexture::BakedPath(image), compress) && ok;
+				}
+			}
+			return ok ? 0 : 1;
+		}
+		else if (arg == "--import") {
+			// offline step: "--import [--vertex-format f] demo.obj ..." writes demo.spak for --package
+			bool ok = true;
+			for (i++; i < argc; i++) {
+				std::string source = argv[i];
+				if (source == "--vertex-format" && i + 1 < argc) {
+					if (!VertexLayout::Parse(argv[++i], vertexFormat)) {
+						std::cout << "Unknown vertex format: " << argv[i] << ", expected float, packed or quantized" << std::endl;
+						return 1;
+					}
+				}
+				else {
+					PackageContent content;
+					ok = ObjImporter::Import(source, content) && ScenePackage::Write(ScenePackage::PackagePath(source), content, vertexFormat) && ok;
+				}
+			}
+			return ok ? 0 : 1;
+		}
+		else if (arg == "--regress") {
+			// "--regress [--update] [--record-missing] [--only case] [--tolerance n] [--max-pixels share] [--max-slowdown share] [directory]"
+			// renders the scripted cases and compares them with the goldens in directory, and with its frame
+			// time baseline when a slowdown is given
+			RegressionOptions options;
+			for (i++; i < argc; i++) {
+				std::string option = argv[i];
+				if (option == "--update") {
+					options.update = true;
+				}
+				else if (option == "--record-missing") {
+					options.recordMissing = true;
+				}
+				else if (option == "--only" && i + 1 < argc) {
+					options.only = argv[++i];
+				}
+				else if (option == "--tolerance" && i + 1 < argc) {
+					options.tolerance = atoi(argv[++i]);
+				}
+				else if (option == "--max-pixels" && i + 1 < argc) {
+					options.maxDifferentPixels = atof(argv[++i]);
+				}
+				else if (option == "--max-slowdown" && i + 1 < argc) {
+					options.gateFrameTimes = true;
+					options.maxSlowdown = atof(argv[++i]);
+				}
+				else {
+					options.directory = option;
+				}
+			}
+			return RunRegression(options);
+		}
+		else if (arg == "--package" && i + 1 < argc) {
+			packagePath = argv[++i];
+		}
+		else if (arg == "--renderer" && i + 1 < argc) {
+			std::string renderer = argv[++i];
+			if (renderer != "forward" && renderer != "deferred" && renderer != "software") {
+				std::cout << "Unknown renderer: " << renderer << ", expected forward, deferred or software" << std::endl;
+				return 1;
+			}
+			deferredShading = renderer == "deferred";
+			softwareRendering = renderer == "software";
+		}
+		else if (arg == "--shadows" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (setting != "on" && setting != "off") {
+				std::cout << "Unknown shadow setting: " << setting << ", expected on or off" << std::endl;
+				return 1;
+			}
+			shadows = setting == "on";
+		}
+		else if (arg == "--occlusion" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (setting != "on" && setting != "off") {
+				std::cout << "Unknown occlusion setting: " << setting << ", expected on or off" << std::endl;
+				return 1;
+			}
+			occlusion = setting == "on";
+		}
+		else if (arg == "--lod-pixels" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			double pixels = 0.0;
+			if (!ParseNumber(setting, pixels) || pixels < 0.0) {
+				std::cout << "Unknown lod pixel setting: " << setting << ", expected a number of pixels, 0 or more" << std::endl;
+				return 1;
+			}
+			lodPixels = (float)pixels;
+		}
+		else if (arg == "--lightmaps" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (setting != "on" && setting != "off") {
+				std::cout << "Unknown lightmap setting: " << setting << ", expected on or off" << std::endl;
+				return 1;
+			}
+			lightmaps = setting == "on";
+		}
+		else if (arg == "--lights" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (!ParseCount(setting, clusteredLightCount) || clusteredLightCount < 0) {
+				std::cout << "Unknown light count: " << setting << ", expected a whole number, 0 or more" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--instances" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (!ParseCount(setting, cubeInstanceCount) || cubeInstanceCount <= 0) {
+				std::cout << "Unknown instance count: " << setting << ", expected a whole number, 1 or more" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--vertex-format" && i + 1 < argc) {
+			if (!VertexLayout::Parse(argv[++i], vertexFormat)) {
+				std::cout << "Unknown vertex format: " << argv[i] << ", expected float, packed or quantized" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--headless" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (!ParseCount(setting, headlessFrames) || headlessFrames <= 0) {
+				std::cout << "Unknown headless frame count: " << setting << ", expected a whole number, 1 or more" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--timestep" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (!ParseNumber(setting, timestep) || timestep <= 0.0) {
+				std::cout << "Unknown timestep: " << setting << ", expected milliseconds, more than 0" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--tick" && i + 1 < argc) {
+			std::string setting = argv[++i];
+			if (!ParseNumber(setting, tick) || tick <= 0.0) {
+				std::cout << "Unknown tick: " << setting << ", expected milliseconds, more than 0" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--report" && i + 1 < argc) {
+			reportPath = argv[++i];
+		}
+		else if (arg == "--profile" && i + 1 < argc) {
+			profilePath = argv[++i];
+		}
+	}
+
+	Demo app;
+	app.SetClusteredLightCount(clusteredLightCount);
+	app.SetCubeInstanceCount(cubeInstanceCount);
+	app.SetVertexFormat(vertexFormat);
+	app.SetPackage(packagePath);
+	app.SetDeferredShading(deferredShading);
+	app.SetShadows(shadows);
+	app.SetOcclusionCulling(occlusion);
+	app.SetLodPixels(lodPixels);
+	app.SetLightmaps(lightmaps);
+	app.SetBackend(softwareRendering ? BACKEND_SOFTWARE : BACKEND_OPENGL);
+	app.SetProfileOutput(profilePath);
+	app.SetSimulationTick(tick);
+	if (headlessFrames > 0) {
+		app.StartHeadless(800, 600, headlessFrames, timestep, reportPath);
+	}
+	else {
+		app.Start("Multiple Lighting Demo", 800, 600, false, false);
+	}
 }
\ No newline at end of file
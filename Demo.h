@@ -1,33 +1,146 @@
 #pragma once
 #include "RenderEngine.h"
+#include "LightSet.h"
+#include "ClusteredLights.h"
+#include "DeferredRenderer.h"
+#include "OcclusionCuller.h"
+#include "Scene.h"
+#include "ShadowMaps.h"
+#include "SoftwareRenderer.h"
+#include "TripleBuffer.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/vector_angle.hpp>
 #include <SOIL/SOIL.h>
 
+// a point of a scripted camera path: where the eye is and what it looks at, at a simulated time in ms
+struct CameraKey
+{
+	double time;
+	glm::vec3 position, target;
+};
+
 class Demo :
 	public RenderEngine
 {
 public:
 	Demo();
 	~Demo();
+	// more than zero switches phase 2 of the shader to clustered forward lighting with this many point lights
+	void SetClusteredLightCount(int count) { clusteredLightCount = count; }
+	// more than one replaces the spinning cube with a warehouse of that many crates
+	void SetCubeInstanceCount(int count) { cubeInstanceCount = count > 0 ? count : 1; }
+	void SetVertexFormat(VertexFormat format) { vertexFormat = format; }
+	// a scene package to show instead of the built-in door and floor, see ObjImporter
+	void SetPackage(const std::string& path) { packagePath = path; }
+	// light the scene with DeferredRenderer instead of in multipleLight.frag
+	void SetDeferredShading(bool deferred) { deferredShading = deferred; }
+	void SetShadows(bool enabled) { shadowsEnabled = enabled; }
+	// skip the renderables hidden behind others, found by occlusion queries; forward shading only
+	void SetOcclusionCulling(bool enabled) { occlusionCulling = enabled; }
+	// error in pixels a renderable's level of detail may show at its distance, 0 draws full meshes
+	void SetLodPixels(float pixels) { lodPixels = pixels; }
+	// bake the directional and point lights into lightmaps of the static renderables, forward
+	// shading only; the bake is cached in LIGHTMAP_FILE
+	void SetLightmaps(bool enabled) { lightmapsEnabled = enabled; }
+	// the camera follows path, linearly between keys and held before the first and after the
+	// last, instead of the input; keys are in time order
+	void SetCameraPath(const std::vector<CameraKey>& path) { cameraPath = path; }
 private:
-	GLuint shadowmapShader, cubeVBO, cubeVAO, cubeEBO, cube_texture, planeVBO, planeVAO, planeEBO, plane_texture, stexture, stexture2;
+	// texture unit of the lightmap atlas, above the shadow maps
+	static const GLuint LIGHTMAP_UNIT = 8;
+	// the variant of multipleLight for shaderFeatures, or the G-buffer writer when shading is
+	// deferred; owned by the engine's variant cache
+	Shader shadowmapShader;
+	LightFeatures shaderFeatures;
+	// handles resolved from the reflected uniform table whenever the variant changes
+	Uniform<glm::mat4> viewProjectionUniform;
+	Uniform<glm::vec3> viewPosUniform;
+	Uniform<int> materialDiffuseUniform, materialSpecularUniform;
+	Uniform<float> materialShininessUniform;
+	LightSet lights;
+	ClusteredLights clusteredLights;
+	int clusteredLightCount = 0;
+	DeferredRenderer deferred;
+	bool deferredShading = false;
+	// cascades for the directional light and a map for the flashlight, the spinning crates are
+	// the only dynamic casters
+	ShadowMaps shadows;
+	bool shadowsEnabled = true;
+	OcclusionCuller occlusion;
+	bool occlusionCulling = true;
+	float lodPixels = 1.0f;
+	// what the lightmapped renderables are drawn with: the variant without the static lights'
+	// phases, reading them from the lightmap instead
+	Shader lightmapShader;
+	Uniform<glm::mat4> lightmapViewProjectionUniform;
+	Uniform<glm::vec3> lightmapViewPosUniform;
+	Uniform<float> lightmapShininessUniform;
+	GLuint lightmap = 0;
+	bool lightmapsEnabled = false;
+	// BACKEND_SOFTWARE draws with the CPU rasterizer on the job threads, from a CPU only scene and
+	// textures it decodes itself; shadows, lightmaps, deferred shading and occlusion culling are off.
+	// The draws of the frame.
+	SoftwareRenderer software;
+	std::vector<SoftwareDraw> softwareDraws;
+	// every mesh, material, crate and point light of the demo
+	Scene scene;
+	// crates turned by Render, each with its own phase
+	struct Spinner
+	{
+		Entity entity;
+		float phase;
+	};
+	std::vector<Spinner> spinners;
+	int cubeInstanceCount = 1;
+	VertexFormat vertexFormat = VERTEX_PACKED;
+	std::string packagePath;
+	// scene light revision last copied into the light block or the clusters
+	unsigned int sceneLightRevision = 0;
+	// simulation thread only: the camera, CAMERA_SPEED is a fraction of the view vector per ms
 	float viewCamX, viewCamY, viewCamZ, upCamX, upCamY, upCamZ, posCamX, posCamY, posCamZ, CAMERA_SPEED, fovy;
 	float angle = 0;
+	glm::vec3 flashlightPos, flashlightDir;
+	std::vector<CameraKey> cameraPath;
+	// what a tick hands to the renderer: the camera, the crates' spin and the flashlight
+	struct Snapshot
+	{
+		double time;
+		glm::vec3 cameraPos, cameraTarget, cameraUp;
+		float fovy;
+		float angle;
+		glm::vec3 flashlightPos, flashlightDir;
+	};
+	TripleBuffer<Snapshot> snapshots;
+	// render thread only: the two newest snapshots and the blend of them the frame shows
+	Snapshot previous, current, shown;
 	virtual void Init();
 	virtual void DeInit();
+	virtual void ProcessInput(const InputState& input);
 	virtual void Update(double deltaTime);
+	virtual void Interpolate(double renderTime);
 	virtual void Render();
-	virtual void ProcessInput(GLFWwindow *window);
-	void BuildTexturedCube();
-	void BuildTexturedPlane();
-	void DrawTexturedCube();
-	void DrawTexturedPlane();
+	virtual void RenderSoftware();
+	virtual void ReadFrame(std::vector<unsigned char>& pixels);
+	void TakeSnapshot(Snapshot& snapshot) const;
+	void InitScene();
+	bool LoadPackage(const std::string& path);
+	GLuint LoadTexture(const std::string& path, const TextureOptions& options);
+	unsigned int BuildCubeMesh();
+	unsigned int BuildPlaneMesh();
+	void AimFlashlight();
+	void AnimateCrates();
+	void CullScene(const glm::mat4& projection, const glm::mat4& viewProjection);
+	void SyncLights();
+	void DrawScene();
 	void MoveCamera(float speed);
 	void StrafeCamera(float speed);
 	void RotateCamera(float speed);
 	void InitCamera();
+	void FollowCameraPath();
+	void InitLights();
+	void InitLightmaps();
+	void SelectShader(const LightFeatures& features);
 };
 
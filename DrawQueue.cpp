@@ -0,0 +1,41 @@
+#include "DrawQueue.h"
+#include <algorithm>
+
+unsigned long long DrawQueue::Key(GLuint program, unsigned int material, GLuint vao, float depth)
+{
+	// depth / (depth + 1) maps [0, inf) onto [0, 1) monotonically, no far plane needed
+	float clamped = depth > 0.0f ? depth : 0.0f;
+	unsigned long long quantized = (unsigned long long)(clamped / (clamped + 1.0f) * 16777215.0f);
+	return ((unsigned long long)(program & 0x3FF) << 54)
+		| ((unsigned long long)(material & 0xFFFF) << 38)
+		| ((unsigned long long)(vao & 0x3FFF) << 24)
+		| (quantized & 0xFFFFFF);
+}
+
+void DrawQueue::Execute(GLState& state, const std::function<void(GLuint program, unsigned int material)>& bindMaterial)
+{
+	std::sort(commands.begin(), commands.end(), [](const DrawCommand& a, const DrawCommand& b) {
+		return a.key < b.key;
+	});
+
+	programChanges = materialChanges = 0;
+	GLuint program = 0;
+	unsigned int material = 0;
+	for (size_t i = 0; i < commands.size(); i++) {
+		const DrawCommand& command = commands[i];
+		bool programChanged = i == 0 || command.program != program;
+		if (programChanged) {
+			state.UseProgram(command.program);
+			program = command.program;
+			programChanges++;
+		}
+		// material uniforms belong to the program, so a new program needs them again
+		if (programChanged || command.material != material) {
+			bindMaterial(command.program, command.material);
+			material = command.material;
+			materialChanges++;
+		}
+		state.BindVertexArray(command.mesh->Vao());
+		command.mesh->DrawBound(command.range, command.first, command.count);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "GLState.h"
+#include "InstancedMesh.h"
+
+// One instanced draw. The key decides the submission order, see DrawQueue::Key.
+struct DrawCommand
+{
+	unsigned long long key = 0;
+	GLuint program = 0;
+	// handed back to the material callback, which binds its textures and uniforms
+	unsigned int material = 0;
+	// instance buffer and VAO to draw from, and the indexed mesh in it
+	InstancedMesh* mesh = NULL;
+	MeshRange range;
+	size_t first = 0, count = 0;
+};
+
+// Collects a frame's draws and issues them sorted by a 64 bit key, so draws sharing a program,
+// then a material, then a VAO end up next to each other and most state changes are filtered
+// out by GLState. Within equal state the draws go front to back.
+class DrawQueue
+{
+public:
+	// program in the top 10 bits, material in the next 16, VAO in the next 14 and view depth in
+	// the low 24; wider ids only lose ordering, never correctness
+	static unsigned long long Key(GLuint program, unsigned int material, GLuint vao, float depth);
+
+	void Clear() { commands.clear(); }
+	void Submit(const DrawCommand& command) { commands.push_back(command); }
+	size_t Size() const { return commands.size(); }
+
+	// sorts and issues every draw; bindMaterial is called after the program is bound, whenever
+	// the program or the material differs from the previous draw's
+	void Execute(GLState& state, const std::function<void(GLuint program, unsigned int material)>& bindMaterial);
+
+	// state changes the last Execute asked for after sorting
+	unsigned int ProgramChanges() const { return programChanges; }
+	unsigned int MaterialChanges() const { return materialChanges; }
+
+private:
+	std::vector<DrawCommand> commands;
+	unsigned int programChanges = 0, materialChanges = 0;
+};
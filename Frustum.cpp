@@ -0,0 +1,105 @@
+#include "Frustum.h"
+#include <cmath>
+
+AABB AABB::FromVertices(const float* vertices, size_t vertexCount, size_t stride, size_t offset)
+{
+	if (vertexCount == 0) {
+		return AABB();
+	}
+	const float* position = vertices + offset;
+	AABB box(glm::vec3(position[0], position[1], position[2]), glm::vec3(position[0], position[1], position[2]));
+	for (size_t i = 1; i < vertexCount; i++) {
+		position = vertices + i * stride + offset;
+		box.min = glm::min(box.min, glm::vec3(position[0], position[1], position[2]));
+		box.max = glm::max(box.max, glm::vec3(position[0], position[1], position[2]));
+	}
+	return box;
+}
+
+float AABB::SurfaceArea() const
+{
+	glm::vec3 size = max - min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool AABB::Contains(const AABB& other) const
+{
+	return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+		&& max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+}
+
+AABB AABB::Union(const AABB& other) const
+{
+	return AABB(glm::min(min, other.min), glm::max(max, other.max));
+}
+
+AABB AABB::Expanded(float margin) const
+{
+	return AABB(min - glm::vec3(margin), max + glm::vec3(margin));
+}
+
+// Arvo: the new extent along each axis is the extent projected onto the absolute rotated axes
+AABB AABB::Transformed(const glm::mat4& transform) const
+{
+	glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+	glm::vec3 extent = Extent();
+	glm::vec3 newExtent(0.0f);
+	for (int column = 0; column < 3; column++) {
+		newExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+	}
+	return AABB(center - newExtent, center + newExtent);
+}
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 6; i++) {
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+// Gribb and Hartmann: each plane is the last row of the matrix plus or minus one of the others
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; row++) {
+		rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		planes[axis * 2] = rows[3] + rows[axis];
+		planes[axis * 2 + 1] = rows[3] - rows[axis];
+	}
+	for (int i = 0; i < 6; i++) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+Frustum::Result Frustum::Test(const AABB& box, unsigned int& planeMask) const
+{
+	glm::vec3 center = box.Center();
+	glm::vec3 extent = box.Extent();
+	for (int i = 0; i < 6; i++) {
+		if (!(planeMask & (1u << i))) {
+			continue;
+		}
+		glm::vec3 normal = glm::vec3(planes[i]);
+		float distance = glm::dot(normal, center) + planes[i].w;
+		float radius = glm::dot(glm::abs(normal), extent);
+		if (distance + radius < 0.0f) {
+			return OUTSIDE;
+		}
+		if (distance - radius >= 0.0f) {
+			planeMask &= ~(1u << i);
+		}
+	}
+	return planeMask == 0 ? INSIDE : INTERSECTING;
+}
+
+bool Frustum::operator==(const Frustum& other) const
+{
+	for (int i = 0; i < 6; i++) {
+		if (planes[i] != other.planes[i]) {
+			return false;
+		}
+	}
+	return true;
+}
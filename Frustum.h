@@ -0,0 +1,46 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Axis aligned bounding box
+struct AABB
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	AABB() {}
+	AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+	// bounds of the positions in an interleaved vertex array, stride and offset in floats
+	static AABB FromVertices(const float* vertices, size_t vertexCount, size_t stride, size_t offset = 0);
+
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	glm::vec3 Extent() const { return (max - min) * 0.5f; }
+	float SurfaceArea() const;
+	bool Contains(const AABB& other) const;
+	AABB Union(const AABB& other) const;
+	AABB Expanded(float margin) const;
+	// smallest box around this one after the transform, without touching the eight corners
+	AABB Transformed(const glm::mat4& transform) const;
+};
+
+// The six planes of a view frustum, pointing inwards, extracted from a view projection matrix.
+// The default frustum has no planes that reject anything.
+class Frustum
+{
+public:
+	enum Result { OUTSIDE, INTERSECTING, INSIDE };
+	static const unsigned int ALL_PLANES = 0x3F;
+
+	Frustum();
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	// planeMask selects the planes still to test; the planes the box is fully inside of are
+	// cleared from it, so children of a node only test what their parent straddled
+	Result Test(const AABB& box, unsigned int& planeMask) const;
+	bool operator==(const Frustum& other) const;
+	bool operator!=(const Frustum& other) const { return !(*this == other); }
+
+private:
+	glm::vec4 planes[6];
+};
@@ -0,0 +1,119 @@
+#include "GLState.h"
+#include <cstddef>
+
+const GLuint GLState::UNKNOWN;
+
+GLState::GLState()
+{
+	Invalidate();
+}
+
+void GLState::Invalidate()
+{
+	program = vao = UNKNOWN;
+	polygonMode = UNKNOWN;
+	for (Capability& capability : capabilities) {
+		capability.enabled = UNKNOWN;
+	}
+	InvalidateTextures();
+}
+
+void GLState::InvalidateTextures()
+{
+	activeUnit = UNKNOWN;
+	for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+		texture2D[unit] = textureBuffer[unit] = UNKNOWN;
+	}
+}
+
+bool GLState::Change(GLuint& current, GLuint value)
+{
+	if (current == value) {
+		redundant++;
+		return false;
+	}
+	current = value;
+	issued++;
+	return true;
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (Change(this->program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	if (Change(this->vao, vao)) {
+		glBindVertexArray(vao);
+	}
+}
+
+void GLState::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	GLuint* binding = NULL;
+	if (unit < GL_STATE_TEXTURE_UNITS) {
+		if (target == GL_TEXTURE_2D) {
+			binding = &texture2D[unit];
+		}
+		else if (target == GL_TEXTURE_BUFFER) {
+			binding = &textureBuffer[unit];
+		}
+	}
+	if (binding != NULL && *binding == texture) {
+		redundant++;
+		return;
+	}
+	// the active unit only matters for the bind, so it is switched lazily
+	if (Change(activeUnit, unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	glBindTexture(target, texture);
+	issued++;
+	if (binding != NULL) {
+		*binding = texture;
+	}
+}
+
+void GLState::SetCapability(GLenum name, GLuint enabled)
+{
+	Capability* capability = NULL;
+	for (Capability& known : capabilities) {
+		if (known.name == name) {
+			capability = &known;
+			break;
+		}
+	}
+	if (capability == NULL) {
+		Capability added = { name, UNKNOWN };
+		capabilities.push_back(added);
+		capability = &capabilities.back();
+	}
+	if (Change(capability->enabled, enabled)) {
+		if (enabled) {
+			glEnable(name);
+		}
+		else {
+			glDisable(name);
+		}
+	}
+}
+
+void GLState::Enable(GLenum capability)
+{
+	SetCapability(capability, 1);
+}
+
+void GLState::Disable(GLenum capability)
+{
+	SetCapability(capability, 0);
+}
+
+void GLState::PolygonMode(GLenum mode)
+{
+	if (Change(polygonMode, mode)) {
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <vector>
+
+// texture units whose bindings are tracked, above this every bind is issued
+#define GL_STATE_TEXTURE_UNITS 16
+
+// Shadow copy of the GL state the renderer changes most: program, VAO, texture bindings,
+// enabled capabilities and polygon mode. Calls that would set what is already set are dropped
+// and counted, the rest go to GL. Code that changes this state with direct GL calls has to
+// Invalidate afterwards, the next call of each kind is then issued unconditionally.
+class GLState
+{
+public:
+	GLState();
+
+	void Invalidate();
+	// only the texture bindings and the active unit, after a texture upload
+	void InvalidateTextures();
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vao);
+	// GL_TEXTURE_2D and GL_TEXTURE_BUFFER are tracked per unit, other targets are always issued
+	void BindTexture(GLuint unit, GLenum target, GLuint texture);
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	// for GL_FRONT_AND_BACK, the only face core profiles accept
+	void PolygonMode(GLenum mode);
+
+	// calls that reached GL and calls that were dropped since the last ResetCounters
+	unsigned int Issued() const { return issued; }
+	unsigned int Redundant() const { return redundant; }
+	void ResetCounters() { issued = redundant = 0; }
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+	GLuint program, vao, activeUnit;
+	GLuint texture2D[GL_STATE_TEXTURE_UNITS], textureBuffer[GL_STATE_TEXTURE_UNITS];
+	GLenum polygonMode;
+	// capability and whether it is enabled, UNKNOWN once invalidated
+	struct Capability { GLenum name; GLuint enabled; };
+	std::vector<Capability> capabilities;
+	unsigned int issued = 0, redundant = 0;
+
+	void SetCapability(GLenum capability, GLuint enabled);
+	// true if the value changed and the call has to be issued
+	bool Change(GLuint& current, GLuint value);
+};
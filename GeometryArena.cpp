@@ -0,0 +1,208 @@
+#include "GeometryArena.h"
+#include <algorithm>
+
+const size_t RangeAllocator::FAILED;
+
+void RangeAllocator::Reset(size_t capacity)
+{
+	blocks.clear();
+	this->capacity = 0;
+	used = 0;
+	Grow(capacity);
+}
+
+void RangeAllocator::Grow(size_t capacity)
+{
+	if (capacity <= this->capacity) {
+		return;
+	}
+	size_t added = capacity - this->capacity;
+	// extend a free block that already reaches the old end instead of adding a neighbour
+	if (!blocks.empty() && blocks.back().offset + blocks.back().size == this->capacity) {
+		blocks.back().size += added;
+	}
+	else {
+		Block block = { this->capacity, added };
+		blocks.push_back(block);
+	}
+	this->capacity = capacity;
+}
+
+size_t RangeAllocator::Allocate(size_t size)
+{
+	if (size == 0) {
+		return 0;
+	}
+	for (size_t i = 0; i < blocks.size(); i++) {
+		if (blocks[i].size >= size) {
+			size_t offset = blocks[i].offset;
+			blocks[i].offset += size;
+			blocks[i].size -= size;
+			if (blocks[i].size == 0) {
+				blocks.erase(blocks.begin() + i);
+			}
+			used += size;
+			return offset;
+		}
+	}
+	return FAILED;
+}
+
+void RangeAllocator::Free(size_t offset, size_t size)
+{
+	if (size == 0) {
+		return;
+	}
+	std::vector<Block>::iterator next = std::lower_bound(blocks.begin(), blocks.end(), offset, [](const Block& block, size_t offset) {
+		return block.offset < offset;
+	});
+	bool mergePrevious = next != blocks.begin() && (next - 1)->offset + (next - 1)->size == offset;
+	bool mergeNext = next != blocks.end() && offset + size == next->offset;
+	if (mergePrevious && mergeNext) {
+		(next - 1)->size += size + next->size;
+		blocks.erase(next);
+	}
+	else if (mergePrevious) {
+		(next - 1)->size += size;
+	}
+	else if (mergeNext) {
+		next->offset = offset;
+		next->size += size;
+	}
+	else {
+		Block block = { offset, size };
+		blocks.insert(next, block);
+	}
+	used -= size;
+}
+
+void GeometryArena::Create(VertexFormat format, size_t vertexCapacity, size_t indexCapacity)
+{
+	this->format = format;
+	vertexSpace.Reset(vertexCapacity);
+	indexSpace.Reset(indexCapacity);
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vertexBuffer);
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * VertexLayout::Stride(format), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	PointAttributes();
+}
+
+void GeometryArena::Delete()
+{
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &lightmapBuffer);
+	vao = vertexBuffer = indexBuffer = lightmapBuffer = 0;
+	vertexSpace.Reset(0);
+	indexSpace.Reset(0);
+	packed.clear();
+	packed.shrink_to_fit();
+}
+
+void GeometryArena::PointAttributes()
+{
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	VertexLayout::PointAttributes(format);
+	if (lightmapBuffer != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, lightmapBuffer);
+		glVertexAttribPointer(GEOMETRY_LIGHTMAP_LOCATION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+		glEnableVertexAttribArray(GEOMETRY_LIGHTMAP_LOCATION);
+	}
+	// the element buffer binding is VAO state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GLuint GeometryArena::Resize(GLuint buffer, size_t oldBytes, size_t newBytes)
+{
+	GLuint resized;
+	glGenBuffers(1, &resized);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+	if (oldBytes > 0) {
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+	return resized;
+}
+
+MeshRange GeometryArena::Add(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, GLsizei indexCount)
+{
+	packed.resize(vertexCount * VertexLayout::Stride(format));
+	VertexLayout::Pack(format, vertices, vertexCount, packed.data());
+	return AddPacked(packed.data(), vertexCount, indices, indexCount);
+}
+
+MeshRange GeometryArena::AddPacked(const void* vertices, size_t vertexCount, const GLuint* indices, GLsizei indexCount)
+{
+	const size_t vertexBytes = VertexLayout::Stride(format);
+	bool resized = false;
+
+	size_t firstVertex = vertexSpace.Allocate(vertexCount);
+	if (firstVertex == RangeAllocator::FAILED) {
+		size_t capacity = std::max(vertexSpace.Capacity() * 2, vertexSpace.Capacity() + vertexCount);
+		vertexBuffer = Resize(vertexBuffer, vertexSpace.Capacity() * vertexBytes, capacity * vertexBytes);
+		if (lightmapBuffer != 0) {
+			lightmapBuffer = Resize(lightmapBuffer, vertexSpace.Capacity() * 2 * sizeof(GLfloat), capacity * 2 * sizeof(GLfloat));
+		}
+		vertexSpace.Grow(capacity);
+		firstVertex = vertexSpace.Allocate(vertexCount);
+		resized = true;
+	}
+	size_t firstIndex = indexSpace.Allocate(indexCount);
+	if (firstIndex == RangeAllocator::FAILED) {
+		size_t capacity = std::max(indexSpace.Capacity() * 2, indexSpace.Capacity() + indexCount);
+		indexBuffer = Resize(indexBuffer, indexSpace.Capacity() * sizeof(GLuint), capacity * sizeof(GLuint));
+		indexSpace.Grow(capacity);
+		firstIndex = indexSpace.Allocate(indexCount);
+		resized = true;
+	}
+	// a new buffer has to be attached to the VAO again
+	if (resized) {
+		PointAttributes();
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * vertexBytes, vertexCount * vertexBytes, vertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(GLuint), indexCount * sizeof(GLuint), indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	MeshRange range;
+	range.firstVertex = firstVertex;
+	range.vertexCount = vertexCount;
+	range.firstIndex = firstIndex;
+	range.indexCount = indexCount;
+	return range;
+}
+
+void GeometryArena::SetLightmapCoords(const MeshRange& range, const GLfloat* coords)
+{
+	if (lightmapBuffer == 0) {
+		glGenBuffers(1, &lightmapBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, lightmapBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexSpace.Capacity() * 2 * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+		PointAttributes();
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, lightmapBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstVertex * 2 * sizeof(GLfloat), range.vertexCount * 2 * sizeof(GLfloat), coords);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryArena::Remove(const MeshRange& range)
+{
+	vertexSpace.Free(range.firstVertex, range.vertexCount);
+	indexSpace.Free(range.firstIndex, range.indexCount);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <cstddef>
+#include <vector>
+#include "VertexFormat.h"
+
+// attribute location of the optional second tex coords, see GeometryArena::SetLightmapCoords
+#define GEOMETRY_LIGHTMAP_LOCATION 10
+
+// First fit allocator of ranges in [0, capacity). Free blocks are kept sorted by offset and
+// merged with their neighbours on Free, so freed ranges are reused before the end grows.
+class RangeAllocator
+{
+public:
+	static const size_t FAILED = (size_t)-1;
+
+	void Reset(size_t capacity);
+	// adds [old capacity, capacity) to the free space
+	void Grow(size_t capacity);
+	// offset of a free range of size elements, FAILED if none is large enough
+	size_t Allocate(size_t size);
+	void Free(size_t offset, size_t size);
+
+	size_t Capacity() const { return capacity; }
+	size_t Used() const { return used; }
+	size_t FreeBlocks() const { return blocks.size(); }
+
+private:
+	struct Block { size_t offset, size; };
+	std::vector<Block> blocks;
+	size_t capacity = 0, used = 0;
+};
+
+// where a mesh lives in the arena; indices are relative to baseVertex
+struct MeshRange
+{
+	size_t firstVertex = 0, vertexCount = 0;
+	size_t firstIndex = 0;
+	GLsizei indexCount = 0;
+};
+
+// One vertex buffer, one index buffer and one VAO shared by every mesh. Meshes are sub allocated
+// ranges of the two buffers and drawn with glDrawElements*BaseVertex, so switching meshes is an
+// offset instead of a VAO bind. Buffers grow by copying into a buffer twice as large. Vertices
+// are stored in the arena's VertexFormat.
+class GeometryArena
+{
+public:
+	// capacities are in vertices and indices
+	void Create(VertexFormat format, size_t vertexCapacity, size_t indexCapacity);
+	void Delete();
+
+	// vertices hold GEOMETRY_VERTEX_FLOATS floats each and are packed into the arena's format,
+	// indices start at 0 for the mesh's first vertex
+	MeshRange Add(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, GLsizei indexCount);
+	// same for vertices already in the arena's format, copied to GL as they are
+	MeshRange AddPacked(const void* vertices, size_t vertexCount, const GLuint* indices, GLsizei indexCount);
+	// frees the ranges for the next Add, the data is left in place
+	void Remove(const MeshRange& range);
+	// second tex coords of range's vertices, 2 floats each, read at GEOMETRY_LIGHTMAP_LOCATION;
+	// their buffer is created by the first call and grows with the vertex buffer
+	void SetLightmapCoords(const MeshRange& range, const GLfloat* coords);
+
+	// holds the vertex attributes and the element buffer; other attributes may be added by the owner
+	GLuint Vao() const { return vao; }
+	VertexFormat Format() const { return format; }
+	size_t VertexCapacity() const { return vertexSpace.Capacity(); }
+	size_t IndexCapacity() const { return indexSpace.Capacity(); }
+	size_t VerticesUsed() const { return vertexSpace.Used(); }
+	size_t IndicesUsed() const { return indexSpace.Used(); }
+
+private:
+	GLuint vao = 0, vertexBuffer = 0, indexBuffer = 0;
+	GLuint lightmapBuffer = 0;
+	VertexFormat format = VERTEX_FLOAT;
+	// vertices of the current Add in the arena's format
+	std::vector<unsigned char> packed;
+	RangeAllocator vertexSpace, indexSpace;
+
+	// new buffer of newBytes holding a copy of the old one's oldBytes, the old one is deleted
+	static GLuint Resize(GLuint buffer, size_t oldBytes, size_t newBytes);
+	void PointAttributes();
+};
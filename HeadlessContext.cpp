@@ -0,0 +1,111 @@
+#include "HeadlessContext.h"
+#include <iostream>
+
+#ifdef _WIN32
+
+bool HeadlessContext::Create()
+{
+	glfwInit();
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	hiddenWindow = glfwCreateWindow(1, 1, "", NULL, NULL);
+	if (hiddenWindow == NULL) {
+		std::cout << "ERROR::HEADLESS_CONTEXT::WINDOW_NOT_CREATED" << std::endl;
+		return false;
+	}
+	glfwMakeContextCurrent(hiddenWindow);
+	return true;
+}
+
+void HeadlessContext::Destroy()
+{
+	glfwDestroyWindow(hiddenWindow);
+	hiddenWindow = NULL;
+	glfwTerminate();
+}
+
+void* HeadlessContext::GetProcAddress(const char* name)
+{
+	return (void*)glfwGetProcAddress(name);
+}
+
+#else
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+bool HeadlessContext::Create()
+{
+	// prefer Mesa's surfaceless platform, it needs neither X11, Wayland nor a DRM device
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+	if (getPlatformDisplay != NULL) {
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (eglDisplay == EGL_NO_DISPLAY) {
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+		std::cout << "ERROR::HEADLESS_CONTEXT::NO_DISPLAY" << std::endl;
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		std::cout << "ERROR::HEADLESS_CONTEXT::NO_OPENGL_API" << std::endl;
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) || configCount == 0) {
+		std::cout << "ERROR::HEADLESS_CONTEXT::NO_CONFIG" << std::endl;
+		return false;
+	}
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+	if (eglContext == EGL_NO_CONTEXT) {
+		std::cout << "ERROR::HEADLESS_CONTEXT::CONTEXT_NOT_CREATED" << std::endl;
+		return false;
+	}
+	// no surface at all, everything is drawn into the engine's framebuffer object
+	if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		std::cout << "ERROR::HEADLESS_CONTEXT::CONTEXT_NOT_CURRENT" << std::endl;
+		eglDestroyContext(eglDisplay, eglContext);
+		return false;
+	}
+
+	display = eglDisplay;
+	context = eglContext;
+	return true;
+}
+
+void HeadlessContext::Destroy()
+{
+	if (display != NULL) {
+		eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+		eglTerminate((EGLDisplay)display);
+	}
+	display = NULL;
+	context = NULL;
+}
+
+void* HeadlessContext::GetProcAddress(const char* name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+#endif
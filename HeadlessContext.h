@@ -0,0 +1,26 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <GLFW/glfw3.h>
+#include <cstddef>
+
+// OpenGL 3.3 core context without a visible window. On Linux it is a surfaceless EGL context,
+// which Mesa llvmpipe provides on machines without a GPU or display. Elsewhere it falls back to
+// a hidden GLFW window. Either way there is no default framebuffer to draw into, so the engine
+// renders into its own FBO.
+class HeadlessContext
+{
+public:
+	// returns false if no context could be created
+	bool Create();
+	void Destroy();
+	// loader for gladLoadGLLoader
+	static void* GetProcAddress(const char* name);
+
+private:
+#ifdef _WIN32
+	GLFWwindow* hiddenWindow = NULL;
+#else
+	void* display = NULL;
+	void* context = NULL;
+#endif
+};
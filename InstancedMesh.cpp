@@ -0,0 +1,93 @@
+#include "InstancedMesh.h"
+#include <cstddef>
+
+void InstancedMesh::Create(GLuint vao, GLsizei indexCount)
+{
+	this->vao = vao;
+	this->indexCount = indexCount;
+	instanceCount = 0;
+	capacity = 0;
+
+	glGenBuffers(1, &instanceBuffer);
+	glBindVertexArray(vao);
+	PointAttributes(0);
+	for (int location = INSTANCE_MODEL_LOCATION; location < INSTANCE_NORMAL_LOCATION + 3; location++) {
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// expects the VAO to be bound, leaves the instance buffer bound to GL_ARRAY_BUFFER
+void InstancedMesh::PointAttributes(size_t first)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	// a mat4 attribute takes four vec4 locations and a mat3 three vec3 ones, each advancing once per
+	// instance; the normal columns are read as vec4, the lightmapped shaders find the tile in their w
+	size_t base = first * sizeof(InstanceTransform);
+	for (int column = 0; column < 4; column++) {
+		glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (GLvoid*)(base + offsetof(InstanceTransform, model) + column * sizeof(glm::vec4)));
+	}
+	for (int column = 0; column < 3; column++) {
+		glVertexAttribPointer(INSTANCE_NORMAL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (GLvoid*)(base + offsetof(InstanceTransform, normal) + column * sizeof(glm::vec4)));
+	}
+	attributeFirst = first;
+}
+
+void InstancedMesh::Delete()
+{
+	glDeleteBuffers(1, &instanceBuffer);
+	instanceBuffer = 0;
+	instanceCount = capacity = 0;
+}
+
+void InstancedMesh::SetInstances(const InstanceTransform* instances, size_t count)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	// grow geometrically, then keep orphaning the same size so the driver can recycle the storage
+	if (count > capacity) {
+		capacity = count > capacity * 2 ? count : capacity * 2;
+	}
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceTransform), NULL, GL_STREAM_DRAW);
+	if (count > 0) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceTransform), instances);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	instanceCount = count;
+}
+
+void InstancedMesh::Draw()
+{
+	Draw(0, instanceCount);
+}
+
+void InstancedMesh::Draw(size_t first, size_t count)
+{
+	if (count == 0) {
+		return;
+	}
+	glBindVertexArray(vao);
+	DrawBound(first, count);
+	glBindVertexArray(0);
+}
+
+void InstancedMesh::DrawBound(size_t first, size_t count)
+{
+	MeshRange range;
+	range.indexCount = indexCount;
+	DrawBound(range, first, count);
+}
+
+void InstancedMesh::DrawBound(const MeshRange& range, size_t first, size_t count)
+{
+	if (count == 0) {
+		return;
+	}
+	// later ranges of the buffer are reached by moving the attribute pointers
+	if (first != attributeFirst) {
+		PointAttributes(first);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (GLvoid*)(range.firstIndex * sizeof(GLuint)), (GLsizei)count, (GLint)range.firstVertex);
+}
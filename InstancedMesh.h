@@ -0,0 +1,48 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "GeometryArena.h"
+#include "TransformSystem.h"
+
+// first vertex attributes of the per instance model and normal matrices, one location per column
+#define INSTANCE_MODEL_LOCATION 3
+#define INSTANCE_NORMAL_LOCATION 7
+
+// Draws many copies of an indexed mesh with one glDrawElementsInstanced. The per instance
+// matrices live in an instanced vertex attribute buffer attached to the mesh's VAO. With a
+// GeometryArena's VAO one instance buffer serves every mesh of the arena, each draw naming
+// the mesh's range.
+class InstancedMesh
+{
+public:
+	// vao must already hold the mesh's vertex attributes and element buffer; indexCount is
+	// what the draws without a MeshRange use
+	void Create(GLuint vao, GLsizei indexCount = 0);
+	void Delete();
+
+	// replaces every instance; the old storage is orphaned so the GPU can keep reading it
+	void SetInstances(const InstanceTransform* instances, size_t count);
+	void Draw();
+	// draws instances [first, first + count) of the last SetInstances
+	void Draw(size_t first, size_t count);
+	// same, for callers that bound Vao() themselves; the VAO is left bound
+	void DrawBound(size_t first, size_t count);
+	// same, drawing the arena mesh at range
+	void DrawBound(const MeshRange& range, size_t first, size_t count);
+
+	GLuint Vao() const { return vao; }
+
+	size_t InstanceCount() const { return instanceCount; }
+
+private:
+	GLuint vao = 0;
+	GLuint instanceBuffer = 0;
+	GLsizei indexCount = 0;
+	size_t instanceCount = 0;
+	size_t capacity = 0;
+	// instance the attribute pointers currently start at, GL 3.3 has no base instance
+	size_t attributeFirst = 0;
+
+	void PointAttributes(size_t first);
+};
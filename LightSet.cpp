@@ -0,0 +1,108 @@
+#include "LightSet.h"
+#include <algorithm>
+#include <cstring>
+
+void LightSet::Create()
+{
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), &block, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+	dirty.clear();
+}
+
+void LightSet::Delete()
+{
+	glDeleteBuffers(1, &ubo);
+	ubo = 0;
+}
+
+void LightSet::SetDirLight(const DirLight& light)
+{
+	Write(offsetof(LightBlock, dirLight), &light, sizeof(DirLight));
+}
+
+void LightSet::SetPointLight(int index, const PointLight& light)
+{
+	Write(offsetof(LightBlock, pointLights) + index * sizeof(PointLight), &light, sizeof(PointLight));
+}
+
+void LightSet::SetSpotLight(const SpotLight& light)
+{
+	Write(offsetof(LightBlock, spotLight), &light, sizeof(SpotLight));
+}
+
+static bool IsLit(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular)
+{
+	return ambient != glm::vec3(0.0f) || diffuse != glm::vec3(0.0f) || specular != glm::vec3(0.0f);
+}
+
+LightFeatures LightSet::Features() const
+{
+	LightFeatures features;
+	features.dirLight = IsLit(block.dirLight.ambient, block.dirLight.diffuse, block.dirLight.specular);
+	// the loop runs up to the last lit light, dark ones before it are cheaper to keep than to compact
+	features.pointLights = 0;
+	for (int i = 0; i < NR_POINT_LIGHTS; i++) {
+		const PointLight& light = block.pointLights[i];
+		if (IsLit(light.ambient, light.diffuse, light.specular)) {
+			features.pointLights = i + 1;
+		}
+	}
+	features.spotLight = IsLit(block.spotLight.ambient, block.spotLight.diffuse, block.spotLight.specular);
+	return features;
+}
+
+std::string LightFeatures::Defines() const
+{
+	return "#define DIR_LIGHT " + std::to_string(dirLight ? 1 : 0) + "\n"
+		"#define POINT_LIGHT_COUNT " + std::to_string(pointLights) + "\n"
+		"#define SPOT_LIGHT " + std::to_string(spotLight ? 1 : 0) + "\n";
+}
+
+void LightSet::Write(size_t offset, const void* data, size_t size)
+{
+	unsigned char* dst = (unsigned char*)&block + offset;
+	const unsigned char* src = (const unsigned char*)data;
+
+	// shrink the write to the bytes that differ, rewriting the same values is free
+	size_t first = 0, last = size;
+	while (first < size && dst[first] == src[first]) first++;
+	if (first == size) {
+		return;
+	}
+	while (last > first && dst[last - 1] == src[last - 1]) last--;
+	memcpy(dst + first, src + first, last - first);
+
+	// merge with any overlapping or touching range so Upload issues as few calls as possible
+	Range range = { offset + first, offset + last };
+	for (size_t i = 0; i < dirty.size();) {
+		if (dirty[i].begin <= range.end && range.begin <= dirty[i].end) {
+			range.begin = std::min(range.begin, dirty[i].begin);
+			range.end = std::max(range.end, dirty[i].end);
+			dirty.erase(dirty.begin() + i);
+		}
+		else {
+			i++;
+		}
+	}
+	dirty.push_back(range);
+}
+
+size_t LightSet::Upload()
+{
+	if (dirty.empty()) {
+		return 0;
+	}
+
+	size_t bytes = 0;
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	for (const Range& range : dirty) {
+		glBufferSubData(GL_UNIFORM_BUFFER, range.begin, range.end - range.begin, (const unsigned char*)&block + range.begin);
+		bytes += range.end - range.begin;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	dirty.clear();
+	return bytes;
+}
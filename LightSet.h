@@ -0,0 +1,94 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// CPU mirrors of the structs in the std140 "Lights" block of multipleLight.frag.
+// Every vec3 is followed by a float so the C++ layout matches std140 without hidden padding.
+struct DirLight
+{
+	glm::vec3 direction; float pad0;
+	glm::vec3 ambient; float pad1;
+	glm::vec3 diffuse; float pad2;
+	glm::vec3 specular; float pad3;
+};
+
+struct PointLight
+{
+	glm::vec3 position; float constant;
+	glm::vec3 ambient; float linear;
+	glm::vec3 diffuse; float quadratic;
+	glm::vec3 specular; float pad0;
+};
+
+struct SpotLight
+{
+	glm::vec3 position; float cutOff;
+	glm::vec3 direction; float outerCutOff;
+	glm::vec3 ambient; float constant;
+	glm::vec3 diffuse; float linear;
+	glm::vec3 specular; float quadratic;
+};
+
+// must match NR_POINT_LIGHTS in multipleLight.frag
+#define NR_POINT_LIGHTS 4
+
+struct LightBlock
+{
+	DirLight dirLight;
+	PointLight pointLights[NR_POINT_LIGHTS];
+	SpotLight spotLight;
+};
+
+static_assert(sizeof(DirLight) == 64, "DirLight does not match std140");
+static_assert(sizeof(PointLight) == 64, "PointLight does not match std140");
+static_assert(sizeof(SpotLight) == 80, "SpotLight does not match std140");
+static_assert(offsetof(LightBlock, pointLights) == 64, "LightBlock does not match std140");
+static_assert(offsetof(LightBlock, spotLight) == 64 + 64 * NR_POINT_LIGHTS, "LightBlock does not match std140");
+
+// The lighting phases a variant of multipleLight.frag is compiled with. Phases that are left
+// out cost nothing per fragment, instead of being evaluated at zero intensity.
+struct LightFeatures
+{
+	bool dirLight = true;
+	// the first pointLights entries of the block are evaluated
+	int pointLights = NR_POINT_LIGHTS;
+	bool spotLight = true;
+
+	bool operator==(const LightFeatures& other) const { return dirLight == other.dirLight && pointLights == other.pointLights && spotLight == other.spotLight; }
+	bool operator!=(const LightFeatures& other) const { return !(*this == other); }
+	// DIR_LIGHT, POINT_LIGHT_COUNT and SPOT_LIGHT for BuildShaderVariant
+	std::string Defines() const;
+};
+
+// Owns the uniform buffer behind the "Lights" block. Setters only mark the bytes that actually
+// changed, and Upload sends just those ranges, so a static rig costs nothing per frame.
+class LightSet
+{
+public:
+	static const GLuint BINDING = 0;
+
+	void Create();
+	void Delete();
+
+	void SetDirLight(const DirLight& light);
+	void SetPointLight(int index, const PointLight& light);
+	void SetSpotLight(const SpotLight& light);
+	const LightBlock& Block() const { return block; }
+	// the cheapest variant that still renders the current rig: lights without any colour are dropped
+	LightFeatures Features() const;
+
+	// Flushes the dirty ranges with glBufferSubData, returns the number of bytes uploaded
+	size_t Upload();
+
+private:
+	struct Range { size_t begin, end; };
+
+	GLuint ubo = 0;
+	LightBlock block = {};
+	std::vector<Range> dirty;
+
+	void Write(size_t offset, const void* data, size_t size);
+};
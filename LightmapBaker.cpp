@@ -0,0 +1,643 @@
+#include "LightmapBaker.h"
+#include "ClusteredLights.h"
+#include "VertexFormat.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+struct LightmapHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	unsigned int size;
+	unsigned int meshes, instances;
+};
+
+// 64 bit FNV-1a over raw bytes, continued from hash
+static unsigned long long Fnv1a(const void* data, size_t size, unsigned long long hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// orthonormal tangent and bitangent of a unit normal (Duff et al. 2017); multipleLight.frag
+// builds the same frame to decode the dominant direction
+static void TangentFrame(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent)
+{
+	float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+	float a = -1.0f / (sign + n.z);
+	float b = n.x * n.y * a;
+	tangent = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	bitangent = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+}
+
+static float Luminance(const glm::vec3& colour)
+{
+	return colour.x * 0.299f + colour.y * 0.587f + colour.z * 0.114f;
+}
+
+// closest point to p on the 2D triangle abc, as barycentric weights (Ericson, Real-Time Collision Detection 5.1.5)
+static glm::vec3 ClosestBarycentric(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+{
+	glm::vec2 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		return glm::vec3(1, 0, 0);
+	}
+	glm::vec2 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		return glm::vec3(0, 1, 0);
+	}
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		float v = d1 / (d1 - d3);
+		return glm::vec3(1.0f - v, v, 0.0f);
+	}
+	glm::vec2 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		return glm::vec3(0, 0, 1);
+	}
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		float w = d2 / (d2 - d6);
+		return glm::vec3(1.0f - w, 0.0f, w);
+	}
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return glm::vec3(0.0f, 1.0f - w, w);
+	}
+	float denominator = 1.0f / (va + vb + vc);
+	float v = vb * denominator, w = vc * denominator;
+	return glm::vec3(1.0f - v - w, v, w);
+}
+
+// packs rectangles into rows of a square of side size, tallest first; false if they do not fit
+static bool PackShelves(const std::vector<glm::uvec2>& rects, const std::vector<unsigned int>& order, unsigned int size, std::vector<glm::uvec2>& corners)
+{
+	corners.resize(rects.size());
+	unsigned int x = 0, y = 0, rowHeight = 0;
+	for (unsigned int i : order) {
+		if (x + rects[i].x > size) {
+			x = 0;
+			y += rowHeight;
+			rowHeight = 0;
+		}
+		if (x + rects[i].x > size || y + rects[i].y > size) {
+			return false;
+		}
+		corners[i] = glm::uvec2(x, y);
+		x += rects[i].x;
+		rowHeight = std::max(rowHeight, rects[i].y);
+	}
+	return true;
+}
+
+// indices of rects, tallest first
+static std::vector<unsigned int> TallestFirst(const std::vector<glm::uvec2>& rects)
+{
+	std::vector<unsigned int> order(rects.size());
+	std::iota(order.begin(), order.end(), 0u);
+	std::stable_sort(order.begin(), order.end(), [&rects](unsigned int a, unsigned int b) { return rects[a].y > rects[b].y; });
+	return order;
+}
+
+void LightmapBaker::SetLights(const DirLight& dirLight, const std::vector<PointLight>& pointLights)
+{
+	this->dirLight = dirLight;
+	this->pointLights = pointLights;
+}
+
+unsigned int LightmapBaker::AddMesh(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+{
+	Mesh mesh;
+	for (size_t i = 0; i < vertexCount; i++) {
+		const GLfloat* vertex = vertices + i * GEOMETRY_VERTEX_FLOATS;
+		mesh.positions.push_back(glm::vec3(vertex[0], vertex[1], vertex[2]));
+		mesh.normals.push_back(glm::vec3(vertex[5], vertex[6], vertex[7]));
+	}
+	mesh.indices.assign(indices, indices + indexCount);
+	meshes.push_back(mesh);
+	return (unsigned int)meshes.size() - 1;
+}
+
+unsigned int LightmapBaker::AddInstance(unsigned int mesh, const glm::mat4& model)
+{
+	Instance instance;
+	instance.mesh = mesh;
+	instance.model = model;
+	instance.scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	instances.push_back(instance);
+	return (unsigned int)instances.size() - 1;
+}
+
+unsigned long long LightmapBaker::Key() const
+{
+	const float settings[] = { (float)LIGHTMAP_VERSION, LIGHTMAP_TEXELS_PER_UNIT, (float)LIGHTMAP_PADDING, LIGHTMAP_RAY_BIAS };
+	unsigned long long hash = Fnv1a(settings, sizeof(settings));
+	hash = Fnv1a(&dirLight, sizeof(dirLight), hash);
+	for (const PointLight& light : pointLights) {
+		hash = Fnv1a(&light, sizeof(light), hash);
+	}
+	for (const Mesh& mesh : meshes) {
+		hash = Fnv1a(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3), hash);
+		hash = Fnv1a(mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3), hash);
+		hash = Fnv1a(mesh.indices.data(), mesh.indices.size() * sizeof(GLuint), hash);
+	}
+	for (const Instance& instance : instances) {
+		hash = Fnv1a(&instance.mesh, sizeof(instance.mesh), hash);
+		hash = Fnv1a(&instance.model, sizeof(instance.model), hash);
+	}
+	return hash;
+}
+
+// charts are the connected parts of the mesh, each projected along its area weighted normal;
+// coordinates are in texels at texelsPerUnit until the tile size is known
+void LightmapBaker::Unwrap(Mesh& mesh, float texelsPerUnit)
+{
+	size_t vertexCount = mesh.positions.size();
+	std::vector<unsigned int> parent(vertexCount);
+	std::iota(parent.begin(), parent.end(), 0u);
+	auto find = [&parent](unsigned int v) {
+		while (parent[v] != v) {
+			parent[v] = parent[parent[v]];
+			v = parent[v];
+		}
+		return v;
+	};
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		parent[find(mesh.indices[i + 1])] = find(mesh.indices[i]);
+		parent[find(mesh.indices[i + 2])] = find(mesh.indices[i]);
+	}
+
+	std::vector<unsigned int> chartOf(vertexCount, 0xFFFFFFFFu);
+	std::vector<glm::vec3> chartNormals;
+	for (size_t v = 0; v < vertexCount; v++) {
+		unsigned int root = find((unsigned int)v);
+		if (chartOf[root] == 0xFFFFFFFFu) {
+			chartOf[root] = (unsigned int)chartNormals.size();
+			chartNormals.push_back(glm::vec3(0.0f));
+		}
+		chartOf[v] = chartOf[root];
+	}
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		const glm::vec3& a = mesh.positions[mesh.indices[i]];
+		chartNormals[chartOf[mesh.indices[i]]] += glm::cross(mesh.positions[mesh.indices[i + 1]] - a, mesh.positions[mesh.indices[i + 2]] - a);
+	}
+
+	// project and find each chart's extent
+	size_t chartCount = chartNormals.size();
+	std::vector<glm::vec2> projected(vertexCount);
+	std::vector<glm::vec2> low(chartCount, glm::vec2(FLT_MAX)), high(chartCount, glm::vec2(-FLT_MAX));
+	for (size_t v = 0; v < vertexCount; v++) {
+		glm::vec3 normal = chartNormals[chartOf[v]];
+		float length = glm::length(normal);
+		normal = length > 0.0f ? normal / length : glm::vec3(0, 1, 0);
+		glm::vec3 tangent, bitangent;
+		TangentFrame(normal, tangent, bitangent);
+		projected[v] = glm::vec2(glm::dot(mesh.positions[v], tangent), glm::dot(mesh.positions[v], bitangent)) * texelsPerUnit;
+		low[chartOf[v]] = glm::min(low[chartOf[v]], projected[v]);
+		high[chartOf[v]] = glm::max(high[chartOf[v]], projected[v]);
+	}
+	std::vector<glm::uvec2> cells(chartCount);
+	size_t area = 0;
+	unsigned int side = 1;
+	for (size_t chart = 0; chart < chartCount; chart++) {
+		glm::vec2 extent = glm::max(high[chart] - low[chart], glm::vec2(0.0f));
+		cells[chart] = glm::uvec2((unsigned int)std::ceil(extent.x) + LIGHTMAP_PADDING, (unsigned int)std::ceil(extent.y) + LIGHTMAP_PADDING);
+		area += (size_t)cells[chart].x * cells[chart].y;
+		side = std::max(side, std::max(cells[chart].x, cells[chart].y));
+	}
+
+	// the smallest square tile the shelves fit in
+	std::vector<unsigned int> order = TallestFirst(cells);
+	std::vector<glm::uvec2> corners;
+	side = std::max(side, (unsigned int)std::ceil(std::sqrt((double)area)));
+	while (!PackShelves(cells, order, side, corners)) {
+		side += std::max(1u, side / 16);
+	}
+	mesh.tileSize = side;
+	mesh.coords.resize(vertexCount * 2);
+	for (size_t v = 0; v < vertexCount; v++) {
+		unsigned int chart = chartOf[v];
+		glm::vec2 texel = projected[v] - low[chart] + glm::vec2(corners[chart]) + glm::vec2(LIGHTMAP_PADDING / 2);
+		mesh.coords[v * 2] = texel.x / side;
+		mesh.coords[v * 2 + 1] = texel.y / side;
+	}
+}
+
+bool LightmapBaker::PackAtlas()
+{
+	std::vector<glm::uvec2> tiles(instances.size());
+	size_t area = 0;
+	unsigned int largest = 1;
+	for (size_t i = 0; i < instances.size(); i++) {
+		Instance& instance = instances[i];
+		const Mesh& mesh = meshes[instance.mesh];
+		instance.size = std::max(1u, (unsigned int)std::ceil(mesh.tileSize * instance.scale / mesh.scale - 0.001f));
+		tiles[i] = glm::uvec2(instance.size);
+		area += (size_t)instance.size * instance.size;
+		largest = std::max(largest, instance.size);
+	}
+
+	std::vector<unsigned int> order = TallestFirst(tiles);
+	std::vector<glm::uvec2> corners;
+	size = 1;
+	while (size < largest || (size_t)size * size < area) {
+		size *= 2;
+	}
+	while (!PackShelves(tiles, order, size, corners)) {
+		size *= 2;
+		if (size > LIGHTMAP_MAX_SIZE) {
+			std::cout << "ERROR::LIGHTMAP::ATLAS_FULL " << instances.size() << " tiles of " << area << " texels do not fit " << LIGHTMAP_MAX_SIZE << "x" << LIGHTMAP_MAX_SIZE << std::endl;
+			size = 0;
+			return false;
+		}
+	}
+	for (size_t i = 0; i < instances.size(); i++) {
+		Instance& instance = instances[i];
+		instance.x = corners[i].x;
+		instance.y = corners[i].y;
+		instance.tile = glm::vec3((float)instance.size, (float)instance.x, (float)instance.y) / (float)size;
+	}
+	return true;
+}
+
+void LightmapBaker::BuildTree()
+{
+	triangles.clear();
+	nodes.clear();
+	for (const Instance& instance : instances) {
+		const Mesh& mesh = meshes[instance.mesh];
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			Triangle triangle;
+			triangle.a = glm::vec3(instance.model * glm::vec4(mesh.positions[mesh.indices[i]], 1.0f));
+			triangle.b = glm::vec3(instance.model * glm::vec4(mesh.positions[mesh.indices[i + 1]], 1.0f));
+			triangle.c = glm::vec3(instance.model * glm::vec4(mesh.positions[mesh.indices[i + 2]], 1.0f));
+			triangles.push_back(triangle);
+		}
+	}
+	if (triangles.empty()) {
+		return;
+	}
+	nodes.push_back(Node());
+	BuildNode(0, 0, (unsigned int)triangles.size());
+}
+
+// median split along the longest axis of the centroids, down to four triangles per leaf
+void LightmapBaker::BuildNode(unsigned int node, unsigned int first, unsigned int count)
+{
+	glm::vec3 low(FLT_MAX), high(-FLT_MAX), centroidLow(FLT_MAX), centroidHigh(-FLT_MAX);
+	for (unsigned int i = first; i < first + count; i++) {
+		const Triangle& t = triangles[i];
+		low = glm::min(low, glm::min(t.a, glm::min(t.b, t.c)));
+		high = glm::max(high, glm::max(t.a, glm::max(t.b, t.c)));
+		glm::vec3 centroid = (t.a + t.b + t.c) / 3.0f;
+		centroidLow = glm::min(centroidLow, centroid);
+		centroidHigh = glm::max(centroidHigh, centroid);
+	}
+	nodes[node].min = low;
+	nodes[node].max = high;
+	if (count <= 4) {
+		nodes[node].first = first;
+		nodes[node].count = count;
+		return;
+	}
+
+	glm::vec3 extent = centroidHigh - centroidLow;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	unsigned int half = count / 2;
+	std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+		[axis](const Triangle& a, const Triangle& b) { return a.a[axis] + a.b[axis] + a.c[axis] < b.a[axis] + b.b[axis] + b.c[axis]; });
+
+	unsigned int children = (unsigned int)nodes.size();
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+	nodes[node].first = children;
+	nodes[node].count = 0;
+	BuildNode(children, first, half);
+	BuildNode(children + 1, first + half, count - half);
+}
+
+// any hit along the ray closer than distance, Moller-Trumbore against the triangles of every leaf it enters
+bool LightmapBaker::Occluded(const glm::vec3& origin, const glm::vec3& direction, float distance) const
+{
+	if (nodes.empty()) {
+		return false;
+	}
+	glm::vec3 inverse = 1.0f / direction;
+	unsigned int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		glm::vec3 t0 = (node.min - origin) * inverse, t1 = (node.max - origin) * inverse;
+		glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, distance));
+		if (enter > exit) {
+			continue;
+		}
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+		for (unsigned int i = node.first; i < node.first + node.count; i++) {
+			const Triangle& t = triangles[i];
+			glm::vec3 ab = t.b - t.a, ac = t.c - t.a;
+			glm::vec3 p = glm::cross(direction, ac);
+			float determinant = glm::dot(ab, p);
+			if (std::fabs(determinant) < 1e-12f) {
+				continue;
+			}
+			float inverseDeterminant = 1.0f / determinant;
+			glm::vec3 s = origin - t.a;
+			float u = glm::dot(s, p) * inverseDeterminant;
+			if (u < 0.0f || u > 1.0f) {
+				continue;
+			}
+			glm::vec3 q = glm::cross(s, ab);
+			float v = glm::dot(direction, q) * inverseDeterminant;
+			if (v < 0.0f || u + v > 1.0f) {
+				continue;
+			}
+			float hit = glm::dot(ac, q) * inverseDeterminant;
+			if (hit > 0.0f && hit < distance) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void LightmapBaker::Light(const glm::vec3& position, const glm::vec3& normal, glm::vec4& irradiance, glm::vec4& specular) const
+{
+	glm::vec3 diffuseSum = dirLight.ambient, specularSum(0.0f), direction(0.0f);
+	glm::vec3 origin = position + normal * LIGHTMAP_RAY_BIAS;
+
+	glm::vec3 lightDir = glm::normalize(-dirLight.direction);
+	float diff = glm::dot(normal, lightDir);
+	if (diff > 0.0f && !Occluded(origin, lightDir, FLT_MAX)) {
+		diffuseSum += dirLight.diffuse * diff;
+		specularSum += dirLight.specular;
+		direction += lightDir * Luminance(dirLight.specular);
+	}
+
+	for (const PointLight& light : pointLights) {
+		glm::vec3 toLight = light.position - position;
+		float distance = glm::length(toLight);
+		if (distance > ClusteredLights::LightRadius(light) || distance <= 0.0f) {
+			continue;
+		}
+		float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+		diffuseSum += light.ambient * attenuation;
+		lightDir = toLight / distance;
+		diff = glm::dot(normal, lightDir);
+		if (diff > 0.0f && !Occluded(origin, lightDir, distance)) {
+			diffuseSum += light.diffuse * diff * attenuation;
+			specularSum += light.specular * attenuation;
+			direction += lightDir * Luminance(light.specular * attenuation);
+		}
+	}
+
+	// the dominant direction in the normal's tangent frame, the normal itself without any light
+	float length = glm::length(direction);
+	direction = length > 0.0f ? direction / length : normal;
+	glm::vec3 tangent, bitangent;
+	TangentFrame(normal, tangent, bitangent);
+	irradiance = glm::vec4(diffuseSum, glm::dot(direction, tangent));
+	specular = glm::vec4(specularSum, glm::dot(direction, bitangent));
+}
+
+size_t LightmapBaker::BakeInstance(const Instance& instance)
+{
+	const Mesh& mesh = meshes[instance.mesh];
+	unsigned int side = instance.size;
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+
+	// what each texel of the tile sees: 2 where its centre is inside a triangle, 1 where a
+	// triangle only touches it and is sampled at its closest point, 0 for padding
+	std::vector<unsigned char> coverage((size_t)side * side, 0);
+	std::vector<glm::vec3> positions((size_t)side * side), normals((size_t)side * side);
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		glm::vec2 uv[3];
+		glm::vec3 position[3], normal[3];
+		for (int k = 0; k < 3; k++) {
+			GLuint v = mesh.indices[i + k];
+			uv[k] = glm::vec2(mesh.coords[v * 2], mesh.coords[v * 2 + 1]) * (float)side;
+			position[k] = glm::vec3(instance.model * glm::vec4(mesh.positions[v], 1.0f));
+			normal[k] = normalMatrix * mesh.normals[v];
+		}
+		float area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y);
+		if (std::fabs(area) < 1e-8f) {
+			continue;
+		}
+		glm::vec2 low = glm::min(uv[0], glm::min(uv[1], uv[2])), high = glm::max(uv[0], glm::max(uv[1], uv[2]));
+		int x0 = std::max(0, (int)std::floor(low.x - 0.5f)), x1 = std::min((int)side - 1, (int)std::ceil(high.x + 0.5f));
+		int y0 = std::max(0, (int)std::floor(low.y - 0.5f)), y1 = std::min((int)side - 1, (int)std::ceil(high.y + 0.5f));
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				size_t texel = (size_t)y * side + x;
+				if (coverage[texel] == 2) {
+					continue;
+				}
+				glm::vec2 centre(x + 0.5f, y + 0.5f);
+				glm::vec3 weights = ClosestBarycentric(centre, uv[0], uv[1], uv[2]);
+				glm::vec2 closest = uv[0] * weights.x + uv[1] * weights.y + uv[2] * weights.z;
+				float offset = glm::length(closest - centre);
+				unsigned char covered = offset < 1e-4f ? 2 : (offset < 0.5f && coverage[texel] == 0 ? 1 : 0);
+				if (covered == 0) {
+					continue;
+				}
+				coverage[texel] = covered;
+				positions[texel] = position[0] * weights.x + position[1] * weights.y + position[2] * weights.z;
+				normals[texel] = normal[0] * weights.x + normal[1] * weights.y + normal[2] * weights.z;
+			}
+		}
+	}
+
+	std::vector<glm::vec4> lit((size_t)side * side * LIGHTMAP_LAYERS, glm::vec4(0.0f));
+	size_t covered = 0;
+	for (size_t texel = 0; texel < coverage.size(); texel++) {
+		if (coverage[texel] != 0) {
+			glm::vec3 normal = normals[texel];
+			float length = glm::length(normal);
+			Light(positions[texel], length > 0.0f ? normal / length : glm::vec3(0, 1, 0), lit[texel * LIGHTMAP_LAYERS], lit[texel * LIGHTMAP_LAYERS + 1]);
+			covered++;
+		}
+	}
+
+	// padding texels take the mean of their covered neighbours, so filtering at a chart's edge
+	// blends with its own light instead of black
+	for (int pass = 0; pass < LIGHTMAP_PADDING / 2; pass++) {
+		std::vector<unsigned char> filled = coverage;
+		for (int y = 0; y < (int)side; y++) {
+			for (int x = 0; x < (int)side; x++) {
+				size_t texel = (size_t)y * side + x;
+				if (coverage[texel] != 0) {
+					continue;
+				}
+				glm::vec4 sum[LIGHTMAP_LAYERS] = {};
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						int nx = x + dx, ny = y + dy;
+						if (nx < 0 || ny < 0 || nx >= (int)side || ny >= (int)side || coverage[(size_t)ny * side + nx] == 0) {
+							continue;
+						}
+						for (int layer = 0; layer < LIGHTMAP_LAYERS; layer++) {
+							sum[layer] += lit[((size_t)ny * side + nx) * LIGHTMAP_LAYERS + layer];
+						}
+						count++;
+					}
+				}
+				if (count > 0) {
+					for (int layer = 0; layer < LIGHTMAP_LAYERS; layer++) {
+						lit[texel * LIGHTMAP_LAYERS + layer] = sum[layer] / (float)count;
+					}
+					filled[texel] = 1;
+				}
+			}
+		}
+		coverage.swap(filled);
+	}
+
+	// the tile is this instance's alone, so threads write the atlas without locking
+	for (unsigned int y = 0; y < side; y++) {
+		for (unsigned int x = 0; x < side; x++) {
+			for (int layer = 0; layer < LIGHTMAP_LAYERS; layer++) {
+				const glm::vec4& value = lit[((size_t)y * side + x) * LIGHTMAP_LAYERS + layer];
+				unsigned short* out = &texels[(((size_t)layer * size + instance.y + y) * size + instance.x + x) * 4];
+				for (int c = 0; c < 4; c++) {
+					out[c] = VertexLayout::ToHalf(value[c]);
+				}
+			}
+		}
+	}
+	return covered;
+}
+
+bool LightmapBaker::Bake(ThreadPool* pool)
+{
+	// each mesh at the density of its smallest instance, so none gets less padding than LIGHTMAP_PADDING
+	for (Mesh& mesh : meshes) {
+		mesh.scale = FLT_MAX;
+	}
+	for (const Instance& instance : instances) {
+		meshes[instance.mesh].scale = std::min(meshes[instance.mesh].scale, instance.scale);
+	}
+	for (Mesh& mesh : meshes) {
+		if (mesh.scale != FLT_MAX) {
+			Unwrap(mesh, LIGHTMAP_TEXELS_PER_UNIT * mesh.scale);
+		}
+	}
+	litTexels = 0;
+	if (instances.empty() || !PackAtlas()) {
+		return false;
+	}
+	BuildTree();
+
+	texels.assign((size_t)size * size * 4 * LIGHTMAP_LAYERS, 0);
+	std::atomic<size_t> covered(0);
+	auto bake = [this, &covered](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			covered += BakeInstance(instances[i]);
+		}
+	};
+	if (pool != NULL) {
+		pool->ParallelFor(instances.size(), 1, bake);
+	}
+	else {
+		bake(0, instances.size());
+	}
+	litTexels = covered;
+	// only needed for the rays
+	triangles.clear();
+	triangles.shrink_to_fit();
+	nodes.clear();
+	nodes.shrink_to_fit();
+	return true;
+}
+
+bool LightmapBaker::Load(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	LightmapHeader header;
+	if (!file || !file.read((char*)&header, sizeof(header))) {
+		return false;
+	}
+	if (header.magic != LIGHTMAP_MAGIC || header.version != LIGHTMAP_VERSION || header.key != Key()
+		|| header.meshes != meshes.size() || header.instances != instances.size() || header.size == 0 || header.size > LIGHTMAP_MAX_SIZE) {
+		return false;
+	}
+	for (Mesh& mesh : meshes) {
+		mesh.coords.resize(mesh.positions.size() * 2);
+		file.read((char*)mesh.coords.data(), mesh.coords.size() * sizeof(GLfloat));
+	}
+	for (Instance& instance : instances) {
+		file.read((char*)&instance.tile, sizeof(instance.tile));
+	}
+	size = header.size;
+	texels.resize((size_t)size * size * 4 * LIGHTMAP_LAYERS);
+	file.read((char*)texels.data(), texels.size() * sizeof(unsigned short));
+	if (!file) {
+		std::cout << "WARNING::LIGHTMAP::TRUNCATED " << path << std::endl;
+		size = 0;
+		return false;
+	}
+	return true;
+}
+
+bool LightmapBaker::Save(const std::string& path) const
+{
+	LightmapHeader header;
+	header.magic = LIGHTMAP_MAGIC;
+	header.version = LIGHTMAP_VERSION;
+	header.key = Key();
+	header.size = size;
+	header.meshes = (unsigned int)meshes.size();
+	header.instances = (unsigned int)instances.size();
+
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file) {
+		std::cout << "ERROR::LIGHTMAP::WRITE_FAILED " << path << std::endl;
+		return false;
+	}
+	file.write((const char*)&header, sizeof(header));
+	for (const Mesh& mesh : meshes) {
+		// meshes without an instance were never unwrapped
+		std::vector<GLfloat> coords(mesh.coords);
+		coords.resize(mesh.positions.size() * 2, 0.0f);
+		file.write((const char*)coords.data(), coords.size() * sizeof(GLfloat));
+	}
+	for (const Instance& instance : instances) {
+		file.write((const char*)&instance.tile, sizeof(instance.tile));
+	}
+	file.write((const char*)texels.data(), texels.size() * sizeof(unsigned short));
+	return (bool)file;
+}
+
+GLuint LightmapBaker::CreateTexture() const
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA16F, size, size, LIGHTMAP_LAYERS, 0, GL_RGBA, GL_HALF_FLOAT, texels.data());
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
+}
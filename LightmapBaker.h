@@ -0,0 +1,119 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "LightSet.h"
+#include "ThreadPool.h"
+
+#define LIGHTMAP_MAGIC 0x504D4C42u // "BLMP"
+#define LIGHTMAP_VERSION 1
+// lightmap resolution on a surface of the smallest instance of a mesh, larger ones get more texels
+#define LIGHTMAP_TEXELS_PER_UNIT 4.0f
+// texels between two charts; a chart gets half of it on each side so bilinear filtering never
+// reads into its neighbour
+#define LIGHTMAP_PADDING 2
+#define LIGHTMAP_MAX_SIZE 4096
+// shadow rays start this far off the surface
+#define LIGHTMAP_RAY_BIAS 0.01f
+// layer 0: irradiance and the x of the dominant light direction, layer 1: specular colour and its y
+#define LIGHTMAP_LAYERS 2
+
+// Offline baker of the static light rig, on the CPU. Every mesh gets a second set of tex coords
+// at bake time: its triangles are split into charts of connected triangles, each chart is
+// projected onto its plane and the charts are packed into the mesh's square tile. Every
+// instance then gets a tile of its own in one square atlas, sized by its scale, and each texel
+// of a tile sums what the directional light and the point lights cast on it, with shadow rays
+// against all instances. Diffuse light (with the lights' ambient) is stored as irradiance, the
+// albedo is applied at runtime; specular is stored as the lights' colour and their intensity
+// weighted mean direction, so the runtime evaluates one highlight however many lights there are.
+//
+// Charts are projected flat, so meshes with per-face vertices unwrap without overlap, while a
+// connected curved surface folds onto itself. Point lights beyond ClusteredLights::LightRadius
+// are left out like in clustered forward mode.
+class LightmapBaker
+{
+public:
+	void SetLights(const DirLight& dirLight, const std::vector<PointLight>& pointLights);
+	// vertices hold GEOMETRY_VERTEX_FLOATS floats each; returns the id for AddInstance
+	unsigned int AddMesh(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount);
+	// an instance is lit and casts shadows on every other one
+	unsigned int AddInstance(unsigned int mesh, const glm::mat4& model);
+
+	// hash of the lights, meshes and instances; a saved bake with the same key is the same bake
+	unsigned long long Key() const;
+	// unwraps the meshes, packs the atlas and lights every texel, split over the pool's threads;
+	// fails if the tiles do not fit in LIGHTMAP_MAX_SIZE
+	bool Bake(ThreadPool* pool = NULL);
+	// the result of Bake, loaded only if it was baked from the same input
+	bool Load(const std::string& path);
+	bool Save(const std::string& path) const;
+
+	// side of the atlas in texels, 0 before a bake
+	unsigned int Size() const { return size; }
+	// 2 floats per vertex of a mesh, in [0, 1] over its tile
+	const std::vector<GLfloat>& MeshCoords(unsigned int mesh) const { return meshes[mesh].coords; }
+	// scale and offset from the mesh coords into the atlas, the instance's tile
+	glm::vec3 InstanceTile(unsigned int instance) const { return instances[instance].tile; }
+	// texels covered by a surface, of the last Bake
+	size_t LitTexels() const { return litTexels; }
+	// a GL_TEXTURE_2D_ARRAY of LIGHTMAP_LAYERS RGBA16F layers, filtered linearly
+	GLuint CreateTexture() const;
+
+private:
+	struct Mesh
+	{
+		std::vector<glm::vec3> positions, normals;
+		std::vector<GLuint> indices;
+		std::vector<GLfloat> coords;
+		// smallest scale of an instance and the side of the tile in texels at that scale
+		float scale = 1.0f;
+		unsigned int tileSize = 0;
+	};
+
+	struct Instance
+	{
+		unsigned int mesh;
+		glm::mat4 model;
+		float scale;
+		// atlas texel of the tile's corner and its side
+		unsigned int x = 0, y = 0, size = 0;
+		glm::vec3 tile = glm::vec3(0.0f);
+	};
+
+	// every static triangle in world space, in a bounding volume hierarchy for the shadow rays
+	struct Triangle
+	{
+		glm::vec3 a, b, c;
+	};
+	struct Node
+	{
+		glm::vec3 min, max;
+		// children at first and first + 1, or count triangles from first
+		unsigned int first, count;
+	};
+
+	DirLight dirLight = {};
+	std::vector<PointLight> pointLights;
+	std::vector<Mesh> meshes;
+	std::vector<Instance> instances;
+	std::vector<Triangle> triangles;
+	std::vector<Node> nodes;
+
+	unsigned int size = 0;
+	// LIGHTMAP_LAYERS layers of size * size RGBA half floats
+	std::vector<unsigned short> texels;
+	size_t litTexels = 0;
+
+	static void Unwrap(Mesh& mesh, float texelsPerUnit);
+	bool PackAtlas();
+	void BuildTree();
+	void BuildNode(unsigned int node, unsigned int first, unsigned int count);
+	bool Occluded(const glm::vec3& origin, const glm::vec3& direction, float distance) const;
+	// rasterizes and lights one instance's tile, returns the covered texels
+	size_t BakeInstance(const Instance& instance);
+	// what the lights cast on a surface point: irradiance and specular colour, each with one
+	// component of the dominant direction in w
+	void Light(const glm::vec3& position, const glm::vec3& normal, glm::vec4& irradiance, glm::vec4& specular) const;
+};
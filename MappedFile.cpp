@@ -0,0 +1,96 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+	HANDLE view = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (view == NULL) {
+		CloseHandle(handle);
+		return false;
+	}
+	data = (const unsigned char*)MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		CloseHandle(view);
+		CloseHandle(handle);
+		return false;
+	}
+	file = handle;
+	mapping = view;
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data != NULL) {
+		UnmapViewOfFile(data);
+		CloseHandle((HANDLE)mapping);
+		CloseHandle((HANDLE)file);
+	}
+	data = NULL;
+	file = mapping = NULL;
+	size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	close(fd);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	data = (const unsigned char*)view;
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data != NULL) {
+		munmap((void*)data, size);
+	}
+	data = NULL;
+	size = 0;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read only memory mapping of a whole file. Pages are only read from disk when they are
+// touched, and stay shared with the OS file cache, so nothing is copied up front.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// returns false if the file does not exist, is empty or cannot be mapped
+	bool Open(const std::string& path);
+	void Close();
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	const unsigned char* data = NULL;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file = NULL;
+	void* mapping = NULL;
+#endif
+};
@@ -0,0 +1,477 @@
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// remaining triangle counts the valence boost is tabulated for, above it the last entry is used
+#define MESH_VALENCE_TABLE 32
+
+// both parts of the vertex score, tabulated since the pow calls would otherwise dominate
+struct ScoreTables
+{
+	float cache[MESH_OPTIMIZER_CACHE], valence[MESH_VALENCE_TABLE];
+
+	ScoreTables()
+	{
+		for (int position = 0; position < MESH_OPTIMIZER_CACHE; position++) {
+			// the last triangle's vertices, a fixed score so the next one does not just reuse its edge
+			cache[position] = position < 3 ? 0.75f : std::pow(1.0f - (position - 3) * (1.0f / (MESH_OPTIMIZER_CACHE - 3)), 1.5f);
+		}
+		valence[0] = 0.0f;
+		for (int count = 1; count < MESH_VALENCE_TABLE; count++) {
+			valence[count] = 2.0f * std::pow((float)count, -0.5f);
+		}
+	}
+};
+
+// score of a vertex: recently used ones are preferred, and ones with few triangles left get a
+// boost so they are finished off instead of leaving lone triangles behind
+static float VertexScore(int cachePosition, unsigned int remaining)
+{
+	static const ScoreTables tables;
+	if (remaining == 0) {
+		return -1.0f;
+	}
+	float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+	return score + tables.valence[remaining < MESH_VALENCE_TABLE ? remaining : MESH_VALENCE_TABLE - 1];
+}
+
+void MeshOptimizer::OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// triangles of each vertex; the first remaining[v] of its list are the ones not emitted yet
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		remaining[indices[i]]++;
+	}
+	std::vector<size_t> adjacencyFirst(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		adjacencyFirst[v + 1] = adjacencyFirst[v] + remaining[v];
+	}
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<size_t> fill(adjacencyFirst.begin(), adjacencyFirst.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		score[v] = VertexScore(-1, remaining[v]);
+	}
+	std::vector<unsigned char> emitted(triangleCount, 0);
+	std::vector<GLuint> ordered(triangleCount * 3);
+
+	// three more slots than the cache, for the vertices of the triangle just added
+	unsigned int cache[MESH_OPTIMIZER_CACHE + 3], next[MESH_OPTIMIZER_CACHE + 3];
+	size_t cacheSize = 0;
+	size_t cursor = 0;
+	long long best = -1;
+	for (size_t out = 0; out < triangleCount; out++) {
+		// dead end, nothing in the cache has triangles left: take the next one in input order
+		if (best < 0) {
+			while (emitted[cursor]) {
+				cursor++;
+			}
+			best = (long long)cursor;
+		}
+		size_t triangle = (size_t)best;
+		emitted[triangle] = 1;
+		const GLuint* corners = indices + triangle * 3;
+		memcpy(&ordered[out * 3], corners, 3 * sizeof(GLuint));
+
+		// drop the triangle from its vertices' remaining lists
+		for (int corner = 0; corner < 3; corner++) {
+			GLuint v = corners[corner];
+			unsigned int* list = &adjacency[adjacencyFirst[v]];
+			for (unsigned int i = 0; i < remaining[v]; i++) {
+				if (list[i] == triangle) {
+					list[i] = list[remaining[v] - 1];
+					list[remaining[v] - 1] = (unsigned int)triangle;
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// the triangle's vertices move to the front, the rest keep their order
+		size_t nextSize = 0;
+		for (int corner = 0; corner < 3; corner++) {
+			next[nextSize++] = corners[corner];
+		}
+		for (size_t i = 0; i < cacheSize; i++) {
+			GLuint v = cache[i];
+			if (v != corners[0] && v != corners[1] && v != corners[2]) {
+				next[nextSize++] = v;
+			}
+		}
+		for (size_t i = 0; i < nextSize; i++) {
+			GLuint v = next[i];
+			cachePosition[v] = i < MESH_OPTIMIZER_CACHE ? (int)i : -1;
+			score[v] = VertexScore(cachePosition[v], remaining[v]);
+		}
+		cacheSize = nextSize < MESH_OPTIMIZER_CACHE ? nextSize : MESH_OPTIMIZER_CACHE;
+		memcpy(cache, next, cacheSize * sizeof(unsigned int));
+
+		// the best next triangle is one touching the cache
+		best = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < cacheSize; i++) {
+			GLuint v = cache[i];
+			const unsigned int* list = &adjacency[adjacencyFirst[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++) {
+				const GLuint* other = indices + list[j] * 3;
+				float triangleScore = score[other[0]] + score[other[1]] + score[other[2]];
+				if (triangleScore > bestScore) {
+					bestScore = triangleScore;
+					best = list[j];
+				}
+			}
+		}
+	}
+	memcpy(indices, ordered.data(), triangleCount * 3 * sizeof(GLuint));
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GLfloat* vertices, size_t vertexCount, GLuint* indices, size_t indexCount)
+{
+	const GLuint unused = 0xFFFFFFFFu;
+	std::vector<GLuint> remap(vertexCount, unused);
+	GLuint next = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		if (remap[indices[i]] == unused) {
+			remap[indices[i]] = next++;
+		}
+		indices[i] = remap[indices[i]];
+	}
+	for (size_t v = 0; v < vertexCount; v++) {
+		if (remap[v] == unused) {
+			remap[v] = next++;
+		}
+	}
+
+	std::vector<GLfloat> ordered(vertexCount * GEOMETRY_VERTEX_FLOATS);
+	for (size_t v = 0; v < vertexCount; v++) {
+		memcpy(&ordered[remap[v] * GEOMETRY_VERTEX_FLOATS], vertices + v * GEOMETRY_VERTEX_FLOATS, GEOMETRY_VERTEX_FLOATS * sizeof(GLfloat));
+	}
+	memcpy(vertices, ordered.data(), ordered.size() * sizeof(GLfloat));
+}
+
+float MeshOptimizer::AverageCacheMissRatio(const GLuint* indices, size_t indexCount, size_t vertexCount, size_t cacheSize)
+{
+	if (indexCount < 3) {
+		return 0.0f;
+	}
+	// a vertex is cached while fewer than cacheSize misses happened since its own
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t time = cacheSize + 1, misses = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		if (time - insertedAt[indices[i]] > cacheSize) {
+			insertedAt[indices[i]] = time++;
+			misses++;
+		}
+	}
+	return (float)misses / (indexCount / 3);
+}
+
+// a triangle whose normal turns further than this, as a cosine, would fold over its neighbours
+#define MESH_SIMPLIFY_MAX_TURN 0.25f
+
+// symmetric 4x4 matrix of plane equations summed with area weights; the error of a point is its
+// mean squared distance to the planes
+struct Quadric
+{
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+	double weight = 0;
+
+	void AddPlane(const glm::vec3& normal, float distance, double area)
+	{
+		double x = normal.x, y = normal.y, z = normal.z, d = distance;
+		a00 += area * x * x; a01 += area * x * y; a02 += area * x * z; a03 += area * x * d;
+		a11 += area * y * y; a12 += area * y * z; a13 += area * y * d;
+		a22 += area * z * z; a23 += area * z * d;
+		a33 += area * d * d;
+		weight += area;
+	}
+
+	void Add(const Quadric& other)
+	{
+		a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+		a11 += other.a11; a12 += other.a12; a13 += other.a13;
+		a22 += other.a22; a23 += other.a23;
+		a33 += other.a33;
+		weight += other.weight;
+	}
+
+	double Error(const glm::vec3& point) const
+	{
+		double x = point.x, y = point.y, z = point.z;
+		double sum = a00 * x * x + a11 * y * y + a22 * z * z + a33
+			+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+		// rounding can take a point on every plane slightly below 0
+		return weight > 0.0 ? std::fabs(sum) / weight : 0.0;
+	}
+};
+
+// State of one simplification run, so BuildLods can take a level, go on collapsing from there
+// and keep the quadrics of what was collapsed before. Vertices at the same position are welded
+// for topology and quadrics; only unwelded, unlocked vertices collapse, onto a neighbour.
+class Simplification
+{
+public:
+	Simplification(const GLfloat* vertices, size_t vertexCount, const GLuint* source, size_t indexCount);
+	// collapses in passes of independent collapses until at most targetIndexCount indices are
+	// left or none is possible at all
+	void Run(size_t targetIndexCount);
+	const std::vector<GLuint>& Indices() const { return indices; }
+	float Error() const { return (float)std::sqrt(error); }
+
+private:
+	static const GLuint NONE = 0xFFFFFFFFu;
+
+	std::vector<glm::vec3> positions;
+	std::vector<GLuint> indices;
+	// first vertex at each vertex's position, the one quadrics and topology go by
+	std::vector<GLuint> weld;
+	// by welded vertex: seams, open borders and non-manifold edges stay
+	std::vector<unsigned char> locked;
+	std::vector<Quadric> quadrics;
+	// largest squared error of a collapse so far
+	double error = 0.0;
+
+	// per pass: triangles of each welded vertex, the cheapest collapse of each vertex
+	std::vector<size_t> adjacencyFirst;
+	std::vector<unsigned int> adjacency;
+	std::vector<GLuint> bestTarget, remap, candidates;
+	std::vector<double> bestCost;
+	std::vector<unsigned char> touched;
+
+	void BuildAdjacency();
+	// moving vertex onto target's position turns one of vertex's triangles too far
+	bool Folds(GLuint vertex, GLuint target) const;
+};
+
+const GLuint Simplification::NONE;
+
+Simplification::Simplification(const GLfloat* vertices, size_t vertexCount, const GLuint* source, size_t indexCount)
+{
+	positions.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		positions[v] = glm::vec3(vertices[v * GEOMETRY_VERTEX_FLOATS], vertices[v * GEOMETRY_VERTEX_FLOATS + 1], vertices[v * GEOMETRY_VERTEX_FLOATS + 2]);
+	}
+
+	// sorted by position, each run of equal positions welds to its lowest vertex
+	std::vector<GLuint> order(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		order[v] = (GLuint)v;
+	}
+	std::sort(order.begin(), order.end(), [this](GLuint a, GLuint b) {
+		const glm::vec3& p = positions[a];
+		const glm::vec3& q = positions[b];
+		return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z != q.z ? p.z < q.z : a < b;
+	});
+	weld.resize(vertexCount);
+	locked.assign(vertexCount, 0);
+	for (size_t i = 0; i < vertexCount; i++) {
+		bool same = i > 0 && positions[order[i]] == positions[order[i - 1]];
+		weld[order[i]] = same ? weld[order[i - 1]] : order[i];
+		if (same) {
+			locked[weld[order[i]]] = 1;
+		}
+	}
+
+	// triangles already degenerate once welded are dropped
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		GLuint a = weld[source[i]], b = weld[source[i + 1]], c = weld[source[i + 2]];
+		if (a != b && b != c && a != c) {
+			indices.insert(indices.end(), source + i, source + i + 3);
+		}
+	}
+
+	// an edge not shared by exactly two triangles is a border, or worse, and keeps its ends
+	std::vector<unsigned long long> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		for (int corner = 0; corner < 3; corner++) {
+			unsigned long long a = weld[indices[i + corner]], b = weld[indices[i + (corner + 1) % 3]];
+			edges.push_back(a < b ? a << 32 | b : b << 32 | a);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size();) {
+		size_t run = i + 1;
+		while (run < edges.size() && edges[run] == edges[i]) {
+			run++;
+		}
+		if (run - i != 2) {
+			locked[edges[i] >> 32] = 1;
+			locked[edges[i] & 0xFFFFFFFFu] = 1;
+		}
+		i = run;
+	}
+
+	quadrics.resize(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		const glm::vec3& p0 = positions[indices[i]];
+		glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f) {
+			continue;
+		}
+		normal /= length;
+		for (int corner = 0; corner < 3; corner++) {
+			quadrics[weld[indices[i + corner]]].AddPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+		}
+	}
+}
+
+void Simplification::BuildAdjacency()
+{
+	size_t vertexCount = positions.size();
+	adjacencyFirst.assign(vertexCount + 1, 0);
+	for (GLuint v : indices) {
+		adjacencyFirst[weld[v] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++) {
+		adjacencyFirst[v + 1] += adjacencyFirst[v];
+	}
+	adjacency.resize(indices.size());
+	std::vector<size_t> fill(adjacencyFirst.begin(), adjacencyFirst.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) {
+		adjacency[fill[weld[indices[i]]]++] = (unsigned int)(i / 3);
+	}
+}
+
+bool Simplification::Folds(GLuint vertex, GLuint target) const
+{
+	for (size_t i = adjacencyFirst[vertex]; i < adjacencyFirst[vertex + 1]; i++) {
+		const GLuint* corners = &indices[adjacency[i] * 3];
+		glm::vec3 before[3], after[3];
+		bool collapses = false;
+		for (int corner = 0; corner < 3; corner++) {
+			collapses |= weld[corners[corner]] == weld[target];
+			before[corner] = positions[corners[corner]];
+			after[corner] = corners[corner] == vertex ? positions[target] : before[corner];
+		}
+		// the triangles along the collapsed edge go away
+		if (collapses) {
+			continue;
+		}
+		glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normalBefore, normalAfter) <= MESH_SIMPLIFY_MAX_TURN * glm::length(normalBefore) * glm::length(normalAfter)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Simplification::Run(size_t targetIndexCount)
+{
+	size_t vertexCount = positions.size();
+	while (indices.size() > targetIndexCount) {
+		BuildAdjacency();
+
+		// the cheapest collapse of every vertex that may go, along the edges of its triangles
+		bestTarget.assign(vertexCount, NONE);
+		bestCost.assign(vertexCount, DBL_MAX);
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (int corner = 0; corner < 3; corner++) {
+				GLuint vertex = indices[i + corner];
+				if (locked[weld[vertex]] || weld[vertex] != vertex) {
+					continue;
+				}
+				for (int other = 1; other < 3; other++) {
+					GLuint target = indices[i + (corner + other) % 3];
+					Quadric merged = quadrics[vertex];
+					merged.Add(quadrics[weld[target]]);
+					double cost = merged.Error(positions[target]);
+					if (cost < bestCost[vertex]) {
+						bestCost[vertex] = cost;
+						bestTarget[vertex] = target;
+					}
+				}
+			}
+		}
+		candidates.clear();
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (bestTarget[v] != NONE) {
+				candidates.push_back((GLuint)v);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [this](GLuint a, GLuint b) { return bestCost[a] < bestCost[b]; });
+
+		// cheapest first; a collapse takes its one ring out of the pass, whose costs and fold
+		// checks it just made stale
+		remap.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			remap[v] = (GLuint)v;
+		}
+		touched.assign(vertexCount, 0);
+		size_t excess = (indices.size() - targetIndexCount + 2) / 3, removed = 0, collapsed = 0;
+		for (GLuint vertex : candidates) {
+			if (removed >= excess) {
+				break;
+			}
+			GLuint target = bestTarget[vertex];
+			if (touched[vertex] || touched[weld[target]] || Folds(vertex, target)) {
+				continue;
+			}
+			for (size_t i = adjacencyFirst[vertex]; i < adjacencyFirst[vertex + 1]; i++) {
+				const GLuint* corners = &indices[adjacency[i] * 3];
+				bool collapses = false;
+				for (int corner = 0; corner < 3; corner++) {
+					touched[weld[corners[corner]]] = 1;
+					collapses |= weld[corners[corner]] == weld[target];
+				}
+				removed += collapses ? 1 : 0;
+			}
+			remap[vertex] = target;
+			quadrics[weld[target]].Add(quadrics[vertex]);
+			error = std::max(error, bestCost[vertex]);
+			collapsed++;
+		}
+		if (collapsed == 0) {
+			break;
+		}
+
+		// the triangles along collapsed edges are left with two corners at one position
+		size_t kept = 0;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			GLuint a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (weld[a] != weld[b] && weld[b] != weld[c] && weld[a] != weld[c]) {
+				indices[kept++] = a;
+				indices[kept++] = b;
+				indices[kept++] = c;
+			}
+		}
+		indices.resize(kept);
+	}
+}
+
+void MeshOptimizer::BuildLods(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount, std::vector<MeshLodLevel>& levels)
+{
+	levels.clear();
+	Simplification simplification(vertices, vertexCount, indices, indexCount);
+	size_t previous = indexCount;
+	for (int level = 1; level < MESH_LOD_LEVELS; level++) {
+		simplification.Run(previous / 6 * 3);
+		size_t count = simplification.Indices().size();
+		if (count == 0 || (float)count > previous * MESH_LOD_MIN_REDUCTION) {
+			break;
+		}
+		MeshLodLevel lod;
+		lod.indices = simplification.Indices();
+		lod.error = simplification.Error();
+		OptimizeVertexCache(lod.indices.data(), lod.indices.size(), vertexCount);
+		levels.push_back(lod);
+		previous = count;
+	}
+}
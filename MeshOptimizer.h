@@ -0,0 +1,44 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <cstddef>
+#include <vector>
+
+// FIFO post transform cache size the miss ratio is measured with, a common hardware size
+#define MESH_CACHE_SIZE 16
+// LRU cache size the triangle order is optimized for, see OptimizeVertexCache
+#define MESH_OPTIMIZER_CACHE 32
+// levels of detail BuildLods makes at most, the full mesh included
+#define MESH_LOD_LEVELS 5
+// a level is only kept when it has at most this share of the triangles of the one before
+#define MESH_LOD_MIN_REDUCTION 0.8f
+
+// a coarser level of a mesh, indexing the full mesh's vertices
+struct MeshLodLevel
+{
+	std::vector<GLuint> indices;
+	// object space distance the level's surface may be off the full mesh's
+	float error;
+};
+
+// Preprocessing of indexed triangle lists, done once when a mesh is loaded or baked.
+class MeshOptimizer
+{
+public:
+	// reorders the triangles so vertices are reused while still in the post transform cache,
+	// after Forsyth's "Linear-Speed Vertex Cache Optimisation"; the triangles stay the same
+	static void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount);
+	// renumbers the vertices in order of first use and moves them accordingly, so the vertex
+	// fetch walks the buffer front to back; unused vertices end up last. The vertices hold
+	// GEOMETRY_VERTEX_FLOATS floats each.
+	static void OptimizeVertexFetch(GLfloat* vertices, size_t vertexCount, GLuint* indices, size_t indexCount);
+	// vertices transformed per triangle with a FIFO cache: 3 means no reuse, a large regular
+	// grid can get close to 0.5
+	static float AverageCacheMissRatio(const GLuint* indices, size_t indexCount, size_t vertexCount, size_t cacheSize = MESH_CACHE_SIZE);
+	// chain of up to MESH_LOD_LEVELS - 1 coarser levels of one simplification run, each with
+	// about half the triangles of the one before; ends early at a level that would not save
+	// enough of them. The run collapses edges onto one of their two vertices, cheapest first by
+	// Garland and Heckbert's quadric error metric. Vertices are never moved or added, so levels
+	// index the mesh's vertices and can share its vertex buffer; vertices on open borders and
+	// ones sharing their position with another, uv or normal seams, stay where they are.
+	static void BuildLods(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount, std::vector<MeshLodLevel>& levels);
+};
@@ -0,0 +1,367 @@
+#include "ObjImporter.h"
+#include "Frustum.h"
+#include "MeshOptimizer.h"
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+// the v/vt/vn triple of a face corner, 0 based, -1 when the corner leaves it out
+struct ObjCorner
+{
+	int position, texCoords, normal;
+	bool operator==(const ObjCorner& other) const { return position == other.position && texCoords == other.texCoords && normal == other.normal; }
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner& corner) const
+	{
+		return ((size_t)corner.position * 73856093u) ^ ((size_t)(corner.texCoords + 1) * 19349663u) ^ ((size_t)(corner.normal + 1) * 83492791u);
+	}
+};
+
+// the faces of one object and material pair, becomes one mesh
+struct ObjPart
+{
+	std::string object;
+	unsigned int material;
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	std::vector<unsigned char> needsNormal;
+	std::unordered_map<ObjCorner, GLuint, ObjCornerHash> corners;
+};
+
+static const char* SkipSpaces(const char* text)
+{
+	while (*text == ' ' || *text == '\t') {
+		text++;
+	}
+	return text;
+}
+
+// whether line starts with keyword followed by a space, tab or the end
+static bool Keyword(const char* line, const char* keyword, const char** rest)
+{
+	size_t length = strlen(keyword);
+	if (strncmp(line, keyword, length) != 0 || (line[length] != ' ' && line[length] != '\t' && line[length] != '\0')) {
+		return false;
+	}
+	*rest = SkipSpaces(line + length);
+	return true;
+}
+
+// up to count floats, returns how many were read
+static int ReadFloats(const char* text, float* values, int count)
+{
+	int read = 0;
+	while (read < count) {
+		char* end;
+		float value = strtof(text, &end);
+		if (end == text) {
+			break;
+		}
+		values[read++] = value;
+		text = end;
+	}
+	return read;
+}
+
+// the rest of the line without trailing white space
+static std::string Trimmed(const char* text)
+{
+	size_t length = strlen(text);
+	while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t' || text[length - 1] == '\r')) {
+		length--;
+	}
+	return std::string(text, length);
+}
+
+static std::string Directory(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// map_* entries may put options before the file name, which comes last
+static std::string LastToken(const char* text)
+{
+	std::string value = Trimmed(text);
+	size_t space = value.find_last_of(" \t");
+	return space == std::string::npos ? value : value.substr(space + 1);
+}
+
+// texture paths are stored relative to the OBJ, prefix is the library's directory relative to it
+static void ReadMaterialLibrary(const std::string& path, const std::string& prefix, PackageContent& content, std::unordered_map<std::string, unsigned int>& materialIds)
+{
+	std::ifstream in(path.c_str());
+	if (!in) {
+		std::cout << "WARNING::OBJ_IMPORTER::MTLLIB_NOT_FOUND " << path << std::endl;
+		return;
+	}
+	std::string line;
+	size_t current = content.materials.size();
+	while (std::getline(in, line)) {
+		const char* text = SkipSpaces(line.c_str());
+		const char* rest;
+		if (Keyword(text, "newmtl", &rest)) {
+			PackageMaterial material;
+			material.diffuse = material.specular = SCENE_PACKAGE_NO_STRING;
+			material.flags = SCENE_PACKAGE_MIPMAPS;
+			// the demo's shininess for materials that do not say
+			material.shininess = 0.4f;
+			current = content.materials.size();
+			content.materials.push_back(material);
+			materialIds[Trimmed(rest)] = (unsigned int)current;
+		}
+		else if (current < content.materials.size()) {
+			if (Keyword(text, "Ns", &rest)) {
+				ReadFloats(rest, &content.materials[current].shininess, 1);
+			}
+			else if (Keyword(text, "map_Kd", &rest)) {
+				content.materials[current].diffuse = content.AddString(prefix + LastToken(rest));
+			}
+			else if (Keyword(text, "map_Ks", &rest)) {
+				content.materials[current].specular = content.AddString(prefix + LastToken(rest));
+			}
+		}
+	}
+}
+
+// the corner's vertex in part, added on first use
+static GLuint CornerVertex(ObjPart& part, const ObjCorner& corner, const std::vector<float>& positions, const std::vector<float>& texCoords, const std::vector<float>& normals)
+{
+	std::unordered_map<ObjCorner, GLuint, ObjCornerHash>::iterator found = part.corners.find(corner);
+	if (found != part.corners.end()) {
+		return found->second;
+	}
+	GLuint index = (GLuint)part.needsNormal.size();
+	GLfloat vertex[GEOMETRY_VERTEX_FLOATS] = {};
+	memcpy(vertex, &positions[corner.position * 3], 3 * sizeof(float));
+	if (corner.texCoords >= 0) {
+		memcpy(vertex + 3, &texCoords[corner.texCoords * 2], 2 * sizeof(float));
+	}
+	if (corner.normal >= 0) {
+		memcpy(vertex + 5, &normals[corner.normal * 3], 3 * sizeof(float));
+	}
+	part.vertices.insert(part.vertices.end(), vertex, vertex + GEOMETRY_VERTEX_FLOATS);
+	part.needsNormal.push_back(corner.normal < 0);
+	part.corners[corner] = index;
+	return index;
+}
+
+// one OBJ index to 0 based, negative ones count back from the end; -1 if out of range
+static int ResolveIndex(long index, size_t count)
+{
+	long resolved = index < 0 ? (long)count + index : index - 1;
+	return resolved >= 0 && resolved < (long)count ? (int)resolved : -1;
+}
+
+// area weighted average of the face normals, for the vertices the file gave none
+static void SmoothNormals(ObjPart& part)
+{
+	bool any = false;
+	for (unsigned char needs : part.needsNormal) {
+		any = any || needs;
+	}
+	if (!any) {
+		return;
+	}
+	for (size_t i = 0; i + 2 < part.indices.size(); i += 3) {
+		GLfloat* corners[3];
+		for (int c = 0; c < 3; c++) {
+			corners[c] = &part.vertices[part.indices[i + c] * GEOMETRY_VERTEX_FLOATS];
+		}
+		glm::vec3 p0(corners[0][0], corners[0][1], corners[0][2]);
+		glm::vec3 p1(corners[1][0], corners[1][1], corners[1][2]);
+		glm::vec3 p2(corners[2][0], corners[2][1], corners[2][2]);
+		glm::vec3 face = glm::cross(p1 - p0, p2 - p0);
+		for (int c = 0; c < 3; c++) {
+			if (part.needsNormal[part.indices[i + c]]) {
+				corners[c][5] += face.x;
+				corners[c][6] += face.y;
+				corners[c][7] += face.z;
+			}
+		}
+	}
+	for (size_t v = 0; v < part.needsNormal.size(); v++) {
+		if (part.needsNormal[v]) {
+			GLfloat* normal = &part.vertices[v * GEOMETRY_VERTEX_FLOATS + 5];
+			float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			for (int c = 0; c < 3; c++) {
+				normal[c] = length > 0.0f ? normal[c] / length : (c == 1 ? 1.0f : 0.0f);
+			}
+		}
+	}
+}
+
+bool ObjImporter::Import(const std::string& objPath, PackageContent& content)
+{
+	std::ifstream in(objPath.c_str());
+	if (!in) {
+		std::cout << "ERROR::OBJ_IMPORTER::OPEN_FAILED " << objPath << std::endl;
+		return false;
+	}
+	std::string directory = Directory(objPath);
+
+	std::vector<float> positions, texCoords, normals;
+	std::vector<ObjPart> parts;
+	std::unordered_map<std::string, unsigned int> materialIds;
+	const unsigned int noMaterial = 0xFFFFFFFFu;
+	unsigned int defaultMaterial = noMaterial, material = noMaterial;
+	std::string object;
+	size_t part = parts.size();
+	size_t skippedFaces = 0;
+	std::vector<GLuint> face;
+
+	std::string line;
+	while (std::getline(in, line)) {
+		const char* text = SkipSpaces(line.c_str());
+		const char* rest;
+		if (Keyword(text, "v", &rest)) {
+			float values[3] = {};
+			ReadFloats(rest, values, 3);
+			positions.insert(positions.end(), values, values + 3);
+		}
+		else if (Keyword(text, "vt", &rest)) {
+			float values[2] = {};
+			ReadFloats(rest, values, 2);
+			texCoords.insert(texCoords.end(), values, values + 2);
+		}
+		else if (Keyword(text, "vn", &rest)) {
+			float values[3] = {};
+			ReadFloats(rest, values, 3);
+			normals.insert(normals.end(), values, values + 3);
+		}
+		else if (Keyword(text, "f", &rest)) {
+			if (material == noMaterial) {
+				if (defaultMaterial == noMaterial) {
+					PackageMaterial fallback = { SCENE_PACKAGE_NO_STRING, SCENE_PACKAGE_NO_STRING, SCENE_PACKAGE_MIPMAPS, 0.4f };
+					defaultMaterial = (unsigned int)content.materials.size();
+					content.materials.push_back(fallback);
+				}
+				material = defaultMaterial;
+			}
+			if (part == parts.size()) {
+				for (part = 0; part < parts.size(); part++) {
+					if (parts[part].object == object && parts[part].material == material) {
+						break;
+					}
+				}
+				if (part == parts.size()) {
+					parts.push_back(ObjPart());
+					parts.back().object = object;
+					parts.back().material = material;
+				}
+			}
+
+			face.clear();
+			bool valid = true;
+			const char* corner = rest;
+			while (*corner != '\0' && *corner != '\r') {
+				char* end;
+				long indices[3] = { strtol(corner, &end, 10), 0, 0 };
+				if (end == corner) {
+					break;
+				}
+				corner = end;
+				for (int slot = 1; slot < 3 && *corner == '/'; slot++) {
+					corner++;
+					indices[slot] = strtol(corner, &end, 10);
+					corner = end;
+				}
+				ObjCorner key;
+				key.position = ResolveIndex(indices[0], positions.size() / 3);
+				key.texCoords = indices[1] == 0 ? -1 : ResolveIndex(indices[1], texCoords.size() / 2);
+				key.normal = indices[2] == 0 ? -1 : ResolveIndex(indices[2], normals.size() / 3);
+				valid = valid && key.position >= 0 && (indices[1] == 0 || key.texCoords >= 0) && (indices[2] == 0 || key.normal >= 0);
+				if (valid) {
+					face.push_back(CornerVertex(parts[part], key, positions, texCoords, normals));
+				}
+				corner = SkipSpaces(corner);
+			}
+			if (!valid || face.size() < 3) {
+				skippedFaces++;
+				continue;
+			}
+			for (size_t i = 1; i + 1 < face.size(); i++) {
+				const GLuint triangle[3] = { face[0], face[i], face[i + 1] };
+				parts[part].indices.insert(parts[part].indices.end(), triangle, triangle + 3);
+			}
+		}
+		else if (Keyword(text, "o", &rest) || Keyword(text, "g", &rest)) {
+			object = Trimmed(rest);
+			part = parts.size();
+		}
+		else if (Keyword(text, "usemtl", &rest)) {
+			std::unordered_map<std::string, unsigned int>::iterator found = materialIds.find(Trimmed(rest));
+			material = found != materialIds.end() ? found->second : noMaterial;
+			part = parts.size();
+		}
+		else if (Keyword(text, "mtllib", &rest)) {
+			std::string library = Trimmed(rest);
+			ReadMaterialLibrary(directory + library, Directory(library), content, materialIds);
+		}
+		else if (Keyword(text, "#light", &rest)) {
+			float values[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 1.0f, 0.09f, 0.032f };
+			if (ReadFloats(rest, values, 12) < 9) {
+				std::cout << "WARNING::OBJ_IMPORTER::INVALID_LIGHT " << Trimmed(rest) << std::endl;
+				continue;
+			}
+			PackageLight light;
+			memcpy(light.position, values, 3 * sizeof(float));
+			memcpy(light.ambient, values + 3, 3 * sizeof(float));
+			memcpy(light.diffuse, values + 6, 3 * sizeof(float));
+			memcpy(light.specular, values + 6, 3 * sizeof(float));
+			light.constant = values[9];
+			light.linear = values[10];
+			light.quadratic = values[11];
+			content.lights.push_back(light);
+		}
+	}
+	if (skippedFaces > 0) {
+		std::cout << "WARNING::OBJ_IMPORTER::INVALID_FACES " << skippedFaces << " in " << objPath << std::endl;
+	}
+
+	for (ObjPart& source : parts) {
+		if (source.indices.empty()) {
+			continue;
+		}
+		SmoothNormals(source);
+		size_t vertexCount = source.needsNormal.size();
+		MeshOptimizer::OptimizeVertexCache(source.indices.data(), source.indices.size(), vertexCount);
+		MeshOptimizer::OptimizeVertexFetch(source.vertices.data(), vertexCount, source.indices.data(), source.indices.size());
+		std::vector<MeshLodLevel> levels;
+		MeshOptimizer::BuildLods(source.vertices.data(), vertexCount, source.indices.data(), source.indices.size(), levels);
+
+		PackageMesh mesh;
+		mesh.firstVertex = (unsigned int)(content.vertices.size() / GEOMETRY_VERTEX_FLOATS);
+		mesh.vertexCount = (unsigned int)vertexCount;
+		mesh.firstIndex = (unsigned int)content.indices.size();
+		mesh.indexCount = (unsigned int)source.indices.size();
+		AABB bounds = AABB::FromVertices(source.vertices.data(), vertexCount, GEOMETRY_VERTEX_FLOATS);
+		memcpy(mesh.boundsMin, &bounds.min[0], sizeof(mesh.boundsMin));
+		memcpy(mesh.boundsMax, &bounds.max[0], sizeof(mesh.boundsMax));
+		mesh.firstLod = (unsigned int)content.lods.size();
+		mesh.lodCount = (unsigned int)levels.size();
+
+		PackageRenderable renderable = { (unsigned int)content.meshes.size(), source.material, { 0, 0, 0 }, { 0, 0, 0, 1 }, { 1, 1, 1 } };
+		content.meshes.push_back(mesh);
+		content.renderables.push_back(renderable);
+		content.vertices.insert(content.vertices.end(), source.vertices.begin(), source.vertices.end());
+		content.indices.insert(content.indices.end(), source.indices.begin(), source.indices.end());
+		// the levels go behind the full mesh's indices, on its vertices
+		for (const MeshLodLevel& level : levels) {
+			PackageLod lod;
+			lod.firstIndex = (unsigned int)content.indices.size();
+			lod.indexCount = (unsigned int)level.indices.size();
+			lod.error = level.error;
+			content.lods.push_back(lod);
+			content.indices.insert(content.indices.end(), level.indices.begin(), level.indices.end());
+		}
+	}
+	return true;
+}
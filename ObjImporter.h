@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include "ScenePackage.h"
+
+// Wavefront OBJ to package content, the offline half of the scene package. Reads v, vt, vn and
+// f (polygons are fanned into triangles, negative indices count from the end), o and g, and
+// usemtl with the newmtl, Ns, map_Kd and map_Ks entries of its mtllib. Every object and
+// material pair becomes one mesh with one renderable at the origin; vertices without a normal
+// get the average of their faces' normals. Each mesh is optimized with MeshOptimizer, and its
+// levels of detail are baked into the package so loading it builds none.
+//
+// OBJ has no lights, so point lights are read from comment lines the other tools ignore:
+//   #light px py pz  ar ag ab  dr dg db  [constant linear quadratic]
+// with the diffuse colour also used as specular.
+class ObjImporter
+{
+public:
+	// appends to content, which may already hold other imports; false if the file cannot be read
+	static bool Import(const std::string& objPath, PackageContent& content);
+};
@@ -0,0 +1,186 @@
+#include "OcclusionCuller.h"
+
+void OcclusionCuller::Create()
+{
+	// unit cube, scaled and moved onto each box by the vertex shader
+	const GLfloat corners[] = {
+		0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0,
+		0, 0, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1,
+	};
+	const GLubyte indices[] = {
+		0, 2, 1, 0, 3, 2, // back
+		4, 5, 6, 4, 6, 7, // front
+		0, 1, 5, 0, 5, 4, // bottom
+		3, 6, 2, 3, 7, 6, // top
+		0, 4, 7, 0, 7, 3, // left
+		1, 2, 6, 1, 6, 5, // right
+	};
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ebo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+}
+
+void OcclusionCuller::Delete()
+{
+	for (const Query& query : inFlight) {
+		glDeleteQueries(1, &query.query);
+	}
+	if (!freeQueries.empty()) {
+		glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+	}
+	inFlight.clear();
+	freeQueries.clear();
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+	vao = vbo = ebo = 0;
+	tracked.clear();
+	hiddenEntities.clear();
+}
+
+void OcclusionCuller::SetShader(const Shader& shader)
+{
+	boxShader = shader;
+	viewProjectionUniform = boxShader.Get<glm::mat4>("viewProjection");
+	boxMinUniform = boxShader.Get<glm::vec3>("boxMin");
+	boxSizeUniform = boxShader.Get<glm::vec3>("boxSize");
+}
+
+OcclusionCuller::Tracked& OcclusionCuller::Track(Entity entity)
+{
+	if (entity.index >= tracked.size()) {
+		tracked.resize(entity.index + 1);
+	}
+	Tracked& state = tracked[entity.index];
+	if (state.generation != entity.generation) {
+		state = Tracked();
+		state.generation = entity.generation;
+	}
+	return state;
+}
+
+void OcclusionCuller::Show(Scene& scene, Entity entity, Tracked& state)
+{
+	state.occludedFrames = 0;
+	if (state.hidden) {
+		state.hidden = false;
+		scene.SetHidden(entity, false);
+	}
+}
+
+void OcclusionCuller::Resolve(Scene& scene)
+{
+	// queries finish in the order they were issued, the first one not available ends the check
+	while (!inFlight.empty()) {
+		const Query& query = inFlight.front();
+		GLuint available = 0;
+		glGetQueryObjectuiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			break;
+		}
+		GLuint passed = 0;
+		glGetQueryObjectuiv(query.query, GL_QUERY_RESULT, &passed);
+		freeQueries.push_back(query.query);
+		Entity entity = query.entity;
+		inFlight.pop_front();
+
+		// a query of an entity that is gone by now
+		if (entity.index >= tracked.size() || tracked[entity.index].generation != entity.generation) {
+			continue;
+		}
+		Tracked& state = tracked[entity.index];
+		state.pending = false;
+		if (passed) {
+			Show(scene, entity, state);
+		}
+		else if (++state.occludedFrames >= OCCLUSION_HIDE_FRAMES && !state.hidden) {
+			state.hidden = true;
+			scene.SetHidden(entity, true);
+			hiddenEntities.push_back(entity);
+		}
+	}
+}
+
+void OcclusionCuller::Issue(GLState& state, Scene& scene, const glm::mat4& viewProjection, const glm::vec3& eye)
+{
+	frame++;
+	queries = hidden = hiddenTriangles = 0;
+	scene.FrustumRenderables(entities, bounds);
+
+	state.UseProgram(boxShader.program);
+	state.BindVertexArray(vao);
+	state.Enable(GL_DEPTH_TEST);
+	boxShader.Set(viewProjectionUniform, viewProjection);
+	// the boxes only test, the frame keeps its colour and depth
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+
+	for (size_t i = 0; i < entities.size(); i++) {
+		Tracked& tracking = Track(entities[i]);
+		tracking.frame = frame;
+		AABB box = bounds[i].Expanded(OCCLUSION_BOX_MARGIN);
+		// the near plane cuts into a box around the eye, whatever is left of it says nothing
+		if (box.Contains(AABB(eye, eye))) {
+			Show(scene, entities[i], tracking);
+			continue;
+		}
+		if (tracking.hidden) {
+			unsigned int mesh, material;
+			glm::mat4 model;
+			hidden++;
+			if (scene.Renderable(entities[i], mesh, material, model)) {
+				hiddenTriangles += scene.LodRange(mesh, scene.Lod(entities[i])).indexCount / 3;
+			}
+		}
+		if (tracking.pending) {
+			continue;
+		}
+
+		GLuint query;
+		if (freeQueries.empty()) {
+			glGenQueries(1, &query);
+		}
+		else {
+			query = freeQueries.back();
+			freeQueries.pop_back();
+		}
+		boxShader.Set(boxMinUniform, box.min);
+		boxShader.Set(boxSizeUniform, box.max - box.min);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (GLvoid*)0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		Query issued;
+		issued.query = query;
+		issued.entity = entities[i];
+		inFlight.push_back(issued);
+		tracking.pending = true;
+		queries++;
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+
+	// hidden renderables that left the frustum come back shown, so they are there the frame
+	// they return instead of one later
+	size_t kept = 0;
+	for (Entity entity : hiddenEntities) {
+		if (entity.index >= tracked.size() || tracked[entity.index].generation != entity.generation || !tracked[entity.index].hidden) {
+			continue;
+		}
+		Tracked& tracking = tracked[entity.index];
+		if (tracking.frame != frame) {
+			Show(scene, entity, tracking);
+			continue;
+		}
+		hiddenEntities[kept++] = entity;
+	}
+	hiddenEntities.resize(kept);
+}
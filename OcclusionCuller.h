@@ -0,0 +1,87 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "Frustum.h"
+#include "GLState.h"
+#include "Scene.h"
+#include "Shader.h"
+
+// query results in a row that have to find a renderable occluded before it is hidden, so one
+// that peeks out between occluders every other frame does not flicker
+#define OCCLUSION_HIDE_FRAMES 3
+// boxes grow by this much on every side, so a surface lying on its own box never hides it
+#define OCCLUSION_BOX_MARGIN 0.05f
+
+// Occlusion culling with GL_ANY_SAMPLES_PASSED queries. Once the frame's opaque renderables are
+// drawn, the world box of every renderable inside the frustum, hidden ones included, is drawn
+// against their depth in a query of its own, without writing colour or depth. The results are
+// read in a later frame, only once GL says they are available, so the CPU never waits on them.
+// A renderable is hidden after OCCLUSION_HIDE_FRAMES occluded results in a row and shown again
+// by the first result that finds it visible, one frame after it came out from behind its
+// occluders. Hidden renderables are left out of Scene::Cull's batches but still cast shadows.
+//
+// Scene batches draw many instances per call, so results are consumed a frame late rather than
+// by conditional rendering, which could only skip a whole batch.
+//
+// Per frame: Resolve before Scene::Cull, Issue after the opaque draws.
+class OcclusionCuller
+{
+public:
+	void Create();
+	void Delete();
+	// occlusionBox.vert with shadowDepth.frag
+	void SetShader(const Shader& shader);
+
+	// applies the results that are available, shows and hides renderables of the scene
+	void Resolve(Scene& scene);
+	// queries the boxes of the renderables of the last Scene::Cull against the bound depth buffer;
+	// hidden renderables that left the frustum or hold the eye are shown again
+	void Issue(GLState& state, Scene& scene, const glm::mat4& viewProjection, const glm::vec3& eye);
+
+	// of the last Issue: queries issued, hidden renderables inside the frustum and their triangles
+	// at the level of detail they would be drawn at
+	size_t Queries() const { return queries; }
+	size_t Hidden() const { return hidden; }
+	size_t HiddenTriangles() const { return hiddenTriangles; }
+
+private:
+	// occlusion state of an entity, by entity index
+	struct Tracked
+	{
+		unsigned int generation = 0;
+		unsigned int occludedFrames = 0;
+		bool hidden = false;
+		// a query of it is in flight, no other is issued until it is read
+		bool pending = false;
+		// last Issue that found it inside the frustum
+		unsigned long long frame = 0;
+	};
+
+	struct Query
+	{
+		GLuint query;
+		Entity entity;
+	};
+
+	GLuint vao = 0, vbo = 0, ebo = 0;
+	Shader boxShader;
+	Uniform<glm::mat4> viewProjectionUniform;
+	Uniform<glm::vec3> boxMinUniform, boxSizeUniform;
+
+	std::vector<Tracked> tracked;
+	// in flight in the order they were issued, and query objects ready for reuse
+	std::deque<Query> inFlight;
+	std::vector<GLuint> freeQueries;
+	std::vector<Entity> hiddenEntities;
+	std::vector<Entity> entities;
+	std::vector<AABB> bounds;
+	unsigned long long frame = 0;
+	size_t queries = 0, hidden = 0, hiddenTriangles = 0;
+
+	// the state of entity, reset if the index belonged to an entity that is gone
+	Tracked& Track(Entity entity);
+	void Show(Scene& scene, Entity entity, Tracked& state);
+};
@@ -0,0 +1,381 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+// the history keeps the newest samples only, about an hour at 60 fps
+static const size_t HISTORY_LIMIT = 1 << 18;
+
+static const char* PHASE_NAMES[PHASE_COUNT] = { "input", "update", "render", "swap" };
+
+Profiler::~Profiler()
+{
+	Shutdown();
+}
+
+void Profiler::Init(bool gpuTimers)
+{
+	this->gpuTimers = gpuTimers;
+	for (InFlight& slot : inFlight) {
+		if (gpuTimers) {
+			glGenQueries(PROFILER_MAX_PASSES, slot.queries);
+		}
+		slot.used = false;
+	}
+	memset(passIssued, 0, sizeof(passIssued));
+	frame = 0;
+	initialized = true;
+
+	collecting = true;
+	collector = std::thread(&Profiler::Collect, this);
+}
+
+void Profiler::Shutdown()
+{
+	if (!initialized) {
+		return;
+	}
+
+	// the remaining frames are waited for, in the order they were rendered
+	for (unsigned long long f = frame > PROFILER_QUERY_LATENCY ? frame - PROFILER_QUERY_LATENCY : 0; f < frame; f++) {
+		InFlight& slot = inFlight[f % PROFILER_QUERY_LATENCY];
+		if (slot.used) {
+			Resolve(slot, true);
+		}
+	}
+	if (gpuTimers) {
+		for (InFlight& slot : inFlight) {
+			glDeleteQueries(PROFILER_MAX_PASSES, slot.queries);
+		}
+	}
+	initialized = false;
+
+	collecting = false;
+	collector.join();
+}
+
+void Profiler::BeginFrame()
+{
+	if (!initialized) {
+		return;
+	}
+	// this slot was last used PROFILER_QUERY_LATENCY frames ago, its queries should be done by now
+	InFlight& slot = inFlight[frame % PROFILER_QUERY_LATENCY];
+	if (slot.used) {
+		Resolve(slot, false);
+	}
+
+	memset(&current, 0, sizeof(current));
+	current.frame = frame;
+	for (float& gpu : current.gpuMs) {
+		gpu = -1.0f;
+	}
+	memset(passIssued, 0, sizeof(passIssued));
+	frameStart = Clock::now();
+}
+
+void Profiler::EndFrame()
+{
+	if (!initialized) {
+		return;
+	}
+	current.frameMs = std::chrono::duration<float, std::milli>(Clock::now() - frameStart).count();
+
+	InFlight& slot = inFlight[frame % PROFILER_QUERY_LATENCY];
+	slot.sample = current;
+	memcpy(slot.issued, passIssued, sizeof(passIssued));
+	slot.used = true;
+	frame++;
+}
+
+void Profiler::BeginPhase(ProfilePhase phase)
+{
+	phaseStart[phase] = Clock::now();
+}
+
+void Profiler::EndPhase(ProfilePhase phase)
+{
+	current.cpuMs[phase] += std::chrono::duration<float, std::milli>(Clock::now() - phaseStart[phase]).count();
+}
+
+void Profiler::BeginGpuPass(const char* name)
+{
+	if (!initialized || !gpuTimers || activePass >= 0) {
+		return;
+	}
+	int pass = FindOrAdd(passNames, name, PROFILER_MAX_PASSES);
+	// a pass can only be timed once per frame, its query object is per slot
+	if (pass < 0 || passIssued[pass]) {
+		return;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, inFlight[frame % PROFILER_QUERY_LATENCY].queries[pass]);
+	passIssued[pass] = true;
+	activePass = pass;
+}
+
+void Profiler::EndGpuPass()
+{
+	if (activePass < 0) {
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	activePass = -1;
+}
+
+void Profiler::SetCounter(const char* name, double value)
+{
+	int counter = FindOrAdd(counterNames, name, PROFILER_MAX_COUNTERS);
+	if (counter >= 0) {
+		current.counters[counter] = (float)value;
+	}
+}
+
+int Profiler::FindOrAdd(std::vector<std::string>& names, const char* name, size_t limit)
+{
+	for (size_t i = 0; i < names.size(); i++) {
+		if (names[i] == name) {
+			return (int)i;
+		}
+	}
+	if (names.size() == limit) {
+		return -1;
+	}
+	names.push_back(name);
+	return (int)names.size() - 1;
+}
+
+void Profiler::Resolve(InFlight& slot, bool wait)
+{
+	for (int pass = 0; pass < PROFILER_MAX_PASSES; pass++) {
+		if (!slot.issued[pass]) {
+			continue;
+		}
+		GLint available = 0;
+		if (!wait) {
+			glGetQueryObjectiv(slot.queries[pass], GL_QUERY_RESULT_AVAILABLE, &available);
+		}
+		if (wait || available) {
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(slot.queries[pass], GL_QUERY_RESULT, &nanoseconds);
+			slot.sample.gpuMs[pass] = (float)(nanoseconds / 1.0e6);
+		}
+	}
+	slot.used = false;
+	Publish(slot.sample);
+}
+
+void Profiler::Publish(const FrameSample& sample)
+{
+	if (!ring.Push(sample)) {
+		dropped++;
+	}
+}
+
+void Profiler::Collect()
+{
+	// drains the ring buffer into the history until Shutdown, then one last time
+	for (;;) {
+		bool stop = !collecting;
+		{
+			FrameSample sample;
+			std::lock_guard<std::mutex> lock(historyMutex);
+			while (ring.Pop(sample)) {
+				history.push_back(sample);
+				if (history.size() > HISTORY_LIMIT) {
+					history.pop_front();
+				}
+			}
+		}
+		if (stop) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
+
+std::vector<FrameSample> Profiler::Snapshot()
+{
+	std::lock_guard<std::mutex> lock(historyMutex);
+	return std::vector<FrameSample>(history.begin(), history.end());
+}
+
+double Profiler::Percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+	return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+std::vector<double> Profiler::FrameTimes()
+{
+	std::vector<FrameSample> samples = Snapshot();
+	std::vector<double> times;
+	times.reserve(samples.size());
+	for (const FrameSample& sample : samples) {
+		times.push_back(sample.frameMs);
+	}
+	return times;
+}
+
+// one named column of the history with its summary statistics
+struct Series
+{
+	std::string name;
+	std::vector<double> values;
+	double mean, p50, p95, p99, max;
+};
+
+static void Summarize(Series& series)
+{
+	std::vector<double> sorted = series.values;
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0;
+	for (double value : sorted) {
+		total += value;
+	}
+	series.mean = sorted.empty() ? 0.0 : total / sorted.size();
+	series.p50 = Profiler::Percentile(sorted, 50);
+	series.p95 = Profiler::Percentile(sorted, 95);
+	series.p99 = Profiler::Percentile(sorted, 99);
+	series.max = sorted.empty() ? 0.0 : sorted.back();
+}
+
+static std::vector<Series> BuildSeries(const std::vector<FrameSample>& samples, const std::vector<std::string>& passNames, const std::vector<std::string>& counterNames)
+{
+	std::vector<Series> series;
+	Series frameSeries;
+	frameSeries.name = "frame_ms";
+	for (const FrameSample& sample : samples) {
+		frameSeries.values.push_back(sample.frameMs);
+	}
+	series.push_back(frameSeries);
+
+	for (int phase = 0; phase < PHASE_COUNT; phase++) {
+		Series phaseSeries;
+		phaseSeries.name = std::string(PHASE_NAMES[phase]) + "_ms";
+		for (const FrameSample& sample : samples) {
+			phaseSeries.values.push_back(sample.cpuMs[phase]);
+		}
+		series.push_back(phaseSeries);
+	}
+	// GPU passes only count frames in which they ran and were resolved
+	for (size_t pass = 0; pass < passNames.size(); pass++) {
+		Series passSeries;
+		passSeries.name = "gpu_" + passNames[pass] + "_ms";
+		for (const FrameSample& sample : samples) {
+			if (sample.gpuMs[pass] >= 0.0f) {
+				passSeries.values.push_back(sample.gpuMs[pass]);
+			}
+		}
+		series.push_back(passSeries);
+	}
+	for (size_t counter = 0; counter < counterNames.size(); counter++) {
+		Series counterSeries;
+		counterSeries.name = counterNames[counter];
+		for (const FrameSample& sample : samples) {
+			counterSeries.values.push_back(sample.counters[counter]);
+		}
+		series.push_back(counterSeries);
+	}
+	for (Series& s : series) {
+		Summarize(s);
+	}
+	return series;
+}
+
+void Profiler::PrintSummary(std::ostream& out)
+{
+	std::vector<FrameSample> samples = Snapshot();
+	std::vector<Series> series = BuildSeries(samples, passNames, counterNames);
+
+	out << "Profile of " << samples.size() << " frames";
+	if (dropped > 0) {
+		out << " (" << dropped << " dropped)";
+	}
+	out << std::endl;
+	out << std::setw(28) << std::left << "" << std::right << std::setw(10) << "mean" << std::setw(10) << "p50"
+		<< std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+	out << std::fixed << std::setprecision(3);
+	for (const Series& s : series) {
+		out << std::setw(28) << std::left << s.name << std::right << std::setw(10) << s.mean << std::setw(10) << s.p50
+			<< std::setw(10) << s.p95 << std::setw(10) << s.p99 << std::setw(10) << s.max << std::endl;
+	}
+	out << std::defaultfloat;
+}
+
+bool Profiler::Export(const std::string& path)
+{
+	std::ofstream file(path.c_str());
+	if (!file) {
+		return false;
+	}
+	std::vector<FrameSample> samples = Snapshot();
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	file << std::fixed << std::setprecision(4);
+
+	if (!json) {
+		file << "frame,frame_ms";
+		for (int phase = 0; phase < PHASE_COUNT; phase++) {
+			file << "," << PHASE_NAMES[phase] << "_ms";
+		}
+		for (const std::string& name : passNames) {
+			file << ",gpu_" << name << "_ms";
+		}
+		for (const std::string& name : counterNames) {
+			file << "," << name;
+		}
+		file << "\n";
+		for (const FrameSample& sample : samples) {
+			file << sample.frame << "," << sample.frameMs;
+			for (int phase = 0; phase < PHASE_COUNT; phase++) {
+				file << "," << sample.cpuMs[phase];
+			}
+			for (size_t pass = 0; pass < passNames.size(); pass++) {
+				file << ",";
+				if (sample.gpuMs[pass] >= 0.0f) {
+					file << sample.gpuMs[pass];
+				}
+			}
+			for (size_t counter = 0; counter < counterNames.size(); counter++) {
+				file << "," << sample.counters[counter];
+			}
+			file << "\n";
+		}
+		return true;
+	}
+
+	std::vector<Series> series = BuildSeries(samples, passNames, counterNames);
+	file << "{\n  \"summary\": {\n";
+	for (size_t i = 0; i < series.size(); i++) {
+		const Series& s = series[i];
+		file << "    \"" << s.name << "\": { \"mean\": " << s.mean << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95
+			<< ", \"p99\": " << s.p99 << ", \"max\": " << s.max << " }" << (i + 1 < series.size() ? "," : "") << "\n";
+	}
+	file << "  },\n  \"dropped\": " << dropped << ",\n  \"frames\": [\n";
+	for (size_t i = 0; i < samples.size(); i++) {
+		const FrameSample& sample = samples[i];
+		file << "    { \"frame\": " << sample.frame << ", \"frame_ms\": " << sample.frameMs;
+		for (int phase = 0; phase < PHASE_COUNT; phase++) {
+			file << ", \"" << PHASE_NAMES[phase] << "_ms\": " << sample.cpuMs[phase];
+		}
+		for (size_t pass = 0; pass < passNames.size(); pass++) {
+			file << ", \"gpu_" << passNames[pass] << "_ms\": ";
+			if (sample.gpuMs[pass] >= 0.0f) {
+				file << sample.gpuMs[pass];
+			}
+			else {
+				file << "null";
+			}
+		}
+		for (size_t counter = 0; counter < counterNames.size(); counter++) {
+			file << ", \"" << counterNames[counter] << "\": " << sample.counters[counter];
+		}
+		file << " }" << (i + 1 < samples.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n}\n";
+	return true;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RingBuffer.h"
+
+// CPU phases of the main loop, timed by CpuScope
+enum ProfilePhase
+{
+	PHASE_INPUT,
+	PHASE_UPDATE,
+	PHASE_RENDER,
+	PHASE_SWAP,
+	PHASE_COUNT
+};
+
+#define PROFILER_MAX_PASSES 8
+#define PROFILER_MAX_COUNTERS 24
+// frames between issuing a GL timer query and reading it back, so reading never waits on the GPU
+#define PROFILER_QUERY_LATENCY 4
+
+struct FrameSample
+{
+	unsigned long long frame;
+	float frameMs;
+	float cpuMs[PHASE_COUNT];
+	// -1 when the pass did not run that frame, or its query was still not ready after the latency
+	float gpuMs[PROFILER_MAX_PASSES];
+	float counters[PROFILER_MAX_COUNTERS];
+};
+
+// Per frame instrumentation of the main loop. Samples are completed once their GPU timer
+// queries are available, pushed through a lock-free ring buffer and collected on a background
+// thread, so the render loop never blocks on the profiler or on the GPU.
+class Profiler
+{
+public:
+	~Profiler();
+
+	// needs a current GL context, before that (or without it) every call is a no-op; without
+	// gpuTimers no GL call is made at all and every pass reads -1, for backends without a context
+	void Init(bool gpuTimers = true);
+	// waits for outstanding queries and collects every sample, call before the context goes away
+	void Shutdown();
+
+	void BeginFrame();
+	void EndFrame();
+
+	void BeginPhase(ProfilePhase phase);
+	void EndPhase(ProfilePhase phase);
+
+	// GPU passes are timed with GL_TIME_ELAPSED queries, which cannot nest
+	void BeginGpuPass(const char* name);
+	void EndGpuPass();
+
+	// per frame statistics such as object or GL call counts, reset every frame
+	void SetCounter(const char* name, double value);
+
+	void PrintSummary(std::ostream& out);
+	// writes every collected sample as .csv or .json, chosen by the file extension
+	bool Export(const std::string& path);
+	std::vector<double> FrameTimes();
+
+	// nearest rank percentile of an ascending list
+	static double Percentile(const std::vector<double>& sorted, double p);
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct InFlight
+	{
+		FrameSample sample;
+		GLuint queries[PROFILER_MAX_PASSES];
+		bool issued[PROFILER_MAX_PASSES];
+		bool used;
+	};
+
+	bool initialized = false;
+	bool gpuTimers = false;
+	unsigned long long frame = 0;
+	FrameSample current;
+	Clock::time_point frameStart;
+	Clock::time_point phaseStart[PHASE_COUNT];
+	InFlight inFlight[PROFILER_QUERY_LATENCY];
+	bool passIssued[PROFILER_MAX_PASSES];
+	int activePass = -1;
+
+	std::vector<std::string> passNames, counterNames;
+
+	RingBuffer<FrameSample, 1024> ring;
+	std::atomic<unsigned long long> dropped{ 0 };
+	std::thread collector;
+	std::atomic<bool> collecting{ false };
+	std::mutex historyMutex;
+	std::deque<FrameSample> history;
+
+	int FindOrAdd(std::vector<std::string>& names, const char* name, size_t limit);
+	void Resolve(InFlight& slot, bool wait);
+	void Publish(const FrameSample& sample);
+	void Collect();
+	std::vector<FrameSample> Snapshot();
+};
+
+// Times a phase of the main loop for as long as it is in scope
+class CpuScope
+{
+public:
+	CpuScope(Profiler& profiler, ProfilePhase phase) : profiler(profiler), phase(phase) { profiler.BeginPhase(phase); }
+	~CpuScope() { profiler.EndPhase(phase); }
+private:
+	Profiler& profiler;
+	ProfilePhase phase;
+};
+
+// Times the GL commands issued while it is in scope
+class GpuScope
+{
+public:
+	GpuScope(Profiler& profiler, const char* name) : profiler(profiler) { profiler.BeginGpuPass(name); }
+	~GpuScope() { profiler.EndGpuPass(); }
+private:
+	Profiler& profiler;
+};
@@ -0,0 +1,152 @@
+#include "ProgramCache.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#define PROGRAM_CACHE_MAGIC 0x4E494250u // "PBIN"
+#define PROGRAM_CACHE_VERSION 1
+
+struct ProgramCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	unsigned int binaryFormat;
+	unsigned int length;
+	double compileMs;
+};
+
+// 64 bit FNV-1a, continued from hash
+static unsigned long long Fnv1a(const std::string& text, unsigned long long hash = 14695981039346656037ull)
+{
+	for (unsigned char c : text) {
+		hash = (hash ^ c) * 1099511628211ull;
+	}
+	// separator, so "ab" + "c" and "a" + "bc" do not collide
+	return (hash ^ 0xFF) * 1099511628211ull;
+}
+
+static const char* GLString(GLenum name)
+{
+	const char* value = (const char*)glGetString(name);
+	return value != NULL ? value : "";
+}
+
+void ProgramCache::Init()
+{
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	supported = formats > 0;
+	driver = std::string(GLString(GL_VENDOR)) + "\n" + GLString(GL_RENDERER) + "\n" + GLString(GL_VERSION);
+	if (supported) {
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+}
+
+unsigned long long ProgramCache::Key(const std::string& vertex, const std::string& fragment, const std::string& geometry)
+{
+	unsigned long long hash = Fnv1a(driver);
+	hash = Fnv1a(vertex, hash);
+	hash = Fnv1a(fragment, hash);
+	return Fnv1a(geometry, hash);
+}
+
+std::string ProgramCache::PathFor(unsigned long long key)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string name(16, '0');
+	for (int i = 15; i >= 0; i--, key >>= 4) {
+		name[i] = digits[key & 15];
+	}
+	return directory + "/" + name + ".bin";
+}
+
+GLuint ProgramCache::Load(unsigned long long key)
+{
+	if (!supported) {
+		misses++;
+		return 0;
+	}
+	std::ifstream file(PathFor(key).c_str(), std::ios::binary);
+	ProgramCacheHeader header;
+	if (!file || !file.read((char*)&header, sizeof(header)) || header.magic != PROGRAM_CACHE_MAGIC
+		|| header.version != PROGRAM_CACHE_VERSION || header.key != key) {
+		misses++;
+		return 0;
+	}
+	// Store writes the header and the binary alone, so a length that does not account for the
+	// rest of the file is a truncated or corrupt entry; checked before allocating for it
+	file.seekg(0, std::ios::end);
+	std::streamoff size = file.tellg();
+	if (header.length == 0 || size < 0 || (unsigned long long)size != sizeof(header) + (unsigned long long)header.length) {
+		misses++;
+		return 0;
+	}
+	file.seekg(sizeof(header));
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size())) {
+		misses++;
+		return 0;
+	}
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		// the driver may refuse binaries for any reason, the caller compiles and overwrites it
+		glDeleteProgram(program);
+		rejected++;
+		misses++;
+		return 0;
+	}
+	hits++;
+	savedMs += header.compileMs - std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return program;
+}
+
+void ProgramCache::PrepareForStore(GLuint program)
+{
+	if (supported) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+void ProgramCache::Store(unsigned long long key, GLuint program, double compileMs)
+{
+	if (!supported) {
+		return;
+	}
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<char> binary(length);
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+	ProgramCacheHeader header;
+	header.magic = PROGRAM_CACHE_MAGIC;
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key = key;
+	header.binaryFormat = binaryFormat;
+	header.length = (unsigned int)length;
+	header.compileMs = compileMs;
+
+	std::ofstream file(PathFor(key).c_str(), std::ios::binary);
+	if (!file.write((const char*)&header, sizeof(header)) || !file.write(binary.data(), length)) {
+		std::cout << "WARNING::PROGRAM_CACHE::WRITE_FAILED " << PathFor(key) << std::endl;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <string>
+
+// On disk cache of linked shader programs, stored with glGetProgramBinary. A program is keyed
+// by a hash of its final sources (defines included) and of the GL vendor, renderer and version
+// strings, so a driver update or any edit misses instead of loading a stale binary.
+class ProgramCache
+{
+public:
+	explicit ProgramCache(const std::string& directory = "shadercache") : directory(directory) {}
+
+	// needs a current context; without program binary support every Load misses and Store does nothing
+	void Init();
+
+	unsigned long long Key(const std::string& vertex, const std::string& fragment, const std::string& geometry);
+	// a linked program, or 0 on a miss or when the driver rejects the stored binary
+	GLuint Load(unsigned long long key);
+	// call before glLinkProgram, so the driver keeps the binary around
+	void PrepareForStore(GLuint program);
+	// compileMs is what the full build took, a later hit counts it as time saved
+	void Store(unsigned long long key, GLuint program, double compileMs);
+
+	unsigned int Hits() const { return hits; }
+	unsigned int Misses() const { return misses; }
+	unsigned int Rejected() const { return rejected; }
+	double SavedMs() const { return savedMs; }
+
+private:
+	std::string directory;
+	std::string driver;
+	bool supported = false;
+	unsigned int hits = 0, misses = 0, rejected = 0;
+	double savedMs = 0.0;
+
+	std::string PathFor(unsigned long long key);
+};
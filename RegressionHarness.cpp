@@ -0,0 +1,305 @@
+#include "RegressionHarness.h"
+#include "Demo.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// simulated ms per frame, so a path covers the same frames on every machine
+#define REGRESSION_TIMESTEP 50.0
+// frames left out of the timing: shader variants, first uploads and shadow caches settle in them
+#define REGRESSION_WARMUP_FRAMES 5
+// a diff image shows the channel differences this many times brighter
+#define REGRESSION_DIFF_SCALE 8
+
+// one scripted run of the demo
+struct RegressionCase
+{
+	const char* name;
+	unsigned int width, height;
+	// forward, deferred or software, like --renderer
+	const char* renderer;
+	int instances, lights;
+	bool shadows;
+	unsigned int frames;
+	std::vector<CameraKey> path;
+};
+
+struct RegressionBaseline
+{
+	double p50, p95;
+};
+
+static std::vector<RegressionCase> RegressionCases()
+{
+	std::vector<RegressionCase> cases;
+
+	// the start scene: swinging around the door under the block lights and the flashlight
+	RegressionCase door = { "door_orbit", 800, 600, "forward", 1, 0, true, 40, {} };
+	for (int i = 0; i <= 4; i++) {
+		float angle = glm::radians(-40.0f + i * 20.0f);
+		CameraKey key = { i * 500.0, glm::vec3(8.0f * glm::sin(angle), 1.0f + i * 0.5f, 8.0f * glm::cos(angle)), glm::vec3(0.0f, 1.5f, 0.0f) };
+		door.path.push_back(key);
+	}
+	cases.push_back(door);
+
+	// down from above the warehouse into the middle aisle, then along it, under clustered lights
+	std::vector<CameraKey> walk = {
+		{ 0.0, glm::vec3(0.0f, 8.0f, 28.0f), glm::vec3(0.0f, 0.0f, 0.0f) },
+		{ 800.0, glm::vec3(0.0f, 1.5f, 16.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+		{ 2000.0, glm::vec3(0.5f, 1.5f, 2.0f), glm::vec3(2.0f, 1.0f, -12.0f) },
+	};
+	RegressionCase warehouse = { "warehouse_walk", 640, 360, "forward", 400, 256, true, 40, walk };
+	cases.push_back(warehouse);
+
+	// the warehouse from above its corner, light volumes instead of clusters
+	RegressionCase deferred = { "deferred_pan", 640, 480, "deferred", 400, 64, true, 40, {} };
+	deferred.path.push_back({ 0.0, glm::vec3(-16.0f, 10.0f, 16.0f), glm::vec3(0.0f, 0.0f, 0.0f) });
+	deferred.path.push_back({ 2000.0, glm::vec3(16.0f, 10.0f, 16.0f), glm::vec3(0.0f, 0.0f, 0.0f) });
+	cases.push_back(deferred);
+
+	// the same walk on the CPU rasterizer
+	RegressionCase software = { "software_walk", 320, 240, "software", 400, 64, false, 40, walk };
+	cases.push_back(software);
+	return cases;
+}
+
+static bool MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+	return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// binary PPM, rows top down; the RGB of an RGBA8 capture with rows bottom up
+static bool WritePpm(const std::string& path, unsigned int width, unsigned int height, const std::vector<unsigned char>& rgb)
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write((const char*)rgb.data(), rgb.size());
+	return (bool)file;
+}
+
+static bool ReadPpm(const std::string& path, unsigned int& width, unsigned int& height, std::vector<unsigned char>& rgb)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	std::string magic;
+	int maxValue = 0;
+	if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255) {
+		return false;
+	}
+	// a single whitespace ends the header
+	file.get();
+	rgb.resize((size_t)width * height * 3);
+	file.read((char*)rgb.data(), rgb.size());
+	return (bool)file;
+}
+
+static std::vector<unsigned char> CaptureToRgb(const std::vector<unsigned char>& rgba, unsigned int width, unsigned int height)
+{
+	std::vector<unsigned char> rgb((size_t)width * height * 3);
+	for (unsigned int y = 0; y < height; y++) {
+		const unsigned char* source = &rgba[(size_t)(height - 1 - y) * width * 4];
+		unsigned char* target = &rgb[(size_t)y * width * 3];
+		for (unsigned int x = 0; x < width; x++) {
+			target[x * 3 + 0] = source[x * 4 + 0];
+			target[x * 3 + 1] = source[x * 4 + 1];
+			target[x * 3 + 2] = source[x * 4 + 2];
+		}
+	}
+	return rgb;
+}
+
+static std::map<std::string, RegressionBaseline> LoadBaseline(const std::string& path)
+{
+	std::map<std::string, RegressionBaseline> baseline;
+	std::ifstream file(path.c_str());
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string name;
+		RegressionBaseline entry;
+		if (fields >> name >> entry.p50 >> entry.p95) {
+			baseline[name] = entry;
+		}
+	}
+	return baseline;
+}
+
+static bool SaveBaseline(const std::string& path, const std::map<std::string, RegressionBaseline>& baseline)
+{
+	std::ofstream file(path.c_str());
+	file << "# case, median and 95th percentile frame ms\n";
+	file << std::fixed << std::setprecision(3);
+	for (const auto& entry : baseline) {
+		file << entry.first << " " << entry.second.p50 << " " << entry.second.p95 << "\n";
+	}
+	return (bool)file;
+}
+
+// compares a frame against its golden, returns whether it is within the tolerances; a failing
+// frame writes what was rendered and the difference next to the golden
+static bool CompareFrame(const RegressionOptions& options, const std::string& golden, unsigned int width, unsigned int height, const std::vector<unsigned char>& rgb)
+{
+	std::string prefix = golden.substr(0, golden.size() - 4);
+	unsigned int goldenWidth, goldenHeight;
+	std::vector<unsigned char> expected;
+	if (!ReadPpm(golden, goldenWidth, goldenHeight, expected)) {
+		std::cout << "  FAIL " << golden << ": no golden, record one with --update" << std::endl;
+		return false;
+	}
+	if (goldenWidth != width || goldenHeight != height) {
+		std::cout << "  FAIL " << golden << ": golden is " << goldenWidth << "x" << goldenHeight << ", the frame " << width << "x" << height << std::endl;
+		return false;
+	}
+
+	size_t different = 0;
+	int maxDiff = 0;
+	std::vector<unsigned char> diff(rgb.size());
+	for (size_t pixel = 0; pixel < (size_t)width * height; pixel++) {
+		int pixelDiff = 0;
+		for (int c = 0; c < 3; c++) {
+			int channel = std::abs((int)rgb[pixel * 3 + c] - (int)expected[pixel * 3 + c]);
+			pixelDiff = std::max(pixelDiff, channel);
+			diff[pixel * 3 + c] = (unsigned char)std::min(channel * REGRESSION_DIFF_SCALE, 255);
+		}
+		maxDiff = std::max(maxDiff, pixelDiff);
+		if (pixelDiff > options.tolerance) {
+			different++;
+		}
+	}
+	double share = (double)different / ((size_t)width * height);
+	bool passed = share <= options.maxDifferentPixels;
+	std::cout << "  " << (passed ? "ok   " : "FAIL ") << golden << ": " << different << " pixels off by more than "
+		<< options.tolerance << " (" << std::fixed << std::setprecision(3) << share * 100.0 << "%), max diff " << maxDiff << std::defaultfloat << std::endl;
+	if (!passed) {
+		WritePpm(prefix + ".actual.ppm", width, height, rgb);
+		WritePpm(prefix + ".diff.ppm", width, height, diff);
+	}
+	return passed;
+}
+
+int RunRegression(const RegressionOptions& options)
+{
+	std::string baselinePath = options.directory + "/baseline.txt";
+	std::map<std::string, RegressionBaseline> baseline = LoadBaseline(baselinePath);
+	if ((options.update || options.recordMissing) && !MakeDirectory(options.directory)) {
+		std::cout << "ERROR::REGRESSION::DIRECTORY_NOT_CREATED " << options.directory << std::endl;
+		return 1;
+	}
+
+	bool passed = true;
+	bool baselineChanged = options.update;
+	int ran = 0;
+	for (const RegressionCase& test : RegressionCases()) {
+		if (!options.only.empty() && options.only != test.name) {
+			continue;
+		}
+		ran++;
+		std::cout << test.name << ", " << test.width << "x" << test.height << ", " << test.renderer << ", " << test.frames << " frames" << std::endl;
+
+		std::vector<unsigned int> captureFrames = { test.frames / 4, test.frames / 2, test.frames - 1 };
+		std::vector<std::vector<unsigned char>> captures;
+		std::vector<double> frameTimes;
+		{
+			Demo app;
+			app.SetCubeInstanceCount(test.instances);
+			app.SetClusteredLightCount(test.lights);
+			app.SetDeferredShading(std::string(test.renderer) == "deferred");
+			app.SetBackend(std::string(test.renderer) == "software" ? BACKEND_SOFTWARE : BACKEND_OPENGL);
+			app.SetShadows(test.shadows);
+			app.SetCameraPath(test.path);
+			app.SetCaptureFrames(captureFrames);
+			app.SetQuiet(true);
+			app.StartHeadless(test.width, test.height, test.frames, REGRESSION_TIMESTEP, "");
+			captures = app.Captures();
+			frameTimes = app.FrameTimes();
+		}
+
+		for (size_t i = 0; i < captures.size(); i++) {
+			std::vector<unsigned char> rgb = CaptureToRgb(captures[i], test.width, test.height);
+			std::string golden = options.directory + "/" + test.name + "." + std::to_string(captureFrames[i]) + ".ppm";
+			if (options.update || (options.recordMissing && !std::ifstream(golden.c_str()))) {
+				if (!WritePpm(golden, test.width, test.height, rgb)) {
+					std::cout << "ERROR::REGRESSION::GOLDEN_NOT_WRITTEN " << golden << std::endl;
+					passed = false;
+				}
+				else {
+					std::cout << "  wrote " << golden << std::endl;
+				}
+				continue;
+			}
+			passed = CompareFrame(options, golden, test.width, test.height, rgb) && passed;
+		}
+
+		std::vector<double> sorted;
+		if (frameTimes.size() > REGRESSION_WARMUP_FRAMES) {
+			sorted.assign(frameTimes.begin() + REGRESSION_WARMUP_FRAMES, frameTimes.end());
+		}
+		std::sort(sorted.begin(), sorted.end());
+		RegressionBaseline measured = { Profiler::Percentile(sorted, 50), Profiler::Percentile(sorted, 95) };
+		std::cout << std::fixed << std::setprecision(2);
+		if (options.update) {
+			baseline[test.name] = measured;
+			std::cout << "  frame ms: median " << measured.p50 << ", p95 " << measured.p95 << std::endl;
+		}
+		else if (baseline.count(test.name) == 0) {
+			if (options.recordMissing) {
+				baseline[test.name] = measured;
+				baselineChanged = true;
+				std::cout << "  frame ms: median " << measured.p50 << ", p95 " << measured.p95 << ", recorded as the baseline" << std::endl;
+			}
+			else if (options.gateFrameTimes) {
+				std::cout << "  FAIL frame ms: median " << measured.p50 << ", p95 " << measured.p95 << ", no baseline, record one with --update" << std::endl;
+				passed = false;
+			}
+			else {
+				std::cout << "  frame ms: median " << measured.p50 << ", p95 " << measured.p95 << std::endl;
+			}
+		}
+		else {
+			// the median decides, the tail of a few dozen frames is too noisy to gate on
+			const RegressionBaseline& expected = baseline[test.name];
+			double change = expected.p50 > 0 ? measured.p50 / expected.p50 - 1.0 : 0.0;
+			bool fast = !options.gateFrameTimes || change <= options.maxSlowdown;
+			std::cout << "  " << (options.gateFrameTimes ? (fast ? "ok   " : "FAIL ") : "") << "frame ms: median " << measured.p50 << " against " << expected.p50
+				<< " (" << std::showpos << change * 100.0 << std::noshowpos << "%), p95 " << measured.p95 << " against " << expected.p95 << std::endl;
+			passed = fast && passed;
+		}
+		std::cout << std::defaultfloat;
+	}
+
+	if (ran == 0) {
+		std::cout << "Unknown regression case: " << options.only << std::endl;
+		std::cout << "Available:";
+		for (const RegressionCase& test : RegressionCases()) {
+			std::cout << " " << test.name;
+		}
+		std::cout << std::endl;
+		return 1;
+	}
+	if (baselineChanged && !SaveBaseline(baselinePath, baseline)) {
+		std::cout << "ERROR::REGRESSION::BASELINE_NOT_WRITTEN " << baselinePath << std::endl;
+		return 1;
+	}
+	if (options.update) {
+		return passed ? 0 : 1;
+	}
+	std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+
+struct RegressionOptions
+{
+	// goldens and the frame time baseline, one directory per machine and driver
+	std::string directory = "regression";
+	// writes the goldens and the baseline of this run instead of comparing against them
+	bool update = false;
+	// writes the goldens and baseline entries that are missing instead of failing on them, so the
+	// first run on a machine records what its later runs compare against
+	bool recordMissing = false;
+	// only the case of this name, all of them when empty
+	std::string only;
+	// a channel may be this far off before its pixel counts as different
+	int tolerance = 8;
+	// share of the pixels of a frame that may be different
+	double maxDifferentPixels = 0.001;
+	// whether a median frame slower than the baseline fails the run; frame times only compare
+	// against a baseline recorded on the same machine, so they are just reported by default
+	bool gateFrameTimes = false;
+	// how much slower than the baseline the median frame may get, 0.2 is 20%
+	double maxSlowdown = 0.2;
+};
+
+// Renders the scripted camera paths of the demo scene offscreen, each case at its own fixed
+// resolution and simulated timestep, and compares a few frames of each against golden images.
+// The median frame time is reported against a baseline, and fails the run only when
+// gateFrameTimes is set. A failing frame leaves the image and a diff next to its golden.
+// Started with "--regress" from the command line; needs no display, but an EGL context for the
+// GL cases, which Mesa's llvmpipe provides on the CPU. Goldens depend on the driver, so they are
+// recorded on each machine rather than checked in. Returns the process exit code, non-zero when
+// anything regressed or had nothing to compare to.
+int RunRegression(const RegressionOptions& options);
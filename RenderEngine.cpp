@@ -1,10 +1,15 @@
 #include "RenderEngine.h"
+#include "HeadlessContext.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
 RenderEngine::RenderEngine() {
 }
 
 
 RenderEngine::~RenderEngine() {
-	glfwDestroyWindow(window);
+	if (window != NULL)
+		glfwDestroyWindow(window);
 }
 
 
@@ -49,68 +54,361 @@ void RenderEngine::Start(const char* title, unsigned int width, unsigned int hei
 	{
 		Err("Failed to initialize GLAD");
 	}
+	// the software backend still shows its frames through the window's context
+	glContext = true;
 
 	// set vsync
 	// ---------
 	glfwSwapInterval(vsync ? 1 : 0);
 
+	// input arrives through callbacks during glfwPollEvents and is read by the simulation thread
+	// -------------------------------------------------------------------------------------------
+	glfwSetWindowUserPointer(window, this);
+	glfwSetKeyCallback(window, KeyCallback);
+	glfwSetMouseButtonCallback(window, MouseButtonCallback);
+	glfwSetCursorPosCallback(window, CursorPosCallback);
+
+	textures.Init();
+	programCache.Init();
+
 	// user defined function
 	// ---------------------
 	Init();
+	// Init builds its resources with direct GL calls
+	glState.Invalidate();
 
-	lastFrame = glfwGetTime() * 1000;
+	profiler.Init();
+
+	// simulation thread: input and Update at a fixed tick, on its own core
+	// ---------------------------------------------------------------------
+	simulationTime = 0;
+	simulationStart = SimulationClock::now();
+	simulating = true;
+	simulation = std::thread(&RenderEngine::SimulationLoop, this);
 
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(window)) {
-		// Calculate framerate and frametime
-		double deltaTime = GetDeltaTime();
-		GetFPS();
+	while (!glfwWindowShouldClose(window) && !exitRequested) {
+		profiler.BeginFrame();
 
-		// user defined function
-		// ---------------------
-		ProcessInput(window);
-		Update(deltaTime);
-		Render();
+		// glfw: poll IO events (keys pressed/released, mouse moved etc.), handed to the simulation
+		// -----------------------------------------------------------------------------------------
+		{
+			CpuScope scope(profiler, PHASE_INPUT);
+			glfwPollEvents();
+		}
+		{
+			CpuScope scope(profiler, PHASE_UPDATE);
+			double now = std::chrono::duration<double, std::milli>(SimulationClock::now() - simulationStart).count();
+			Interpolate(now - simulationTick);
+		}
+		unsigned int ticks = simulationTicks.exchange(0);
+		long long microseconds = simulationMicroseconds.exchange(0);
+		profiler.SetCounter("simulation_ticks", ticks);
+		profiler.SetCounter("simulation_ms", ticks > 0 ? microseconds / 1000.0 / ticks : 0.0);
+		{
+			CpuScope scope(profiler, PHASE_RENDER);
+			RenderFrame();
+		}
 
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		// glfw: swap buffers
+		// ------------------
+		{
+			CpuScope scope(profiler, PHASE_SWAP);
+			glfwSwapBuffers(window);
+		}
 
-		//Debug print framerate
-		PrintFrameRate();
+		profiler.EndFrame();
 	}
 
+	simulating = false;
+	simulation.join();
+
 	// user defined function
 	// ---------------------
 	DeInit();
+	DeleteShaderVariants();
+	textures.Shutdown();
+
+	FinishProfile();
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
 	glfwTerminate();
 }
 
-double RenderEngine::GetDeltaTime()
+void RenderEngine::StartHeadless(unsigned int width, unsigned int height, unsigned int frames, double timestep, const std::string& reportPath) {
+
+	// set app configuration
+	this->screenHeight = height;
+	this->screenWidth = width;
+
+	// surfaceless context: there is no window, so no input and no swap; the software backend
+	// needs no context at all
+	// ------------------------------------------------------------------
+	HeadlessContext context;
+	glContext = backend == BACKEND_OPENGL;
+	if (glContext)
+	{
+		if (!context.Create())
+		{
+			Err("Failed to create headless OpenGL context");
+		}
+		if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+		{
+			Err("Failed to initialize GLAD");
+		}
+
+		CreateOffscreenTarget();
+
+		textures.Init();
+		programCache.Init();
+	}
+
+	// user defined function
+	// ---------------------
+	Init();
+	if (glContext)
+	{
+		// every frame should render the real textures, not however many happened to finish in time
+		textures.Finish();
+		glState.Invalidate();
+	}
+
+	profiler.Init(glContext);
+
+	// fixed frame count with a simulated timestep, so every run does the same work; the
+	// simulation runs inline, as many ticks as each frame's timestep covers
+	// ------------------------------------------------------------------------------------
+	simulationTime = 0;
+	double unsimulated = 0;
+	InputState noInput = {};
+	captures.clear();
+	for (unsigned int frame = 0; frame < frames; frame++) {
+		profiler.BeginFrame();
+		if (glContext) {
+			BindMainFramebuffer();
+		}
+		{
+			CpuScope scope(profiler, PHASE_UPDATE);
+			for (unsimulated += timestep; unsimulated >= simulationTick; unsimulated -= simulationTick) {
+				StepSimulation(noInput);
+			}
+			Interpolate(simulationTime + unsimulated - simulationTick);
+		}
+		{
+			CpuScope scope(profiler, PHASE_RENDER);
+			RenderFrame();
+		}
+		// without a swap nothing forces the frame out, glFinish makes the timing include the GPU work
+		if (glContext) {
+			CpuScope scope(profiler, PHASE_SWAP);
+			glFinish();
+		}
+		profiler.EndFrame();
+
+		if (std::find(captureFrames.begin(), captureFrames.end(), frame) != captureFrames.end()) {
+			captures.push_back(std::vector<unsigned char>());
+			ReadFrame(captures.back());
+		}
+	}
+
+	// user defined function
+	// ---------------------
+	DeInit();
+	if (glContext)
+	{
+		DeleteShaderVariants();
+		textures.Shutdown();
+	}
+
+	FinishProfile();
+	frameTimes = profiler.FrameTimes();
+	if (!quiet) {
+		WriteFrameReport(frameTimes, timestep, reportPath);
+	}
+
+	if (glContext)
+	{
+		DestroyOffscreenTarget();
+		context.Destroy();
+		glContext = false;
+	}
+}
+
+void RenderEngine::SimulationLoop()
+{
+	const SimulationClock::duration tick = std::chrono::duration_cast<SimulationClock::duration>(std::chrono::duration<double, std::milli>(simulationTick));
+	SimulationClock::time_point next = simulationStart;
+	while (simulating) {
+		SimulationClock::time_point start = SimulationClock::now();
+		StepSimulation(TakeInput());
+		simulationTicks++;
+		simulationMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(SimulationClock::now() - start).count();
+
+		// the tick after next is due one tick later; when too far behind (a stall, a breakpoint)
+		// the missed ticks are skipped along with their simulated time, so it stays in step with the clock
+		next += tick;
+		SimulationClock::duration behind = SimulationClock::now() - next;
+		if (behind > tick * SIMULATION_MAX_LAG) {
+			long long skipped = behind / tick;
+			next += tick * skipped;
+			simulationTime += simulationTick * skipped;
+		}
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void RenderEngine::StepSimulation(const InputState& input)
 {
+	simulationTime += simulationTick;
+	ProcessInput(input);
+	Update(simulationTick);
+}
 
-	double time = glfwGetTime() * 1000;
-	double delta = time - lastFrame;
-	lastFrame = time;
+InputState RenderEngine::TakeInput()
+{
+	std::lock_guard<std::mutex> lock(inputMutex);
+	InputState input = pendingInput;
+	// held keys carry over, movement is consumed by the tick
+	pendingInput.cursorX = 0;
+	pendingInput.cursorY = 0;
+	return input;
+}
 
-	return delta;
+void RenderEngine::KeyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+{
+	RenderEngine* engine = (RenderEngine*)glfwGetWindowUserPointer(window);
+	if (key < 0 || key > GLFW_KEY_LAST || action == GLFW_REPEAT) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(engine->inputMutex);
+	engine->pendingInput.keys[key] = action == GLFW_PRESS;
+}
+
+void RenderEngine::MouseButtonCallback(GLFWwindow* window, int button, int action, int /*mods*/)
+{
+	RenderEngine* engine = (RenderEngine*)glfwGetWindowUserPointer(window);
+	if (button < 0 || button > GLFW_MOUSE_BUTTON_LAST) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(engine->inputMutex);
+	engine->pendingInput.buttons[button] = action == GLFW_PRESS;
+}
+
+void RenderEngine::CursorPosCallback(GLFWwindow* window, double x, double y)
+{
+	RenderEngine* engine = (RenderEngine*)glfwGetWindowUserPointer(window);
+	std::lock_guard<std::mutex> lock(engine->inputMutex);
+	// the first position only sets where movement is measured from
+	if (engine->cursorKnown) {
+		engine->pendingInput.cursorX += x - engine->lastCursorX;
+		engine->pendingInput.cursorY += y - engine->lastCursorY;
+	}
+	engine->lastCursorX = x;
+	engine->lastCursorY = y;
+	engine->cursorKnown = true;
 }
 
-void RenderEngine::GetFPS()
+void RenderEngine::CreateOffscreenTarget()
 {
-	if (glfwGetTime() * 1000 - last > 1000) {
-		fps = _fps;
-		_fps = 0;
-		last += 1000;
+	glGenRenderbuffers(1, &offscreenColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, screenWidth, screenHeight);
+	glGenRenderbuffers(1, &offscreenDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screenWidth, screenHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mainFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mainFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		Err("Offscreen framebuffer is not complete");
 	}
-	_fps++;
 }
 
+void RenderEngine::DestroyOffscreenTarget()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &mainFramebuffer);
+	glDeleteRenderbuffers(1, &offscreenColor);
+	glDeleteRenderbuffers(1, &offscreenDepth);
+	mainFramebuffer = 0;
+}
+
+void RenderEngine::BindMainFramebuffer()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mainFramebuffer);
+}
+
+void RenderEngine::ReadFrame(std::vector<unsigned char>& pixels)
+{
+	pixels.resize((size_t)screenWidth * screenHeight * 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mainFramebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, screenWidth, screenHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+static std::string JsonEscape(const char* text)
+{
+	std::string escaped;
+	for (const char* c = text; c != NULL && *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			escaped += '\\';
+		escaped += *c;
+	}
+	return escaped;
+}
+
+void RenderEngine::WriteFrameReport(const std::vector<double>& frameTimes, double timestep, const std::string& reportPath)
+{
+	std::vector<double> sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0;
+	for (double time : sorted)
+		total += time;
+
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(4);
+	report << "{\n";
+	report << "  \"backend\": \"" << (backend == BACKEND_SOFTWARE ? "software" : "opengl") << "\",\n";
+	// without a context there is no driver to name
+	report << "  \"renderer\": \"" << (glContext ? JsonEscape((const char*)glGetString(GL_RENDERER)) : std::string("SoftwareRenderer")) << "\",\n";
+	report << "  \"version\": \"" << (glContext ? JsonEscape((const char*)glGetString(GL_VERSION)) : std::string()) << "\",\n";
+	report << "  \"width\": " << screenWidth << ",\n";
+	report << "  \"height\": " << screenHeight << ",\n";
+	report << "  \"frames\": " << frameTimes.size() << ",\n";
+	report << "  \"timestep_ms\": " << timestep << ",\n";
+	report << "  \"simulation_tick_ms\": " << simulationTick << ",\n";
+	report << "  \"frame_ms\": { ";
+	report << "\"min\": " << (sorted.empty() ? 0.0 : sorted.front()) << ", ";
+	report << "\"mean\": " << (sorted.empty() ? 0.0 : total / sorted.size()) << ", ";
+	report << "\"p50\": " << Profiler::Percentile(sorted, 50) << ", ";
+	report << "\"p95\": " << Profiler::Percentile(sorted, 95) << ", ";
+	report << "\"p99\": " << Profiler::Percentile(sorted, 99) << ", ";
+	report << "\"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << " },\n";
+	report << "  \"program_cache\": { \"hits\": " << programCache.Hits() << ", \"misses\": " << programCache.Misses()
+		<< ", \"rejected\": " << programCache.Rejected() << ", \"saved_ms\": " << programCache.SavedMs() << " },\n";
+	report << "  \"frame_times_ms\": [";
+	for (size_t i = 0; i < frameTimes.size(); i++)
+		report << (i ? ", " : "") << frameTimes[i];
+	report << "]\n}\n";
+
+	if (reportPath.empty())
+	{
+		std::cout << report.str();
+		return;
+	}
+	std::ofstream file(reportPath.c_str());
+	if (!file)
+	{
+		Err("Failed to write frame report " + reportPath);
+	}
+	file << report.str();
+}
 
 //Prints out an error message and exits the game
 void RenderEngine::Err(std::string errorString)
@@ -120,13 +418,19 @@ void RenderEngine::Err(std::string errorString)
 	exit(1);
 }
 
-static int frameCounter = 0;
-void RenderEngine::PrintFrameRate() {
-	//print only once every 60 frames
-	frameCounter++;
-	if (frameCounter == 60) {
-		std::cout << "FPS: " << fps << std::endl;
-		frameCounter = 0;
+void RenderEngine::FinishProfile()
+{
+	// collect the outstanding GPU timings while the context is still alive
+	profiler.Shutdown();
+	if (!quiet) {
+		profiler.PrintSummary(std::cout);
+		std::cout << "Program cache: " << programCache.Hits() << " hits, " << programCache.Misses() << " misses ("
+			<< programCache.Rejected() << " rejected), " << std::fixed << std::setprecision(3) << programCache.SavedMs()
+			<< " ms compile time saved" << std::defaultfloat << std::endl;
+	}
+	if (!profilePath.empty() && !profiler.Export(profilePath))
+	{
+		std::cout << "Failed to write profile " << profilePath << std::endl;
 	}
 }
 
@@ -154,7 +458,16 @@ void RenderEngine::CheckShaderErrors(GLuint shader, std::string type)
 	}
 }
 
-GLuint RenderEngine::BuildShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+std::string RenderEngine::InjectDefines(const std::string& source, const std::string& defines)
+{
+	size_t version = source.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+	if (lineEnd == std::string::npos)
+		return defines + source;
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+Shader RenderEngine::BuildShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const std::string& defines)
 {
 	// 1. Retrieve the vertex/fragment source code from filePath
 	std::string vertexCode, fragmentCode, geometryCode;
@@ -188,10 +501,29 @@ GLuint RenderEngine::BuildShader(const char* vertexPath, const char* fragmentPat
 			geometryCode = gShaderStream.str();
 		}
 	}
-	catch (std::ifstream::failure e)
+	catch (std::ifstream::failure&)
 	{
 		Err("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ");
 	}
+	// Insert the defines right after the #version line, which has to stay first
+	if (!defines.empty())
+	{
+		vertexCode = InjectDefines(vertexCode, defines);
+		fragmentCode = InjectDefines(fragmentCode, defines);
+		if (geometryPath != nullptr)
+			geometryCode = InjectDefines(geometryCode, defines);
+	}
+	// A program built from exactly these sources by this driver before is loaded from its binary
+	unsigned long long cacheKey = programCache.Key(vertexCode, fragmentCode, geometryCode);
+	Shader shader;
+	shader.program = programCache.Load(cacheKey);
+	if (shader.program != 0)
+	{
+		shader.Reflect();
+		return shader;
+	}
+	std::chrono::high_resolution_clock::time_point compileStart = std::chrono::high_resolution_clock::now();
+
 	const GLchar* vShaderCode = vertexCode.c_str();
 	const GLchar * fShaderCode = fragmentCode.c_str();
 	// 2. Compile shaders
@@ -208,7 +540,7 @@ GLuint RenderEngine::BuildShader(const char* vertexPath, const char* fragmentPat
 	glCompileShader(fragment);
 	CheckShaderErrors(fragment, "FRAGMENT");
 	// If geometry shader is given, compile geometry shader
-	GLuint geometry;
+	GLuint geometry = 0;
 	if (geometryPath != nullptr)
 	{
 		const GLchar * gShaderCode = geometryCode.c_str();
@@ -223,21 +555,61 @@ GLuint RenderEngine::BuildShader(const char* vertexPath, const char* fragmentPat
 	glAttachShader(program, fragment);
 	if (geometryPath != nullptr)
 		glAttachShader(program, geometry);
+	programCache.PrepareForStore(program);
 	glLinkProgram(program);
 	CheckShaderErrors(program, "PROGRAM");
+	programCache.Store(cacheKey, program, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - compileStart).count());
 	// Delete the shaders as they're linked into our program now and no longer necessery
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
 	if (geometryPath != nullptr)
 		glDeleteShader(geometry);
-	return program;
+	// Reflect the active uniforms once so the render loop never has to query locations
+	shader.program = program;
+	shader.Reflect();
+	return shader;
+
+}
+
+const Shader& RenderEngine::BuildShaderVariant(const char* vertexPath, const char* fragmentPath, const std::string& defines)
+{
+	std::string key = std::string(vertexPath) + "\n" + fragmentPath + "\n" + defines;
+	std::map<std::string, Shader>::iterator it = shaderVariants.find(key);
+	if (it == shaderVariants.end())
+		it = shaderVariants.insert(std::make_pair(key, BuildShader(vertexPath, fragmentPath, nullptr, defines))).first;
+	return it->second;
+}
 
+void RenderEngine::DeleteShaderVariants()
+{
+	for (auto& variant : shaderVariants)
+		variant.second.Delete();
+	shaderVariants.clear();
+}
+
+void RenderEngine::UseShader(const Shader& shader)
+{
+	// Uses the current shader, unless it already is
+	glState.UseProgram(shader.program);
 }
 
-void RenderEngine::UseShader(GLuint program)
+void RenderEngine::RenderFrame()
 {
-	// Uses the current shader
-	glUseProgram(program);
+	if (backend == BACKEND_SOFTWARE) {
+		RenderSoftware();
+		return;
+	}
+	// uploads bind textures directly, behind the state tracker's back
+	bool loading = textures.Pending() > 0;
+	textures.Update();
+	if (loading) {
+		glState.InvalidateTextures();
+	}
+
+	glState.ResetCounters();
+	Render();
+	profiler.SetCounter("gl_state_issued", (double)glState.Issued());
+	profiler.SetCounter("gl_state_redundant", (double)glState.Redundant());
 }
 
 
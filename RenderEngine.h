@@ -3,11 +3,45 @@
 
 #include <GLAD/glad.h>
 #include <GLFW/glfw3.h>
+#include "Shader.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "TextureLoader.h"
+#include "ProgramCache.h"
+#include "GLState.h"
+#include "DrawQueue.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <map>
 
+// default length of a simulation tick in ms, the simulation runs at this rate whatever the frame rate
+#define SIMULATION_TICK_MS (1000.0 / 60.0)
+// ticks the simulation may fall behind before it drops them instead of catching up in a burst
+#define SIMULATION_MAX_LAG 5
+
+// Keyboard and mouse as the simulation sees them at a tick: what is held down, and how far the
+// cursor moved since the previous tick
+struct InputState
+{
+	bool keys[GLFW_KEY_LAST + 1];
+	bool buttons[GLFW_MOUSE_BUTTON_LAST + 1];
+	double cursorX, cursorY;
+};
+
+// what draws the frames: GL, or the CPU through RenderSoftware. The software backend makes no
+// GL call in a headless run; in a window it only shows its frames with GL.
+enum RenderBackend
+{
+	BACKEND_OPENGL,
+	BACKEND_SOFTWARE
+};
 
 class RenderEngine
 {
@@ -15,23 +49,116 @@ public:
 	RenderEngine();
 	~RenderEngine();
 	void Start(const char* title, unsigned int width, unsigned int height, bool vsync, bool fullscreen);
+	// Renders a fixed number of frames offscreen with a fixed simulated timestep (in ms), then writes
+	// a JSON frame time report to reportPath, or to stdout if it is empty. Needs no display: the GL
+	// backend renders into an EGL context, which Mesa's llvmpipe provides without a GPU, and the
+	// software backend creates no context at all.
+	void StartHeadless(unsigned int width, unsigned int height, unsigned int frames, double timestep, const std::string& reportPath);
+	// before Start or StartHeadless
+	void SetBackend(RenderBackend backend) { this->backend = backend; }
+	// on exit every profiled frame is written here, as CSV or as JSON if the path ends in .json
+	void SetProfileOutput(const std::string& path) { profilePath = path; }
+	void SetSimulationTick(double milliseconds) { simulationTick = milliseconds > 0 ? milliseconds : SIMULATION_TICK_MS; }
+	// headless runs read the main framebuffer back after each of these frames, outside the frame time
+	void SetCaptureFrames(const std::vector<unsigned int>& frames) { captureFrames = frames; }
+	// headless runs print neither the profile summary nor the frame report
+	void SetQuiet(bool quiet) { this->quiet = quiet; }
+	// RGBA8 images of the capture frames of the last headless run in frame order, rows bottom up
+	const std::vector<std::vector<unsigned char>>& Captures() const { return captures; }
+	// ms of every frame of the last headless run
+	const std::vector<double>& FrameTimes() const { return frameTimes; }
 protected:
-	unsigned int screenWidth, screenHeight, last = 0, _fps = 0, fps = 0;
-	double lastFrame = 0;
-	GLFWwindow* window;
+	unsigned int screenWidth, screenHeight;
+	GLFWwindow* window = NULL;
+	RenderBackend backend = BACKEND_OPENGL;
+	// a GL context is current on the render thread: always with BACKEND_OPENGL, only in a window
+	// with BACKEND_SOFTWARE
+	bool glContext = false;
+	// framebuffer the frame ends up in: 0 for the window, the offscreen target in headless mode
+	GLuint mainFramebuffer = 0;
+	// worker threads shared by the CPU side systems (light culling, ...)
+	ThreadPool jobs;
+	// per phase CPU timers, GPU pass timers and frame counters, summarized on exit
+	Profiler profiler;
+	// textures decoded on the job threads and uploaded a few per frame before Render
+	TextureLoader textures{ jobs };
+	// linked programs kept on disk between runs, used by BuildShader
+	ProgramCache programCache;
+	// filters redundant binds and enables; its call counts are reported per frame
+	GLState glState;
+	// the frame's draws, sorted by state before they are issued
+	DrawQueue drawQueue;
+	// length of a simulation tick in ms
+	double simulationTick = SIMULATION_TICK_MS;
+	// simulation thread only: simulated ms at the end of the tick being run
+	double simulationTime = 0;
 
+	// Init and DeInit run on the render thread, before the simulation starts and after it stopped
 	virtual void Init() = 0;
 	virtual void DeInit() = 0;
+	// ProcessInput then Update run once per tick on the simulation thread, deltaTime is always
+	// the tick; they may not touch GL or GLFW, and hand their results to the renderer themselves
+	virtual void ProcessInput(const InputState& input) = 0;
 	virtual void Update(double deltaTime) = 0;
+	// render thread, before every Render: renderTime is the simulated time the frame shows,
+	// one tick behind the simulation so there are always two ticks to interpolate between
+	virtual void Interpolate(double renderTime) = 0;
 	virtual void Render() = 0;
-	virtual void ProcessInput(GLFWwindow *window) = 0;
+	// renders the frame instead of Render with BACKEND_SOFTWARE; Init, DeInit and it may only
+	// touch GL where glContext is set
+	virtual void RenderSoftware() = 0;
+	// the frame as RGBA8 rows bottom up, for the headless captures; reads the main framebuffer
+	// back by default
+	virtual void ReadFrame(std::vector<unsigned char>& pixels);
+
+	// asks the render loop to stop after the current frame, from any thread
+	void RequestExit() { exitRequested = true; }
 
-	double GetDeltaTime();
-	void GetFPS();
 	void Err(std::string errorString);
-	void PrintFrameRate();
 	void CheckShaderErrors(GLuint shader, std::string type);
-	GLuint BuildShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath);
-	void UseShader(GLuint program);
+	Shader BuildShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const std::string& defines = "");
+	// Builds each combination of sources and defines once and keeps it until the engine shuts down
+	const Shader& BuildShaderVariant(const char* vertexPath, const char* fragmentPath, const std::string& defines);
+	void UseShader(const Shader& shader);
+	void BindMainFramebuffer();
+	std::string InjectDefines(const std::string& source, const std::string& defines);
+
+private:
+	typedef std::chrono::steady_clock SimulationClock;
+
+	GLuint offscreenColor = 0, offscreenDepth = 0;
+	std::string profilePath;
+	std::map<std::string, Shader> shaderVariants;
+	std::vector<unsigned int> captureFrames;
+	std::vector<std::vector<unsigned char>> captures;
+	std::vector<double> frameTimes;
+	bool quiet = false;
+
+	// written by the GLFW callbacks on the render thread, taken by the simulation every tick
+	std::mutex inputMutex;
+	InputState pendingInput = {};
+	double lastCursorX = 0, lastCursorY = 0;
+	bool cursorKnown = false;
+
+	std::thread simulation;
+	std::atomic<bool> simulating{ false };
+	std::atomic<bool> exitRequested{ false };
+	SimulationClock::time_point simulationStart;
+	// ticks run and time spent in them since the render thread last read them
+	std::atomic<unsigned int> simulationTicks{ 0 };
+	std::atomic<long long> simulationMicroseconds{ 0 };
+
+	void CreateOffscreenTarget();
+	void DestroyOffscreenTarget();
+	void DeleteShaderVariants();
+	void RenderFrame();
+	void SimulationLoop();
+	void StepSimulation(const InputState& input);
+	InputState TakeInput();
+	static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+	static void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+	static void CursorPosCallback(GLFWwindow* window, double x, double y);
+	void FinishProfile();
+	void WriteFrameReport(const std::vector<double>& frameTimes, double timestep, const std::string& reportPath);
 };
 
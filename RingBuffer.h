@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Fixed capacity single producer / single consumer queue. Push and Pop never lock or allocate,
+// so the render loop can publish data that another thread collects. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class RingBuffer
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+public:
+	// producer side, returns false (and drops the item) when the consumer has fallen behind
+	bool Push(const T& item)
+	{
+		size_t head = this->head.load(std::memory_order_relaxed);
+		if (head - tail.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		items[head & (Capacity - 1)] = item;
+		this->head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side, returns false when empty
+	bool Pop(T& item)
+	{
+		size_t tail = this->tail.load(std::memory_order_relaxed);
+		if (tail == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = items[tail & (Capacity - 1)];
+		this->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T items[Capacity];
+	// kept on separate cache lines so producer and consumer do not false share
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) std::atomic<size_t> tail{ 0 };
+};
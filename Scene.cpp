@@ -0,0 +1,611 @@
+#include "Scene.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+
+const unsigned int Scene::NONE;
+
+// room for a few thousand small meshes before the arena has to grow
+#define SCENE_ARENA_VERTICES 65536
+#define SCENE_ARENA_INDICES 196608
+// a renderable only goes to a coarser level once its projected error is this share of the allowed,
+// so one at the switching distance does not flip between two levels every frame
+#define SCENE_LOD_HYSTERESIS 0.75f
+
+unsigned int Scene::AddMesh(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, GLsizei indexCount)
+{
+	if (geometry.Vao() == 0 && !cpuOnly) {
+		geometry.Create(vertexFormat, SCENE_ARENA_VERTICES, SCENE_ARENA_INDICES);
+		instances.Create(geometry.Vao());
+	}
+	std::vector<GLfloat> ordered(vertices, vertices + vertexCount * GEOMETRY_VERTEX_FLOATS);
+	std::vector<GLuint> reordered(indices, indices + indexCount);
+	MeshOptimizer::OptimizeVertexCache(reordered.data(), reordered.size(), vertexCount);
+	MeshOptimizer::OptimizeVertexFetch(ordered.data(), vertexCount, reordered.data(), reordered.size());
+
+	// the levels go behind the full mesh's indices, one index range for all of them
+	SceneMesh mesh;
+	std::vector<MeshLodLevel> levels;
+	MeshOptimizer::BuildLods(ordered.data(), vertexCount, reordered.data(), reordered.size(), levels);
+	for (const MeshLodLevel& level : levels) {
+		SceneLod lod;
+		lod.firstIndex = reordered.size();
+		lod.indexCount = (GLsizei)level.indices.size();
+		lod.error = level.error;
+		mesh.lods.push_back(lod);
+		reordered.insert(reordered.end(), level.indices.begin(), level.indices.end());
+	}
+	if (cpuOnly) {
+		mesh.allocation.vertexCount = vertexCount;
+		mesh.allocation.indexCount = (GLsizei)reordered.size();
+	}
+	else {
+		mesh.allocation = geometry.Add(ordered.data(), vertexCount, reordered.data(), (GLsizei)reordered.size());
+	}
+	mesh.range = mesh.allocation;
+	mesh.range.indexCount = indexCount;
+	for (SceneLod& lod : mesh.lods) {
+		lod.firstIndex += mesh.range.firstIndex;
+	}
+	mesh.bounds = AABB::FromVertices(vertices, vertexCount, GEOMETRY_VERTEX_FLOATS);
+	if (keepMeshData || cpuOnly) {
+		mesh.vertices.swap(ordered);
+		mesh.indices.swap(reordered);
+	}
+	meshes.push_back(mesh);
+	instancesChanged = true;
+	return (unsigned int)meshes.size() - 1;
+}
+
+bool Scene::AddPackageMeshes(const ScenePackage& package, unsigned int& firstMesh)
+{
+	if (cpuOnly) {
+		std::cout << "ERROR::SCENE::PACKAGE_WITHOUT_ARENA " << VertexLayout::Name(package.Format()) << " package for a CPU only scene" << std::endl;
+		return false;
+	}
+	if (geometry.Vao() == 0) {
+		geometry.Create(package.Format(), std::max((size_t)SCENE_ARENA_VERTICES, (size_t)package.VertexCount()), std::max((size_t)SCENE_ARENA_INDICES, (size_t)package.IndexCount()));
+		instances.Create(geometry.Vao());
+	}
+	else if (geometry.Format() != package.Format()) {
+		std::cout << "ERROR::SCENE::PACKAGE_FORMAT " << VertexLayout::Name(package.Format()) << " package for a " << VertexLayout::Name(geometry.Format()) << " arena" << std::endl;
+		return false;
+	}
+	// the package's meshes are ranges of one block, so the block is added as a whole
+	MeshRange block = geometry.AddPacked(package.VertexData(), package.VertexCount(), package.IndexData(), (GLsizei)package.IndexCount());
+	firstMesh = (unsigned int)meshes.size();
+	for (unsigned int i = 0; i < package.MeshCount(); i++) {
+		const PackageMesh& source = package.Mesh(i);
+		SceneMesh mesh;
+		mesh.range.firstVertex = block.firstVertex + source.firstVertex;
+		mesh.range.vertexCount = source.vertexCount;
+		mesh.range.firstIndex = block.firstIndex + source.firstIndex;
+		mesh.range.indexCount = (GLsizei)source.indexCount;
+		if (i == 0) {
+			mesh.allocation = block;
+		}
+		mesh.bounds = AABB(glm::vec3(source.boundsMin[0], source.boundsMin[1], source.boundsMin[2]), glm::vec3(source.boundsMax[0], source.boundsMax[1], source.boundsMax[2]));
+		// the levels were baked by the importer, as ranges of the same index block
+		for (unsigned int l = 0; l < source.lodCount; l++) {
+			const PackageLod& baked = package.Lod(source.firstLod + l);
+			SceneLod lod;
+			lod.firstIndex = block.firstIndex + baked.firstIndex;
+			lod.indexCount = (GLsizei)baked.indexCount;
+			lod.error = baked.error;
+			mesh.lods.push_back(lod);
+		}
+		meshes.push_back(mesh);
+	}
+	instancesChanged = true;
+	return true;
+}
+
+MeshRange Scene::LodRange(unsigned int mesh, unsigned int lod) const
+{
+	MeshRange range = meshes[mesh].range;
+	if (lod > 0) {
+		const SceneLod& level = meshes[mesh].lods[lod - 1];
+		range.firstIndex = level.firstIndex;
+		range.indexCount = level.indexCount;
+	}
+	return range;
+}
+
+size_t Scene::BatchTriangles() const
+{
+	size_t triangles = 0;
+	for (const SceneBatch& batch : batches) {
+		triangles += batch.count * (size_t)LodRange(batch.mesh, batch.lod).indexCount / 3;
+	}
+	return triangles;
+}
+
+void Scene::SetLightmapCoords(unsigned int mesh, const GLfloat* coords)
+{
+	geometry.SetLightmapCoords(meshes[mesh].range, coords);
+}
+
+unsigned int Scene::AddMaterial(const SceneMaterial& material)
+{
+	materials.push_back(material);
+	instancesChanged = true;
+	return (unsigned int)materials.size() - 1;
+}
+
+void Scene::Delete()
+{
+	if (!cpuOnly) {
+		instances.Delete();
+		geometry.Delete();
+	}
+	meshes.clear();
+	materials.clear();
+	generations.clear();
+	renderableSlot.clear();
+	lightSlot.clear();
+	freeIndices.clear();
+	transforms.Clear();
+	meshOf.clear();
+	materialOf.clear();
+	renderableOwner.clear();
+	proxyOf.clear();
+	dynamicOf.clear();
+	hiddenOf.clear();
+	lodOf.clear();
+	lightmapTileOf.clear();
+	bvh.Clear();
+	frustumSlots.clear();
+	visibleSlots.clear();
+	casterSlots.clear();
+	lights.clear();
+	lightOwner.clear();
+	staging.clear();
+	batches.clear();
+}
+
+Entity Scene::Create()
+{
+	Entity entity;
+	if (!freeIndices.empty()) {
+		entity.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else {
+		entity.index = (unsigned int)generations.size();
+		generations.push_back(0);
+		renderableSlot.push_back(NONE);
+		lightSlot.push_back(NONE);
+	}
+	entity.generation = generations[entity.index];
+	return entity;
+}
+
+bool Scene::Alive(Entity entity) const
+{
+	return entity.index < generations.size() && generations[entity.index] == entity.generation;
+}
+
+void Scene::Destroy(Entity entity)
+{
+	if (!Alive(entity)) {
+		return;
+	}
+	if (renderableSlot[entity.index] != NONE) {
+		RemoveRenderable(entity.index);
+	}
+	if (lightSlot[entity.index] != NONE) {
+		RemoveLight(entity.index);
+	}
+	generations[entity.index]++;
+	freeIndices.push_back(entity.index);
+}
+
+void Scene::AddRenderable(Entity entity, unsigned int mesh, unsigned int material, const glm::vec3& position, const glm::vec4& rotation, const glm::vec3& scale)
+{
+	if (!Alive(entity)) {
+		return;
+	}
+	if (renderableSlot[entity.index] != NONE) {
+		RemoveRenderable(entity.index);
+	}
+	renderableSlot[entity.index] = (unsigned int)transforms.Add(position, rotation, scale);
+	meshOf.push_back(mesh);
+	materialOf.push_back(material);
+	renderableOwner.push_back(entity.index);
+	// the BVH leaf is inserted by the next Update, once the world matrix is known
+	proxyOf.push_back(BVH::NONE);
+	dynamicOf.push_back(0);
+	hiddenOf.push_back(0);
+	lodOf.push_back(0);
+	lightmapTileOf.push_back(glm::vec3(0.0f));
+	staticRevision++;
+	instancesChanged = true;
+}
+
+void Scene::SetDynamic(Entity entity, bool dynamic)
+{
+	if (Alive(entity) && renderableSlot[entity.index] != NONE) {
+		dynamicOf[renderableSlot[entity.index]] = dynamic ? 1 : 0;
+		// it moves from one set of casters to the other
+		staticRevision++;
+		dynamicRevision++;
+	}
+}
+
+void Scene::SetPosition(Entity entity, const glm::vec3& position)
+{
+	if (Alive(entity) && renderableSlot[entity.index] != NONE) {
+		transforms.SetPosition(renderableSlot[entity.index], position);
+	}
+}
+
+void Scene::SetRotation(Entity entity, const glm::vec4& rotation)
+{
+	if (Alive(entity) && renderableSlot[entity.index] != NONE) {
+		transforms.SetRotation(renderableSlot[entity.index], rotation);
+	}
+}
+
+void Scene::SetMaterial(Entity entity, unsigned int material)
+{
+	if (Alive(entity) && renderableSlot[entity.index] != NONE) {
+		materialOf[renderableSlot[entity.index]] = material;
+		instancesChanged = true;
+	}
+}
+
+void Scene::SetLightmapTile(Entity entity, const glm::vec3& tile)
+{
+	if (Alive(entity) && renderableSlot[entity.index] != NONE) {
+		lightmapTileOf[renderableSlot[entity.index]] = tile;
+		instancesChanged = true;
+	}
+}
+
+void Scene::SetHidden(Entity entity, bool hidden)
+{
+	if (Alive(entity) && renderableSlot[entity.index] != NONE && (hiddenOf[renderableSlot[entity.index]] != 0) != hidden) {
+		hiddenOf[renderableSlot[entity.index]] = hidden ? 1 : 0;
+		instancesChanged = true;
+	}
+}
+
+bool Scene::Renderable(Entity entity, unsigned int& mesh, unsigned int& material, glm::mat4& model) const
+{
+	if (!Alive(entity) || renderableSlot[entity.index] == NONE) {
+		return false;
+	}
+	unsigned int slot = renderableSlot[entity.index];
+	mesh = meshOf[slot];
+	material = materialOf[slot];
+	model = transforms.Instances()[slot].model;
+	return true;
+}
+
+unsigned int Scene::Lod(Entity entity) const
+{
+	if (!Alive(entity) || renderableSlot[entity.index] == NONE) {
+		return 0;
+	}
+	return lodOf[renderableSlot[entity.index]];
+}
+
+void Scene::Renderables(CasterFilter filter, std::vector<Entity>& out) const
+{
+	out.clear();
+	for (size_t slot = 0; slot < renderableOwner.size(); slot++) {
+		if (filter == CASTERS_ALL || (filter == CASTERS_DYNAMIC) == (dynamicOf[slot] != 0)) {
+			Entity entity;
+			entity.index = renderableOwner[slot];
+			entity.generation = generations[entity.index];
+			out.push_back(entity);
+		}
+	}
+}
+
+// swap the last slot into the hole and point its owner at the new slot
+void Scene::RemoveRenderable(unsigned int index)
+{
+	unsigned int slot = renderableSlot[index];
+	unsigned int last = (unsigned int)transforms.Size() - 1;
+	if (proxyOf[slot] != BVH::NONE) {
+		bvh.Remove(proxyOf[slot]);
+	}
+	if (dynamicOf[slot]) {
+		dynamicRevision++;
+	}
+	else {
+		staticRevision++;
+	}
+	transforms.Remove(slot);
+	meshOf[slot] = meshOf[last];
+	materialOf[slot] = materialOf[last];
+	renderableOwner[slot] = renderableOwner[last];
+	renderableSlot[renderableOwner[slot]] = slot;
+	proxyOf[slot] = proxyOf[last];
+	dynamicOf[slot] = dynamicOf[last];
+	hiddenOf[slot] = hiddenOf[last];
+	lodOf[slot] = lodOf[last];
+	lightmapTileOf[slot] = lightmapTileOf[last];
+	if (slot != last && proxyOf[slot] != BVH::NONE) {
+		bvh.SetUserData(proxyOf[slot], slot);
+	}
+	meshOf.pop_back();
+	materialOf.pop_back();
+	renderableOwner.pop_back();
+	proxyOf.pop_back();
+	dynamicOf.pop_back();
+	hiddenOf.pop_back();
+	lodOf.pop_back();
+	lightmapTileOf.pop_back();
+	renderableSlot[index] = NONE;
+	instancesChanged = true;
+}
+
+void Scene::AddLight(Entity entity, const PointLight& light)
+{
+	if (!Alive(entity)) {
+		return;
+	}
+	if (lightSlot[entity.index] != NONE) {
+		SetLight(entity, light);
+		return;
+	}
+	lightSlot[entity.index] = (unsigned int)lights.size();
+	lights.push_back(light);
+	lightOwner.push_back(entity.index);
+	lightRevision++;
+}
+
+void Scene::SetLight(Entity entity, const PointLight& light)
+{
+	if (Alive(entity) && lightSlot[entity.index] != NONE) {
+		lights[lightSlot[entity.index]] = light;
+		lightRevision++;
+	}
+}
+
+void Scene::RemoveLight(unsigned int index)
+{
+	unsigned int slot = lightSlot[index];
+	lights[slot] = lights.back();
+	lightOwner[slot] = lightOwner.back();
+	lightSlot[lightOwner[slot]] = slot;
+	lights.pop_back();
+	lightOwner.pop_back();
+	lightSlot[index] = NONE;
+	lightRevision++;
+}
+
+size_t Scene::Update(ThreadPool* pool)
+{
+	refit.clear();
+	if (transforms.DirtyCount() > 0) {
+		transforms.DirtyIndices(refit);
+	}
+	size_t updated = transforms.Update(pool);
+
+	// only what moved is refit, and most of that stays inside its fat box
+	const InstanceTransform* world = transforms.Instances();
+	bool staticMoved = false, dynamicMoved = false;
+	for (unsigned int slot : refit) {
+		staticMoved |= !dynamicOf[slot];
+		dynamicMoved |= dynamicOf[slot] != 0;
+		AABB box = meshes[meshOf[slot]].bounds.Transformed(world[slot].model);
+		if (proxyOf[slot] == BVH::NONE) {
+			proxyOf[slot] = bvh.Insert(box, slot);
+		}
+		else {
+			bvh.Move(proxyOf[slot], box);
+		}
+	}
+	if (updated > 0) {
+		instancesChanged = true;
+	}
+	staticRevision += staticMoved ? 1 : 0;
+	dynamicRevision += dynamicMoved ? 1 : 0;
+	return updated;
+}
+
+size_t Scene::Cull(const Frustum& frustum, const glm::vec3& eye)
+{
+	if (!instancesChanged && frustum == lastFrustum && eye == lastEye) {
+		// the casters of the last frame are dropped, the visible instances in front of them
+		// are still in the buffer
+		staging.resize(visibleSlots.size());
+		return visibleSlots.size();
+	}
+	lastFrustum = frustum;
+	lastEye = eye;
+	instancesChanged = false;
+
+	frustumSlots.clear();
+	cullTests = bvh.Query(frustum, frustumSlots);
+	visibleSlots.clear();
+	for (unsigned int slot : frustumSlots) {
+		if (!hiddenOf[slot]) {
+			visibleSlots.push_back(slot);
+		}
+	}
+	// the BVH returns leaves in tree order; regrouping in slot order instead reads the
+	// instances front to back rather than all over memory
+	visible.assign(RenderableCount(), 0);
+	for (unsigned int slot : visibleSlots) {
+		visible[slot] = 1;
+	}
+	SelectLods(eye);
+	Regroup(eye);
+	uploadPending = true;
+	return visibleSlots.size();
+}
+
+void Scene::SetLodProjection(const glm::mat4& projection, float viewportHeight, float maxPixels)
+{
+	float scale = projection[1][1] * viewportHeight * 0.5f;
+	if (scale != lodScale || maxPixels != lodMaxPixels) {
+		lodScale = scale;
+		lodMaxPixels = maxPixels;
+		instancesChanged = true;
+	}
+}
+
+// the error of a level in pixels is its object space error, scaled like the renderable, over the
+// distance from the eye to the renderable's bounding sphere; hidden renderables in the frustum
+// get a level too, so they come back at the right one and their savings can be counted
+void Scene::SelectLods(const glm::vec3& eye)
+{
+	const InstanceTransform* world = transforms.Instances();
+	for (unsigned int slot : frustumSlots) {
+		const SceneMesh& mesh = meshes[meshOf[slot]];
+		if (mesh.lods.empty() || lodMaxPixels <= 0.0f) {
+			lodOf[slot] = 0;
+			continue;
+		}
+		const glm::mat4& model = world[slot].model;
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		glm::vec3 center = glm::vec3(model * glm::vec4(mesh.bounds.Center(), 1.0f));
+		float distance = glm::length(center - eye) - glm::length(mesh.bounds.Extent()) * scale;
+		// inside the sphere, or close enough for any error to be seen
+		if (distance <= 0.0f) {
+			lodOf[slot] = 0;
+			continue;
+		}
+		float pixelsPerError = lodScale * scale / distance;
+
+		unsigned int level = lodOf[slot];
+		while (level > 0 && mesh.lods[level - 1].error * pixelsPerError > lodMaxPixels) {
+			level--;
+		}
+		while (level < mesh.lods.size() && mesh.lods[level].error * pixelsPerError <= lodMaxPixels * SCENE_LOD_HYSTERESIS) {
+			level++;
+		}
+		lodOf[slot] = (unsigned char)level;
+	}
+}
+
+void Scene::FrustumRenderables(std::vector<Entity>& entities, std::vector<AABB>& bounds) const
+{
+	entities.clear();
+	bounds.clear();
+	const InstanceTransform* world = transforms.Instances();
+	for (unsigned int slot : frustumSlots) {
+		Entity entity;
+		entity.index = renderableOwner[slot];
+		entity.generation = generations[entity.index];
+		entities.push_back(entity);
+		bounds.push_back(meshes[meshOf[slot]].bounds.Transformed(world[slot].model));
+	}
+}
+
+// counting sort of the visible renderables by mesh and level of detail, then material, into one
+// staging array
+void Scene::Regroup(const glm::vec3& eye)
+{
+	// every level of every mesh gets its own run of keys
+	std::vector<size_t> firstLevel(meshes.size() + 1, 0);
+	for (size_t mesh = 0; mesh < meshes.size(); mesh++) {
+		firstLevel[mesh + 1] = firstLevel[mesh] + 1 + meshes[mesh].lods.size();
+	}
+	size_t materialCount = materials.size();
+	std::vector<size_t> offsets(firstLevel.back() * materialCount + 1, 0);
+	for (unsigned int slot : visibleSlots) {
+		offsets[(firstLevel[meshOf[slot]] + lodOf[slot]) * materialCount + materialOf[slot] + 1]++;
+	}
+	for (size_t key = 1; key < offsets.size(); key++) {
+		offsets[key] += offsets[key - 1];
+	}
+
+	batches.clear();
+	// batches are in key order, so the key indexes them through a small table
+	std::vector<unsigned int> batchOf(offsets.size(), 0);
+	for (size_t mesh = 0; mesh < meshes.size(); mesh++) {
+		for (size_t lod = 0; lod < firstLevel[mesh + 1] - firstLevel[mesh]; lod++) {
+			for (size_t material = 0; material < materialCount; material++) {
+				size_t key = (firstLevel[mesh] + lod) * materialCount + material;
+				if (offsets[key + 1] > offsets[key]) {
+					SceneBatch batch;
+					batch.mesh = (unsigned int)mesh;
+					batch.material = (unsigned int)material;
+					batch.lod = (unsigned int)lod;
+					batch.first = offsets[key];
+					batch.count = offsets[key + 1] - offsets[key];
+					batch.distance = FLT_MAX;
+					batchOf[key] = (unsigned int)batches.size();
+					batches.push_back(batch);
+				}
+			}
+		}
+	}
+
+	staging.resize(visibleSlots.size());
+	const InstanceTransform* world = transforms.Instances();
+	for (size_t slot = 0; slot < visible.size(); slot++) {
+		if (visible[slot]) {
+			size_t key = (firstLevel[meshOf[slot]] + lodOf[slot]) * materialCount + materialOf[slot];
+			InstanceTransform& instance = staging[offsets[key]++];
+			instance = world[slot];
+			// the tile rides in the padding of the normal matrix columns
+			instance.normal[0].w = lightmapTileOf[slot].x;
+			instance.normal[1].w = lightmapTileOf[slot].y;
+			instance.normal[2].w = lightmapTileOf[slot].z;
+			SceneBatch& batch = batches[batchOf[key]];
+			batch.distance = std::min(batch.distance, glm::length(glm::vec3(world[slot].model[3]) - eye));
+		}
+	}
+}
+
+size_t Scene::CullCasters(const Frustum& frustum, CasterFilter filter, std::vector<SceneBatch>& out)
+{
+	out.clear();
+	casterSlots.clear();
+	bvh.Query(frustum, casterSlots);
+	size_t count = 0;
+	for (unsigned int slot : casterSlots) {
+		if (filter == CASTERS_ALL || (filter == CASTERS_DYNAMIC) == (dynamicOf[slot] != 0)) {
+			casterSlots[count++] = slot;
+		}
+	}
+	casterSlots.resize(count);
+	if (count == 0) {
+		return 0;
+	}
+
+	// counting sort by mesh alone, depth passes need no material; slot order within a mesh
+	std::sort(casterSlots.begin(), casterSlots.end());
+	std::vector<size_t> offsets(meshes.size() + 1, 0);
+	for (unsigned int slot : casterSlots) {
+		offsets[meshOf[slot] + 1]++;
+	}
+	size_t base = staging.size();
+	for (size_t mesh = 0; mesh < meshes.size(); mesh++) {
+		if (offsets[mesh + 1] > 0) {
+			SceneBatch batch;
+			batch.mesh = (unsigned int)mesh;
+			batch.material = 0;
+			batch.lod = 0;
+			batch.first = base + offsets[mesh];
+			batch.count = offsets[mesh + 1];
+			batch.distance = 0.0f;
+			out.push_back(batch);
+		}
+		offsets[mesh + 1] += offsets[mesh];
+	}
+
+	staging.resize(base + count);
+	const InstanceTransform* world = transforms.Instances();
+	for (unsigned int slot : casterSlots) {
+		staging[base + offsets[meshOf[slot]]++] = world[slot];
+	}
+	uploadPending = true;
+	return count;
+}
+
+void Scene::Upload()
+{
+	if (!uploadPending || cpuOnly) {
+		return;
+	}
+	instances.SetInstances(staging.data(), staging.size());
+	uploadPending = false;
+}
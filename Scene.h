@@ -0,0 +1,241 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+#include "BVH.h"
+#include "GeometryArena.h"
+#include "InstancedMesh.h"
+#include "LightSet.h"
+#include "ScenePackage.h"
+#include "ThreadPool.h"
+#include "TransformSystem.h"
+
+// Stable reference to an entity. The generation makes handles of removed entities stale
+// instead of silently pointing at whatever reused the slot.
+struct Entity
+{
+	unsigned int index = 0;
+	unsigned int generation = 0;
+};
+
+// a coarser level of detail of a mesh, an index range on the mesh's vertices in the arena
+struct SceneLod
+{
+	size_t firstIndex;
+	GLsizei indexCount;
+	// object space distance the level may be off the full mesh, see MeshOptimizer::BuildLods
+	float error;
+};
+
+// an indexed mesh in the scene's geometry arena
+struct SceneMesh
+{
+	// the full mesh, what level 0 draws
+	MeshRange range;
+	// the arena space the mesh owns, what GeometryArena::Remove takes: its vertices and the indices
+	// of every level. A package's meshes share one block, which its first mesh owns; the others'
+	// is empty
+	MeshRange allocation;
+	// object space bounds of the vertices
+	AABB bounds;
+	// coarser levels, ever coarser; level i + 1 of Scene::LodRange
+	std::vector<SceneLod> lods;
+	// CPU copy in the arena's vertex order, only kept with Scene::SetKeepMeshData or
+	// Scene::SetCpuOnly; the indices of the coarser levels follow the full mesh's, as in the arena
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+};
+
+// textures are owned by the TextureLoader, the scene only refers to them
+struct SceneMaterial
+{
+	GLuint diffuse = 0, specular = 0;
+	float shininess = 0.4f;
+	// lit by the baked lightmap instead of the static lights, see LightmapBaker
+	bool lightmapped = false;
+};
+
+// a run of instances of one mesh sharing one material, drawn with one call; first indexes the
+// scene's instance buffer
+struct SceneBatch
+{
+	unsigned int mesh, material;
+	// level of detail of the mesh, 0 for the full mesh, see Scene::LodRange
+	unsigned int lod;
+	size_t first, count;
+	// distance from the eye to the closest instance origin, for front to back ordering
+	float distance;
+};
+
+// which renderables Scene::CullCasters and Scene::Renderables collect
+enum CasterFilter
+{
+	CASTERS_ALL,
+	CASTERS_STATIC,
+	CASTERS_DYNAMIC
+};
+
+// Scene store in structure of arrays form. Entities with a renderable component own one slot in
+// the transform, mesh and material arrays, entities with a light component one slot in the
+// light array. Every array stays packed: removing moves the last slot into the hole, so adding
+// and removing are O(1) and systems walk the arrays linearly without looking at entities.
+// Renderables are also leaves of a BVH over their world bounds, which Cull walks to batch only
+// what is in the view frustum. Every mesh lives in one geometry arena and every visible instance
+// in one instance buffer on the arena's VAO, so all batches draw from the same VAO.
+class Scene
+{
+public:
+	// how the arena stores vertices, only before the first AddMesh; a package brings its own
+	void SetVertexFormat(VertexFormat format) { vertexFormat = format; }
+	// reorders the mesh for the vertex cache and vertex fetch, builds its coarser levels of detail,
+	// then copies it into the geometry arena, the levels as more indices on the same vertices;
+	// returns the mesh id for AddRenderable. Vertices hold GEOMETRY_VERTEX_FLOATS floats each.
+	// For meshes not loaded from a package; packages carry their levels pre-baked, see
+	// AddPackageMeshes.
+	unsigned int AddMesh(const GLfloat* vertices, size_t vertexCount, const GLuint* indices, GLsizei indexCount);
+	// adds every mesh of the package with its baked levels of detail, its vertex and index sections
+	// going to GL in one copy each; package mesh i gets id firstMesh + i. Fails if the arena
+	// already uses another vertex format.
+	bool AddPackageMeshes(const ScenePackage& package, unsigned int& firstMesh);
+	// AddMesh keeps a CPU copy of every mesh for offline steps such as LightmapBaker
+	void SetKeepMeshData(bool keep) { keepMeshData = keep; }
+	// only before the first AddMesh: meshes live in their CPU copies alone, with no arena and no
+	// instance buffer, and the scene makes no GL call at all; ranges then index the mesh's own
+	// copy and packages, which only come packed for the arena, cannot be added
+	void SetCpuOnly(bool cpuOnly) { this->cpuOnly = cpuOnly; }
+	// second tex coords of a mesh, 2 floats per vertex in the order of SceneMesh::vertices
+	void SetLightmapCoords(unsigned int mesh, const GLfloat* coords);
+	unsigned int AddMaterial(const SceneMaterial& material);
+	// deletes the arena and the instance buffer and forgets every entity
+	void Delete();
+
+	Entity Create();
+	// drops the entity with all its components, stale handles are ignored
+	void Destroy(Entity entity);
+	bool Alive(Entity entity) const;
+	size_t EntityCount() const { return generations.size() - freeIndices.size(); }
+
+	// rotation is a unit quaternion, see TransformSystem
+	void AddRenderable(Entity entity, unsigned int mesh, unsigned int material, const glm::vec3& position, const glm::vec4& rotation, const glm::vec3& scale);
+	void SetPosition(Entity entity, const glm::vec3& position);
+	void SetRotation(Entity entity, const glm::vec4& rotation);
+	void SetMaterial(Entity entity, unsigned int material);
+	// scale and offset that place the mesh's lightmap coords in the renderable's lightmap tile
+	void SetLightmapTile(Entity entity, const glm::vec3& tile);
+	// a hidden renderable is left out of the batches of Cull though it is inside the frustum, for
+	// occlusion culling; it still casts shadows
+	void SetHidden(Entity entity, bool hidden);
+	// mesh, material and world matrix as of the last Update, false if entity has no renderable
+	bool Renderable(Entity entity, unsigned int& mesh, unsigned int& material, glm::mat4& model) const;
+	// level of detail the last Cull picked for the entity's renderable, for hidden ones the level
+	// they would draw; 0 if entity has no renderable
+	unsigned int Lod(Entity entity) const;
+	// every renderable that passes filter
+	void Renderables(CasterFilter filter, std::vector<Entity>& out) const;
+	size_t RenderableCount() const { return transforms.Size(); }
+	// renderables are static until marked dynamic; shadow maps cache what static ones cast
+	void SetDynamic(Entity entity, bool dynamic);
+	// bumped whenever a static, or a dynamic, renderable is added, moved or removed
+	unsigned int StaticRevision() const { return staticRevision; }
+	unsigned int DynamicRevision() const { return dynamicRevision; }
+
+	void AddLight(Entity entity, const PointLight& light);
+	void SetLight(Entity entity, const PointLight& light);
+	// every light component, packed
+	const std::vector<PointLight>& Lights() const { return lights; }
+	// bumped whenever a light is added, changed or removed, so consumers upload only on change
+	unsigned int LightRevision() const { return lightRevision; }
+
+	// recomputes the moved transforms and refits their BVH leaves; returns the number of
+	// transforms recomputed. No GL calls.
+	size_t Update(ThreadPool* pool = NULL);
+	// regroups the renderables inside the frustum per mesh, level of detail and material, skipped
+	// when neither the view nor any instance changed; returns the number of visible renderables
+	size_t Cull(const Frustum& frustum, const glm::vec3& eye = glm::vec3(0.0f));
+	// Cull gives each visible renderable the coarsest level of detail whose error, projected at
+	// its distance from the eye, stays within maxPixels of a viewport viewportHeight pixels high;
+	// the projection's vertical scale is 1 / tan(fovy / 2). A maxPixels of 0 draws full meshes.
+	void SetLodProjection(const glm::mat4& projection, float viewportHeight, float maxPixels);
+	// streams the regrouped instances into the instance buffer, if Cull changed them
+	void Upload();
+	// groups the renderables inside frustum that pass filter per mesh into out, for depth only
+	// passes such as shadow maps; their instances go after the visible ones in the instance
+	// buffer, so call it between Cull and Upload. Valid until the next Cull, returns the number
+	// of instances collected.
+	size_t CullCasters(const Frustum& frustum, CasterFilter filter, std::vector<SceneBatch>& out);
+	// BVH nodes tested by the last Cull that did any work
+	size_t CullTests() const { return cullTests; }
+	// every renderable inside the frustum of the last Cull, hidden ones included, with its world
+	// bounds; call it before any renderable is removed
+	void FrustumRenderables(std::vector<Entity>& entities, std::vector<AABB>& bounds) const;
+
+	// one batch per used mesh and material pair with visible instances, in mesh order
+	const std::vector<SceneBatch>& Batches() const { return batches; }
+	const SceneMesh& Mesh(unsigned int mesh) const { return meshes[mesh]; }
+	// level lod of mesh in the arena, 0 for the full mesh
+	MeshRange LodRange(unsigned int mesh, unsigned int lod) const;
+	// triangles the batches of the last Cull draw
+	size_t BatchTriangles() const;
+	// the visible instances of every batch, on the geometry arena's VAO
+	InstancedMesh& Instances() { return instances; }
+	// the same instances on the CPU, batch by batch; valid until the next Cull
+	const std::vector<InstanceTransform>& StagedInstances() const { return staging; }
+	const GeometryArena& Geometry() const { return geometry; }
+	const SceneMaterial& Material(unsigned int material) const { return materials[material]; }
+	size_t MaterialCount() const { return materials.size(); }
+
+private:
+	static const unsigned int NONE = 0xFFFFFFFFu;
+
+	GeometryArena geometry;
+	VertexFormat vertexFormat = VERTEX_PACKED;
+	bool keepMeshData = false;
+	bool cpuOnly = false;
+	InstancedMesh instances;
+	std::vector<SceneMesh> meshes;
+	std::vector<SceneMaterial> materials;
+
+	// per entity index: current generation and the component slots, NONE when absent
+	std::vector<unsigned int> generations;
+	std::vector<unsigned int> renderableSlot, lightSlot;
+	std::vector<unsigned int> freeIndices;
+
+	// renderable components, slot i of each array belongs to the same entity
+	TransformSystem transforms;
+	std::vector<unsigned int> meshOf, materialOf;
+	std::vector<unsigned int> renderableOwner;
+	std::vector<int> proxyOf;
+	std::vector<unsigned char> dynamicOf, hiddenOf, lodOf;
+	std::vector<glm::vec3> lightmapTileOf;
+	unsigned int staticRevision = 0, dynamicRevision = 0;
+
+	BVH bvh;
+	// slots recomputed by the current Update, refit after it
+	std::vector<unsigned int> refit;
+	// inside the frustum, and of those the ones not hidden
+	std::vector<unsigned int> frustumSlots, visibleSlots, casterSlots;
+	std::vector<unsigned char> visible;
+	Frustum lastFrustum;
+	glm::vec3 lastEye = glm::vec3(0.0f);
+	size_t cullTests = 0;
+	// pixels per unit of error at distance 1, and the error allowed in pixels
+	float lodScale = 0.0f, lodMaxPixels = 0.0f;
+
+	// light components
+	std::vector<PointLight> lights;
+	std::vector<unsigned int> lightOwner;
+	unsigned int lightRevision = 0;
+
+	// visible instances regrouped by mesh and material
+	std::vector<InstanceTransform> staging;
+	std::vector<SceneBatch> batches;
+	// an instance moved, appeared or went away since the last Cull
+	bool instancesChanged = false;
+	bool uploadPending = false;
+
+	void RemoveRenderable(unsigned int index);
+	void RemoveLight(unsigned int index);
+	void SelectLods(const glm::vec3& eye);
+	void Regroup(const glm::vec3& eye);
+};
@@ -0,0 +1,191 @@
+#include "ScenePackage.h"
+#include <fstream>
+#include <iostream>
+
+unsigned int PackageContent::AddString(const std::string& text)
+{
+	if (text.empty()) {
+		return SCENE_PACKAGE_NO_STRING;
+	}
+	unsigned int offset = (unsigned int)strings.size();
+	strings += text;
+	strings += '\0';
+	return offset;
+}
+
+// whether count elements at offset lie inside the file, at an offset the tables can be read from
+static bool SectionFits(size_t fileSize, unsigned int offset, unsigned int count, size_t elementSize)
+{
+	return offset % 4 == 0 && offset <= fileSize && (unsigned long long)count * elementSize <= fileSize - offset;
+}
+
+// whether every one of count indices names one of the vertexCount vertices of its mesh
+static bool IndicesFit(const GLuint* indices, unsigned int count, unsigned int vertexCount)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		if (indices[i] >= vertexCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ScenePackage::Open(const std::string& path)
+{
+	Close();
+	if (!file.Open(path)) {
+		return false;
+	}
+	size_t size = file.Size();
+	if (size < sizeof(PackageHeader)) {
+		Close();
+		return false;
+	}
+	header = (const PackageHeader*)file.Data();
+	if (header->magic != SCENE_PACKAGE_MAGIC || header->version != SCENE_PACKAGE_VERSION || header->vertexFormat > VERTEX_QUANTIZED
+		|| !SectionFits(size, header->meshesOffset, header->meshCount, sizeof(PackageMesh))
+		|| !SectionFits(size, header->lodsOffset, header->lodCount, sizeof(PackageLod))
+		|| !SectionFits(size, header->materialsOffset, header->materialCount, sizeof(PackageMaterial))
+		|| !SectionFits(size, header->renderablesOffset, header->renderableCount, sizeof(PackageRenderable))
+		|| !SectionFits(size, header->lightsOffset, header->lightCount, sizeof(PackageLight))
+		|| !SectionFits(size, header->stringsOffset, header->stringsSize, 1)
+		|| !SectionFits(size, header->verticesOffset, header->vertexCount, VertexLayout::Stride(Format()))
+		|| !SectionFits(size, header->indicesOffset, header->indexCount, sizeof(GLuint))) {
+		std::cout << "WARNING::SCENE_PACKAGE::INVALID_HEADER " << path << std::endl;
+		Close();
+		return false;
+	}
+	meshes = (const PackageMesh*)(file.Data() + header->meshesOffset);
+	lods = (const PackageLod*)(file.Data() + header->lodsOffset);
+	materials = (const PackageMaterial*)(file.Data() + header->materialsOffset);
+	renderables = (const PackageRenderable*)(file.Data() + header->renderablesOffset);
+	lights = (const PackageLight*)(file.Data() + header->lightsOffset);
+	strings = (const char*)(file.Data() + header->stringsOffset);
+
+	// the tables only refer to what is there
+	bool valid = header->stringsSize == 0 || strings[header->stringsSize - 1] == '\0';
+	for (unsigned int i = 0; valid && i < header->meshCount; i++) {
+		const PackageMesh& mesh = meshes[i];
+		valid = mesh.firstVertex <= header->vertexCount && mesh.vertexCount <= header->vertexCount - mesh.firstVertex
+			&& mesh.firstIndex <= header->indexCount && mesh.indexCount <= header->indexCount - mesh.firstIndex
+			&& mesh.firstLod <= header->lodCount && mesh.lodCount <= header->lodCount - mesh.firstLod;
+	}
+	for (unsigned int i = 0; valid && i < header->lodCount; i++) {
+		valid = lods[i].firstIndex <= header->indexCount && lods[i].indexCount <= header->indexCount - lods[i].firstIndex;
+	}
+	// a bad index would make GL, the CPU culling and the software rasterizer read past the
+	// mesh's vertices, so every level's indices are checked once here
+	for (unsigned int i = 0; valid && i < header->meshCount; i++) {
+		const PackageMesh& mesh = meshes[i];
+		valid = IndicesFit(IndexData() + mesh.firstIndex, mesh.indexCount, mesh.vertexCount);
+		for (unsigned int lod = mesh.firstLod; valid && lod < mesh.firstLod + mesh.lodCount; lod++) {
+			valid = IndicesFit(IndexData() + lods[lod].firstIndex, lods[lod].indexCount, mesh.vertexCount);
+		}
+	}
+	for (unsigned int i = 0; valid && i < header->materialCount; i++) {
+		const PackageMaterial& material = materials[i];
+		valid = (material.diffuse == SCENE_PACKAGE_NO_STRING || material.diffuse < header->stringsSize)
+			&& (material.specular == SCENE_PACKAGE_NO_STRING || material.specular < header->stringsSize);
+	}
+	for (unsigned int i = 0; valid && i < header->renderableCount; i++) {
+		valid = renderables[i].mesh < header->meshCount && renderables[i].material < header->materialCount;
+	}
+	if (!valid) {
+		std::cout << "WARNING::SCENE_PACKAGE::INVALID_TABLE " << path << std::endl;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ScenePackage::Close()
+{
+	file.Close();
+	header = NULL;
+	meshes = NULL;
+	lods = NULL;
+	materials = NULL;
+	renderables = NULL;
+	lights = NULL;
+	strings = NULL;
+}
+
+const char* ScenePackage::String(unsigned int offset) const
+{
+	return offset == SCENE_PACKAGE_NO_STRING ? "" : strings + offset;
+}
+
+std::string ScenePackage::PackagePath(const std::string& sourcePath)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return sourcePath + ".spak";
+	}
+	return sourcePath.substr(0, dot) + ".spak";
+}
+
+// offset of the next section of size bytes, aligned; end is advanced past it
+static unsigned int Place(size_t& end, size_t size)
+{
+	end = (end + SCENE_PACKAGE_ALIGNMENT - 1) / SCENE_PACKAGE_ALIGNMENT * SCENE_PACKAGE_ALIGNMENT;
+	unsigned int offset = (unsigned int)end;
+	end += size;
+	return offset;
+}
+
+bool ScenePackage::Write(const std::string& path, const PackageContent& content, VertexFormat format)
+{
+	size_t vertexCount = content.vertices.size() / GEOMETRY_VERTEX_FLOATS;
+	std::vector<unsigned char> packed(vertexCount * VertexLayout::Stride(format));
+	VertexLayout::Pack(format, content.vertices.data(), vertexCount, packed.data());
+
+	PackageHeader header;
+	header.magic = SCENE_PACKAGE_MAGIC;
+	header.version = SCENE_PACKAGE_VERSION;
+	header.vertexFormat = format;
+	header.meshCount = (unsigned int)content.meshes.size();
+	header.lodCount = (unsigned int)content.lods.size();
+	header.materialCount = (unsigned int)content.materials.size();
+	header.renderableCount = (unsigned int)content.renderables.size();
+	header.lightCount = (unsigned int)content.lights.size();
+	header.stringsSize = (unsigned int)content.strings.size();
+	header.vertexCount = (unsigned int)vertexCount;
+	header.indexCount = (unsigned int)content.indices.size();
+
+	size_t end = sizeof(PackageHeader);
+	header.meshesOffset = Place(end, content.meshes.size() * sizeof(PackageMesh));
+	header.lodsOffset = Place(end, content.lods.size() * sizeof(PackageLod));
+	header.materialsOffset = Place(end, content.materials.size() * sizeof(PackageMaterial));
+	header.renderablesOffset = Place(end, content.renderables.size() * sizeof(PackageRenderable));
+	header.lightsOffset = Place(end, content.lights.size() * sizeof(PackageLight));
+	header.stringsOffset = Place(end, content.strings.size());
+	header.verticesOffset = Place(end, packed.size());
+	header.indicesOffset = Place(end, content.indices.size() * sizeof(GLuint));
+
+	std::ofstream out(path.c_str(), std::ios::binary);
+	if (!out) {
+		std::cout << "ERROR::SCENE_PACKAGE::WRITE_FAILED " << path << std::endl;
+		return false;
+	}
+	const char padding[SCENE_PACKAGE_ALIGNMENT] = {};
+	size_t written = 0;
+	// sections in file order, each padded up to its offset
+	const struct { unsigned int offset; const void* data; size_t size; } sections[] = {
+		{ 0, &header, sizeof(header) },
+		{ header.meshesOffset, content.meshes.data(), content.meshes.size() * sizeof(PackageMesh) },
+		{ header.lodsOffset, content.lods.data(), content.lods.size() * sizeof(PackageLod) },
+		{ header.materialsOffset, content.materials.data(), content.materials.size() * sizeof(PackageMaterial) },
+		{ header.renderablesOffset, content.renderables.data(), content.renderables.size() * sizeof(PackageRenderable) },
+		{ header.lightsOffset, content.lights.data(), content.lights.size() * sizeof(PackageLight) },
+		{ header.stringsOffset, content.strings.data(), content.strings.size() },
+		{ header.verticesOffset, packed.data(), packed.size() },
+		{ header.indicesOffset, content.indices.data(), content.indices.size() * sizeof(GLuint) },
+	};
+	for (const auto& section : sections) {
+		out.write(padding, section.offset - written);
+		out.write((const char*)section.data, section.size);
+		written = section.offset + section.size;
+	}
+	return (bool)out;
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "VertexFormat.h"
+
+#define SCENE_PACKAGE_MAGIC 0x4B415053u // "SPAK"
+#define SCENE_PACKAGE_VERSION 2
+// every section starts on this boundary inside the file
+#define SCENE_PACKAGE_ALIGNMENT 16
+// string offset of a texture the material does not have
+#define SCENE_PACKAGE_NO_STRING 0xFFFFFFFFu
+// material flag: sample the diffuse map with mipmaps
+#define SCENE_PACKAGE_MIPMAPS 1u
+
+// On disk layout: header, then the mesh, level of detail, material, renderable and light tables,
+// the string table, the vertex data in the header's VertexFormat and the indices, each section
+// aligned.
+// All fields are little endian 32 bit values; offsets are from the start of the file.
+struct PackageHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int vertexFormat;
+	unsigned int meshCount, meshesOffset;
+	unsigned int lodCount, lodsOffset;
+	unsigned int materialCount, materialsOffset;
+	unsigned int renderableCount, renderablesOffset;
+	unsigned int lightCount, lightsOffset;
+	unsigned int stringsSize, stringsOffset;
+	unsigned int vertexCount, verticesOffset;
+	unsigned int indexCount, indicesOffset;
+};
+
+// a range of the vertex and index sections; indices start at 0 for the mesh's first vertex
+struct PackageMesh
+{
+	unsigned int firstVertex, vertexCount;
+	unsigned int firstIndex, indexCount;
+	float boundsMin[3], boundsMax[3];
+	// the mesh's coarser levels in the level of detail table, ever coarser
+	unsigned int firstLod, lodCount;
+};
+
+// a coarser level of a mesh baked by MeshOptimizer::BuildLods: another range of the index
+// section, on the same vertices as the mesh
+struct PackageLod
+{
+	unsigned int firstIndex, indexCount;
+	// object space distance the level may be off the full mesh
+	float error;
+};
+
+// texture paths are string table offsets, relative to the package's directory
+struct PackageMaterial
+{
+	unsigned int diffuse, specular;
+	unsigned int flags;
+	float shininess;
+};
+
+// rotation is a unit quaternion, see TransformSystem
+struct PackageRenderable
+{
+	unsigned int mesh, material;
+	float position[3];
+	float rotation[4];
+	float scale[3];
+};
+
+struct PackageLight
+{
+	float position[3];
+	float ambient[3], diffuse[3], specular[3];
+	float constant, linear, quadratic;
+};
+
+// Everything a package holds, in memory, as importers build it. Vertices are in the source
+// layout of GEOMETRY_VERTEX_FLOATS floats and are packed when written.
+struct PackageContent
+{
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	std::vector<PackageMesh> meshes;
+	std::vector<PackageLod> lods;
+	std::vector<PackageMaterial> materials;
+	std::vector<PackageRenderable> renderables;
+	std::vector<PackageLight> lights;
+	// NUL terminated strings back to back
+	std::string strings;
+
+	// offset of text in strings, SCENE_PACKAGE_NO_STRING for an empty one
+	unsigned int AddString(const std::string& text);
+};
+
+// Baked scene: meshes already optimized and packed, materials, renderables and a light rig.
+// Opening maps the file, checks the tables against its size and every index against its mesh's
+// vertex count; the vertex and index sections are handed to GL straight from the mapping,
+// nothing is parsed or converted per vertex.
+class ScenePackage
+{
+public:
+	// maps the file and validates every table, returns false if it is not usable
+	bool Open(const std::string& path);
+	void Close();
+
+	VertexFormat Format() const { return (VertexFormat)header->vertexFormat; }
+	unsigned int MeshCount() const { return header->meshCount; }
+	const PackageMesh& Mesh(unsigned int mesh) const { return meshes[mesh]; }
+	const PackageLod& Lod(unsigned int lod) const { return lods[lod]; }
+	unsigned int MaterialCount() const { return header->materialCount; }
+	const PackageMaterial& Material(unsigned int material) const { return materials[material]; }
+	unsigned int RenderableCount() const { return header->renderableCount; }
+	const PackageRenderable& Renderable(unsigned int renderable) const { return renderables[renderable]; }
+	unsigned int LightCount() const { return header->lightCount; }
+	const PackageLight& Light(unsigned int light) const { return lights[light]; }
+	// "" for SCENE_PACKAGE_NO_STRING
+	const char* String(unsigned int offset) const;
+
+	// every vertex of every mesh, VertexCount() * VertexLayout::Stride(Format()) bytes
+	const unsigned char* VertexData() const { return file.Data() + header->verticesOffset; }
+	unsigned int VertexCount() const { return header->vertexCount; }
+	const GLuint* IndexData() const { return (const GLuint*)(file.Data() + header->indicesOffset); }
+	unsigned int IndexCount() const { return header->indexCount; }
+
+	// the package that an importer writes for a source file, "demo.obj" becomes "demo.spak"
+	static std::string PackagePath(const std::string& sourcePath);
+	// packs the vertices into format and writes the package to path
+	static bool Write(const std::string& path, const PackageContent& content, VertexFormat format);
+
+private:
+	MappedFile file;
+	const PackageHeader* header = NULL;
+	const PackageMesh* meshes = NULL;
+	const PackageLod* lods = NULL;
+	const PackageMaterial* materials = NULL;
+	const PackageRenderable* renderables = NULL;
+	const PackageLight* lights = NULL;
+	const char* strings = NULL;
+};
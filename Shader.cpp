@@ -0,0 +1,104 @@
+#include "Shader.h"
+#include <algorithm>
+#include <iostream>
+
+static bool IsSamplerType(GLenum type)
+{
+	switch (type) {
+	case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_SAMPLER_BUFFER: case GL_INT_SAMPLER_BUFFER: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void Shader::Reflect()
+{
+	uniforms.clear();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<GLchar> buffer(maxLength + 1);
+
+	for (GLint i = 0; i < count; i++) {
+		GLint size = 0;
+		GLenum type = 0;
+		GLsizei length = 0;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+		std::string name(buffer.data(), length);
+
+		GLint location = glGetUniformLocation(program, name.c_str());
+		// members of uniform blocks have no location, they are fed through buffers
+		if (location < 0) {
+			continue;
+		}
+
+		// arrays of basic types are reported once as "name[0]" with their size,
+		// register the bare name and every element so "name[i]" can be looked up too
+		size_t bracket = name.rfind("[0]");
+		if (bracket != std::string::npos && bracket + 3 == name.size()) {
+			std::string base = name.substr(0, bracket);
+			uniforms.push_back({ UniformHash(base.c_str()), location, type, base });
+			for (GLint e = 1; e < size; e++) {
+				std::string element = base + "[" + std::to_string(e) + "]";
+				uniforms.push_back({ UniformHash(element.c_str()), glGetUniformLocation(program, element.c_str()), type, element });
+			}
+		}
+		uniforms.push_back({ UniformHash(name.c_str()), location, type, name });
+	}
+
+	std::sort(uniforms.begin(), uniforms.end(), [](const UniformInfo& a, const UniformInfo& b) { return a.hash < b.hash; });
+
+	// two names sharing a hash would silently alias each other, so refuse to run
+	for (size_t i = 1; i < uniforms.size(); i++) {
+		if (uniforms[i].hash == uniforms[i - 1].hash) {
+			std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION " << uniforms[i - 1].name << " / " << uniforms[i].name << std::endl;
+			exit(1);
+		}
+	}
+}
+
+void Shader::Delete()
+{
+	glDeleteProgram(program);
+	program = 0;
+	uniforms.clear();
+}
+
+void Shader::BindUniformBlock(const char* blockName, GLuint binding) const
+{
+	GLuint index = glGetUniformBlockIndex(program, blockName);
+	if (index == GL_INVALID_INDEX) {
+		std::cout << "WARNING::SHADER::UNIFORM_BLOCK_NOT_ACTIVE " << blockName << std::endl;
+		return;
+	}
+	glUniformBlockBinding(program, index, binding);
+}
+
+GLint Shader::Location(unsigned int nameHash) const
+{
+	auto it = std::lower_bound(uniforms.begin(), uniforms.end(), nameHash, [](const UniformInfo& info, unsigned int hash) { return info.hash < hash; });
+	if (it == uniforms.end() || it->hash != nameHash) {
+		return -1;
+	}
+	return it->location;
+}
+
+GLint Shader::Lookup(unsigned int nameHash, const char* name, GLenum expectedType) const
+{
+	auto it = std::lower_bound(uniforms.begin(), uniforms.end(), nameHash, [](const UniformInfo& info, unsigned int hash) { return info.hash < hash; });
+	if (it == uniforms.end() || it->hash != nameHash) {
+		// the linker strips unused uniforms, so this is only worth a warning
+		std::cout << "WARNING::SHADER::UNIFORM_NOT_ACTIVE " << name << std::endl;
+		return -1;
+	}
+	// glUniform1i sets samplers and bools as well as ints
+	bool typeMatches = it->type == expectedType || (expectedType == GL_INT && (IsSamplerType(it->type) || it->type == GL_BOOL));
+	if (!typeMatches) {
+		std::cout << "WARNING::SHADER::UNIFORM_TYPE_MISMATCH " << name << std::endl;
+	}
+	return it->location;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <type_traits>
+#include <string>
+#include <vector>
+
+// FNV-1a hash of a uniform name. It is constexpr so literal names can be hashed at compile time,
+// see UNIFORM_ID below.
+constexpr unsigned int UniformHash(const char* name, unsigned int hash = 2166136261u)
+{
+	return *name == '\0' ? hash : UniformHash(name + 1, (unsigned int)(((unsigned long long)(hash ^ (unsigned char)*name) * 16777619ull) & 0xFFFFFFFFull));
+}
+
+// Forces the hash of a string literal to be evaluated by the compiler, e.g. shader.Location(UNIFORM_ID("model"))
+#define UNIFORM_ID(name) std::integral_constant<unsigned int, UniformHash(name)>::value
+
+// Typed handle to a uniform location, resolved once from the shader's uniform table
+template <typename T>
+struct Uniform
+{
+	GLint location = -1;
+};
+
+// One entry of the reflected uniform table
+struct UniformInfo
+{
+	unsigned int hash;
+	GLint location;
+	GLenum type;
+	std::string name;
+};
+
+class Shader
+{
+public:
+	GLuint program = 0;
+
+	// Queries every active uniform of the linked program once and builds the sorted lookup table
+	void Reflect();
+	void Delete();
+	// Attaches a named uniform block to a uniform buffer binding point
+	void BindUniformBlock(const char* blockName, GLuint binding) const;
+
+	// Table lookups, these never call into GL. Unknown names return -1 which GL silently ignores.
+	GLint Location(unsigned int nameHash) const;
+	GLint Location(const char* name) const { return Location(UniformHash(name)); }
+	const std::vector<UniformInfo>& Uniforms() const { return uniforms; }
+
+	template <typename T>
+	Uniform<T> Get(const char* name) const
+	{
+		Uniform<T> handle;
+		handle.location = Lookup(UniformHash(name), name, GLType<T>());
+		return handle;
+	}
+
+	void Set(Uniform<int> u, int value) const { glUniform1i(u.location, value); }
+	void Set(Uniform<float> u, float value) const { glUniform1f(u.location, value); }
+	void Set(Uniform<glm::vec2> u, const glm::vec2& value) const { glUniform2fv(u.location, 1, glm::value_ptr(value)); }
+	void Set(Uniform<glm::vec3> u, const glm::vec3& value) const { glUniform3fv(u.location, 1, glm::value_ptr(value)); }
+	void Set(Uniform<glm::vec4> u, const glm::vec4& value) const { glUniform4fv(u.location, 1, glm::value_ptr(value)); }
+	void Set(Uniform<glm::mat3> u, const glm::mat3& value) const { glUniformMatrix3fv(u.location, 1, GL_FALSE, glm::value_ptr(value)); }
+	void Set(Uniform<glm::mat4> u, const glm::mat4& value) const { glUniformMatrix4fv(u.location, 1, GL_FALSE, glm::value_ptr(value)); }
+	// uniform arrays, count elements from the one u refers to
+	void Set(Uniform<float> u, const float* values, GLsizei count) const { glUniform1fv(u.location, count, values); }
+	void Set(Uniform<glm::mat4> u, const glm::mat4* values, GLsizei count) const { glUniformMatrix4fv(u.location, count, GL_FALSE, glm::value_ptr(values[0])); }
+
+	// Convenience setter keyed by a (compile time) name hash
+	template <typename T>
+	void Set(unsigned int nameHash, const T& value) const
+	{
+		Uniform<T> handle;
+		handle.location = Location(nameHash);
+		Set(handle, value);
+	}
+
+private:
+	std::vector<UniformInfo> uniforms;
+
+	GLint Lookup(unsigned int nameHash, const char* name, GLenum expectedType) const;
+
+	template <typename T> static GLenum GLType();
+};
+
+template <> inline GLenum Shader::GLType<int>() { return GL_INT; }
+template <> inline GLenum Shader::GLType<float>() { return GL_FLOAT; }
+template <> inline GLenum Shader::GLType<glm::vec2>() { return GL_FLOAT_VEC2; }
+template <> inline GLenum Shader::GLType<glm::vec3>() { return GL_FLOAT_VEC3; }
+template <> inline GLenum Shader::GLType<glm::vec4>() { return GL_FLOAT_VEC4; }
+template <> inline GLenum Shader::GLType<glm::mat3>() { return GL_FLOAT_MAT3; }
+template <> inline GLenum Shader::GLType<glm::mat4>() { return GL_FLOAT_MAT4; }
@@ -0,0 +1,282 @@
+#include "ShadowMaps.h"
+#include "ClusteredLights.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+const GLuint ShadowMaps::SHADOW_UNIT;
+
+GLuint ShadowMaps::CreateArray(bool sampled)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_VIEWS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	// the sampled maps compare in hardware, bilinearly filtered; the caches are only copied from
+	GLint filter = sampled ? GL_LINEAR : GL_NEAREST;
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (sampled) {
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
+}
+
+void ShadowMaps::Create()
+{
+	depthMaps = CreateArray(true);
+	staticMaps = CreateArray(false);
+
+	// one depth only framebuffer per layer of each array
+	glGenFramebuffers(SHADOW_VIEWS, framebuffers);
+	glGenFramebuffers(SHADOW_VIEWS, staticFramebuffers);
+	for (int i = 0; i < SHADOW_VIEWS; i++) {
+		const GLuint targets[] = { framebuffers[i], staticFramebuffers[i] };
+		const GLuint textures[] = { depthMaps, staticMaps };
+		for (int j = 0; j < 2; j++) {
+			glBindFramebuffer(GL_FRAMEBUFFER, targets[j]);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[j], 0, i);
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				std::cout << "ERROR::SHADOW::FRAMEBUFFER_INCOMPLETE layer " << i << std::endl;
+			}
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	for (Layer& layer : layers) {
+		layer = Layer();
+	}
+	for (Cascade& cascade : cascades) {
+		cascade = Cascade();
+	}
+}
+
+void ShadowMaps::Delete()
+{
+	glDeleteFramebuffers(SHADOW_VIEWS, framebuffers);
+	glDeleteFramebuffers(SHADOW_VIEWS, staticFramebuffers);
+	GLuint textures[] = { depthMaps, staticMaps };
+	glDeleteTextures(2, textures);
+	depthMaps = staticMaps = 0;
+}
+
+std::string ShadowMaps::Defines()
+{
+	return "#define SHADOWS\n#define SHADOW_CASCADES " + std::to_string(SHADOW_CASCADES) + "\n";
+}
+
+void ShadowMaps::SetShader(const Shader& depth)
+{
+	depthShader = depth;
+	depthViewProjection = depthShader.Get<glm::mat4>("viewProjection");
+}
+
+void ShadowMaps::Prepare(Scene& scene, const glm::mat4& view, const glm::mat4& projection, const LightBlock& block, const LightFeatures& features)
+{
+	passes = 0;
+	casters = 0;
+	for (Layer& layer : layers) {
+		layer.drawStatic = layer.drawDynamic = false;
+	}
+
+	if (features.dirLight) {
+		glm::mat4 matrices[SHADOW_CASCADES], cullMatrices[SHADOW_CASCADES];
+		FitCascades(view, projection, glm::normalize(block.dirLight.direction), matrices, cullMatrices);
+		for (int i = 0; i < SHADOW_CASCADES; i++) {
+			layers[i].texelSize = 2.0f * cascades[i].halfSize / SHADOW_MAP_SIZE;
+			PrepareLayer(scene, layers[i], matrices[i], cullMatrices[i]);
+		}
+	}
+	if (features.spotLight) {
+		Layer& layer = layers[SHADOW_CASCADES];
+		glm::mat4 matrix = SpotMatrix(block.spotLight, layer.texelSize);
+		PrepareLayer(scene, layer, matrix, matrix);
+	}
+}
+
+void ShadowMaps::FitCascades(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& direction, glm::mat4* matrices, glm::mat4* cullMatrices)
+{
+	// the near and far plane, recovered from the perspective matrix itself
+	float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+	float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+	float distance = std::min(SHADOW_DISTANCE, farPlane);
+
+	// the frustum's corners on the near and far plane; corners of a slice lie on the lines between
+	glm::mat4 inverse = glm::inverse(projection * view);
+	glm::vec3 nearCorners[4], farCorners[4];
+	for (int i = 0; i < 4; i++) {
+		float x = (i & 1) ? 1.0f : -1.0f, y = (i & 2) ? 1.0f : -1.0f;
+		glm::vec4 nearCorner = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+		glm::vec4 farCorner = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+		nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+		farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+	}
+
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+	bool turned = direction != lightDirection;
+	lightDirection = direction;
+
+	float sliceNear = nearPlane;
+	for (int i = 0; i < SHADOW_CASCADES; i++) {
+		float fraction = (float)(i + 1) / SHADOW_CASCADES;
+		float logarithmic = nearPlane * std::pow(distance / nearPlane, fraction);
+		float even = nearPlane + (distance - nearPlane) * fraction;
+		float sliceFar = SHADOW_SPLIT_LAMBDA * logarithmic + (1.0f - SHADOW_SPLIT_LAMBDA) * even;
+
+		// the slice's bounding sphere does not change with the camera's orientation
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int j = 0; j < 4; j++) {
+			glm::vec3 ray = farCorners[j] - nearCorners[j];
+			corners[j] = nearCorners[j] + ray * ((sliceNear - nearPlane) / (farPlane - nearPlane));
+			corners[j + 4] = nearCorners[j] + ray * ((sliceFar - nearPlane) / (farPlane - nearPlane));
+			center += corners[j] + corners[j + 4];
+		}
+		center /= 8.0f;
+		float radius = 0.0f;
+		for (const glm::vec3& corner : corners) {
+			radius = std::max(radius, glm::length(corner - center));
+		}
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// kept while the sphere still fits and the box is not needlessly coarse, so the cached
+		// depth stays valid; when refit, the box is snapped to whole texels
+		Cascade& cascade = cascades[i];
+		glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+		if (turned || glm::length(lightCenter - cascade.center) + radius > cascade.halfSize || radius < cascade.halfSize * 0.5f) {
+			cascade.halfSize = radius * (1.0f + SHADOW_CASCADE_SLACK);
+			float texel = 2.0f * cascade.halfSize / SHADOW_MAP_SIZE;
+			cascade.center = glm::floor(lightCenter / texel) * texel;
+		}
+
+		// lookAt looks down -z, so the depth range is mirrored
+		const glm::vec3& c = cascade.center;
+		float h = cascade.halfSize;
+		matrices[i] = glm::ortho(c.x - h, c.x + h, c.y - h, c.y + h, -c.z - h, -c.z + h) * lightView;
+		cullMatrices[i] = glm::ortho(c.x - h, c.x + h, c.y - h, c.y + h, -c.z - h - SHADOW_CASTER_REACH, -c.z + h) * lightView;
+		sliceNear = sliceFar;
+	}
+}
+
+glm::mat4 ShadowMaps::SpotMatrix(const SpotLight& light, float& texelSize)
+{
+	PointLight reach = {};
+	reach.ambient = light.ambient;
+	reach.diffuse = light.diffuse;
+	reach.specular = light.specular;
+	reach.constant = light.constant;
+	reach.linear = light.linear;
+	reach.quadratic = light.quadratic;
+	float range = std::min(ClusteredLights::LightRadius(reach), SHADOW_MAX_RANGE);
+	float outer = std::acos(glm::clamp(std::min(light.cutOff, light.outerCutOff), -1.0f, 1.0f));
+	float fov = 2.0f * std::min(outer, 1.5f);
+	texelSize = 2.0f * std::tan(fov * 0.5f) / SHADOW_MAP_SIZE;
+
+	glm::vec3 direction = glm::normalize(light.direction);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+	return glm::perspective(fov, 1.0f, SHADOW_SPOT_NEAR, std::max(range, SHADOW_SPOT_NEAR * 2.0f)) * glm::lookAt(light.position, light.position + direction, up);
+}
+
+void ShadowMaps::PrepareLayer(Scene& scene, Layer& layer, const glm::mat4& matrix, const glm::mat4& cullMatrix)
+{
+	bool moved = !layer.valid || matrix != layer.matrix;
+	layer.matrix = matrix;
+	layer.valid = true;
+	Frustum frustum(cullMatrix);
+
+	if (!caching) {
+		layer.drawStatic = true;
+		casters += scene.CullCasters(frustum, CASTERS_ALL, layer.staticBatches);
+		passes++;
+		return;
+	}
+
+	if (moved || scene.StaticRevision() != layer.staticRevision) {
+		layer.drawStatic = true;
+		layer.staticRevision = scene.StaticRevision();
+		casters += scene.CullCasters(frustum, CASTERS_STATIC, layer.staticBatches);
+		passes++;
+	}
+	if (layer.drawStatic || scene.DynamicRevision() != layer.dynamicRevision) {
+		layer.dynamicRevision = scene.DynamicRevision();
+		size_t count = scene.CullCasters(frustum, CASTERS_DYNAMIC, layer.dynamicBatches);
+		// dynamic casters that stay out of the layer do not make it out of date
+		layer.drawDynamic = layer.drawStatic || count > 0 || layer.dynamicCasters > 0;
+		layer.dynamicCasters = count;
+		if (layer.drawDynamic) {
+			casters += count;
+			passes++;
+		}
+	}
+}
+
+void ShadowMaps::Render(GLState& state, Scene& scene)
+{
+	if (passes == 0) {
+		return;
+	}
+	state.UseProgram(depthShader.program);
+	state.BindVertexArray(scene.Instances().Vao());
+	state.Enable(GL_DEPTH_TEST);
+	// casters in front of a cascade's near plane are flattened onto it instead of clipped
+	state.Enable(GL_DEPTH_CLAMP);
+	state.Enable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+	glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+
+	for (int i = 0; i < SHADOW_VIEWS; i++) {
+		Layer& layer = layers[i];
+		if (layer.drawStatic) {
+			glBindFramebuffer(GL_FRAMEBUFFER, caching ? staticFramebuffers[i] : framebuffers[i]);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			depthShader.Set(depthViewProjection, layer.matrix);
+			DrawBatches(scene, layer.staticBatches);
+		}
+		if (layer.drawDynamic) {
+			// the cache is copied, not drawn again, and the dynamic casters go on top
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffers[i]);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[i]);
+			glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+			depthShader.Set(depthViewProjection, layer.matrix);
+			DrawBatches(scene, layer.dynamicBatches);
+		}
+	}
+
+	state.Disable(GL_POLYGON_OFFSET_FILL);
+	state.Disable(GL_DEPTH_CLAMP);
+}
+
+void ShadowMaps::DrawBatches(Scene& scene, const std::vector<SceneBatch>& batches)
+{
+	for (const SceneBatch& batch : batches) {
+		scene.Instances().DrawBound(scene.LodRange(batch.mesh, batch.lod), batch.first, batch.count);
+	}
+}
+
+void ShadowMaps::Bind(GLState& state, const Shader& shader) const
+{
+	glm::mat4 matrices[SHADOW_VIEWS];
+	float texelSizes[SHADOW_VIEWS];
+	for (int i = 0; i < SHADOW_VIEWS; i++) {
+		matrices[i] = layers[i].matrix;
+		texelSizes[i] = layers[i].texelSize;
+	}
+	state.UseProgram(shader.program);
+	state.BindTexture(SHADOW_UNIT, GL_TEXTURE_2D_ARRAY, depthMaps);
+	shader.Set(UNIFORM_ID("shadowMap"), (int)SHADOW_UNIT);
+	Uniform<glm::mat4> matrixArray;
+	matrixArray.location = shader.Location(UNIFORM_ID("shadowMatrices"));
+	shader.Set(matrixArray, matrices, SHADOW_VIEWS);
+	Uniform<float> texelArray;
+	texelArray.location = shader.Location(UNIFORM_ID("shadowTexelSizes"));
+	shader.Set(texelArray, texelSizes, SHADOW_VIEWS);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "GLState.h"
+#include "LightSet.h"
+#include "Scene.h"
+#include "Shader.h"
+
+// cascades of the directional light, the spotlight's map is the layer after them
+#define SHADOW_CASCADES 3
+#define SHADOW_VIEWS (SHADOW_CASCADES + 1)
+#define SHADOW_MAP_SIZE 1024
+// view distance the cascades cover, split SHADOW_SPLIT_LAMBDA logarithmically and the rest evenly
+#define SHADOW_DISTANCE 40.0f
+#define SHADOW_SPLIT_LAMBDA 0.75f
+// a cascade is fit this much larger than its slice of the view, so the camera can move and
+// turn a little before it has to be refit and redrawn
+#define SHADOW_CASCADE_SLACK 0.25f
+// casters up to this far towards the light from a cascade still cast into it, flattened onto
+// its near plane by depth clamping
+#define SHADOW_CASTER_REACH 100.0f
+#define SHADOW_SPOT_NEAR 0.1f
+#define SHADOW_MAX_RANGE 100.0f
+// glPolygonOffset of the depth passes
+#define SHADOW_SLOPE_BIAS 2.0f
+#define SHADOW_CONSTANT_BIAS 4.0f
+
+// Shadow maps of the directional light, as cascades following the camera, and of the spotlight,
+// in the layers of one depth texture array. Each layer keeps a cache of what the static
+// renderables cast, redrawn only when its light view or a static renderable changes; every
+// update copies the cache into the sampled layer and draws just the dynamic renderables on top.
+// A layer whose view and casters are unchanged is not touched at all.
+//
+// Per frame: Prepare between Scene::Cull and Scene::Upload, Render after the upload, then Bind
+// each lighting program built with Defines.
+class ShadowMaps
+{
+public:
+	// texture unit of the depth array, above the G-buffer and cluster units
+	static const GLuint SHADOW_UNIT = 7;
+
+	void Create();
+	void Delete();
+
+	// "#define"s for multipleLight.frag or the deferred passes that sample the maps
+	static std::string Defines();
+	// multipleLight.vert with shadowDepth.frag, instanced
+	void SetShader(const Shader& depth);
+	// off, every map is drawn from all its casters every frame
+	void SetCaching(bool caching) { this->caching = caching; }
+
+	// fits the light views to the camera and collects the casters of every layer that is out of date
+	void Prepare(Scene& scene, const glm::mat4& view, const glm::mat4& projection, const LightBlock& block, const LightFeatures& features);
+	// draws the layers Prepare found out of date, leaves a shadow framebuffer bound
+	void Render(GLState& state, Scene& scene);
+	// binds the depth array and sets the light matrices of a program built with Defines
+	void Bind(GLState& state, const Shader& shader) const;
+
+	// of the last Prepare: layer draws (cache and dynamic ones), and instances they draw
+	unsigned int Passes() const { return passes; }
+	size_t Casters() const { return casters; }
+
+private:
+	struct Layer
+	{
+		// light view projection the layer was drawn with
+		glm::mat4 matrix = glm::mat4(1.0f);
+		// world size of a texel, per unit of distance from the light for the spotlight
+		float texelSize = 0.0f;
+		bool valid = false;
+		// scene revisions the cache and the layer were drawn at
+		unsigned int staticRevision = 0, dynamicRevision = 0;
+		size_t dynamicCasters = 0;
+		// work found by Prepare
+		bool drawStatic = false, drawDynamic = false;
+		std::vector<SceneBatch> staticBatches, dynamicBatches;
+	};
+
+	// a cascade's box around the camera, in light space
+	struct Cascade
+	{
+		glm::vec3 center = glm::vec3(0.0f);
+		float halfSize = 0.0f;
+	};
+
+	GLuint depthMaps = 0, staticMaps = 0;
+	GLuint framebuffers[SHADOW_VIEWS] = {}, staticFramebuffers[SHADOW_VIEWS] = {};
+	Layer layers[SHADOW_VIEWS];
+	Cascade cascades[SHADOW_CASCADES];
+	glm::vec3 lightDirection = glm::vec3(0.0f);
+	bool caching = true;
+	unsigned int passes = 0;
+	size_t casters = 0;
+
+	Shader depthShader;
+	Uniform<glm::mat4> depthViewProjection;
+
+	static GLuint CreateArray(bool sampled);
+	// refits the cascades that no longer hold their slice of the view, returns their matrices
+	void FitCascades(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& direction, glm::mat4* matrices, glm::mat4* cullMatrices);
+	static glm::mat4 SpotMatrix(const SpotLight& light, float& texelSize);
+	void PrepareLayer(Scene& scene, Layer& layer, const glm::mat4& matrix, const glm::mat4& cullMatrix);
+	void DrawBatches(Scene& scene, const std::vector<SceneBatch>& batches);
+};
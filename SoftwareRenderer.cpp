@@ -0,0 +1,1011 @@
+#include "SoftwareRenderer.h"
+#include "ClusteredLights.h"
+#include "VertexFormat.h"
+#include <SOIL/SOIL.h>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__AVX2__)
+#define SOFTWARE_AVX2
+#include <immintrin.h>
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SOFTWARE_SSE
+#include <emmintrin.h>
+#endif
+#if defined(SOFTWARE_AVX2) || defined(SOFTWARE_SSE)
+#define SOFTWARE_SIMD
+#endif
+
+// fragments rasterized and lit together: a 4x2 block of pixels, lanes row by row
+#define PACKET_WIDTH 4
+#define PACKET_HEIGHT 2
+#define PACKET_SIZE (PACKET_WIDTH * PACKET_HEIGHT)
+
+static const float laneX[PACKET_SIZE] = { 0, 1, 2, 3, 0, 1, 2, 3 };
+static const float laneY[PACKET_SIZE] = { 0, 0, 0, 0, 1, 1, 1, 1 };
+
+// once the material is sampled; the normal is normalized and viewDir set by the lighting
+struct SoftwareFragment
+{
+	glm::vec3 position, normal, viewDir;
+	glm::vec3 diffuseColor, specularColor;
+	float shininess;
+};
+
+// the three lighting functions of multipleLight.frag line for line, without shadows
+
+static glm::vec3 CalcDirLight(const DirLight& light, const SoftwareFragment& f)
+{
+	glm::vec3 lightDir = glm::normalize(-light.direction);
+	float diff = glm::max(glm::dot(f.normal, lightDir), 0.0f);
+	glm::vec3 reflectDir = glm::reflect(-lightDir, f.normal);
+	float spec = std::pow(glm::max(glm::dot(f.viewDir, reflectDir), 0.0f), f.shininess);
+	glm::vec3 ambient = light.ambient * f.diffuseColor;
+	glm::vec3 diffuse = light.diffuse * diff * f.diffuseColor;
+	glm::vec3 specular = light.specular * spec * f.specularColor;
+	return ambient + diffuse + specular;
+}
+
+static glm::vec3 CalcPointLight(const PointLight& light, const SoftwareFragment& f)
+{
+	glm::vec3 lightDir = glm::normalize(light.position - f.position);
+	float diff = glm::max(glm::dot(f.normal, lightDir), 0.0f);
+	glm::vec3 reflectDir = glm::reflect(-lightDir, f.normal);
+	float spec = std::pow(glm::max(glm::dot(f.viewDir, reflectDir), 0.0f), f.shininess);
+	float distance = glm::length(light.position - f.position);
+	float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+	glm::vec3 ambient = light.ambient * f.diffuseColor;
+	glm::vec3 diffuse = light.diffuse * diff * f.diffuseColor;
+	glm::vec3 specular = light.specular * spec * f.specularColor;
+	return (ambient + diffuse + specular) * attenuation;
+}
+
+static glm::vec3 CalcSpotLight(const SpotLight& light, const SoftwareFragment& f)
+{
+	glm::vec3 lightDir = glm::normalize(light.position - f.position);
+	float theta = glm::dot(lightDir, glm::normalize(-light.direction));
+	if (theta <= light.cutOff) {
+		return light.ambient * f.diffuseColor;
+	}
+	float diff = glm::max(glm::dot(f.normal, lightDir), 0.0f);
+	glm::vec3 reflectDir = glm::reflect(-lightDir, f.normal);
+	float spec = std::pow(glm::max(glm::dot(f.viewDir, reflectDir), 0.0f), f.shininess);
+	float distance = glm::length(light.position - f.position);
+	float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+	float epsilon = light.cutOff - light.outerCutOff;
+	float intensity = glm::clamp((theta - light.outerCutOff) / epsilon, 0.0f, 1.0f);
+	glm::vec3 ambient = light.ambient * f.diffuseColor;
+	glm::vec3 diffuse = light.diffuse * diff * f.diffuseColor;
+	glm::vec3 specular = light.specular * spec * f.specularColor;
+	return (ambient + diffuse + specular) * (attenuation * intensity);
+}
+
+#ifdef SOFTWARE_SIMD
+// eight floats, one per fragment of a packet; comparisons set a lane to all ones or all zeros
+struct Float8
+{
+#ifdef SOFTWARE_AVX2
+	__m256 v;
+#else
+	__m128 lo, hi;
+#endif
+};
+
+#ifdef SOFTWARE_AVX2
+#define FLOAT8_BINARY(name, avx, sse) static inline Float8 name(const Float8& a, const Float8& b) { Float8 r; r.v = avx(a.v, b.v); return r; }
+#define FLOAT8_COMPARE(name, predicate, sse) static inline Float8 name(const Float8& a, const Float8& b) { Float8 r; r.v = _mm256_cmp_ps(a.v, b.v, predicate); return r; }
+#else
+#define FLOAT8_BINARY(name, avx, sse) static inline Float8 name(const Float8& a, const Float8& b) { Float8 r; r.lo = sse(a.lo, b.lo); r.hi = sse(a.hi, b.hi); return r; }
+#define FLOAT8_COMPARE(name, predicate, sse) FLOAT8_BINARY(name, , sse)
+#endif
+
+FLOAT8_BINARY(operator+, _mm256_add_ps, _mm_add_ps)
+FLOAT8_BINARY(operator-, _mm256_sub_ps, _mm_sub_ps)
+FLOAT8_BINARY(operator*, _mm256_mul_ps, _mm_mul_ps)
+FLOAT8_BINARY(operator/, _mm256_div_ps, _mm_div_ps)
+FLOAT8_BINARY(Min, _mm256_min_ps, _mm_min_ps)
+FLOAT8_BINARY(Max, _mm256_max_ps, _mm_max_ps)
+FLOAT8_BINARY(And, _mm256_and_ps, _mm_and_ps)
+FLOAT8_BINARY(Or, _mm256_or_ps, _mm_or_ps)
+// b where mask is not set
+FLOAT8_BINARY(AndNot, _mm256_andnot_ps, _mm_andnot_ps)
+FLOAT8_COMPARE(Less, _CMP_LT_OQ, _mm_cmplt_ps)
+FLOAT8_COMPARE(LessEqual, _CMP_LE_OQ, _mm_cmple_ps)
+FLOAT8_COMPARE(Greater, _CMP_GT_OQ, _mm_cmpgt_ps)
+FLOAT8_COMPARE(GreaterEqual, _CMP_GE_OQ, _mm_cmpge_ps)
+
+static inline Float8 Splat(float x)
+{
+	Float8 r;
+#ifdef SOFTWARE_AVX2
+	r.v = _mm256_set1_ps(x);
+#else
+	r.lo = r.hi = _mm_set1_ps(x);
+#endif
+	return r;
+}
+
+static inline Float8 Load(const float* p)
+{
+	Float8 r;
+#ifdef SOFTWARE_AVX2
+	r.v = _mm256_loadu_ps(p);
+#else
+	r.lo = _mm_loadu_ps(p);
+	r.hi = _mm_loadu_ps(p + 4);
+#endif
+	return r;
+}
+
+static inline void Store(float* p, const Float8& a)
+{
+#ifdef SOFTWARE_AVX2
+	_mm256_storeu_ps(p, a.v);
+#else
+	_mm_storeu_ps(p, a.lo);
+	_mm_storeu_ps(p + 4, a.hi);
+#endif
+}
+
+static inline Float8 Sqrt(const Float8& a)
+{
+	Float8 r;
+#ifdef SOFTWARE_AVX2
+	r.v = _mm256_sqrt_ps(a.v);
+#else
+	r.lo = _mm_sqrt_ps(a.lo);
+	r.hi = _mm_sqrt_ps(a.hi);
+#endif
+	return r;
+}
+
+// one bit per lane of a mask, lane 0 in bit 0
+static inline int Bits(const Float8& mask)
+{
+#ifdef SOFTWARE_AVX2
+	return _mm256_movemask_ps(mask.v);
+#else
+	return _mm_movemask_ps(mask.lo) | (_mm_movemask_ps(mask.hi) << 4);
+#endif
+}
+
+static inline Float8 Select(const Float8& mask, const Float8& a, const Float8& b)
+{
+	return Or(And(mask, a), AndNot(mask, b));
+}
+
+// nearest whole number, ties to even
+static inline Float8 Round(const Float8& a)
+{
+	Float8 r;
+#ifdef SOFTWARE_AVX2
+	r.v = _mm256_cvtepi32_ps(_mm256_cvtps_epi32(a.v));
+#else
+	r.lo = _mm_cvtepi32_ps(_mm_cvtps_epi32(a.lo));
+	r.hi = _mm_cvtepi32_ps(_mm_cvtps_epi32(a.hi));
+#endif
+	return r;
+}
+
+// x = mantissa * 2^exponent with the mantissa in [1, 2), for positive normal x
+static inline void Split(const Float8& x, Float8& mantissa, Float8& exponent)
+{
+#ifdef SOFTWARE_AVX2
+	__m256i bits = _mm256_castps_si256(x.v);
+	exponent.v = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+	mantissa.v = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000)));
+#else
+	__m128i lo = _mm_castps_si128(x.lo), hi = _mm_castps_si128(x.hi);
+	__m128i bias = _mm_set1_epi32(127), fraction = _mm_set1_epi32(0x007FFFFF), one = _mm_set1_epi32(0x3F800000);
+	exponent.lo = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(lo, 23), bias));
+	exponent.hi = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(hi, 23), bias));
+	mantissa.lo = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(lo, fraction), one));
+	mantissa.hi = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(hi, fraction), one));
+#endif
+}
+
+// 2^n for whole n in [-126, 127]
+static inline Float8 PowerOfTwo(const Float8& n)
+{
+	Float8 r;
+#ifdef SOFTWARE_AVX2
+	r.v = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127)), 23));
+#else
+	__m128i bias = _mm_set1_epi32(127);
+	r.lo = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.lo), bias), 23));
+	r.hi = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.hi), bias), 23));
+#endif
+	return r;
+}
+
+// log2 of positive x, to about 1e-7
+static inline Float8 Log2(const Float8& x)
+{
+	Float8 mantissa, exponent;
+	Split(x, mantissa, exponent);
+	// from [1, 2) to [sqrt(1/2), sqrt(2)), where the series below converges fastest
+	Float8 high = Greater(mantissa, Splat(1.41421356f));
+	mantissa = Select(high, mantissa * Splat(0.5f), mantissa);
+	exponent = exponent + And(high, Splat(1.0f));
+	// log2(m) = 2 / ln(2) * atanh(t) with t = (m - 1) / (m + 1)
+	Float8 one = Splat(1.0f);
+	Float8 t = (mantissa - one) / (mantissa + one);
+	Float8 t2 = t * t;
+	Float8 series = t * (one + t2 * (Splat(1.0f / 3.0f) + t2 * (Splat(1.0f / 5.0f) + t2 * Splat(1.0f / 7.0f))));
+	return exponent + series * Splat(2.88539008f);
+}
+
+// 2^x, to about 2e-7 relative
+static inline Float8 Exp2(const Float8& x)
+{
+	Float8 clamped = Min(Max(x, Splat(-126.0f)), Splat(126.0f));
+	Float8 whole = Round(clamped);
+	Float8 f = clamped - whole;
+	// 2^f for f in [-1/2, 1/2], Taylor series of e^(f ln 2)
+	Float8 p = Splat(1.5403530e-4f);
+	p = p * f + Splat(1.3333558e-3f);
+	p = p * f + Splat(9.6181291e-3f);
+	p = p * f + Splat(5.5504109e-2f);
+	p = p * f + Splat(2.4022651e-1f);
+	p = p * f + Splat(6.9314718e-1f);
+	p = p * f + Splat(1.0f);
+	return p * PowerOfTwo(whole);
+}
+
+// pow(x, y) as GLSL has it for x >= 0: 0 at x = 0
+static inline Float8 Pow(const Float8& x, const Float8& y)
+{
+	Float8 positive = Greater(x, Splat(0.0f));
+	return And(positive, Exp2(y * Log2(Max(x, Splat(FLT_MIN)))));
+}
+
+struct Vec8
+{
+	Float8 x, y, z;
+};
+
+static inline Vec8 Splat(const glm::vec3& v)
+{
+	Vec8 r = { Splat(v.x), Splat(v.y), Splat(v.z) };
+	return r;
+}
+
+static inline Vec8 operator+(const Vec8& a, const Vec8& b) { Vec8 r = { a.x + b.x, a.y + b.y, a.z + b.z }; return r; }
+static inline Vec8 operator-(const Vec8& a, const Vec8& b) { Vec8 r = { a.x - b.x, a.y - b.y, a.z - b.z }; return r; }
+static inline Vec8 operator*(const Vec8& a, const Vec8& b) { Vec8 r = { a.x * b.x, a.y * b.y, a.z * b.z }; return r; }
+static inline Vec8 operator*(const Vec8& a, const Float8& s) { Vec8 r = { a.x * s, a.y * s, a.z * s }; return r; }
+static inline Float8 Dot(const Vec8& a, const Vec8& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline Vec8 Normalize(const Vec8& a) { return a * (Splat(1.0f) / Sqrt(Dot(a, a))); }
+static inline Vec8 Select(const Float8& mask, const Vec8& a, const Vec8& b)
+{
+	Vec8 r = { Select(mask, a.x, b.x), Select(mask, a.y, b.y), Select(mask, a.z, b.z) };
+	return r;
+}
+
+// eight fragments, each member a lane per fragment
+struct Fragment8
+{
+	Vec8 position, normal, viewDir;
+	Vec8 diffuseColor, specularColor;
+	Float8 shininess;
+};
+
+// the lighting functions again, on eight fragments at a time
+
+static Vec8 CalcDirLight(const DirLight& light, const Fragment8& f)
+{
+	Vec8 lightDir = Splat(glm::normalize(-light.direction));
+	Float8 nDotL = Dot(f.normal, lightDir);
+	Float8 diff = Max(nDotL, Splat(0.0f));
+	// reflect(-lightDir, normal)
+	Vec8 reflectDir = f.normal * (nDotL + nDotL) - lightDir;
+	Float8 spec = Pow(Max(Dot(f.viewDir, reflectDir), Splat(0.0f)), f.shininess);
+	return Splat(light.ambient) * f.diffuseColor + Splat(light.diffuse) * f.diffuseColor * diff + Splat(light.specular) * f.specularColor * spec;
+}
+
+static Vec8 CalcPointLight(const PointLight& light, const Fragment8& f)
+{
+	Vec8 toLight = Splat(light.position) - f.position;
+	Float8 distance = Sqrt(Dot(toLight, toLight));
+	Vec8 lightDir = toLight * (Splat(1.0f) / distance);
+	Float8 nDotL = Dot(f.normal, lightDir);
+	Float8 diff = Max(nDotL, Splat(0.0f));
+	Vec8 reflectDir = f.normal * (nDotL + nDotL) - lightDir;
+	Float8 spec = Pow(Max(Dot(f.viewDir, reflectDir), Splat(0.0f)), f.shininess);
+	Float8 attenuation = Splat(1.0f) / (Splat(light.constant) + Splat(light.linear) * distance + Splat(light.quadratic) * (distance * distance));
+	return (Splat(light.ambient) * f.diffuseColor + Splat(light.diffuse) * f.diffuseColor * diff + Splat(light.specular) * f.specularColor * spec) * attenuation;
+}
+
+static Vec8 CalcSpotLight(const SpotLight& light, const Fragment8& f)
+{
+	Vec8 toLight = Splat(light.position) - f.position;
+	Float8 distance = Sqrt(Dot(toLight, toLight));
+	Vec8 lightDir = toLight * (Splat(1.0f) / distance);
+	Float8 theta = Dot(lightDir, Splat(glm::normalize(-light.direction)));
+	Float8 nDotL = Dot(f.normal, lightDir);
+	Float8 diff = Max(nDotL, Splat(0.0f));
+	Vec8 reflectDir = f.normal * (nDotL + nDotL) - lightDir;
+	Float8 spec = Pow(Max(Dot(f.viewDir, reflectDir), Splat(0.0f)), f.shininess);
+	Float8 attenuation = Splat(1.0f) / (Splat(light.constant) + Splat(light.linear) * distance + Splat(light.quadratic) * (distance * distance));
+	Float8 intensity = Min(Max((theta - Splat(light.outerCutOff)) / Splat(light.cutOff - light.outerCutOff), Splat(0.0f)), Splat(1.0f));
+	Vec8 ambient = Splat(light.ambient) * f.diffuseColor;
+	Vec8 lit = (ambient + Splat(light.diffuse) * f.diffuseColor * diff + Splat(light.specular) * f.specularColor * spec) * (attenuation * intensity);
+	// outside the cone only the ambient term is left
+	return Select(Greater(theta, Splat(light.cutOff)), lit, ambient);
+}
+#endif
+
+bool SoftwareRenderer::SimdSupported()
+{
+#ifdef SOFTWARE_SIMD
+	return true;
+#else
+	return false;
+#endif
+}
+
+void SoftwareRenderer::Create(unsigned int width, unsigned int height)
+{
+	this->width = width;
+	this->height = height;
+	tilesX = (width + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+	tilesY = (height + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+	pixels.assign((size_t)width * height * 4, 0);
+	bins.resize(tilesX * tilesY);
+}
+
+void SoftwareRenderer::Delete()
+{
+	textures.clear();
+	// without a Present there may not even be a context
+	if (presentTexture != 0) {
+		glDeleteTextures(1, &presentTexture);
+		glDeleteFramebuffers(1, &presentFramebuffer);
+		presentTexture = presentFramebuffer = 0;
+	}
+}
+
+void SoftwareRenderer::SetTexture(GLuint name, unsigned int width, unsigned int height, const unsigned char* pixels, bool mipmaps)
+{
+	Texture& texture = textures[name];
+	texture.levels.assign(1, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * 4));
+	texture.sizes.assign(1, glm::uvec2(width, height));
+	texture.mipmaps = mipmaps;
+	if (mipmaps) {
+		BuildMips(texture);
+	}
+}
+
+GLuint SoftwareRenderer::LoadTexture(const std::string& path, bool mipmaps)
+{
+	int width, height;
+	unsigned char* image = SOIL_load_image(path.c_str(), &width, &height, 0, SOIL_LOAD_RGBA);
+	if (image == NULL) {
+		std::cout << "ERROR::SOFTWARE_RENDERER::TEXTURE_NOT_LOADED " << path << std::endl;
+		return 0;
+	}
+	// SOIL's first row is the one GL takes for t = 0, so the rows go in as they are
+	GLuint name = textures.empty() ? 1 : textures.rbegin()->first + 1;
+	SetTexture(name, width, height, image, mipmaps);
+	SOIL_free_image_data(image);
+	return name;
+}
+
+void SoftwareRenderer::SetLights(const LightBlock& block, const LightFeatures& features)
+{
+	this->block = block;
+	this->features = features;
+}
+
+void SoftwareRenderer::SetPointLights(const std::vector<PointLight>& pointLights)
+{
+	this->pointLights = pointLights;
+	pointLightRadii.resize(pointLights.size());
+	for (size_t i = 0; i < pointLights.size(); i++) {
+		pointLightRadii[i] = ClusteredLights::LightRadius(pointLights[i]);
+	}
+}
+
+// a box filter over 2x2 texels per level, like glGenerateMipmap
+void SoftwareRenderer::BuildMips(Texture& texture)
+{
+	while (texture.sizes.back().x > 1 || texture.sizes.back().y > 1) {
+		glm::uvec2 size = texture.sizes.back();
+		glm::uvec2 next(std::max(size.x / 2, 1u), std::max(size.y / 2, 1u));
+		const std::vector<unsigned char>& source = texture.levels.back();
+		std::vector<unsigned char> level((size_t)next.x * next.y * 4);
+		for (unsigned int y = 0; y < next.y; y++) {
+			unsigned int y0 = std::min(y * 2, size.y - 1), y1 = std::min(y * 2 + 1, size.y - 1);
+			for (unsigned int x = 0; x < next.x; x++) {
+				unsigned int x0 = std::min(x * 2, size.x - 1), x1 = std::min(x * 2 + 1, size.x - 1);
+				for (int c = 0; c < 4; c++) {
+					unsigned int sum = source[((size_t)y0 * size.x + x0) * 4 + c] + source[((size_t)y0 * size.x + x1) * 4 + c]
+						+ source[((size_t)y1 * size.x + x0) * 4 + c] + source[((size_t)y1 * size.x + x1) * 4 + c];
+					level[((size_t)y * next.x + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		texture.levels.push_back(level);
+		texture.sizes.push_back(next);
+	}
+}
+
+// GL_LINEAR with GL_REPEAT on one level
+static glm::vec3 Bilinear(const std::vector<unsigned char>& level, const glm::uvec2& size, const glm::vec2& texCoords)
+{
+	float x = texCoords.x * size.x - 0.5f, y = texCoords.y * size.y - 0.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	float tx = x - fx, ty = y - fy;
+	int w = (int)size.x, h = (int)size.y;
+	int x0 = ((int)std::fmod(fx, (float)w) + w) % w, y0 = ((int)std::fmod(fy, (float)h) + h) % h;
+	int x1 = (x0 + 1) % w, y1 = (y0 + 1) % h;
+	const unsigned char* a = &level[((size_t)y0 * w + x0) * 4];
+	const unsigned char* b = &level[((size_t)y0 * w + x1) * 4];
+	const unsigned char* c = &level[((size_t)y1 * w + x0) * 4];
+	const unsigned char* d = &level[((size_t)y1 * w + x1) * 4];
+	glm::vec3 result;
+	for (int i = 0; i < 3; i++) {
+		float top = a[i] + (b[i] - a[i]) * tx;
+		float bottom = c[i] + (d[i] - c[i]) * tx;
+		result[i] = (top + (bottom - top) * ty) * (1.0f / 255.0f);
+	}
+	return result;
+}
+
+glm::vec3 SoftwareRenderer::Sample(const Texture* texture, const glm::vec2& texCoords, float lod)
+{
+	if (texture == NULL) {
+		return glm::vec3(0.0f);
+	}
+	// magnified, or without mipmaps: the top level only
+	if (!texture->mipmaps || lod <= 0.0f) {
+		return Bilinear(texture->levels[0], texture->sizes[0], texCoords);
+	}
+	size_t last = texture->levels.size() - 1;
+	lod = std::min(lod, (float)last);
+	size_t level = (size_t)lod;
+	glm::vec3 sample = Bilinear(texture->levels[level], texture->sizes[level], texCoords);
+	if (level == last) {
+		return sample;
+	}
+	return glm::mix(sample, Bilinear(texture->levels[level + 1], texture->sizes[level + 1], texCoords), lod - level);
+}
+
+float SoftwareRenderer::Lod(const Texture* texture, const glm::vec2& ddx, const glm::vec2& ddy)
+{
+	if (texture == NULL || !texture->mipmaps) {
+		return 0.0f;
+	}
+	glm::vec2 size(texture->sizes[0]);
+	float rho = std::max(glm::length(ddx * size), glm::length(ddy * size));
+	return rho > 0.0f ? std::log2(rho) : 0.0f;
+}
+
+void SoftwareRenderer::Render(const std::vector<SoftwareDraw>& draws, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, ThreadPool* pool)
+{
+	glm::mat4 viewProjection = projection * view;
+
+	// a job per run of instances of a draw
+	std::vector<glm::uvec2> jobs;
+	materials.resize(draws.size());
+	for (size_t i = 0; i < draws.size(); i++) {
+		std::map<GLuint, Texture>::const_iterator diffuse = textures.find(draws[i].material.diffuse);
+		std::map<GLuint, Texture>::const_iterator specular = textures.find(draws[i].material.specular);
+		materials[i].diffuse = diffuse == textures.end() ? NULL : &diffuse->second;
+		materials[i].specular = specular == textures.end() ? NULL : &specular->second;
+		materials[i].shininess = draws[i].material.shininess;
+		for (size_t first = 0; first < draws[i].instanceCount; first += SOFTWARE_INSTANCES_PER_JOB) {
+			jobs.push_back(glm::uvec2((unsigned int)i, (unsigned int)first));
+		}
+	}
+	if (jobTriangles.size() < jobs.size()) {
+		jobTriangles.resize(jobs.size());
+	}
+	auto transform = [&](size_t begin, size_t end) {
+		for (size_t job = begin; job < end; job++) {
+			const SoftwareDraw& draw = draws[jobs[job].x];
+			size_t count = std::min<size_t>(SOFTWARE_INSTANCES_PER_JOB, draw.instanceCount - jobs[job].y);
+			jobTriangles[job].clear();
+			TransformInstances(draw, jobs[job].x, jobs[job].y, count, viewProjection, jobTriangles[job]);
+		}
+	};
+	if (pool != NULL) {
+		pool->ParallelFor(jobs.size(), 1, transform);
+	}
+	else {
+		transform(0, jobs.size());
+	}
+
+	// binned in job order, so every tile sees its triangles in draw order whichever thread set them up
+	for (std::vector<const Triangle*>& bin : bins) {
+		bin.clear();
+	}
+	triangleCount = 0;
+	for (size_t job = 0; job < jobs.size(); job++) {
+		for (const Triangle& triangle : jobTriangles[job]) {
+			for (int y = triangle.minY / SOFTWARE_TILE_SIZE; y <= triangle.maxY / SOFTWARE_TILE_SIZE; y++) {
+				for (int x = triangle.minX / SOFTWARE_TILE_SIZE; x <= triangle.maxX / SOFTWARE_TILE_SIZE; x++) {
+					bins[y * tilesX + x].push_back(&triangle);
+				}
+			}
+		}
+		triangleCount += jobTriangles[job].size();
+	}
+
+	if (!pointLights.empty()) {
+		FindLightRects(view, projection);
+	}
+
+	std::atomic<size_t> fragments(0);
+	auto shade = [&](size_t begin, size_t end) {
+		size_t shaded = 0;
+		for (size_t tile = begin; tile < end; tile++) {
+			shaded += RenderTile((unsigned int)tile, viewPos);
+		}
+		fragments += shaded;
+	};
+	if (pool != NULL) {
+		pool->ParallelFor(tilesX * tilesY, 1, shade);
+	}
+	else {
+		shade(0, tilesX * tilesY);
+	}
+	fragmentCount = fragments;
+}
+
+// multipleLight.vert, then primitive assembly
+void SoftwareRenderer::TransformInstances(const SoftwareDraw& draw, unsigned int material, size_t first, size_t count, const glm::mat4& viewProjection, std::vector<Triangle>& out) const
+{
+	std::vector<ClipVertex> transformed(draw.vertexCount);
+	for (size_t i = first; i < first + count; i++) {
+		const InstanceTransform& instance = draw.instances[i];
+		glm::mat3 normalMatrix(glm::vec3(instance.normal[0]), glm::vec3(instance.normal[1]), glm::vec3(instance.normal[2]));
+		for (size_t v = 0; v < draw.vertexCount; v++) {
+			const GLfloat* source = draw.vertices + v * GEOMETRY_VERTEX_FLOATS;
+			glm::vec4 worldPos = instance.model * glm::vec4(source[0], source[1], source[2], 1.0f);
+			ClipVertex& vertex = transformed[v];
+			vertex.position = glm::vec3(worldPos);
+			vertex.normal = normalMatrix * glm::vec3(source[5], source[6], source[7]);
+			vertex.clip = viewProjection * worldPos;
+			// flipped like the shader does, for images stored top row first
+			vertex.texCoords = glm::vec2(source[3], 1.0f - source[4]);
+		}
+		for (size_t t = 0; t + 2 < draw.indexCount; t += 3) {
+			const ClipVertex triangle[3] = { transformed[draw.indices[t]], transformed[draw.indices[t + 1]], transformed[draw.indices[t + 2]] };
+			ClipAndSetup(triangle, material, out);
+		}
+	}
+}
+
+// clips against the near plane and the guard band where needed, then sets up the pieces
+void SoftwareRenderer::ClipAndSetup(const ClipVertex* vertices, unsigned int material, std::vector<Triangle>& out) const
+{
+	// outside one plane of the view volume with every vertex: nothing to draw
+	for (int axis = 0; axis < 3; axis++) {
+		if ((vertices[0].clip[axis] < -vertices[0].clip.w && vertices[1].clip[axis] < -vertices[1].clip.w && vertices[2].clip[axis] < -vertices[2].clip.w)
+			|| (vertices[0].clip[axis] > vertices[0].clip.w && vertices[1].clip[axis] > vertices[1].clip.w && vertices[2].clip[axis] > vertices[2].clip.w)) {
+			return;
+		}
+	}
+
+	// distance of a vertex inside the near plane, then inside each side of the guard band
+	const float guardX = 1.0f + 2.0f * SOFTWARE_GUARD_BAND / width, guardY = 1.0f + 2.0f * SOFTWARE_GUARD_BAND / height;
+	auto distance = [guardX, guardY](const ClipVertex& vertex, int plane) {
+		const glm::vec4& c = vertex.clip;
+		switch (plane) {
+		case 0: return c.z + c.w;
+		case 1: return guardX * c.w - c.x;
+		case 2: return guardX * c.w + c.x;
+		case 3: return guardY * c.w - c.y;
+		default: return guardY * c.w + c.y;
+		}
+	};
+	const int planes = 5;
+	bool inside = true;
+	for (int plane = 0; plane < planes && inside; plane++) {
+		for (int i = 0; i < 3; i++) {
+			inside = inside && distance(vertices[i], plane) >= 0.0f;
+		}
+	}
+	if (inside) {
+		Triangle triangle;
+		if (Setup(vertices[0], vertices[1], vertices[2], material, triangle)) {
+			out.push_back(triangle);
+		}
+		return;
+	}
+
+	// Sutherland-Hodgman, every plane adds at most one vertex
+	ClipVertex polygons[2][3 + planes];
+	int count = 3;
+	std::copy(vertices, vertices + 3, polygons[0]);
+	for (int plane = 0; plane < planes; plane++) {
+		const ClipVertex* in = polygons[plane % 2];
+		ClipVertex* clipped = polygons[(plane + 1) % 2];
+		int clippedCount = 0;
+		for (int i = 0; i < count; i++) {
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			float da = distance(a, plane), db = distance(b, plane);
+			if (da >= 0.0f) {
+				clipped[clippedCount++] = a;
+			}
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				float t = da / (da - db);
+				ClipVertex& vertex = clipped[clippedCount++];
+				vertex.clip = a.clip + (b.clip - a.clip) * t;
+				vertex.position = a.position + (b.position - a.position) * t;
+				vertex.normal = a.normal + (b.normal - a.normal) * t;
+				vertex.texCoords = a.texCoords + (b.texCoords - a.texCoords) * t;
+			}
+		}
+		count = clippedCount;
+		if (count < 3) {
+			return;
+		}
+	}
+	const ClipVertex* polygon = polygons[planes % 2];
+	for (int i = 1; i + 1 < count; i++) {
+		Triangle triangle;
+		if (Setup(polygon[0], polygon[i], polygon[i + 1], material, triangle)) {
+			out.push_back(triangle);
+		}
+	}
+}
+
+// viewport transform, edge functions and attribute planes; false if no pixel centre can be covered
+bool SoftwareRenderer::Setup(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, unsigned int material, Triangle& triangle) const
+{
+	const ClipVertex* vertices[3] = { &a, &b, &c };
+	float x[3], y[3], values[3][PLANE_COUNT];
+	for (int i = 0; i < 3; i++) {
+		const ClipVertex& vertex = *vertices[i];
+		float inverseW = 1.0f / vertex.clip.w;
+		x[i] = (vertex.clip.x * inverseW * 0.5f + 0.5f) * width;
+		y[i] = (vertex.clip.y * inverseW * 0.5f + 0.5f) * height;
+		float* v = values[i];
+		v[PLANE_DEPTH] = vertex.clip.z * inverseW * 0.5f + 0.5f;
+		v[PLANE_INVERSE_W] = inverseW;
+		for (int k = 0; k < 3; k++) {
+			v[PLANE_POSITION + k] = vertex.position[k] * inverseW;
+			v[PLANE_NORMAL + k] = vertex.normal[k] * inverseW;
+		}
+		v[PLANE_TEX_COORDS] = vertex.texCoords.x * inverseW;
+		v[PLANE_TEX_COORDS + 1] = vertex.texCoords.y * inverseW;
+	}
+
+	float e1x = x[1] - x[0], e1y = y[1] - y[0], e2x = x[2] - x[0], e2y = y[2] - y[0];
+	float area = e1x * e2y - e2x * e1y;
+	if (!(area != 0.0f) || !std::isfinite(area)) {
+		return false;
+	}
+
+	// pixel centres at + 0.5 inside the bounds
+	triangle.minX = std::max((int)std::ceil(std::min(x[0], std::min(x[1], x[2])) - 0.5f), 0);
+	triangle.minY = std::max((int)std::ceil(std::min(y[0], std::min(y[1], y[2])) - 0.5f), 0);
+	triangle.maxX = std::min((int)std::floor(std::max(x[0], std::max(x[1], x[2])) - 0.5f), (int)width - 1);
+	triangle.maxY = std::min((int)std::floor(std::max(y[0], std::max(y[1], y[2])) - 0.5f), (int)height - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+		return false;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		int p = i, q = (i + 1) % 3;
+		// the edge from the vertex further left, or lower, whichever triangle it belongs to
+		bool swapped = x[q] < x[p] || (x[q] == x[p] && y[q] < y[p]);
+		if (swapped) {
+			std::swap(p, q);
+		}
+		triangle.px[i] = x[p];
+		triangle.py[i] = y[p];
+		triangle.dx[i] = x[q] - x[p];
+		triangle.dy[i] = y[q] - y[p];
+		// e of the edge in triangle order is positive inside a counter clockwise triangle
+		triangle.sign[i] = (area > 0.0f) != swapped ? 1.0f : -1.0f;
+	}
+
+	triangle.x0 = x[0];
+	triangle.y0 = y[0];
+	float inverseArea = 1.0f / area;
+	for (int plane = 0; plane < PLANE_COUNT; plane++) {
+		float d1 = values[1][plane] - values[0][plane], d2 = values[2][plane] - values[0][plane];
+		triangle.planes[plane][0] = values[0][plane];
+		triangle.planes[plane][1] = (d1 * e2y - d2 * e1y) * inverseArea;
+		triangle.planes[plane][2] = (d2 * e1x - d1 * e2x) * inverseArea;
+	}
+	triangle.material = material;
+	return true;
+}
+
+// screen rectangle of every point light's sphere of influence
+void SoftwareRenderer::FindLightRects(const glm::mat4& view, const glm::mat4& projection)
+{
+	const glm::ivec4 none(1, 1, 0, 0);
+	const glm::ivec4 screen(0, 0, (int)width - 1, (int)height - 1);
+	lightRects.resize(pointLights.size());
+	for (size_t i = 0; i < pointLights.size(); i++) {
+		float radius = pointLightRadii[i];
+		glm::vec3 center = glm::vec3(view * glm::vec4(pointLights[i].position, 1.0f));
+		// entirely behind the camera
+		if (center.z - radius > 0.0f) {
+			lightRects[i] = none;
+			continue;
+		}
+		// the rectangle around the projected corners of the sphere's box, unless a corner is
+		// behind the eye, where the projection wraps around
+		glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+		bool behind = false;
+		for (int corner = 0; corner < 8 && !behind; corner++) {
+			glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+			glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+			if (clip.w <= 0.0f) {
+				behind = true;
+				break;
+			}
+			glm::vec2 pixel((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height);
+			low = glm::min(low, pixel);
+			high = glm::max(high, pixel);
+		}
+		if (behind) {
+			lightRects[i] = screen;
+			continue;
+		}
+		glm::ivec4 rect((int)std::max(std::floor(low.x), -1.0f), (int)std::max(std::floor(low.y), -1.0f),
+			(int)std::min(std::ceil(high.x), (float)width), (int)std::min(std::ceil(high.y), (float)height));
+		lightRects[i] = rect.x > rect.z || rect.y > rect.w ? none : rect;
+	}
+}
+
+size_t SoftwareRenderer::RenderTile(unsigned int tile, const glm::vec3& viewPos)
+{
+	const int tileX = (int)(tile % tilesX) * SOFTWARE_TILE_SIZE, tileY = (int)(tile / tilesX) * SOFTWARE_TILE_SIZE;
+	const int packetsX = SOFTWARE_TILE_SIZE / PACKET_WIDTH, packetsY = SOFTWARE_TILE_SIZE / PACKET_HEIGHT;
+	// packet after packet, each one PACKET_SIZE lanes
+	float depth[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+	const Triangle* shown[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+	std::fill(depth, depth + SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE, 1.0f);
+	std::fill(shown, shown + SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE, (const Triangle*)NULL);
+
+	// visibility: the closest triangle at every pixel
+	for (const Triangle* triangle : bins[tile]) {
+		const Triangle& t = *triangle;
+		int firstX = (std::max(t.minX, tileX) - tileX) / PACKET_WIDTH, lastX = (std::min(t.maxX, tileX + SOFTWARE_TILE_SIZE - 1) - tileX) / PACKET_WIDTH;
+		int firstY = (std::max(t.minY, tileY) - tileY) / PACKET_HEIGHT, lastY = (std::min(t.maxY, tileY + SOFTWARE_TILE_SIZE - 1) - tileY) / PACKET_HEIGHT;
+		for (int packetY = firstY; packetY <= lastY; packetY++) {
+			for (int packetX = firstX; packetX <= lastX; packetX++) {
+				int packet = (packetY * packetsX + packetX) * PACKET_SIZE;
+				float x = tileX + packetX * PACKET_WIDTH + 0.5f, y = tileY + packetY * PACKET_HEIGHT + 0.5f;
+#ifdef SOFTWARE_SIMD
+				Float8 px = Splat(x) + Load(laneX), py = Splat(y) + Load(laneY);
+				auto inside = [&t, &px, &py](int e) {
+					Float8 value = (Splat(t.dx[e]) * (py - Splat(t.py[e])) - Splat(t.dy[e]) * (px - Splat(t.px[e]))) * Splat(t.sign[e]);
+					return t.sign[e] > 0.0f ? GreaterEqual(value, Splat(0.0f)) : Greater(value, Splat(0.0f));
+				};
+				Float8 covered = And(inside(0), And(inside(1), inside(2)));
+				if (Bits(covered) == 0) {
+					continue;
+				}
+				Float8 z = Splat(t.planes[PLANE_DEPTH][0]) + Splat(t.planes[PLANE_DEPTH][1]) * (px - Splat(t.x0)) + Splat(t.planes[PLANE_DEPTH][2]) * (py - Splat(t.y0));
+				Float8 stored = Load(depth + packet);
+				Float8 closer = And(covered, Less(z, stored));
+				int bits = Bits(closer);
+				if (bits == 0) {
+					continue;
+				}
+				Store(depth + packet, Select(closer, z, stored));
+				for (int lane = 0; lane < PACKET_SIZE; lane++) {
+					if (bits & (1 << lane)) {
+						shown[packet + lane] = triangle;
+					}
+				}
+#else
+				for (int lane = 0; lane < PACKET_SIZE; lane++) {
+					float px = x + laneX[lane], py = y + laneY[lane];
+					bool covered = true;
+					for (int e = 0; e < 3; e++) {
+						float value = (t.dx[e] * (py - t.py[e]) - t.dy[e] * (px - t.px[e])) * t.sign[e];
+						covered = covered && (t.sign[e] > 0.0f ? value >= 0.0f : value > 0.0f);
+					}
+					float z = t.planes[PLANE_DEPTH][0] + t.planes[PLANE_DEPTH][1] * (px - t.x0) + t.planes[PLANE_DEPTH][2] * (py - t.y0);
+					if (covered && z < depth[packet + lane]) {
+						depth[packet + lane] = z;
+						shown[packet + lane] = triangle;
+					}
+				}
+#endif
+			}
+		}
+	}
+
+	// the point lights that may reach this tile
+	std::vector<unsigned int> tileLights;
+	for (size_t i = 0; i < lightRects.size() && !pointLights.empty(); i++) {
+		const glm::ivec4& rect = lightRects[i];
+		if (rect.x < tileX + SOFTWARE_TILE_SIZE && rect.z >= tileX && rect.y < tileY + SOFTWARE_TILE_SIZE && rect.w >= tileY) {
+			tileLights.push_back((unsigned int)i);
+		}
+	}
+
+	// shading: every visible pixel once
+	size_t shaded = 0;
+	for (int packetY = 0; packetY < packetsY; packetY++) {
+		for (int packetX = 0; packetX < packetsX; packetX++) {
+			int packet = (packetY * packetsX + packetX) * PACKET_SIZE;
+			int originX = tileX + packetX * PACKET_WIDTH, originY = tileY + packetY * PACKET_HEIGHT;
+			if (originX >= (int)width || originY >= (int)height) {
+				continue;
+			}
+			SoftwareFragment fragments[PACKET_SIZE];
+			int mask = 0;
+			for (int lane = 0; lane < PACKET_SIZE; lane++) {
+				SoftwareFragment& f = fragments[lane];
+				const Triangle* triangle = shown[packet + lane];
+				if (triangle == NULL) {
+					// something harmless for the lanes that are not drawn
+					f.position = viewPos - glm::vec3(0.0f, 0.0f, 1.0f);
+					f.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+					f.diffuseColor = f.specularColor = glm::vec3(0.0f);
+					f.shininess = 1.0f;
+					continue;
+				}
+				mask |= 1 << lane;
+				const Triangle& t = *triangle;
+				float dx = originX + laneX[lane] + 0.5f - t.x0, dy = originY + laneY[lane] + 0.5f - t.y0;
+				auto plane = [&t, dx, dy](int index) { return t.planes[index][0] + t.planes[index][1] * dx + t.planes[index][2] * dy; };
+				// perspective correct: every attribute over w, divided by 1 / w
+				float inverseW = plane(PLANE_INVERSE_W), w = 1.0f / inverseW;
+				for (int k = 0; k < 3; k++) {
+					f.position[k] = plane(PLANE_POSITION + k) * w;
+					f.normal[k] = plane(PLANE_NORMAL + k) * w;
+				}
+				glm::vec2 texCoords(plane(PLANE_TEX_COORDS) * w, plane(PLANE_TEX_COORDS + 1) * w);
+				// d(a / b) = (da - a / b * db) / b, for the screen space derivatives of the tex coords
+				glm::vec2 ddx((t.planes[PLANE_TEX_COORDS][1] - texCoords.x * t.planes[PLANE_INVERSE_W][1]) * w,
+					(t.planes[PLANE_TEX_COORDS + 1][1] - texCoords.y * t.planes[PLANE_INVERSE_W][1]) * w);
+				glm::vec2 ddy((t.planes[PLANE_TEX_COORDS][2] - texCoords.x * t.planes[PLANE_INVERSE_W][2]) * w,
+					(t.planes[PLANE_TEX_COORDS + 1][2] - texCoords.y * t.planes[PLANE_INVERSE_W][2]) * w);
+				const Material& material = materials[t.material];
+				f.diffuseColor = Sample(material.diffuse, texCoords, Lod(material.diffuse, ddx, ddy));
+				f.specularColor = Sample(material.specular, texCoords, Lod(material.specular, ddx, ddy));
+				f.shininess = material.shininess;
+			}
+
+			glm::vec3 colors[PACKET_SIZE];
+			if (mask != 0) {
+				ShadePacket(fragments, mask, viewPos, tileLights, colors);
+			}
+			for (int lane = 0; lane < PACKET_SIZE; lane++) {
+				int x = originX + (int)laneX[lane], y = originY + (int)laneY[lane];
+				if (x >= (int)width || y >= (int)height) {
+					continue;
+				}
+				unsigned char* pixel = &pixels[((size_t)y * width + x) * 4];
+				if ((mask & (1 << lane)) == 0) {
+					pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+					continue;
+				}
+				shaded++;
+				for (int k = 0; k < 3; k++) {
+					pixel[k] = (unsigned char)(glm::clamp(colors[lane][k], 0.0f, 1.0f) * 255.0f + 0.5f);
+				}
+				pixel[3] = 255;
+			}
+		}
+	}
+	return shaded;
+}
+
+void SoftwareRenderer::ShadePacket(const SoftwareFragment* fragments, int mask, const glm::vec3& viewPos, const std::vector<unsigned int>& tileLights, glm::vec3* colors) const
+{
+#ifdef SOFTWARE_SIMD
+	if (simd) {
+		// from one struct per fragment to one register per member
+		float lanes[16][PACKET_SIZE];
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			const SoftwareFragment& f = fragments[lane];
+			for (int k = 0; k < 3; k++) {
+				lanes[k][lane] = f.position[k];
+				lanes[3 + k][lane] = f.normal[k];
+				lanes[6 + k][lane] = f.diffuseColor[k];
+				lanes[9 + k][lane] = f.specularColor[k];
+			}
+			lanes[12][lane] = f.shininess;
+			lanes[13][lane] = (mask & (1 << lane)) ? 1.0f : 0.0f;
+		}
+		Fragment8 f;
+		f.position = { Load(lanes[0]), Load(lanes[1]), Load(lanes[2]) };
+		Vec8 normal = { Load(lanes[3]), Load(lanes[4]), Load(lanes[5]) };
+		f.diffuseColor = { Load(lanes[6]), Load(lanes[7]), Load(lanes[8]) };
+		f.specularColor = { Load(lanes[9]), Load(lanes[10]), Load(lanes[11]) };
+		f.shininess = Load(lanes[12]);
+		Float8 active = Greater(Load(lanes[13]), Splat(0.0f));
+		f.normal = Normalize(normal);
+		f.viewDir = Normalize(Splat(viewPos) - f.position);
+
+		Vec8 result = Splat(glm::vec3(0.0f));
+		if (features.dirLight) {
+			result = result + CalcDirLight(block.dirLight, f);
+		}
+		if (pointLights.empty()) {
+			for (int i = 0; i < features.pointLights; i++) {
+				result = result + CalcPointLight(block.pointLights[i], f);
+			}
+		}
+		else {
+			for (unsigned int index : tileLights) {
+				const PointLight& light = pointLights[index];
+				Vec8 toLight = Splat(light.position) - f.position;
+				Float8 reached = And(active, LessEqual(Dot(toLight, toLight), Splat(pointLightRadii[index] * pointLightRadii[index])));
+				if (Bits(reached) == 0) {
+					continue;
+				}
+				result = result + Select(reached, CalcPointLight(light, f), Splat(glm::vec3(0.0f)));
+			}
+		}
+		if (features.spotLight) {
+			result = result + CalcSpotLight(block.spotLight, f);
+		}
+
+		Store(lanes[0], result.x);
+		Store(lanes[1], result.y);
+		Store(lanes[2], result.z);
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			colors[lane] = glm::vec3(lanes[0][lane], lanes[1][lane], lanes[2][lane]);
+		}
+		return;
+	}
+#endif
+	for (int lane = 0; lane < PACKET_SIZE; lane++) {
+		if ((mask & (1 << lane)) == 0) {
+			continue;
+		}
+		SoftwareFragment f = fragments[lane];
+		f.normal = glm::normalize(f.normal);
+		f.viewDir = glm::normalize(viewPos - f.position);
+		glm::vec3 result(0.0f);
+		if (features.dirLight) {
+			result += CalcDirLight(block.dirLight, f);
+		}
+		if (pointLights.empty()) {
+			for (int i = 0; i < features.pointLights; i++) {
+				result += CalcPointLight(block.pointLights[i], f);
+			}
+		}
+		else {
+			for (unsigned int index : tileLights) {
+				if (glm::distance(pointLights[index].position, f.position) <= pointLightRadii[index]) {
+					result += CalcPointLight(pointLights[index], f);
+				}
+			}
+		}
+		if (features.spotLight) {
+			result += CalcSpotLight(block.spotLight, f);
+		}
+		colors[lane] = result;
+	}
+}
+
+void SoftwareRenderer::Present(GLState& state, GLuint target)
+{
+	if (presentTexture == 0) {
+		glGenTextures(1, &presentTexture);
+		state.BindTexture(0, GL_TEXTURE_2D, presentTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glGenFramebuffers(1, &presentFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, presentFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, presentTexture, 0);
+	}
+	state.BindTexture(0, GL_TEXTURE_2D, presentTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, presentFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include "GLState.h"
+#include "LightSet.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+
+// side of a screen tile in pixels, a multiple of the 4x2 fragment packets; every tile is
+// rasterized and shaded by one job, start to end
+#define SOFTWARE_TILE_SIZE 32
+// pixels a triangle may reach beyond the viewport before it is clipped, keeps the edge
+// functions of triangles passing close by the camera within float precision
+#define SOFTWARE_GUARD_BAND 4096.0f
+// instances of a draw transformed and set up by one job
+#define SOFTWARE_INSTANCES_PER_JOB 16
+
+// a fragment as main() of multipleLight.frag sees it, in SoftwareRenderer.cpp
+struct SoftwareFragment;
+
+// instances of one mesh with one material, like a SceneBatch; the arrays belong to the caller
+// and are read during Render only
+struct SoftwareDraw
+{
+	// GEOMETRY_VERTEX_FLOATS floats per vertex, see Scene::AddMesh
+	const GLfloat* vertices;
+	size_t vertexCount;
+	const GLuint* indices;
+	size_t indexCount;
+	const InstanceTransform* instances;
+	size_t instanceCount;
+	SceneMaterial material;
+};
+
+// Renders the multipleLight model on the CPU, for machines without a GPU and as a reference
+// that comes out the same on every machine and thread count. Instances are transformed,
+// clipped and set up in parallel jobs, then binned into screen tiles. Each tile is rasterized
+// by one job into a depth buffer and a buffer of the triangle every pixel shows, then shaded
+// once per visible pixel: texture samples per fragment, lighting eight fragments at a time by
+// SIMD versions of CalcDirLight, CalcPointLight and CalcSpotLight (AVX2 in builds with
+// /arch:AVX2, SSE2 otherwise), or one at a time by a scalar transliteration of the shader.
+//
+// Textures are found by the names the materials refer to, GL names for copies of GL textures or
+// the renderer's own names from LoadTexture; an unknown name samples black like texture 0 does.
+// There are no shadow maps and no lightmaps: every light is unoccluded, as with shadows off.
+// No GL calls except in Present and Delete, and those only after a Present, so the renderer and
+// its Pixels work without a context.
+class SoftwareRenderer
+{
+public:
+	// allocates the framebuffer
+	void Create(unsigned int width, unsigned int height);
+	// frees the textures and the GL objects of Present
+	void Delete();
+
+	// a copy of an RGBA8 image, rows bottom up as GL stores them; mipmaps builds the chain and
+	// samples it trilinearly like GL_LINEAR_MIPMAP_LINEAR, otherwise bilinearly. Wraps like GL_REPEAT.
+	void SetTexture(GLuint name, unsigned int width, unsigned int height, const unsigned char* pixels, bool mipmaps);
+	// decodes the image at path with SOIL into a texture under a new name, which it returns; 0
+	// when the image cannot be read
+	GLuint LoadTexture(const std::string& path, bool mipmaps);
+	// the block and the phases of the variant the image should match
+	void SetLights(const LightBlock& block, const LightFeatures& features);
+	// not empty, replaces the block's point lights; each one is left out where it is beyond
+	// ClusteredLights::LightRadius, like in clustered forward mode. Empty goes back to the block.
+	void SetPointLights(const std::vector<PointLight>& pointLights);
+	// the scalar shading path instead of the SIMD one, to check and benchmark the kernels;
+	// builds without SSE2 always shade scalar
+	void SetSimd(bool simd) { this->simd = simd; }
+	static bool SimdSupported();
+
+	// draws into the framebuffer cleared to 0, with depth test GL_LESS and no face culling;
+	// viewPos is what the shader's viewPos uniform would be set to. Serial without a pool.
+	void Render(const std::vector<SoftwareDraw>& draws, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, ThreadPool* pool = NULL);
+	// RGBA8, rows bottom up like glReadPixels
+	const std::vector<unsigned char>& Pixels() const { return pixels; }
+	unsigned int Width() const { return width; }
+	unsigned int Height() const { return height; }
+	// triangles that reached a tile, and fragments shaded, of the last Render
+	size_t Triangles() const { return triangleCount; }
+	size_t Fragments() const { return fragmentCount; }
+
+	// copies the framebuffer into the colour buffer of target through a texture and a blit,
+	// target stays bound; optional, needs a current GL context
+	void Present(GLState& state, GLuint target);
+
+private:
+	struct Texture
+	{
+		// level i is width >> i by height >> i, at least 1x1, rows bottom up
+		std::vector<std::vector<unsigned char>> levels;
+		std::vector<glm::uvec2> sizes;
+		bool mipmaps = false;
+	};
+
+	// a vertex after the vertex stage, what multipleLight.vert hands to the rasterizer
+	struct ClipVertex
+	{
+		glm::vec4 clip;
+		glm::vec3 position, normal;
+		glm::vec2 texCoords;
+	};
+
+	// planes of a triangle: window depth, 1/w and the attributes over w
+	enum Plane
+	{
+		PLANE_DEPTH,
+		PLANE_INVERSE_W,
+		PLANE_POSITION,
+		PLANE_NORMAL = PLANE_POSITION + 3,
+		PLANE_TEX_COORDS = PLANE_NORMAL + 3,
+		PLANE_COUNT = PLANE_TEX_COORDS + 2
+	};
+
+	struct Triangle
+	{
+		// edge i is e(x, y) = dx * (y - py) - dy * (x - px) from P to Q, its vertices taken in a
+		// fixed order so two triangles sharing the edge evaluate it bit for bit alike. A pixel is
+		// inside where e * sign > 0; on the edge itself only where sign > 0, so it is drawn once.
+		float px[3], py[3], dx[3], dy[3], sign[3];
+		// pixels that may be covered, inclusive
+		int minX, minY, maxX, maxY;
+		// value, x and y gradient of every plane, from vertex 0 at (x0, y0)
+		float x0, y0;
+		float planes[PLANE_COUNT][3];
+		unsigned int material;
+	};
+
+	struct Material
+	{
+		const Texture* diffuse;
+		const Texture* specular;
+		float shininess;
+	};
+
+	unsigned int width = 0, height = 0;
+	unsigned int tilesX = 0, tilesY = 0;
+	std::vector<unsigned char> pixels;
+	std::map<GLuint, Texture> textures;
+	LightBlock block = {};
+	LightFeatures features;
+	std::vector<PointLight> pointLights;
+	std::vector<float> pointLightRadii;
+	bool simd = true;
+
+	// per frame: materials of the draws, triangles set up by each job and the triangles of every tile
+	std::vector<Material> materials;
+	std::vector<std::vector<Triangle>> jobTriangles;
+	std::vector<std::vector<const Triangle*>> bins;
+	// point lights reaching each tile, as a pixel rectangle per light; empty rectangles for
+	// lights out of view
+	std::vector<glm::ivec4> lightRects;
+	size_t triangleCount = 0, fragmentCount = 0;
+
+	// Present's upload texture and the framebuffer it is blitted from
+	GLuint presentTexture = 0, presentFramebuffer = 0;
+
+	void TransformInstances(const SoftwareDraw& draw, unsigned int material, size_t first, size_t count, const glm::mat4& viewProjection, std::vector<Triangle>& out) const;
+	void ClipAndSetup(const ClipVertex* vertices, unsigned int material, std::vector<Triangle>& out) const;
+	bool Setup(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, unsigned int material, Triangle& triangle) const;
+	void FindLightRects(const glm::mat4& view, const glm::mat4& projection);
+	// rasterizes and shades one tile into the framebuffer, returns the fragments shaded
+	size_t RenderTile(unsigned int tile, const glm::vec3& viewPos);
+	// lights the lanes of mask out of a packet of fragments; tileLights index pointLights
+	void ShadePacket(const SoftwareFragment* fragments, int mask, const glm::vec3& viewPos, const std::vector<unsigned int>& tileLights, glm::vec3* colors) const;
+
+	static void BuildMips(Texture& texture);
+	static glm::vec3 Sample(const Texture* texture, const glm::vec2& texCoords, float lod);
+	// level of detail of a sample from the screen space derivatives of its tex coords
+	static float Lod(const Texture* texture, const glm::vec2& ddx, const glm::vec2& ddy);
+};
@@ -0,0 +1,217 @@
+#include "TextureLoader.h"
+#include <SOIL/SOIL.h>
+#include <cstring>
+#include <iostream>
+
+// uploads of one image that may lose their pixel buffer before it keeps the placeholder for good
+#define TEXTURE_UPLOAD_ATTEMPTS 3
+
+void TextureLoader::Init()
+{
+	glGenBuffers(PBO_COUNT, pbos);
+
+	// compressed baked files are only used where the driver can sample them
+	compressionSupported = BakedTexture::CompressionSupported();
+}
+
+void TextureLoader::Shutdown()
+{
+	// decode jobs write into this object, so they have to be done before it goes away
+	std::deque<Decoded> leftovers;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		decodedSignal.wait(lock, [this] { return decoding == 0; });
+		leftovers.swap(decoded);
+	}
+	for (Decoded& image : leftovers) {
+		SOIL_free_image_data(image.pixels);
+	}
+	glDeleteBuffers(PBO_COUNT, pbos);
+	if (!textures.empty()) {
+		glDeleteTextures((GLsizei)textures.size(), textures.data());
+	}
+	textures.clear();
+}
+
+GLuint TextureLoader::Load(const std::string& path, const TextureOptions& options)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, options.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, options.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, options.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// a single level is mipmap complete, so the placeholder samples fine with any filter
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, options.placeholder);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	textures.push_back(texture);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		decoding++;
+	}
+	pool.Submit([this, texture, path, options]() {
+		Decoded image;
+		image.texture = texture;
+		image.options = options;
+		image.path = path;
+		image.pixels = NULL;
+		image.width = image.height = 0;
+		image.attempts = 0;
+
+		std::shared_ptr<BakedTexture> baked = std::make_shared<BakedTexture>();
+		if (baked->Open(BakedTexture::BakedPath(path)) && (baked->Format() != BAKED_BC1 || compressionSupported)) {
+			// the page faults are taken here rather than in the copy on the GL thread
+			baked->Prefault();
+			image.baked = baked;
+		}
+		else {
+			image.pixels = SOIL_load_image(path.c_str(), &image.width, &image.height, 0, SOIL_LOAD_RGBA);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		decoded.push_back(image);
+		decoding--;
+		decodedSignal.notify_all();
+	});
+	return texture;
+}
+
+void TextureLoader::Update(size_t budgetBytes)
+{
+	size_t uploaded = 0;
+	while (uploaded == 0 || uploaded < budgetBytes) {
+		Decoded image;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (decoded.empty()) {
+				return;
+			}
+			image = decoded.front();
+			decoded.pop_front();
+		}
+		uploaded += (image.baked ? UploadBaked(image) : Upload(image)) + 1;
+	}
+}
+
+void TextureLoader::Finish()
+{
+	for (;;) {
+		Update((size_t)-1);
+		std::unique_lock<std::mutex> lock(mutex);
+		if (decoding == 0 && decoded.empty()) {
+			return;
+		}
+		decodedSignal.wait(lock, [this] { return !decoded.empty() || decoding == 0; });
+	}
+}
+
+size_t TextureLoader::Pending()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return decoding + decoded.size();
+}
+
+bool TextureLoader::FillUploadBuffer(const void* data, size_t size)
+{
+	// round robin over the PBOs; orphaning the storage means the driver never waits for the previous upload
+	GLuint pbo = pbos[nextPbo];
+	size_t& capacity = pboSizes[nextPbo];
+	nextPbo = (nextPbo + 1) % PBO_COUNT;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	if (capacity < size) {
+		capacity = size;
+	}
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped != NULL) {
+		memcpy(mapped, data, size);
+		// GL_FALSE means the contents were lost while mapped, a mode switch for instance
+		if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+			return true;
+		}
+	}
+	// sourcing the upload from the orphaned storage would replace the placeholder with garbage
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return false;
+}
+
+void TextureLoader::RetryUpload(Decoded& image)
+{
+	if (++image.attempts < TEXTURE_UPLOAD_ATTEMPTS) {
+		std::cout << "ERROR::TEXTURE::UPLOAD_FAILED " << image.path << ", trying again" << std::endl;
+		std::lock_guard<std::mutex> lock(mutex);
+		decoded.push_back(image);
+		return;
+	}
+	std::cout << "ERROR::TEXTURE::UPLOAD_FAILED " << image.path << ", keeping the placeholder" << std::endl;
+	SOIL_free_image_data(image.pixels);
+	image.pixels = NULL;
+	image.baked.reset();
+}
+
+size_t TextureLoader::Upload(Decoded& image)
+{
+	if (image.pixels == NULL) {
+		// keep the placeholder rather than bringing the whole demo down over one image
+		std::cout << "ERROR::TEXTURE::LOAD_FAILED " << image.path << std::endl;
+		return 0;
+	}
+
+	size_t size = (size_t)image.width * image.height * 4;
+	if (!FillUploadBuffer(image.pixels, size)) {
+		RetryUpload(image);
+		return 0;
+	}
+	SOIL_free_image_data(image.pixels);
+	image.pixels = NULL;
+
+	glBindTexture(GL_TEXTURE_2D, image.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	// with a PBO bound the data pointer is an offset into it
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)0);
+	if (image.options.mipmaps) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return size;
+}
+
+size_t TextureLoader::UploadBaked(Decoded& image)
+{
+	const BakedTexture& baked = *image.baked;
+	// without mipmaps only the top level is sampled, so only that one is uploaded
+	unsigned int levels = image.options.mipmaps ? baked.Levels() : 1;
+
+	// the levels are stored back to back in upload order, one copy moves all of them
+	size_t first = baked.Level(0).offset;
+	size_t size = baked.Level(levels - 1).offset + baked.Level(levels - 1).size - first;
+	if (!FillUploadBuffer(baked.LevelData(0), size)) {
+		RetryUpload(image);
+		return 0;
+	}
+
+	GLenum internalFormat = BakedTexture::InternalFormat(baked.Format());
+	glBindTexture(GL_TEXTURE_2D, image.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (unsigned int level = 0; level < levels; level++) {
+		const BakedLevel& data = baked.Level(level);
+		const void* offset = (const void*)(size_t)(data.offset - first);
+		if (baked.Format() == BAKED_BC1) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, data.width, data.height, 0, data.size, offset);
+		}
+		else {
+			glTexImage2D(GL_TEXTURE_2D, level, internalFormat, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+		}
+	}
+	// keeps the texture complete whichever levels were uploaded
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	image.baked.reset();
+	return size;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+#include "BakedTexture.h"
+
+struct TextureOptions
+{
+	GLint wrap = GL_REPEAT;
+	bool mipmaps = false;
+	// colour of the 1x1 texture bound until the image is ready
+	unsigned char placeholder[4] = { 128, 128, 128, 255 };
+};
+
+// Loads textures without blocking the first frame. Load hands out a texture name right away,
+// backed by a 1x1 placeholder; the image is decoded on the thread pool and Update streams the
+// finished pixels into GL through a small set of reused pixel buffer objects. A baked file next
+// to the image (see BakedTexture) is preferred, it is mapped instead of decoded and brings its
+// own mip chain.
+class TextureLoader
+{
+public:
+	explicit TextureLoader(ThreadPool& pool) : pool(pool) {}
+
+	void Init();
+	// waits for outstanding decodes and deletes every texture it created
+	void Shutdown();
+
+	GLuint Load(const std::string& path, const TextureOptions& options);
+	// uploads finished images, at least one and then up to budgetBytes per call
+	void Update(size_t budgetBytes = 8 << 20);
+	// blocks until every requested texture is decoded and uploaded
+	void Finish();
+
+	size_t Pending();
+
+private:
+	struct Decoded
+	{
+		GLuint texture;
+		TextureOptions options;
+		std::string path;
+		unsigned char* pixels;
+		int width, height;
+		// set instead of pixels when the baked file was used
+		std::shared_ptr<BakedTexture> baked;
+		// uploads that lost their pixel buffer so far
+		int attempts;
+	};
+
+	static const int PBO_COUNT = 3;
+
+	ThreadPool& pool;
+	GLuint pbos[PBO_COUNT] = {};
+	size_t pboSizes[PBO_COUNT] = {};
+	int nextPbo = 0;
+	bool compressionSupported = false;
+	std::vector<GLuint> textures;
+
+	std::mutex mutex;
+	std::condition_variable decodedSignal;
+	std::deque<Decoded> decoded;
+	size_t decoding = 0;
+
+	bool FillUploadBuffer(const void* data, size_t size);
+	void RetryUpload(Decoded& image);
+	size_t Upload(Decoded& image);
+	size_t UploadBaked(Decoded& image);
+};
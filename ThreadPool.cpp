@@ -0,0 +1,102 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0) {
+		unsigned int hardware = std::thread::hardware_concurrency();
+		threadCount = hardware > 1 ? hardware - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+			if (stopping && tasks.empty()) {
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& fn)
+{
+	if (count == 0) {
+		return;
+	}
+	grain = std::max<size_t>(grain, 1);
+	size_t chunks = (count + grain - 1) / grain;
+	if (chunks == 1) {
+		fn(0, count);
+		return;
+	}
+
+	// chunks are claimed through an atomic counter so fast threads simply take more of them
+	struct Job
+	{
+		std::atomic<size_t> next;
+		std::mutex mutex;
+		std::condition_variable done;
+		size_t helpersLeft;
+	} job;
+	job.next = 0;
+	size_t helpers = std::min<size_t>(workers.size(), chunks - 1);
+	job.helpersLeft = helpers;
+
+	auto work = [&job, &fn, count, grain]() {
+		for (;;) {
+			size_t begin = job.next.fetch_add(grain);
+			if (begin >= count) {
+				break;
+			}
+			fn(begin, std::min(begin + grain, count));
+		}
+	};
+
+	for (size_t i = 0; i < helpers; i++) {
+		Submit([&job, work]() {
+			work();
+			std::lock_guard<std::mutex> lock(job.mutex);
+			if (--job.helpersLeft == 0) {
+				job.done.notify_one();
+			}
+		});
+	}
+	work();
+
+	// the job lives on this stack frame, so wait until every helper has let go of it
+	std::unique_lock<std::mutex> lock(job.mutex);
+	job.done.wait(lock, [&job] { return job.helpersLeft == 0; });
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small persistent pool of worker threads. ParallelFor splits a range over the workers and the
+// calling thread and blocks until every chunk is done; Submit queues fire and forget tasks.
+class ThreadPool
+{
+public:
+	// threadCount 0 uses one worker per hardware thread, minus the caller
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	// number of threads that take part in a ParallelFor, including the caller
+	unsigned int Size() const { return (unsigned int)workers.size() + 1; }
+
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& fn);
+	void Submit(std::function<void()> task);
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void WorkerLoop();
+};
@@ -0,0 +1,269 @@
+#include "TransformSystem.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+
+size_t TransformSystem::Add(const glm::vec3& position, const glm::vec4& rotation, const glm::vec3& scale)
+{
+	positionX.push_back(0.0f); positionY.push_back(0.0f); positionZ.push_back(0.0f);
+	rotationX.push_back(0.0f); rotationY.push_back(0.0f); rotationZ.push_back(0.0f); rotationW.push_back(1.0f);
+	scaleX.push_back(1.0f); scaleY.push_back(1.0f); scaleZ.push_back(1.0f);
+	dirty.push_back(0);
+	instances.push_back(InstanceTransform());
+	size_t index = Size() - 1;
+	Set(index, position, rotation, scale);
+	return index;
+}
+
+void TransformSystem::Remove(size_t index)
+{
+	size_t last = Size() - 1;
+	if (dirty[index]) {
+		dirtyCount--;
+	}
+	if (index != last) {
+		positionX[index] = positionX[last]; positionY[index] = positionY[last]; positionZ[index] = positionZ[last];
+		rotationX[index] = rotationX[last]; rotationY[index] = rotationY[last]; rotationZ[index] = rotationZ[last]; rotationW[index] = rotationW[last];
+		scaleX[index] = scaleX[last]; scaleY[index] = scaleY[last]; scaleZ[index] = scaleZ[last];
+		dirty[index] = dirty[last];
+		instances[index] = instances[last];
+	}
+	positionX.pop_back(); positionY.pop_back(); positionZ.pop_back();
+	rotationX.pop_back(); rotationY.pop_back(); rotationZ.pop_back(); rotationW.pop_back();
+	scaleX.pop_back(); scaleY.pop_back(); scaleZ.pop_back();
+	dirty.pop_back();
+	instances.pop_back();
+}
+
+void TransformSystem::Clear()
+{
+	positionX.clear(); positionY.clear(); positionZ.clear();
+	rotationX.clear(); rotationY.clear(); rotationZ.clear(); rotationW.clear();
+	scaleX.clear(); scaleY.clear(); scaleZ.clear();
+	dirty.clear();
+	dirtyCount = 0;
+	instances.clear();
+}
+
+void TransformSystem::Set(size_t index, const glm::vec3& position, const glm::vec4& rotation, const glm::vec3& scale)
+{
+	SetPosition(index, position);
+	SetRotation(index, rotation);
+	scaleX[index] = scale.x;
+	scaleY[index] = scale.y;
+	scaleZ[index] = scale.z;
+}
+
+void TransformSystem::SetPosition(size_t index, const glm::vec3& position)
+{
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	MarkDirty(index);
+}
+
+void TransformSystem::SetRotation(size_t index, const glm::vec4& rotation)
+{
+	rotationX[index] = rotation.x;
+	rotationY[index] = rotation.y;
+	rotationZ[index] = rotation.z;
+	rotationW[index] = rotation.w;
+	MarkDirty(index);
+}
+
+void TransformSystem::MarkDirty(size_t index)
+{
+	if (!dirty[index]) {
+		dirty[index] = 1;
+		dirtyCount++;
+	}
+}
+
+glm::vec4 TransformSystem::AxisAngle(const glm::vec3& axis, float angle)
+{
+	glm::vec3 unit = glm::normalize(axis) * std::sin(angle * 0.5f);
+	return glm::vec4(unit.x, unit.y, unit.z, std::cos(angle * 0.5f));
+}
+
+void TransformSystem::DirtyIndices(std::vector<unsigned int>& out) const
+{
+	size_t i = 0;
+	// skip four clean objects at a time, most of a large scene does not move
+	for (; i + 4 <= Size(); i += 4) {
+		unsigned int blockDirty;
+		memcpy(&blockDirty, &dirty[i], sizeof(blockDirty));
+		if (blockDirty == 0) {
+			continue;
+		}
+		for (size_t j = i; j < i + 4; j++) {
+			if (dirty[j]) {
+				out.push_back((unsigned int)j);
+			}
+		}
+	}
+	for (; i < Size(); i++) {
+		if (dirty[i]) {
+			out.push_back((unsigned int)i);
+		}
+	}
+}
+
+size_t TransformSystem::Update(ThreadPool* pool)
+{
+	if (dirtyCount == 0) {
+		return 0;
+	}
+	size_t updated = dirtyCount;
+	size_t blocks = (Size() + 3) / 4;
+	// a few thousand objects are done faster than the pool can be woken up
+	if (pool != NULL && Size() > 16384) {
+		pool->ParallelFor(blocks, 1024, [this](size_t begin, size_t end) {
+			UpdateRange(begin * 4, std::min(end * 4, Size()));
+		});
+	}
+	else {
+		UpdateRange(0, Size());
+	}
+	dirtyCount = 0;
+	return updated;
+}
+
+// model = translate * rotate * scale, normal = transpose(inverse(mat3(model))) = rotate * inverse(scale)
+void TransformSystem::UpdateRange(size_t begin, size_t end)
+{
+	size_t i = begin;
+#ifdef TRANSFORM_SSE
+	const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+	for (; i + 4 <= end; i += 4) {
+		// whole blocks of four are skipped when none of them moved
+		unsigned int blockDirty;
+		memcpy(&blockDirty, &dirty[i], sizeof(blockDirty));
+		if (blockDirty == 0) {
+			continue;
+		}
+		memset(&dirty[i], 0, 4);
+
+		__m128 qx = _mm_loadu_ps(&rotationX[i]), qy = _mm_loadu_ps(&rotationY[i]);
+		__m128 qz = _mm_loadu_ps(&rotationZ[i]), qw = _mm_loadu_ps(&rotationW[i]);
+		__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+		// rotation matrix, rRC is row R of column C
+		__m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		__m128 r10 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		__m128 r20 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		__m128 r01 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		__m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		__m128 r21 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+		__m128 r02 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		__m128 r12 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		__m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+		__m128 sx = _mm_loadu_ps(&scaleX[i]), sy = _mm_loadu_ps(&scaleY[i]), sz = _mm_loadu_ps(&scaleZ[i]);
+		__m128 ix = _mm_div_ps(one, sx), iy = _mm_div_ps(one, sy), iz = _mm_div_ps(one, sz);
+
+		// each register holds one matrix element of four objects; transposing turns them into
+		// one column of each object, ready to store
+		__m128 m0 = _mm_mul_ps(r00, sx), m1 = _mm_mul_ps(r10, sx), m2 = _mm_mul_ps(r20, sx), m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&instances[i].model[0][0], m0);
+		_mm_storeu_ps(&instances[i + 1].model[0][0], m1);
+		_mm_storeu_ps(&instances[i + 2].model[0][0], m2);
+		_mm_storeu_ps(&instances[i + 3].model[0][0], m3);
+
+		m0 = _mm_mul_ps(r01, sy); m1 = _mm_mul_ps(r11, sy); m2 = _mm_mul_ps(r21, sy); m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&instances[i].model[1][0], m0);
+		_mm_storeu_ps(&instances[i + 1].model[1][0], m1);
+		_mm_storeu_ps(&instances[i + 2].model[1][0], m2);
+		_mm_storeu_ps(&instances[i + 3].model[1][0], m3);
+
+		m0 = _mm_mul_ps(r02, sz); m1 = _mm_mul_ps(r12, sz); m2 = _mm_mul_ps(r22, sz); m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&instances[i].model[2][0], m0);
+		_mm_storeu_ps(&instances[i + 1].model[2][0], m1);
+		_mm_storeu_ps(&instances[i + 2].model[2][0], m2);
+		_mm_storeu_ps(&instances[i + 3].model[2][0], m3);
+
+		m0 = _mm_loadu_ps(&positionX[i]); m1 = _mm_loadu_ps(&positionY[i]); m2 = _mm_loadu_ps(&positionZ[i]); m3 = one;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&instances[i].model[3][0], m0);
+		_mm_storeu_ps(&instances[i + 1].model[3][0], m1);
+		_mm_storeu_ps(&instances[i + 2].model[3][0], m2);
+		_mm_storeu_ps(&instances[i + 3].model[3][0], m3);
+
+		m0 = _mm_mul_ps(r00, ix); m1 = _mm_mul_ps(r10, ix); m2 = _mm_mul_ps(r20, ix); m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&instances[i].normal[0][0], m0);
+		_mm_storeu_ps(&instances[i + 1].normal[0][0], m1);
+		_mm_storeu_ps(&instances[i + 2].normal[0][0], m2);
+		_mm_storeu_ps(&instances[i + 3].normal[0][0], m3);
+
+		m0 = _mm_mul_ps(r01, iy); m1 = _mm_mul_ps(r11, iy); m2 = _mm_mul_ps(r21, iy); m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&instances[i].normal[1][0], m0);
+		_mm_storeu_ps(&instances[i + 1].normal[1][0], m1);
+		_mm_storeu_ps(&instances[i + 2].normal[1][0], m2);
+		_mm_storeu_ps(&instances[i + 3].normal[1][0], m3);
+
+		m0 = _mm_mul_ps(r02, iz); m1 = _mm_mul_ps(r12, iz); m2 = _mm_mul_ps(r22, iz); m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&instances[i].normal[2][0], m0);
+		_mm_storeu_ps(&instances[i + 1].normal[2][0], m1);
+		_mm_storeu_ps(&instances[i + 2].normal[2][0], m2);
+		_mm_storeu_ps(&instances[i + 3].normal[2][0], m3);
+	}
+#endif
+	// the last partial block, or everything without SSE
+	for (; i < end; i++) {
+		if (dirty[i]) {
+			UpdateOne(i);
+			dirty[i] = 0;
+		}
+	}
+}
+
+void TransformSystem::UpdateOne(size_t i)
+{
+	float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+	glm::vec3 column0(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y));
+	glm::vec3 column1(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x));
+	glm::vec3 column2(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y));
+
+	InstanceTransform& instance = instances[i];
+	instance.model[0] = glm::vec4(column0 * scaleX[i], 0.0f);
+	instance.model[1] = glm::vec4(column1 * scaleY[i], 0.0f);
+	instance.model[2] = glm::vec4(column2 * scaleZ[i], 0.0f);
+	instance.model[3] = glm::vec4(positionX[i], positionY[i], positionZ[i], 1.0f);
+	instance.normal[0] = glm::vec4(column0 / scaleX[i], 0.0f);
+	instance.normal[1] = glm::vec4(column1 / scaleY[i], 0.0f);
+	instance.normal[2] = glm::vec4(column2 / scaleZ[i], 0.0f);
+}
+
+void TransformSystem::UpdateReference()
+{
+	for (size_t i = 0; i < Size(); i++) {
+		float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+		glm::mat4 rotation(1.0f);
+		rotation[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f);
+		rotation[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f);
+		rotation[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f);
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(positionX[i], positionY[i], positionZ[i]))
+			* rotation * glm::scale(glm::mat4(1.0f), glm::vec3(scaleX[i], scaleY[i], scaleZ[i]));
+		// what the vertex shader used to do for every vertex
+		glm::mat3 normal = glm::mat3(glm::transpose(glm::inverse(model)));
+
+		instances[i].model = model;
+		for (int c = 0; c < 3; c++) {
+			instances[i].normal[c] = glm::vec4(normal[c], 0.0f);
+		}
+		dirty[i] = 0;
+	}
+	dirtyCount = 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+#include "ThreadPool.h"
+
+// Per instance data streamed to the GPU by InstancedMesh. The normal matrix columns are padded
+// to vec4 so the kernel can store whole SIMD registers; the shader reads their xyz, and Scene
+// puts a renderable's lightmap tile (scale, offset x, offset y) in their w.
+struct InstanceTransform
+{
+	glm::mat4 model;
+	glm::vec4 normal[3];
+};
+
+static_assert(sizeof(InstanceTransform) == 112, "InstanceTransform must stay tightly packed for the instance buffer");
+
+// Translation, rotation and scale of many objects, kept as structure of arrays. Update turns
+// every object that changed since the last call into its model and normal matrix with an SSE
+// batch kernel, four objects at a time, so objects that did not move cost nothing.
+class TransformSystem
+{
+public:
+	// rotation is a unit quaternion (x, y, z, w), returns the index of the new object
+	size_t Add(const glm::vec3& position, const glm::vec4& rotation, const glm::vec3& scale);
+	// moves the last object into index, so every other index stays valid
+	void Remove(size_t index);
+	void Clear();
+
+	void Set(size_t index, const glm::vec3& position, const glm::vec4& rotation, const glm::vec3& scale);
+	void SetPosition(size_t index, const glm::vec3& position);
+	void SetRotation(size_t index, const glm::vec4& rotation);
+
+	// recomputes the dirty objects, spread over the pool when there are many; returns how many were recomputed
+	size_t Update(ThreadPool* pool = NULL);
+	// indices Update is about to recompute, in ascending order
+	void DirtyIndices(std::vector<unsigned int>& out) const;
+	size_t DirtyCount() const { return dirtyCount; }
+	// reference path through glm, one object at a time, used to check and benchmark the kernel
+	void UpdateReference();
+
+	size_t Size() const { return positionX.size(); }
+	glm::vec3 Position(size_t index) const { return glm::vec3(positionX[index], positionY[index], positionZ[index]); }
+	const InstanceTransform* Instances() const { return instances.data(); }
+
+	static glm::vec4 AxisAngle(const glm::vec3& axis, float angle);
+
+private:
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	// one byte per object, read four at a time by the kernel
+	std::vector<unsigned char> dirty;
+	size_t dirtyCount = 0;
+	std::vector<InstanceTransform> instances;
+
+	void MarkDirty(size_t index);
+	void UpdateRange(size_t begin, size_t end);
+	void UpdateOne(size_t index);
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+
+// Latest value handoff between one writer and one reader thread. The writer fills Back() and
+// publishes it, the reader picks up the newest published value with Acquire; neither side ever
+// waits for the other, and values the reader was too slow for are simply skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+	// writer side: the slot to fill, owned by the writer until Publish
+	T& Back() { return slots[back]; }
+
+	// writer side: makes Back() the newest value and hands the writer a free slot
+	void Publish()
+	{
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// reader side: swaps in the newest value if one was published since the last call
+	bool Acquire()
+	{
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+			return false;
+		}
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// reader side: the value picked up by the last successful Acquire
+	const T& Front() const { return slots[front]; }
+
+private:
+	// the middle slot's index, with FRESH set while the reader has not taken it yet
+	static const unsigned int INDEX = 3;
+	static const unsigned int FRESH = 4;
+
+	T slots[3];
+	unsigned int back = 0, front = 1;
+	// kept away from the slots, which both threads write
+	alignas(64) std::atomic<unsigned int> middle{ 2 };
+};
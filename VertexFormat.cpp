@@ -0,0 +1,136 @@
+#include "VertexFormat.h"
+#include <cmath>
+#include <cstring>
+
+size_t VertexLayout::Stride(VertexFormat format)
+{
+	switch (format) {
+	case VERTEX_PACKED:
+		return 3 * sizeof(GLfloat) + 2 * sizeof(unsigned short) + sizeof(GLuint);
+	case VERTEX_QUANTIZED:
+		// the position is padded to four halves so the following attributes stay 4 byte aligned
+		return 4 * sizeof(unsigned short) + 2 * sizeof(unsigned short) + sizeof(GLuint);
+	default:
+		return GEOMETRY_VERTEX_FLOATS * sizeof(GLfloat);
+	}
+}
+
+void VertexLayout::Pack(VertexFormat format, const GLfloat* vertices, size_t count, unsigned char* packed)
+{
+	if (format == VERTEX_FLOAT) {
+		memcpy(packed, vertices, count * Stride(format));
+		return;
+	}
+	size_t stride = Stride(format);
+	for (size_t i = 0; i < count; i++) {
+		const GLfloat* vertex = vertices + i * GEOMETRY_VERTEX_FLOATS;
+		unsigned char* out = packed + i * stride;
+		if (format == VERTEX_QUANTIZED) {
+			unsigned short position[4] = { ToHalf(vertex[0]), ToHalf(vertex[1]), ToHalf(vertex[2]), 0 };
+			memcpy(out, position, sizeof(position));
+			out += sizeof(position);
+		}
+		else {
+			memcpy(out, vertex, 3 * sizeof(GLfloat));
+			out += 3 * sizeof(GLfloat);
+		}
+		unsigned short texCoords[2] = { ToHalf(vertex[3]), ToHalf(vertex[4]) };
+		memcpy(out, texCoords, sizeof(texCoords));
+		out += sizeof(texCoords);
+		GLuint normal = PackNormal(vertex[5], vertex[6], vertex[7]);
+		memcpy(out, &normal, sizeof(normal));
+	}
+}
+
+void VertexLayout::PointAttributes(VertexFormat format)
+{
+	GLsizei stride = (GLsizei)Stride(format);
+	if (format == VERTEX_FLOAT) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(0 * sizeof(GLfloat)));
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(3 * sizeof(GLfloat)));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(5 * sizeof(GLfloat)));
+	}
+	else {
+		size_t position = format == VERTEX_QUANTIZED ? 4 * sizeof(unsigned short) : 3 * sizeof(GLfloat);
+		glVertexAttribPointer(0, 3, format == VERTEX_QUANTIZED ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+		glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)position);
+		// packed normals take all four components, the shader's vec3 ignores w
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)(position + 2 * sizeof(unsigned short)));
+	}
+	for (GLuint location = 0; location < 3; location++) {
+		glEnableVertexAttribArray(location);
+	}
+}
+
+const char* VertexLayout::Name(VertexFormat format)
+{
+	switch (format) {
+	case VERTEX_PACKED:
+		return "packed";
+	case VERTEX_QUANTIZED:
+		return "quantized";
+	default:
+		return "float";
+	}
+}
+
+bool VertexLayout::Parse(const std::string& name, VertexFormat& format)
+{
+	const VertexFormat formats[] = { VERTEX_FLOAT, VERTEX_PACKED, VERTEX_QUANTIZED };
+	for (VertexFormat candidate : formats) {
+		if (name == Name(candidate)) {
+			format = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned short VertexLayout::ToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000;
+	unsigned int magnitude = bits & 0x7FFFFFFF;
+	if (magnitude >= 0x7F800000) {
+		// infinity stays infinity, NaN stays a quiet NaN
+		return (unsigned short)(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+	}
+	if (magnitude >= 0x477FF000) {
+		// 65520 and above round past the largest half
+		return (unsigned short)(sign | 0x7C00);
+	}
+	if (magnitude < 0x38800000) {
+		// below 2^-14 the half is subnormal, in units of 2^-24
+		if (magnitude < 0x33000000) {
+			return (unsigned short)sign;
+		}
+		unsigned int mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		unsigned int shift = 126 - (magnitude >> 23);
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) {
+			half++;
+		}
+		return (unsigned short)(sign | half);
+	}
+	// rebias the exponent from 127 to 15 and drop 13 mantissa bits; a carry into the exponent is correct
+	unsigned int half = (magnitude - 0x38000000) >> 13;
+	unsigned int rest = magnitude & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		half++;
+	}
+	return (unsigned short)(sign | half);
+}
+
+GLuint VertexLayout::PackNormal(float x, float y, float z)
+{
+	const float components[3] = { x, y, z };
+	GLuint packed = 0;
+	for (int i = 0; i < 3; i++) {
+		float clamped = components[i] < -1.0f ? -1.0f : (components[i] > 1.0f ? 1.0f : components[i]);
+		int value = (int)std::floor(clamped * 511.0f + 0.5f);
+		packed |= ((GLuint)value & 0x3FF) << (10 * i);
+	}
+	return packed;
+}
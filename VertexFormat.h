@@ -0,0 +1,40 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <cstddef>
+#include <string>
+
+// floats per source vertex: position, tex coords, normal
+#define GEOMETRY_VERTEX_FLOATS 8
+
+// how mesh vertices are stored on the GPU; the vertex shader sees the same vec3/vec2/vec3 in all
+enum VertexFormat
+{
+	// the source layout as is, 32 bytes
+	VERTEX_FLOAT = 0,
+	// float position, half float tex coords, normal in GL_INT_2_10_10_10_REV, 20 bytes
+	VERTEX_PACKED = 1,
+	// VERTEX_PACKED with half float positions, 16 bytes; about 3 significant digits, so
+	// coordinates far from the origin lose precision
+	VERTEX_QUANTIZED = 2
+};
+
+// Conversion of source vertices into a VertexFormat and the matching attribute setup at
+// locations 0 (position), 1 (tex coords) and 2 (normal).
+class VertexLayout
+{
+public:
+	static size_t Stride(VertexFormat format);
+	// writes count vertices of GEOMETRY_VERTEX_FLOATS floats each as count * Stride bytes
+	static void Pack(VertexFormat format, const GLfloat* vertices, size_t count, unsigned char* packed);
+	// for the bound VAO, reading from the buffer bound to GL_ARRAY_BUFFER
+	static void PointAttributes(VertexFormat format);
+
+	static const char* Name(VertexFormat format);
+	// accepts the names above, false for anything else
+	static bool Parse(const std::string& name, VertexFormat& format);
+
+	// IEEE half, rounded to nearest even; overflow becomes infinity
+	static unsigned short ToHalf(float value);
+	// a unit vector in a signed normalized 2_10_10_10 word, w = 0
+	static GLuint PackNormal(float x, float y, float z);
+};
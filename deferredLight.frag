@@ -0,0 +1,262 @@
+#version 330 core
+// lighting passes of DeferredRenderer, one of FULLSCREEN_PASS, POINT_VOLUME or SPOT_VOLUME.
+// The light math is the one of multipleLight.frag, fed from the G-buffer instead of a mesh.
+out vec4 FragColor;
+
+// the light structs live in a std140 uniform block, scalars fill the padding after each vec3
+// so the layout matches the C++ mirror in LightSet.h
+struct DirLight {
+    vec3 direction;
+	
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+#define NR_POINT_LIGHTS 4
+
+// lighting phases of this variant, injected from LightFeatures; on their own every phase runs
+#ifndef DIR_LIGHT
+#define DIR_LIGHT 1
+#endif
+#ifndef SPOT_LIGHT
+#define SPOT_LIGHT 1
+#endif
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
+#ifdef POINT_VOLUME
+flat in vec4 PositionConstant;
+flat in vec4 AmbientLinear;
+flat in vec4 DiffuseQuadratic;
+flat in vec4 SpecularRadius;
+#endif
+
+#ifdef SHADOWS
+// ShadowMaps: the directional light's cascades, then the spotlight, one layer each
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOW_CASCADES + 1];
+// world size of a layer's texel, per unit of distance from the light for the spotlight
+uniform float shadowTexelSizes[SHADOW_CASCADES + 1];
+
+float DirShadow(vec3 fragPos, vec3 normal);
+float SpotShadow(vec3 fragPos, vec3 normal);
+#endif
+// how much of the directional and the spot light gets past the shadow casters to this fragment
+float dirVisibility = 1.0;
+float spotVisibility = 1.0;
+
+// the G-buffer, read one texel per pixel
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+uniform vec3 viewPos;
+
+// the material at this pixel, shared by the functions below
+vec3 diffuseColor;
+vec3 specularColor;
+float shininess;
+
+// function prototypes
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    // nothing was drawn here, the background stays as cleared
+    if (depth == 1.0)
+        discard;
+
+    // world position back from the depth buffer
+    vec4 clip = vec4(vec3(gl_FragCoord.xy / screenSize, depth) * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    diffuseColor = texelFetch(gAlbedo, texel, 0).rgb;
+    specularColor = texelFetch(gSpecular, texel, 0).rgb;
+    vec4 normalShininess = texelFetch(gNormal, texel, 0);
+    vec3 norm = normalize(normalShininess.xyz);
+    shininess = normalShininess.w;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 result = vec3(0.0);
+#ifdef FULLSCREEN_PASS
+    // phase 1: directional lighting
+#if DIR_LIGHT
+#ifdef SHADOWS
+    dirVisibility = DirShadow(fragPos, norm);
+#endif
+    result += CalcDirLight(dirLight, norm, viewDir);
+#endif
+    // outside its cone the spot light still adds its ambient, inside the cone pass takes over
+#if SPOT_LIGHT
+    if (dot(normalize(spotLight.position - fragPos), normalize(-spotLight.direction)) <= spotLight.cutOff)
+        result += spotLight.ambient * diffuseColor;
+#endif
+#endif
+
+#ifdef POINT_VOLUME
+    // phase 2: this instance's point light, up to the radius its volume was sized for
+    if (length(PositionConstant.xyz - fragPos) > SpecularRadius.w)
+        discard;
+    PointLight light;
+    light.position = PositionConstant.xyz;
+    light.constant = PositionConstant.w;
+    light.ambient = AmbientLinear.xyz;
+    light.linear = AmbientLinear.w;
+    light.diffuse = DiffuseQuadratic.xyz;
+    light.quadratic = DiffuseQuadratic.w;
+    light.specular = SpecularRadius.xyz;
+    result = CalcPointLight(light, norm, fragPos, viewDir);
+#endif
+
+#ifdef SPOT_VOLUME
+    // phase 3: spot light, inside its cone
+    if (dot(normalize(spotLight.position - fragPos), normalize(-spotLight.direction)) <= spotLight.cutOff)
+        discard;
+#ifdef SHADOWS
+    spotVisibility = SpotShadow(fragPos, norm);
+#endif
+    result = CalcSpotLight(spotLight, norm, fragPos, viewDir);
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
+
+#ifdef SHADOWS
+// four taps half a texel around coords, each compared and filtered bilinearly by the sampler
+float SampleShadow(vec3 coords, int layer)
+{
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int x = 0; x < 2; x++)
+        for(int y = 0; y < 2; y++)
+            lit += texture(shadowMap, vec4(coords.xy + (vec2(x, y) - 0.5) * texel, float(layer), coords.z));
+    return lit * 0.25;
+}
+
+// from the first cascade the fragment is inside of, past the last one nothing is shadowed
+float DirShadow(vec3 fragPos, vec3 normal)
+{
+    for(int i = 0; i < SHADOW_CASCADES; i++)
+    {
+        // pushed out along the normal by a texel and a half, against acne on steep surfaces
+        vec3 coords = vec3(shadowMatrices[i] * vec4(fragPos + normal * shadowTexelSizes[i] * 1.5, 1.0)) * 0.5 + 0.5;
+        if(all(greaterThan(coords.xy, vec2(0.01))) && all(lessThan(coords.xy, vec2(0.99))))
+            return SampleShadow(coords, i);
+    }
+    return 1.0;
+}
+
+float SpotShadow(vec3 fragPos, vec3 normal)
+{
+    // the spotlight's texels grow with the distance from it
+    float offset = shadowTexelSizes[SHADOW_CASCADES] * length(spotLight.position - fragPos) * 1.5;
+    vec4 clip = shadowMatrices[SHADOW_CASCADES] * vec4(fragPos + normal * offset, 1.0);
+    vec3 coords = clip.xyz / clip.w * 0.5 + 0.5;
+    if(clip.w <= 0.0 || any(lessThan(coords.xy, vec2(0.0))) || any(greaterThan(coords.xy, vec2(1.0))))
+        return 1.0;
+    return SampleShadow(coords, SHADOW_CASCADES);
+}
+#endif
+
+// calculates the color when using a directional light.
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    // combine results
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+    diffuse *= dirVisibility;
+    specular *= dirVisibility;
+    return (ambient + diffuse + specular);
+}
+
+// calculates the color when using a point light.
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // combine results
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    return (ambient + diffuse + specular);
+}
+
+// calculates the color when using a spot light, inside its cone.
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float theta = dot(lightDir, normalize(-light.direction));
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // spotlight intensity
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    // combine results
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    diffuse *= spotVisibility;
+    specular *= spotVisibility;
+    return (ambient + diffuse + specular);
+}
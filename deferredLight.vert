@@ -0,0 +1,49 @@
+#version 330 core
+// lighting passes of DeferredRenderer, one of FULLSCREEN_PASS, POINT_VOLUME or SPOT_VOLUME
+
+#ifdef POINT_VOLUME
+layout (location = 0) in vec3 aPos;
+// a PointLight per instance, laid out like the std140 struct; w of the last is the radius
+layout (location = 1) in vec4 lightPositionConstant;
+layout (location = 2) in vec4 lightAmbientLinear;
+layout (location = 3) in vec4 lightDiffuseQuadratic;
+layout (location = 4) in vec4 lightSpecularRadius;
+
+flat out vec4 PositionConstant;
+flat out vec4 AmbientLinear;
+flat out vec4 DiffuseQuadratic;
+flat out vec4 SpecularRadius;
+
+uniform mat4 viewProjection;
+
+void main()
+{
+    PositionConstant = lightPositionConstant;
+    AmbientLinear = lightAmbientLinear;
+    DiffuseQuadratic = lightDiffuseQuadratic;
+    SpecularRadius = lightSpecularRadius;
+    gl_Position = viewProjection * vec4(lightPositionConstant.xyz + aPos * lightSpecularRadius.w, 1.0);
+}
+#endif
+
+#ifdef SPOT_VOLUME
+layout (location = 0) in vec3 aPos;
+
+// places the unit cone at the spotlight, see DeferredRenderer::SpotModel
+uniform mat4 spotModel;
+uniform mat4 viewProjection;
+
+void main()
+{
+    gl_Position = viewProjection * spotModel * vec4(aPos, 1.0);
+}
+#endif
+
+#ifdef FULLSCREEN_PASS
+// one triangle over the whole screen, from the vertex index alone
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+#endif
@@ -0,0 +1,25 @@
+#version 330 core
+// G-buffer pass of DeferredRenderer, drawn with multipleLight.vert; no lighting happens here
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gSpecular;
+layout (location = 2) out vec4 gNormal;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform Material material;
+
+void main()
+{
+    gAlbedo = vec4(texture(material.diffuse, TexCoords).rgb, 1.0);
+    gSpecular = vec4(texture(material.specular, TexCoords).rgb, 1.0);
+    // shininess rides along in w, the normal target is a float format
+    gNormal = vec4(normalize(Normal), material.shininess);
+}
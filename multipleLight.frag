@@ -7,6 +7,8 @@ struct Material {
     float shininess;
 }; 
 
+// the light structs live in a std140 uniform block, scalars fill the padding after each vec3
+// so the layout matches the C++ mirror in LightSet.h
 struct DirLight {
     vec3 direction;
 	
@@ -17,43 +19,91 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
-    
     float constant;
-    float linear;
-    float quadratic;
-	
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-  
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
 };
 
 #define NR_POINT_LIGHTS 4
 
+// lighting phases of this variant, injected from LightFeatures; on their own every phase runs
+#ifndef DIR_LIGHT
+#define DIR_LIGHT 1
+#endif
+#ifndef POINT_LIGHT_COUNT
+#define POINT_LIGHT_COUNT NR_POINT_LIGHTS
+#endif
+#ifndef SPOT_LIGHT
+#define SPOT_LIGHT 1
+#endif
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
 uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+};
 uniform Material material;
 
+// the material at this fragment, sampled once in main and shared by every light
+vec3 diffuseColor;
+vec3 specularColor;
+
+#ifdef SHADOWS
+// ShadowMaps: the directional light's cascades, then the spotlight, one layer each
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOW_CASCADES + 1];
+// world size of a layer's texel, per unit of distance from the light for the spotlight
+uniform float shadowTexelSizes[SHADOW_CASCADES + 1];
+
+float DirShadow(vec3 fragPos, vec3 normal);
+float SpotShadow(vec3 fragPos, vec3 normal);
+#endif
+#ifdef LIGHTMAP
+// LightmapBaker's atlas; the static lights are baked in and the variant leaves their phases out
+in vec2 LightmapCoords;
+// layer 0: irradiance and x, layer 1: specular colour and y of the lights' dominant direction
+// in the tangent frame of the normal
+uniform sampler2DArray lightmap;
+
+vec3 CalcBakedLight(vec3 normal, vec3 viewDir);
+#endif
+// how much of the directional and the spot light gets past the shadow casters to this fragment
+float dirVisibility = 1.0;
+float spotVisibility = 1.0;
+
+#ifdef CLUSTERED_LIGHTING
+// clustered point lights, filled by ClusteredLights on the CPU
+uniform usamplerBuffer clusterGrid;         // (offset, count) into clusterLightIndices per cluster
+uniform usamplerBuffer clusterLightIndices; // light indices, grouped per cluster
+uniform samplerBuffer clusterLights;        // four texels per PointLight, same layout as the block above
+uniform vec2 clusterTileSize;               // size of a screen tile in pixels
+uniform vec4 clusterDepth;                  // near, far, slice scale, slice bias
+
+int ClusterIndex();
+PointLight FetchPointLight(int index);
+#endif
+
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
@@ -64,6 +114,16 @@ void main()
     // properties
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
+    diffuseColor = vec3(texture(material.diffuse, TexCoords));
+    specularColor = vec3(texture(material.specular, TexCoords));
+#ifdef SHADOWS
+#if DIR_LIGHT
+    dirVisibility = DirShadow(FragPos, norm);
+#endif
+#if SPOT_LIGHT
+    spotVisibility = SpotShadow(FragPos, norm);
+#endif
+#endif
     
     // == =====================================================
     // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
@@ -71,17 +131,127 @@ void main()
     // per lamp. In the main() function we take all the calculated colors and sum them up for
     // this fragment's final color.
     // == =====================================================
+    vec3 result = vec3(0.0);
+#ifdef LIGHTMAP
+    // phases 1 and 2 as baked, one lightmap lookup for any number of static lights
+    result += CalcBakedLight(norm, viewDir);
+#endif
     // phase 1: directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+#if DIR_LIGHT
+    result += CalcDirLight(dirLight, norm, viewDir);
+#endif
 	// phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
+#ifdef CLUSTERED_LIGHTING
+    // only the lights assigned to this fragment's cluster
+    uvec2 range = texelFetch(clusterGrid, ClusterIndex()).xy;
+    for(uint i = 0u; i < range.y; i++)
+        result += CalcPointLight(FetchPointLight(int(texelFetch(clusterLightIndices, int(range.x + i)).r)), norm, FragPos, viewDir);
+#else
+    for(int i = 0; i < POINT_LIGHT_COUNT; i++)
         result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+#endif
     // phase 3: spot light
+#if SPOT_LIGHT
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+#endif
     
     FragColor = vec4(result, 1.0);
 }
 
+#ifdef CLUSTERED_LIGHTING
+// finds the cluster of this fragment from its screen tile and its exponential depth slice
+int ClusterIndex()
+{
+    float nearPlane = clusterDepth.x;
+    float farPlane = clusterDepth.y;
+    float ndcZ = gl_FragCoord.z * 2.0 - 1.0;
+    float viewDepth = 2.0 * nearPlane * farPlane / (farPlane + nearPlane - ndcZ * (farPlane - nearPlane));
+    int slice = clamp(int(log(viewDepth) * clusterDepth.z - clusterDepth.w), 0, CLUSTER_Z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    return tile.x + CLUSTER_X * (tile.y + CLUSTER_Y * slice);
+}
+
+PointLight FetchPointLight(int index)
+{
+    vec4 a = texelFetch(clusterLights, index * 4);
+    vec4 b = texelFetch(clusterLights, index * 4 + 1);
+    vec4 c = texelFetch(clusterLights, index * 4 + 2);
+    vec4 d = texelFetch(clusterLights, index * 4 + 3);
+    PointLight light;
+    light.position = a.xyz;
+    light.constant = a.w;
+    light.ambient = b.xyz;
+    light.linear = b.w;
+    light.diffuse = c.xyz;
+    light.quadratic = c.w;
+    light.specular = d.xyz;
+    return light;
+}
+#endif
+
+#ifdef SHADOWS
+// four taps half a texel around coords, each compared and filtered bilinearly by the sampler
+float SampleShadow(vec3 coords, int layer)
+{
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int x = 0; x < 2; x++)
+        for(int y = 0; y < 2; y++)
+            lit += texture(shadowMap, vec4(coords.xy + (vec2(x, y) - 0.5) * texel, float(layer), coords.z));
+    return lit * 0.25;
+}
+
+// from the first cascade the fragment is inside of, past the last one nothing is shadowed
+float DirShadow(vec3 fragPos, vec3 normal)
+{
+    for(int i = 0; i < SHADOW_CASCADES; i++)
+    {
+        // pushed out along the normal by a texel and a half, against acne on steep surfaces
+        vec3 coords = vec3(shadowMatrices[i] * vec4(fragPos + normal * shadowTexelSizes[i] * 1.5, 1.0)) * 0.5 + 0.5;
+        if(all(greaterThan(coords.xy, vec2(0.01))) && all(lessThan(coords.xy, vec2(0.99))))
+            return SampleShadow(coords, i);
+    }
+    return 1.0;
+}
+
+float SpotShadow(vec3 fragPos, vec3 normal)
+{
+    // the spotlight's texels grow with the distance from it
+    float offset = shadowTexelSizes[SHADOW_CASCADES] * length(spotLight.position - fragPos) * 1.5;
+    vec4 clip = shadowMatrices[SHADOW_CASCADES] * vec4(fragPos + normal * offset, 1.0);
+    vec3 coords = clip.xyz / clip.w * 0.5 + 0.5;
+    if(clip.w <= 0.0 || any(lessThan(coords.xy, vec2(0.0))) || any(greaterThan(coords.xy, vec2(1.0))))
+        return 1.0;
+    return SampleShadow(coords, SHADOW_CASCADES);
+}
+#endif
+
+#ifdef LIGHTMAP
+// the same frame as TangentFrame in LightmapBaker.cpp (Duff et al. 2017)
+void TangentFrame(vec3 n, out vec3 tangent, out vec3 bitangent)
+{
+    float sign = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (sign + n.z);
+    float b = n.x * n.y * a;
+    tangent = vec3(1.0 + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    bitangent = vec3(b, sign + n.y * n.y * a, -n.y);
+}
+
+// baked diffuse, plus one highlight of the baked specular colour from the dominant direction
+vec3 CalcBakedLight(vec3 normal, vec3 viewDir)
+{
+    vec4 irradiance = texture(lightmap, vec3(LightmapCoords, 0.0));
+    vec4 specular = texture(lightmap, vec3(LightmapCoords, 1.0));
+    vec3 tangent, bitangent;
+    TangentFrame(normal, tangent, bitangent);
+    vec2 planar = vec2(irradiance.w, specular.w);
+    vec3 lightDir = normalize(tangent * planar.x + bitangent * planar.y + normal * sqrt(max(1.0 - dot(planar, planar), 0.0)));
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    return irradiance.rgb * diffuseColor + specular.rgb * spec * specularColor;
+}
+#endif
+
 // calculates the color when using a directional light.
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
@@ -92,9 +262,11 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+    diffuse *= dirVisibility;
+    specular *= dirVisibility;
     return (ambient + diffuse + specular);
 }
 
@@ -111,9 +283,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -139,14 +311,16 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 	    float epsilon = light.cutOff - light.outerCutOff;
 	    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 	    // combine results
-	    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-	    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-	    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+	    vec3 ambient = light.ambient * diffuseColor;
+	    vec3 diffuse = light.diffuse * diff * diffuseColor;
+	    vec3 specular = light.specular * spec * specularColor;
 	    ambient *= attenuation * intensity;
 	    diffuse *= attenuation * intensity;
 	    specular *= attenuation * intensity;
+	    diffuse *= spotVisibility;
+	    specular *= spotVisibility;
 	    return (ambient + diffuse + specular);
     }else{
-        return light.ambient * vec3(texture(material.diffuse, TexCoords));
+        return light.ambient * diffuseColor;
     }
 }
\ No newline at end of file
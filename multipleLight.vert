@@ -7,17 +7,46 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+#ifdef LIGHTMAP
+// second tex coords from LightmapBaker, over the mesh's tile
+layout (location = 10) in vec2 aLightmapCoords;
+out vec2 LightmapCoords;
+#endif
+
+#ifdef INSTANCED
+// per instance model and normal matrices from InstancedMesh, one column per location
+layout (location = 3) in mat4 instanceModel;
+#ifdef LIGHTMAP
+// the w of the normal columns is the instance's lightmap tile: scale, offset x, offset y
+layout (location = 7) in vec4 instanceNormal[3];
+#else
+layout (location = 7) in mat3 instanceNormal;
+#endif
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// transpose(inverse(mat3(model))), computed once per object on the CPU
+uniform mat3 normalMatrix;
+#endif
+// projection * view, computed once per frame on the CPU
+uniform mat4 viewProjection;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+#ifdef INSTANCED
+    mat4 model = instanceModel;
+#ifdef LIGHTMAP
+    mat3 normalMatrix = mat3(instanceNormal[0].xyz, instanceNormal[1].xyz, instanceNormal[2].xyz);
+    LightmapCoords = aLightmapCoords * instanceNormal[0].w + vec2(instanceNormal[1].w, instanceNormal[2].w);
+#else
+    mat3 normalMatrix = instanceNormal;
+#endif
+#endif
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    FragPos = vec3(worldPos);
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
     
-    gl_Position = projection * view * model * vec4(FragPos, 1.0);
+    gl_Position = viewProjection * worldPos;
     // We swap the y-axis by substracing our coordinates from 1. This is done because most images have the top y-axis inversed with OpenGL's top y-axis.
 	TexCoords = vec2(aTexCoords.x, 1.0 - aTexCoords.y);
 
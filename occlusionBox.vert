@@ -0,0 +1,13 @@
+#version 330 core
+// world box of a renderable for the queries of OcclusionCuller, drawn with shadowDepth.frag
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 viewProjection;
+// the unit cube is stretched from boxMin by boxSize
+uniform vec3 boxMin;
+uniform vec3 boxSize;
+
+void main()
+{
+	gl_Position = viewProjection * vec4(boxMin + aPos * boxSize, 1.0);
+}
@@ -0,0 +1,6 @@
+#version 330 core
+// depth only pass of ShadowMaps, drawn with multipleLight.vert, and the box queries of
+// OcclusionCuller; the depth test does all the work
+void main()
+{
+}